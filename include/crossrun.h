@@ -11,6 +11,9 @@
 
 #include "crossrunenv.h"
 #include "crossrunproc.h"
+#include "crossrunopts.h"
+#include <stddef.h>
+#include <stdint.h>
 
 /*! \brief version number constants
  * \sa     crossrun_get_version()
@@ -21,9 +24,9 @@
 /*! \brief major version number */
 #define CROSSRUN_VERSION_MAJOR 1
 /*! \brief minor version number */
-#define CROSSRUN_VERSION_MINOR 0
+#define CROSSRUN_VERSION_MINOR 1
 /*! \brief micro version number */
-#define CROSSRUN_VERSION_MICRO 1
+#define CROSSRUN_VERSION_MICRO 0
 /*! @} */
 
 /*! \brief packed version number */
@@ -61,6 +64,29 @@ DLL_EXPORT_CROSSRUN void crossrun_get_version (int* pmajor, int* pminor, int* pm
  */
 DLL_EXPORT_CROSSRUN const char* crossrun_get_version_string ();
 
+/*! \brief stream identifiers
+ * \name   CROSSRUN_STREAM_*
+ * \{
+ */
+/*! \brief standard input of the shell process */
+#define CROSSRUN_STREAM_STDIN           0
+/*! \brief standard output of the shell process */
+#define CROSSRUN_STREAM_STDOUT          1
+/*! \brief error output of the shell process */
+#define CROSSRUN_STREAM_STDERR          2
+/*! @} */
+
+/*! \brief results of reading a line
+ * \sa     crossrun_read_line()
+ * \name   CROSSRUN_LINE_*
+ * \{
+ */
+/*! \brief a complete line (or the last part of a line) was read */
+#define CROSSRUN_LINE_COMPLETE          1
+/*! \brief part of a line longer than the read-ahead buffer was read */
+#define CROSSRUN_LINE_PARTIAL           2
+/*! @} */
+
 /*! \brief data type for handling shell process
  */
 typedef struct crossrun_data* crossrun;
@@ -73,10 +99,24 @@ typedef struct crossrun_data* crossrun;
  * \sa     crossrunenv
  * \sa     CROSSRUN_PRIO_*
  * \sa     crossrun_cpumask
+ * \sa     crossrun_open_with_options()
  * \sa     crossrun_free()
  */
 DLL_EXPORT_CROSSRUN crossrun crossrun_open (const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity);
 
+/*! \brief open a shell process with additional options
+ * \param  command     shell command to execute
+ * \param  environment environment variables (NULL to inherit)
+ * \param  priority    desired process priority value as CROSSRUN_PRIO_* (note that most operating systems only allow current or lower priority)
+ * \param  affinity    logical processors the process is allowed to run on (NULL for no restriction)
+ * \param  options     options (NULL for defaults)
+ * \return shell process handle or NULL on error
+ * \sa     crossrun_options
+ * \sa     crossrun_open()
+ * \sa     crossrun_free()
+ */
+DLL_EXPORT_CROSSRUN crossrun crossrun_open_with_options (const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options);
+
 /*! \brief get process ID
  * \param  handle      shell process handle
  * \return process ID or 0 on error
@@ -158,6 +198,107 @@ DLL_EXPORT_CROSSRUN int crossrun_read (crossrun handle, char* buf, int buflen);
  */
 DLL_EXPORT_CROSSRUN int crossrun_read_available (crossrun handle, char* buf, int buflen);
 
+/*! \brief get data waiting to be read from a shell process without removing it
+ * \param  handle      shell process handle
+ * \param  buf         buffer
+ * \param  buflen      size of buffer in bytes
+ * \return number of bytes copied (can be 0 if no data was available yet) or -1 on end of file or error
+ * \sa     crossrun_read()
+ * \sa     crossrun_data_waiting()
+ * \sa     crossrun_options_set_read_buffer()
+ * \note   the data is kept in the read-ahead buffer, which is allocated with size CROSSRUN_READ_BUFFER_DEFAULT_SIZE if none was set, so at most that many bytes can be peeked at
+ */
+DLL_EXPORT_CROSSRUN int crossrun_peek (crossrun handle, char* buf, int buflen);
+
+/*! \brief read the next line from the standard output of a shell process
+ * \param  handle      shell process handle
+ * \param  line        pointer that will receive the start of the line (not terminated and without the newline)
+ * \param  linelen     pointer that will receive the length of the line in bytes
+ * \return CROSSRUN_LINE_COMPLETE or CROSSRUN_LINE_PARTIAL if a line was read, 0 on end of file or -1 on error
+ * \sa     CROSSRUN_LINE_*
+ * \sa     crossrun_read_lines()
+ * \sa     crossrun_options_set_read_buffer()
+ * \note   the line points into the read-ahead buffer (which is allocated with size CROSSRUN_READ_BUFFER_DEFAULT_SIZE if none was set) and is only valid until the next read from the shell process
+ * \note   a line longer than the read-ahead buffer is returned in parts as CROSSRUN_LINE_PARTIAL, followed by the last part as CROSSRUN_LINE_COMPLETE
+ * \note   a carriage return before the newline is not removed
+ */
+DLL_EXPORT_CROSSRUN int crossrun_read_line (crossrun handle, const char** line, size_t* linelen);
+
+/*! \brief callback function type called for each line read from a shell process
+ * \param  line         start of the line (not terminated and without the newline)
+ * \param  linelen      length of the line in bytes
+ * \param  partial      non-zero if this is only part of a line longer than the read-ahead buffer, in which case the rest follows in the next call(s)
+ * \param  callbackdata user data
+ * \return 0 to continue or any other value to abort
+ * \sa     crossrun_read_lines()
+ */
+typedef int (*crossrun_line_callback_fn)(const char* line, size_t linelen, int partial, void* callbackdata);
+
+/*! \brief read all lines from the standard output of a shell process until the end of file
+ * \param  handle       shell process handle
+ * \param  linefn       callback function called for each line
+ * \param  callbackdata user data passed to the callback function
+ * \return 0 when the end of file was reached, the non-zero value returned by linefn if it aborted or -1 on error
+ * \sa     crossrun_read_line()
+ * \note   the line passed to the callback function is only valid during the call
+ */
+DLL_EXPORT_CROSSRUN int crossrun_read_lines (crossrun handle, crossrun_line_callback_fn linefn, void* callbackdata);
+
+/*! \brief get statistics about reading the output of a shell process
+ * \param  handle      shell process handle
+ * \param  bytesread   pointer that will receive the number of bytes read from the outputs of the shell process (can be NULL)
+ * \param  syscalls    pointer that will receive the number of system calls made to read from or check the outputs of the shell process (can be NULL)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_options_set_read_buffer()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_get_read_stats (crossrun handle, uint64_t* bytesread, uint64_t* syscalls);
+
+/*! \brief get the checksum of the output of a shell process read so far
+ * \param  handle      shell process handle
+ * \param  stream      output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  crc         pointer that will receive the CRC32C checksum of the output (can be NULL)
+ * \param  length      pointer that will receive the number of bytes included in the checksum (can be NULL)
+ * \return zero on success, non-zero on error (including when checksums were not enabled with crossrun_options_set_checksum())
+ * \sa     crossrun_options_set_checksum()
+ * \sa     crossrun_crc32c()
+ * \note   the checksum is complete after all output was read, output still in the read-ahead buffer is already included
+ */
+DLL_EXPORT_CROSSRUN int crossrun_get_checksum (crossrun handle, int stream, uint32_t* crc, uint64_t* length);
+
+/*! \brief compute or continue a CRC32C (Castagnoli) checksum
+ * \param  crc         checksum of the previous data (0 to start a new checksum)
+ * \param  data        data
+ * \param  datalen     size of data in bytes
+ * \return checksum including data
+ * \sa     crossrun_get_checksum()
+ * \note   uses the SSE 4.2 CRC32 instruction where supported by the processor
+ */
+DLL_EXPORT_CROSSRUN uint32_t crossrun_crc32c (uint32_t crc, const void* data, size_t datalen);
+
+/*! \brief read data from the error output of a shell process
+ * \param  handle      shell process handle
+ * \param  buf         buffer
+ * \param  buflen      size of buffer in bytes
+ * \return number of bytes read (can be less than buflen), 0 on end of file or -1 on error (including when the error output was not opened with CROSSRUN_STDERR_PIPE)
+ * \sa     crossrun_options_set_stderr()
+ * \sa     crossrun_read_any()
+ * \sa     crossrun_open_with_options()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_read_stderr (crossrun handle, char* buf, int buflen);
+
+/*! \brief read data from whichever of standard output and error output of a shell process has data available first
+ * \param  handle      shell process handle
+ * \param  buf         buffer
+ * \param  buflen      size of buffer in bytes
+ * \param  stream      pointer that will receive the stream the data was read from as CROSSRUN_STREAM_* (can be NULL)
+ * \return number of bytes read (can be less than buflen), 0 when the end of both outputs was reached or -1 on error
+ * \sa     crossrun_read()
+ * \sa     crossrun_read_stderr()
+ * \sa     crossrun_options_set_stderr()
+ * \note   because both outputs are waited for at the same time a process blocked on writing to one of them can't cause a deadlock
+ */
+DLL_EXPORT_CROSSRUN int crossrun_read_any (crossrun handle, char* buf, int buflen, int* stream);
+
 /*! \brief write to shell process
  * \param  handle      shell process handle
  * \param  data        data buffer to write
@@ -168,6 +309,38 @@ DLL_EXPORT_CROSSRUN int crossrun_read_available (crossrun handle, char* buf, int
  */
 DLL_EXPORT_CROSSRUN int crossrun_writedata (crossrun handle, const char* data, int datalen);
 
+/*! \brief data block for writing multiple blocks at once
+ * \sa     crossrun_writev()
+ */
+typedef struct {
+  const char* data;       /**< data to write */
+  size_t datalen;         /**< size of data in bytes */
+} crossrun_iovec;
+
+/*! \brief write multiple data blocks to shell process as if they were one block
+ * \param  handle      shell process handle
+ * \param  iov         array of data blocks
+ * \param  iovcnt      number of data blocks in iov
+ * \return 0 on success
+ * \sa     crossrun_writedata()
+ * \sa     crossrun_write_pages()
+ * \note   on POSIX systems the blocks are written with as few writev() calls as possible,
+ *         so for example a header and a record can be written without concatenating them first
+ */
+DLL_EXPORT_CROSSRUN int crossrun_writev (crossrun handle, const crossrun_iovec* iov, int iovcnt);
+
+/*! \brief write large data buffer to shell process without copying it where supported
+ * \param  handle      shell process handle
+ * \param  data        data buffer to write (preferably aligned to memory pages)
+ * \param  datalen     size of data buffer to write (preferably a multiple of the memory page size)
+ * \return 0 on success
+ * \sa     crossrun_writev()
+ * \note   on Linux the memory pages are mapped into the pipe with vmsplice() instead of being copied,
+ *         so the data must not be modified or freed until the shell process has read all of it
+ *         (for example until it has exited), on other platforms the data is written as with crossrun_writev()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_write_pages (crossrun handle, const char* data, size_t datalen);
+
 /*! \brief write string to shell process
  * \param  handle      shell process handle
  * \param  data        string to write
@@ -185,6 +358,161 @@ DLL_EXPORT_CROSSRUN int crossrun_write (crossrun handle, const char* data);
  */
 DLL_EXPORT_CROSSRUN void crossrun_write_eof (crossrun handle);
 
+/*! \brief callback function type called when data was read from a shell process
+ * \param  data         data read
+ * \param  datalen      number of bytes read
+ * \param  callbackdata user data
+ * \return 0 to continue or any other value to abort
+ * \sa     crossrun_read_write()
+ */
+typedef int (*crossrun_read_callback_fn)(const char* data, size_t datalen, void* callbackdata);
+
+/*! \brief write data to a shell process while reading its output at the same time
+ * \param  handle           shell process handle
+ * \param  readfn           callback function called for each block of output read (or NULL to discard output)
+ * \param  readcallbackdata user data passed to the callback function
+ * \param  writedata        data to write to the standard input of the shell process (can be NULL)
+ * \param  writedatalen     size of data to write
+ * \return 0 when all data was written and the end of the output was reached, the non-zero value returned by readfn if it aborted or -1 on error
+ * \sa     crossrun_writedata()
+ * \sa     crossrun_read()
+ * \sa     crossrun_write_eof()
+ * \note   the standard input of the shell process is closed after all data was written
+ * \note   if the error output was opened with CROSSRUN_STDERR_PIPE it is read too and passed to readfn
+ * \note   unlike writing all data before reading this can't deadlock when the shell process produces a lot of output while its input is written
+ * \note   on POSIX systems writing to a process that closed its standard input raises SIGPIPE, which should be ignored by the calling program if this can happen
+ */
+DLL_EXPORT_CROSSRUN int crossrun_read_write (crossrun handle, crossrun_read_callback_fn readfn, void* readcallbackdata, const char* writedata, size_t writedatalen);
+
+/*! \brief flags for forwarding output
+ * \sa     crossrun_forward()
+ * \name   CROSSRUN_FORWARD_*
+ * \{
+ */
+/*! \brief forward the error output (opened with CROSSRUN_STDERR_PIPE) instead of standard output */
+#define CROSSRUN_FORWARD_STDERR         0x01
+/*! \brief copy the data through a buffer instead of moving it between file descriptors in the kernel */
+#define CROSSRUN_FORWARD_NO_SPLICE      0x02
+/*! @} */
+
+/*! \brief forward the output of a shell process to a file descriptor until the end of the output is reached
+ * \param  handle       shell process handle
+ * \param  fd           file descriptor to write the output to (a file, socket or pipe)
+ * \param  flags        combination of CROSSRUN_FORWARD_* flags (or 0)
+ * \param  inspectfn    callback function called with a copy of the data forwarded (or NULL)
+ * \param  callbackdata user data passed to the callback function
+ * \param  forwarded    pointer that will receive the number of bytes forwarded (can be NULL)
+ * \return 0 when the end of the output was reached, the non-zero value returned by inspectfn if it aborted or -1 on error
+ * \sa     CROSSRUN_FORWARD_*
+ * \sa     crossrun_read()
+ * \note   on Linux the data is moved from the pipe to fd with splice() without passing through the calling process,
+ *         and if inspectfn is set it is duplicated with tee() so only the inspected copy is read,
+ *         on other systems or if splice() is not supported for fd the data is read and written
+ * \note   on Windows fd is a C runtime file descriptor
+ */
+DLL_EXPORT_CROSSRUN int crossrun_forward (crossrun handle, int fd, int flags, crossrun_read_callback_fn inspectfn, void* callbackdata, uint64_t* forwarded);
+
+/*! \brief write queue events
+ * \sa     crossrun_write_queue_fn
+ * \name   CROSSRUN_WRITE_QUEUE_*
+ * \{
+ */
+/*! \brief all queued data was written */
+#define CROSSRUN_WRITE_QUEUE_DRAINED    1
+/*! \brief queued data dropped to half the high watermark after having reached it */
+#define CROSSRUN_WRITE_QUEUE_LOW        2
+/*! \brief writing failed (for example because the shell process closed its standard input) and queued data was discarded */
+#define CROSSRUN_WRITE_QUEUE_ERROR      3
+/*! @} */
+
+/*! \brief callback function type called when the state of the write queue of a shell process changes
+ * \param  handle       shell process handle
+ * \param  event        event as CROSSRUN_WRITE_QUEUE_*
+ * \param  callbackdata user data
+ * \sa     crossrun_write_queue_create()
+ * \sa     CROSSRUN_WRITE_QUEUE_*
+ */
+typedef void (*crossrun_write_queue_fn) (crossrun handle, int event, void* callbackdata);
+
+/*! \brief set up a bounded queue for writing to a shell process without blocking
+ * \param  handle        shell process handle
+ * \param  size          maximum number of bytes queued
+ * \param  highwatermark number of bytes queued from which crossrun_write_queue_backpressure() reports backpressure (0 for size)
+ * \param  fn            callback function called when the state of the queue changes (or NULL)
+ * \param  callbackdata  user data passed to the callback function
+ * \return zero on success, non-zero on error (for example on platforms where this is not supported)
+ * \sa     crossrun_write_queued()
+ * \sa     crossrun_write_queue_flush()
+ * \sa     crossrun_write_queue_backpressure()
+ * \note   the standard input of the shell process is switched to non-blocking mode
+ * \note   when the shell process is registered with a crossrun_loop event loop, the event loop writes queued data as soon as the pipe is writable
+ * \note   data still queued is discarded when crossrun_write_eof() is called
+ */
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_create (crossrun handle, size_t size, size_t highwatermark, crossrun_write_queue_fn fn, void* callbackdata);
+
+/*! \brief write data to a shell process without blocking, queuing what can't be written yet
+ * \param  handle       shell process handle
+ * \param  data         data to write
+ * \param  datalen      number of bytes to write
+ * \return number of bytes written or queued (less than datalen if the queue is full) or -1 on error
+ * \sa     crossrun_write_queue_create()
+ * \sa     crossrun_write_queue_pending()
+ * \note   data is only copied to the queue if it can't be written to the pipe immediately
+ */
+DLL_EXPORT_CROSSRUN int crossrun_write_queued (crossrun handle, const char* data, size_t datalen);
+
+/*! \brief write as much queued data to a shell process as possible without blocking
+ * \param  handle       shell process handle
+ * \return 0 if the queue is empty, 1 if data is still queued or -1 on error
+ * \sa     crossrun_write_queued()
+ * \sa     crossrun_write_queue_poll_fd()
+ * \note   not needed when the shell process is registered with a crossrun_loop event loop
+ */
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_flush (crossrun handle);
+
+/*! \brief get number of bytes queued for writing to a shell process
+ * \param  handle       shell process handle
+ * \return number of bytes queued
+ * \sa     crossrun_write_queued()
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_write_queue_pending (crossrun handle);
+
+/*! \brief check if the write queue of a shell process has reached its high watermark
+ * \param  handle       shell process handle
+ * \return 1 from the moment the number of bytes queued reaches the high watermark until it drops to half of it again, otherwise 0
+ * \sa     crossrun_write_queue_create()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_backpressure (crossrun handle);
+
+/*! \brief get file descriptor to wait for with poll() (for POLLOUT) before calling crossrun_write_queue_flush()
+ * \param  handle       shell process handle
+ * \return file descriptor or -1 if no data is queued
+ * \sa     crossrun_write_queue_flush()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_poll_fd (crossrun handle);
+
+/*! \brief get the size of a pipe used for a standard stream of a shell process
+ * \param  handle       shell process handle
+ * \param  stream       standard stream as CROSSRUN_STREAM_*
+ * \return size of the pipe in bytes or 0 on error or if not supported on this platform
+ * \sa     crossrun_set_pipe_size()
+ * \sa     crossrun_options_set_pipe_size()
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_get_pipe_size (crossrun handle, int stream);
+
+/*! \brief change the size of a pipe used for a standard stream of a shell process
+ * \param  handle       shell process handle
+ * \param  stream       standard stream as CROSSRUN_STREAM_*
+ * \param  size         new size of the pipe in bytes (limited to /proc/sys/fs/pipe-max-size and rounded up by the system)
+ * \return new size of the pipe in bytes or 0 on error or if not supported on this platform
+ * \sa     crossrun_get_pipe_size()
+ * \sa     crossrun_options_set_pipe_size()
+ * \note   shrinking the pipes of idle shell processes saves kernel memory,
+ *         but a pipe can't be made smaller than the data it currently holds
+ * \note   only supported on Linux
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_set_pipe_size (crossrun handle, int stream, size_t size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,160 @@
+/**
+ * @file crossruncapture.h
+ * @brief crossrun library header file with functions for running a shell process to completion
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for running a shell process with input while capturing its output and exit code
+ */
+
+#ifndef __INCLUDED_CROSSRUNCAPTURE_H
+#define __INCLUDED_CROSSRUNCAPTURE_H
+
+#include "crossrun.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief data type for holding the captured output of a shell process
+ * \sa     crossrun_capture_create()
+ * \sa     crossrun_capture_free()
+ * \sa     crossrun_run_capture()
+ */
+typedef struct crossrun_capture_struct* crossrun_capture;
+
+/*! \brief create data structure for capturing the output of shell processes
+ * \return capture data structure or NULL on error
+ * \sa     crossrun_capture_free()
+ * \sa     crossrun_run_capture()
+ * \note   the same data structure can be used for multiple runs, in which case the memory allocated for previous runs is reused
+ */
+DLL_EXPORT_CROSSRUN crossrun_capture crossrun_capture_create ();
+
+/*! \brief destroy data structure for capturing the output of shell processes
+ * \param  capture       capture data structure
+ * \sa     crossrun_capture_create()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_capture_free (crossrun_capture capture);
+
+/*! \brief capture output in a buffer provided by the caller instead of memory allocated as needed
+ * \param  capture       capture data structure
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  buf           buffer (NULL to go back to memory allocated as needed)
+ * \param  bufsize       size of buffer in bytes
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_capture_get_data()
+ * \sa     crossrun_capture_get_total()
+ * \note   output that doesn't fit in the buffer is read but discarded
+ */
+DLL_EXPORT_CROSSRUN int crossrun_capture_set_buffer (crossrun_capture capture, int stream, char* buf, size_t bufsize);
+
+/*! \brief limit the memory used for captured output and write the output to a file beyond that limit
+ * \param  capture       capture data structure
+ * \param  limit         maximum number of bytes of memory used per output stream (0 for no limit, which is the default)
+ * \param  spilldir      directory in which to create the file for output exceeding the limit (NULL for a memory backed file on Linux or the temporary folder otherwise)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_capture_map()
+ * \sa     crossrun_capture_read()
+ * \sa     crossrun_capture_get_spill_stats()
+ * \note   the file is unnamed (or removed as soon as possible) and is closed on the next run or when the capture data structure is destroyed
+ * \note   once output was spilled the memory is only used to combine small blocks of output into larger writes
+ * \note   has no effect on output captured in a buffer provided with crossrun_capture_set_buffer()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_capture_set_memory_limit (crossrun_capture capture, size_t limit, const char* spilldir);
+
+/*! \brief run a shell process to completion while writing input to it and capturing its output
+ * \param  capture       capture data structure
+ * \param  command       shell command to execute
+ * \param  environment   environment variables (NULL to inherit)
+ * \param  priority      desired process priority value as CROSSRUN_PRIO_*
+ * \param  affinity      logical processors the process is allowed to run on (NULL for no restriction)
+ * \param  options       options (NULL for defaults, use crossrun_options_set_stderr() with CROSSRUN_STDERR_PIPE to capture error output separately)
+ * \param  input         data to write to the standard input of the shell process (can be NULL)
+ * \param  inputlen      size of data to write
+ * \return zero when the process was run or non-zero on error
+ * \sa     crossrun_capture_get_data()
+ * \sa     crossrun_capture_get_exit_code()
+ * \sa     crossrun_capture_get_timings()
+ * \sa     crossrun_open_with_options()
+ * \sa     crossrun_read_write()
+ * \note   input and output are handled at the same time, so large input and output can't cause a deadlock
+ */
+DLL_EXPORT_CROSSRUN int crossrun_run_capture (crossrun_capture capture, const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options, const char* input, size_t inputlen);
+
+/*! \brief get captured output of the last run
+ * \param  capture       capture data structure
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  datalen       pointer that will receive the number of bytes captured (can be NULL)
+ * \return captured data (followed by a terminating zero if space allows) or NULL on error or if the output was spilled to a file
+ * \sa     crossrun_run_capture()
+ * \sa     crossrun_capture_get_total()
+ * \sa     crossrun_capture_map()
+ * \note   the data remains valid until the next run or until the capture data structure is destroyed
+ */
+DLL_EXPORT_CROSSRUN const char* crossrun_capture_get_data (crossrun_capture capture, int stream, size_t* datalen);
+
+/*! \brief get all captured output of the last run in memory, mapping the file it was spilled to if needed
+ * \param  capture       capture data structure
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  datalen       pointer that will receive the number of bytes captured (can be NULL)
+ * \return captured data or NULL on error (for example if it is too large to be mapped in the address space)
+ * \sa     crossrun_capture_set_memory_limit()
+ * \sa     crossrun_capture_read()
+ * \note   the mapping remains valid until the next run or until the capture data structure is destroyed
+ */
+DLL_EXPORT_CROSSRUN const char* crossrun_capture_map (crossrun_capture capture, int stream, uint64_t* datalen);
+
+/*! \brief read part of the captured output of the last run, from memory or from the file it was spilled to
+ * \param  capture       capture data structure
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  offset        position in the captured output to start reading from
+ * \param  buf           buffer
+ * \param  buflen        size of buffer in bytes
+ * \return number of bytes read, 0 at the end of the captured output or -1 on error
+ * \sa     crossrun_capture_set_memory_limit()
+ * \sa     crossrun_capture_map()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_capture_read (crossrun_capture capture, int stream, uint64_t offset, char* buf, size_t buflen);
+
+/*! \brief get statistics about output spilled to a file during the last run
+ * \param  capture       capture data structure
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  spilledbytes  pointer that will receive the number of bytes written to the file (can be NULL)
+ * \param  spillwrites   pointer that will receive the number of writes to the file (can be NULL)
+ * \return 1 if the output was spilled to a file, 0 if the output was kept in memory or -1 on error
+ * \sa     crossrun_capture_set_memory_limit()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_capture_get_spill_stats (crossrun_capture capture, int stream, uint64_t* spilledbytes, uint64_t* spillwrites);
+
+/*! \brief get number of bytes the shell process wrote to an output during the last run
+ * \param  capture       capture data structure
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \return number of bytes written, which is more than the number of bytes captured if a buffer provided by the caller was too small
+ * \sa     crossrun_capture_get_data()
+ * \sa     crossrun_capture_set_buffer()
+ */
+DLL_EXPORT_CROSSRUN uint64_t crossrun_capture_get_total (crossrun_capture capture, int stream);
+
+/*! \brief get exit code of the shell process of the last run
+ * \param  capture       capture data structure
+ * \return exit code
+ * \sa     crossrun_run_capture()
+ */
+DLL_EXPORT_CROSSRUN unsigned long crossrun_capture_get_exit_code (crossrun_capture capture);
+
+/*! \brief get timings of the last run
+ * \param  capture       capture data structure
+ * \param  startusec     pointer that will receive the time in microseconds it took to start the shell process (can be NULL)
+ * \param  totalusec     pointer that will receive the time in microseconds from starting the shell process until it exited (can be NULL)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_run_capture()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_capture_get_timings (crossrun_capture capture, uint64_t* startusec, uint64_t* totalusec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNCAPTURE_H
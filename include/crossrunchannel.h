@@ -0,0 +1,117 @@
+/**
+ * @file crossrunchannel.h
+ * @brief crossrun library header file with functions for exchanging records with a shell process through shared memory
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for a channel between the calling process and a shell process,
+ * consisting of 2 ring buffers in shared memory (one for each direction) that is passed to the shell process as an extra file descriptor.
+ * The shell process uses the same functions to attach to the channel and to exchange records.
+ */
+
+#ifndef __INCLUDED_CROSSRUNCHANNEL_H
+#define __INCLUDED_CROSSRUNCHANNEL_H
+
+#include "crossrun.h"
+#include "crossrunopts.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief file descriptor number on which the shell process receives the channel
+ * \sa     crossrun_channel_open_child()
+ */
+#define CROSSRUN_CHANNEL_FD 3
+
+/*! \brief data type for a shared memory channel
+ * \sa     crossrun_channel_create()
+ * \sa     crossrun_channel_open_child()
+ * \sa     crossrun_channel_free()
+ */
+typedef struct crossrun_channel_struct* crossrun_channel;
+
+/*! \brief create a shared memory channel for exchanging records with a shell process
+ * \param  size          size in bytes of the ring buffer for each direction (rounded up to a power of 2 of at least 4096)
+ * \return channel or NULL on error (for example on platforms where this is not supported)
+ * \sa     crossrun_options_set_channel()
+ * \sa     crossrun_channel_write()
+ * \sa     crossrun_channel_read()
+ * \sa     crossrun_channel_free()
+ * \note   records are copied into and out of memory shared by both processes, so no system calls are needed
+ *         to move the data and the only system calls made are to wake up a process waiting for data or space
+ * \note   only supported on Linux
+ */
+DLL_EXPORT_CROSSRUN crossrun_channel crossrun_channel_create (size_t size);
+
+/*! \brief attach to the channel passed to the current process by the calling process
+ * \return channel or NULL if the current process wasn't started with a channel or on error
+ * \sa     crossrun_options_set_channel()
+ * \sa     crossrun_channel_free()
+ * \note   to be called from the shell process
+ */
+DLL_EXPORT_CROSSRUN crossrun_channel crossrun_channel_open_child ();
+
+/*! \brief close and destroy a shared memory channel
+ * \param  channel       channel
+ * \sa     crossrun_channel_create()
+ * \sa     crossrun_channel_open_child()
+ * \note   the other process can keep using the shared memory
+ */
+DLL_EXPORT_CROSSRUN void crossrun_channel_free (crossrun_channel channel);
+
+/*! \brief pass a shared memory channel to shell processes started with these options
+ * \param  options       options
+ * \param  channel       channel (NULL to not pass a channel, which is the default)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_channel_create()
+ * \sa     crossrun_channel_open_child()
+ * \note   the shell process receives the channel as file descriptor CROSSRUN_CHANNEL_FD
+ * \note   the channel must not be destroyed before the shell process was started
+ * \note   not applied to the processes of a pipeline
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_channel (crossrun_options options, crossrun_channel channel);
+
+/*! \brief write a record to a shared memory channel
+ * \param  channel       channel
+ * \param  data          data
+ * \param  datalen       size of data (including 8 bytes of overhead must not exceed the size of the ring buffer)
+ * \param  timeout       maximum time in milliseconds to wait for space in the ring buffer (0 to not wait or -1 to wait indefinitely)
+ * \return zero on success, 1 if there was no space within the timeout or -1 on error
+ * \sa     crossrun_channel_read()
+ * \sa     crossrun_channel_close()
+ * \note   each process should only write from one thread at a time
+ * \note   a process that writes and reads without waiting for each other must use timeouts to avoid both processes waiting for space at the same time
+ */
+DLL_EXPORT_CROSSRUN int crossrun_channel_write (crossrun_channel channel, const char* data, size_t datalen, int timeout);
+
+/*! \brief read a record from a shared memory channel
+ * \param  channel       channel
+ * \param  buf           buffer
+ * \param  buflen        size of buffer in bytes
+ * \param  datalen       pointer that will receive the size of the record (can be NULL)
+ * \param  timeout       maximum time in milliseconds to wait for a record (0 to not wait or -1 to wait indefinitely)
+ * \return 1 if a record was read, 0 if there was no record within the timeout or -1 at the end of the channel or on error
+ * \sa     crossrun_channel_write()
+ * \sa     crossrun_channel_close()
+ * \note   if the record doesn't fit in the buffer -1 is returned and the record is not removed,
+ *         in which case the size stored in datalen is larger than buflen
+ * \note   each process should only read from one thread at a time
+ */
+DLL_EXPORT_CROSSRUN int crossrun_channel_read (crossrun_channel channel, char* buf, size_t buflen, size_t* datalen, int timeout);
+
+/*! \brief indicate no more records will be written to a shared memory channel
+ * \param  channel       channel
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_channel_write()
+ * \sa     crossrun_channel_read()
+ * \note   the other process can still read the records written before and gets the end of the channel after that
+ * \note   a process exiting without calling this function doesn't close the channel, so the other process should use a timeout when reading
+ */
+DLL_EXPORT_CROSSRUN int crossrun_channel_close (crossrun_channel channel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNCHANNEL_H
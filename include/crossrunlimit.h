@@ -0,0 +1,80 @@
+/**
+ * @file crossrunlimit.h
+ * @brief crossrun library header file with functions for limiting the rate of output read from a shell process
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for capping the number of bytes or lines per second taken from the output of a shell process,
+ * so a shell process producing excessive output can't keep the calling process busy processing it.
+ */
+
+#ifndef __INCLUDED_CROSSRUNLIMIT_H
+#define __INCLUDED_CROSSRUNLIMIT_H
+
+#include "crossrun.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief what happens to output above the limit set with crossrun_set_output_limit()
+ * \sa     crossrun_set_output_limit()
+ * \name   CROSSRUN_LIMIT_*
+ * \{
+ */
+/*! \brief discard output above the limit */
+#define CROSSRUN_LIMIT_DROP             0
+/*! \brief keep one in every n lines above the limit */
+#define CROSSRUN_LIMIT_SAMPLE           1
+/*! \brief discard output above the limit but remember the last part of it */
+#define CROSSRUN_LIMIT_HEAD_TAIL        2
+/*! @} */
+
+/*! \brief limit the rate of output read from a shell process
+ * \param  handle        shell process handle
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  maxbytes      maximum number of bytes per second (0 for no limit)
+ * \param  maxlines      maximum number of lines per second (0 for no limit)
+ * \param  mode          what happens to output above the limit as CROSSRUN_LIMIT_*
+ * \param  param         for CROSSRUN_LIMIT_SAMPLE the n in one in every n lines is kept,
+ *                       for CROSSRUN_LIMIT_HEAD_TAIL the number of bytes of the most recently discarded output to remember
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_get_output_limit_stats()
+ * \sa     crossrun_get_output_limit_tail()
+ * \note   output above the limit is removed by the functions reading output (including crossrun_forward() and crossrun_loop),
+ *         these functions don't return until output within the limit or the end of the output is available
+ * \note   the decision to keep or discard is made at the start of each line, so lines are kept or discarded as a whole
+ * \note   with CROSSRUN_LIMIT_DROP output waiting in a pipe after the limit was reached is moved to /dev/null by the system
+ *         without being read where supported (Linux, unless checksums are enabled), its lines are not counted
+ * \note   setting both maxbytes and maxlines to 0 removes the limit and its statistics,
+ *         setting a new limit resets the statistics
+ */
+DLL_EXPORT_CROSSRUN int crossrun_set_output_limit (crossrun handle, int stream, uint64_t maxbytes, uint64_t maxlines, int mode, size_t param);
+
+/*! \brief get statistics about output discarded because of the limit set with crossrun_set_output_limit()
+ * \param  handle          shell process handle
+ * \param  stream          output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  discardedbytes  pointer that will receive the number of bytes discarded (can be NULL)
+ * \param  discardedlines  pointer that will receive the number of lines discarded (can be NULL)
+ * \return zero on success, non-zero on error (including when no limit was set)
+ * \sa     crossrun_set_output_limit()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_get_output_limit_stats (crossrun handle, int stream, uint64_t* discardedbytes, uint64_t* discardedlines);
+
+/*! \brief get the most recently discarded output remembered with CROSSRUN_LIMIT_HEAD_TAIL
+ * \param  handle        shell process handle
+ * \param  stream        output stream as CROSSRUN_STREAM_STDOUT or CROSSRUN_STREAM_STDERR
+ * \param  buf           buffer that will receive the data (can be NULL to only get the length)
+ * \param  buflen        size of buffer in bytes
+ * \return number of bytes remembered, of which at most buflen are copied to buf
+ * \sa     crossrun_set_output_limit()
+ * \note   if more output was discarded than is remembered the data starts at the first complete line
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_get_output_limit_tail (crossrun handle, int stream, char* buf, size_t buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNLIMIT_H
@@ -0,0 +1,163 @@
+/**
+ * @file crossrunloop.h
+ * @brief crossrun library header file with event loop functions
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for handling the input and output of many shell processes from a single thread
+ */
+
+#ifndef __INCLUDED_CROSSRUNLOOP_H
+#define __INCLUDED_CROSSRUNLOOP_H
+
+#include "crossrun.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief event loop engines
+ * \sa     crossrun_loop_create_with_engine()
+ * \sa     crossrun_loop_get_engine()
+ * \name   CROSSRUN_LOOP_ENGINE_*
+ * \{
+ */
+/*! \brief readiness notification with epoll */
+#define CROSSRUN_LOOP_ENGINE_EPOLL      1
+/*! \brief asynchronous I/O with io_uring (reads stay posted on all output streams and writes are submitted in batches) */
+#define CROSSRUN_LOOP_ENGINE_IO_URING   2
+/*! @} */
+
+/*! \brief data type for event loop handling multiple shell processes
+ * \sa     crossrun_loop_create()
+ * \sa     crossrun_loop_free()
+ */
+typedef struct crossrun_loop_struct* crossrun_loop;
+
+/*! \brief callback function type called when data was read from a shell process
+ * \param  handle        shell process handle
+ * \param  stream        stream the data was read from as CROSSRUN_STREAM_*
+ * \param  data          data read
+ * \param  datalen       number of bytes read
+ * \param  callbackdata  user data
+ * \return 0 to continue processing, any other value to remove the shell process from the event loop
+ * \sa     crossrun_loop_add()
+ * \sa     CROSSRUN_STREAM_*
+ */
+typedef int (*crossrun_loop_data_fn) (crossrun handle, int stream, const char* data, size_t datalen, void* callbackdata);
+
+/*! \brief callback function type called when the standard input of a shell process can be written to without blocking
+ * \param  handle        shell process handle
+ * \param  callbackdata  user data
+ * \return 0 to keep waiting for the standard input to become writable, any other value to stop waiting
+ * \sa     crossrun_loop_add()
+ * \sa     crossrun_loop_want_write()
+ */
+typedef int (*crossrun_loop_writable_fn) (crossrun handle, void* callbackdata);
+
+/*! \brief callback function type called when a shell process has exited and all its output was read
+ * \param  handle        shell process handle
+ * \param  exitcode      exit code of the shell process
+ * \param  callbackdata  user data
+ * \sa     crossrun_loop_add()
+ */
+typedef void (*crossrun_loop_exit_fn) (crossrun handle, unsigned long exitcode, void* callbackdata);
+
+/*! \brief create an event loop
+ * \return event loop or NULL on error (for example on platforms where this is not supported)
+ * \sa     crossrun_loop_free()
+ */
+DLL_EXPORT_CROSSRUN crossrun_loop crossrun_loop_create ();
+
+/*! \brief create an event loop using a specific engine
+ * \param  engine        desired engine as CROSSRUN_LOOP_ENGINE_* (if the engine is not supported by the running system the epoll engine is used instead)
+ * \return event loop or NULL on error (for example on platforms where this is not supported)
+ * \sa     CROSSRUN_LOOP_ENGINE_*
+ * \sa     crossrun_loop_get_engine()
+ * \sa     crossrun_loop_free()
+ */
+DLL_EXPORT_CROSSRUN crossrun_loop crossrun_loop_create_with_engine (int engine);
+
+/*! \brief get the engine used by an event loop
+ * \param  loop          event loop
+ * \return engine as CROSSRUN_LOOP_ENGINE_* or -1 on error
+ * \sa     CROSSRUN_LOOP_ENGINE_*
+ * \sa     crossrun_loop_create_with_engine()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_get_engine (crossrun_loop loop);
+
+/*! \brief destroy an event loop (shell processes still registered are removed but not closed)
+ * \param  loop          event loop
+ * \sa     crossrun_loop_create()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_loop_free (crossrun_loop loop);
+
+/*! \brief register a shell process with an event loop
+ * \param  loop          event loop
+ * \param  handle        shell process handle
+ * \param  datafn        callback function called when data was read (or NULL to discard output)
+ * \param  writablefn    callback function called when standard input is writable (or NULL)
+ * \param  exitfn        callback function called when the process has exited (or NULL)
+ * \param  callbackdata  user data passed to the callback functions
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_loop_remove()
+ * \sa     crossrun_loop_want_write()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_add (crossrun_loop loop, crossrun handle, crossrun_loop_data_fn datafn, crossrun_loop_writable_fn writablefn, crossrun_loop_exit_fn exitfn, void* callbackdata);
+
+/*! \brief remove a shell process from an event loop (the shell process handle is not closed)
+ * \param  loop          event loop
+ * \param  handle        shell process handle
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_loop_add()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_remove (crossrun_loop loop, crossrun handle);
+
+/*! \brief enable or disable calling the writable callback for a shell process
+ * \param  loop          event loop
+ * \param  handle        shell process handle
+ * \param  enable        non-zero to enable or zero to disable
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_loop_add()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_want_write (crossrun_loop loop, crossrun handle, int enable);
+
+/*! \brief queue data to be written to the standard input of a shell process by the event loop
+ * \param  loop          event loop
+ * \param  handle        shell process handle
+ * \param  data          data to write (copied by the event loop)
+ * \param  datalen       number of bytes to write
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_loop_add()
+ * \sa     crossrun_write_eof()
+ * \note   the standard input of the shell process is switched to non-blocking mode
+ * \note   data still queued is discarded when crossrun_write_eof() is called
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_write (crossrun_loop loop, crossrun handle, const char* data, size_t datalen);
+
+/*! \brief get number of shell processes registered with an event loop
+ * \param  loop          event loop
+ * \return number of registered shell processes
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_loop_count (crossrun_loop loop);
+
+/*! \brief wait for events and call the callback functions
+ * \param  loop          event loop
+ * \param  timeout       maximum time to wait in milliseconds (-1 to wait indefinitely, 0 to not wait)
+ * \return number of events processed or -1 on error
+ * \sa     crossrun_loop_run()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_run_once (crossrun_loop loop, int timeout);
+
+/*! \brief process events until no more shell processes are registered with an event loop
+ * \param  loop          event loop
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_loop_run_once()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_loop_run (crossrun_loop loop);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNLOOP_H
@@ -0,0 +1,234 @@
+/**
+ * @file crossrunopts.h
+ * @brief crossrun library header file with process creation options
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for setting options used when starting a shell process with the crossrun library
+ */
+
+#ifndef __INCLUDED_CROSSRUNOPTS_H
+#define __INCLUDED_CROSSRUNOPTS_H
+
+#include "crossrunenv.h"
+#include <stddef.h>
+
+/*! \brief error output handling modes
+ * \sa     crossrun_options_set_stderr()
+ * \name   CROSSRUN_STDERR_*
+ * \{
+ */
+/*! \brief error output is merged with standard output (default) */
+#define CROSSRUN_STDERR_MERGE           0
+/*! \brief error output is sent to a separate pipe that can be read with crossrun_read_stderr() */
+#define CROSSRUN_STDERR_PIPE            1
+/*! \brief error output is discarded */
+#define CROSSRUN_STDERR_DISCARD         2
+/*! @} */
+
+/*! \brief standard stream connection modes
+ * \sa     crossrun_options_set_stdio()
+ * \name   CROSSRUN_STDIO_*
+ * \{
+ */
+/*! \brief stream is connected to a pipe used by the crossrun functions for reading and writing (default for standard input and standard output) */
+#define CROSSRUN_STDIO_PIPE             0
+/*! \brief stream is inherited from the calling process */
+#define CROSSRUN_STDIO_INHERIT          1
+/*! \brief stream is connected to the null device (input is empty and output is discarded) */
+#define CROSSRUN_STDIO_NULL             2
+/*! \brief error output goes wherever standard output goes (only valid for error output, default for error output) */
+#define CROSSRUN_STDIO_MERGE            3
+/*! \brief stream is connected to a file descriptor of the calling process (set with crossrun_options_set_stdio_fd()) */
+#define CROSSRUN_STDIO_FD               4
+/*! \brief stream is connected to a file (set with crossrun_options_set_stdio_file()) */
+#define CROSSRUN_STDIO_FILE             5
+/*! @} */
+
+/*! \brief NUMA memory policies for crossrun_options_set_mempolicy()
+ * \sa     crossrun_options_set_mempolicy()
+ * \name   CROSSRUN_MEMPOLICY_*
+ * \{
+ */
+/*! \brief memory policy of the calling process is inherited (default) */
+#define CROSSRUN_MEMPOLICY_DEFAULT      0
+/*! \brief memory is only allocated on the nodes */
+#define CROSSRUN_MEMPOLICY_BIND         1
+/*! \brief memory is allocated on the first node if possible, otherwise on other nodes */
+#define CROSSRUN_MEMPOLICY_PREFERRED    2
+/*! \brief memory pages are allocated on the nodes in turn */
+#define CROSSRUN_MEMPOLICY_INTERLEAVE   3
+/*! @} */
+
+/*! \brief size of the read-ahead buffer allocated by crossrun_peek() if none was set with crossrun_options_set_read_buffer() */
+#define CROSSRUN_READ_BUFFER_DEFAULT_SIZE (64 * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief data type for options used when starting a shell process
+ * \sa     crossrun_options_create()
+ * \sa     crossrun_options_free()
+ * \sa     crossrun_open_with_options()
+ */
+typedef struct crossrun_options_struct* crossrun_options;
+
+/*! \brief create data structure for options with default values
+ * \return data structure for options or NULL on error
+ * \sa     crossrun_options_free()
+ * \sa     crossrun_open_with_options()
+ */
+DLL_EXPORT_CROSSRUN crossrun_options crossrun_options_create ();
+
+/*! \brief destroy data structure for options
+ * \param  options       options
+ * \sa     crossrun_options_create()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_options_free (crossrun_options options);
+
+/*! \brief set how the error output of the shell process is handled
+ * \param  options       options
+ * \param  mode          error output handling as CROSSRUN_STDERR_*
+ * \return zero on success, non-zero on error
+ * \sa     CROSSRUN_STDERR_*
+ * \sa     crossrun_options_set_stdio()
+ * \sa     crossrun_read_stderr()
+ * \sa     crossrun_read_any()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stderr (crossrun_options options, int mode);
+
+/*! \brief set how a standard stream of the shell process is connected
+ * \param  options       options
+ * \param  stream        standard stream as CROSSRUN_STREAM_*
+ * \param  mode          connection as CROSSRUN_STDIO_PIPE, CROSSRUN_STDIO_INHERIT, CROSSRUN_STDIO_NULL or CROSSRUN_STDIO_MERGE
+ * \return zero on success, non-zero on error
+ * \sa     CROSSRUN_STDIO_*
+ * \sa     crossrun_options_set_stdio_fd()
+ * \sa     crossrun_options_set_stdio_file()
+ * \note   only streams connected with CROSSRUN_STDIO_PIPE can be written to or read from with the crossrun functions,
+ *         for other streams the shell process reads or writes directly without the calling process being involved
+ * \note   crossrun_options_set_stderr() is a shorthand for setting the mode of error output
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stdio (crossrun_options options, int stream, int mode);
+
+/*! \brief connect a standard stream of the shell process to a file descriptor of the calling process
+ * \param  options       options
+ * \param  stream        standard stream as CROSSRUN_STREAM_*
+ * \param  fd            file descriptor (for example of an open file or socket)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_options_set_stdio()
+ * \note   the file descriptor is duplicated when the shell process is started, so it can be closed afterwards
+ *         but must remain open for as long as the options are used
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stdio_fd (crossrun_options options, int stream, int fd);
+
+/*! \brief connect a standard stream of the shell process to a file
+ * \param  options       options
+ * \param  stream        standard stream as CROSSRUN_STREAM_*
+ * \param  path          path of the file
+ * \param  flags         additional open() flags like O_CREAT, O_TRUNC, O_APPEND or O_EXCL
+ *                       (the file is opened for reading for standard input and for writing for the outputs)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_options_set_stdio()
+ * \note   the file is opened each time a shell process is started with these options,
+ *         if it can't be opened the shell process is not started
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stdio_file (crossrun_options options, int stream, const char* path, int flags);
+
+/*! \brief set the size of the read-ahead buffer for standard output
+ * \param  options       options
+ * \param  size          size of the buffer in bytes (0 to disable read-ahead buffering, which is the default)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_read()
+ * \sa     crossrun_peek()
+ * \sa     crossrun_get_read_stats()
+ * \note   with a read-ahead buffer each time output is available it is read with one large read, after which
+ *         crossrun_data_waiting(), crossrun_peek() and small reads are served from memory without system calls
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_read_buffer (crossrun_options options, size_t size);
+
+/*! \brief set the size of the pipes used for the standard streams
+ * \param  options       options
+ * \param  size          size of the pipes in bytes (0 for the system default, which is 64 KiB on Linux)
+ * \param  maxsize       size up to which the output pipes are grown when reads repeatedly find them full (0 to never grow them)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_get_pipe_size()
+ * \sa     crossrun_set_pipe_size()
+ * \note   larger pipes let a shell process producing a lot of output continue longer without waiting for the calling process
+ * \note   on Linux the sizes are limited to /proc/sys/fs/pipe-max-size and rounded up to a power of 2 memory pages by the system,
+ *         growing stops when the limit on pipe memory per user is reached,
+ *         on Windows only size is used as a hint when creating the pipes
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_pipe_size (crossrun_options options, size_t size, size_t maxsize);
+
+/*! \brief connect standard input and standard output of the shell process to one socket instead of 2 pipes
+ * \param  options       options
+ * \param  enable        non-zero to use a socket, zero to use pipes (default)
+ * \param  bufsize       size of the socket send and receive buffers in bytes (0 for the system default)
+ * \return zero on success, non-zero on error (for example on platforms where this is not supported)
+ * \sa     crossrun_options_set_stdio()
+ * \sa     crossrun_write_eof()
+ * \note   the calling process uses a single file descriptor for both streams, which halves the number of file descriptors
+ *         and kernel buffers needed when running many shell processes at once, reading and writing work as with pipes
+ * \note   crossrun_write_eof() shuts down the sending direction of the socket, so the shell process sees the end of its input
+ *         while its output can still be read
+ * \note   the end of the output is only reached when the shell process closed both its standard input and standard output,
+ *         which usually happens when it exits
+ * \note   only applies if both standard input and standard output are set to CROSSRUN_STDIO_PIPE and no pseudo-terminal is used,
+ *         the pipe size functions don't apply to the socket
+ * \note   not supported for pipelines
+ * \note   not supported on Windows
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_socketpair (crossrun_options options, int enable, size_t bufsize);
+
+/*! \brief compute a checksum of standard output and error output while the calling process reads them
+ * \param  options       options
+ * \param  enable        non-zero to compute checksums, zero not to (default)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_get_checksum()
+ * \note   this allows comparing large outputs without keeping them in memory,
+ *         only output read through the crossrun functions (including crossrun_forward() and crossrun_loop) is included
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_checksum (crossrun_options options, int enable);
+
+/*! \brief connect standard input and standard output of the shell process to a pseudo-terminal instead of pipes
+ * \param  options       options
+ * \param  enable        non-zero to use a pseudo-terminal, zero to use pipes (default)
+ * \param  rows          number of rows of the terminal window (0 for 24)
+ * \param  columns       number of columns of the terminal window (0 for 80)
+ * \return zero on success, non-zero on error (for example on platforms where this is not supported)
+ * \sa     crossrun_options_set_stdio()
+ * \note   programs that buffer their output in large blocks when writing to a pipe usually only buffer
+ *         up to the end of each line when writing to a terminal, so output becomes available immediately
+ * \note   the terminal is set to raw mode, so data is passed unchanged in both directions and input is not echoed,
+ *         which also means the shell process doesn't see the end of its input when crossrun_write_eof() is called
+ * \note   only applies to standard input and standard output if they are set to CROSSRUN_STDIO_PIPE,
+ *         error output also goes to the terminal if it is set to CROSSRUN_STDIO_MERGE
+ * \note   the shell process is started in a new session with the terminal as its controlling terminal
+ * \note   not supported for pipelines
+ * \note   not supported on Windows
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_pty (crossrun_options options, int enable, unsigned short rows, unsigned short columns);
+
+/*! \brief set the NUMA nodes the shell process allocates its memory on
+ * \param  options       options
+ * \param  mode          memory policy as CROSSRUN_MEMPOLICY_*
+ * \param  nodes         array with NUMA node numbers (or NULL to use the nodes of the logical processors the shell process runs on)
+ * \param  nodecount     number of elements in nodes
+ * \return zero on success, non-zero on error (for example on platforms where this is not supported)
+ * \sa     crossrun_open_with_options()
+ * \sa     crossrun_topology_get_domains()
+ * \note   without nodes the nodes of the affinity mask passed to crossrun_open_with_options() are used
+ *         (or of the affinity mask of the calling process if none is passed), so memory stays local to the logical processors,
+ *         on systems with only one NUMA node no memory policy is set in that case
+ * \note   the memory policy is set in the shell process before the program is started,
+ *         if the system doesn't support it (or doesn't have the nodes) the program is started anyway
+ * \note   only supported on Linux
+ */
+DLL_EXPORT_CROSSRUN int crossrun_options_set_mempolicy (crossrun_options options, int mode, const int* nodes, size_t nodecount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNOPTS_H
@@ -0,0 +1,94 @@
+/**
+ * @file crossrunpipeline.h
+ * @brief crossrun library header file with functions for running shell processes connected in a pipeline
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for running shell processes where the standard output of each process
+ * is connected directly to the standard input of the next process
+ */
+
+#ifndef __INCLUDED_CROSSRUNPIPELINE_H
+#define __INCLUDED_CROSSRUNPIPELINE_H
+
+#include "crossrun.h"
+#include "crossrunopts.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief data type for a pipeline of shell processes
+ * \sa     crossrun_pipeline_open()
+ * \sa     crossrun_pipeline_free()
+ */
+typedef struct crossrun_pipeline_struct* crossrun_pipeline;
+
+/*! \brief start shell processes connected in a pipeline
+ * \param  commands      array of shell commands to execute
+ * \param  count         number of commands
+ * \param  environment   environment variables for all processes (NULL to inherit)
+ * \param  priority      desired process priority value for all processes as CROSSRUN_PRIO_*
+ * \param  affinity      logical processors all processes are allowed to run on (NULL for no restriction)
+ * \param  options       options (NULL for defaults)
+ * \return pipeline or NULL on error
+ * \sa     crossrun_pipeline_get_stage()
+ * \sa     crossrun_pipeline_wait()
+ * \sa     crossrun_pipeline_free()
+ * \note   the standard output of each process is connected to the standard input of the next process with a pipe
+ *         that is not read or written by the calling process,
+ *         so the calling process only writes to the standard input of the first process and reads the standard output of the last process
+ * \note   the options for standard input apply to the first process, the options for standard output apply to the last process
+ *         and the options for error output apply to all processes, except that CROSSRUN_STDIO_MERGE only applies to the last process
+ *         (the error output of the other processes is inherited from the calling process)
+ * \note   the memory policy applies to all processes
+ * \note   options using a socket or a pseudo-terminal for standard input and output are not supported and make this function fail
+ * \note   checksums are computed for the output read from each process with the crossrun functions,
+ *         which for standard output is only the last process
+ */
+DLL_EXPORT_CROSSRUN crossrun_pipeline crossrun_pipeline_open (const char** commands, int count, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options);
+
+/*! \brief get number of shell processes in a pipeline
+ * \param  pipeline      pipeline
+ * \return number of shell processes
+ * \sa     crossrun_pipeline_open()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_pipeline_count (crossrun_pipeline pipeline);
+
+/*! \brief get handle of a shell process in a pipeline
+ * \param  pipeline      pipeline
+ * \param  index         index of the shell process (0 for the first process, -1 for the last process)
+ * \return shell process handle or NULL on error
+ * \sa     crossrun_pipeline_open()
+ * \note   write to the first process and read from the last process with the crossrun functions,
+ *         the handles of all processes can be used to get their status, stop them or wait for them
+ * \note   the handles are owned by the pipeline and must not be freed with crossrun_free()
+ */
+DLL_EXPORT_CROSSRUN crossrun crossrun_pipeline_get_stage (crossrun_pipeline pipeline, int index);
+
+/*! \brief wait for all shell processes in a pipeline to finish
+ * \param  pipeline      pipeline
+ * \return exit code of the last shell process
+ * \sa     crossrun_pipeline_open()
+ * \sa     crossrun_get_exit_code()
+ * \note   make sure the output of the last process is read, or the pipeline may never finish
+ */
+DLL_EXPORT_CROSSRUN unsigned long crossrun_pipeline_wait (crossrun_pipeline pipeline);
+
+/*! \brief forcefully stop all shell processes in a pipeline
+ * \param  pipeline      pipeline
+ * \sa     crossrun_pipeline_open()
+ * \sa     crossrun_kill()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_pipeline_kill (crossrun_pipeline pipeline);
+
+/*! \brief clean up a pipeline, closing the handles of all its shell processes
+ * \param  pipeline      pipeline
+ * \sa     crossrun_pipeline_open()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_pipeline_free (crossrun_pipeline pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNPIPELINE_H
@@ -0,0 +1,133 @@
+/**
+ * @file crossrunplanner.h
+ * @brief crossrun library header file with functions for distributing shell processes over logical processors
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for choosing the logical processors shell processes run on based on the processor topology,
+ * keeping track of the threads already placed so new shell processes go to the least loaded cores.
+ */
+
+#ifndef __INCLUDED_CROSSRUNPLANNER_H
+#define __INCLUDED_CROSSRUNPLANNER_H
+
+#include "crossrun.h"
+#include "crossrunproc.h"
+#include "crossrunopts.h"
+#include "crossruntopology.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief placement policies for crossrun_planner_place()
+ * \sa     crossrun_planner_place()
+ * \name   CROSSRUN_PLAN_*
+ * \{
+ */
+/*! \brief threads are spread over the least loaded physical cores, preferring other caches and packages than those already in use */
+#define CROSSRUN_PLAN_SPREAD            0
+/*! \brief all threads are placed on the cores sharing the least loaded level 3 cache (or package if caches are unknown) */
+#define CROSSRUN_PLAN_COMPACT           1
+/*! \brief the job gets all logical processors of the least loaded NUMA node */
+#define CROSSRUN_PLAN_ISOLATE           2
+/*! @} */
+
+/*! \brief data type for a planner distributing shell processes over logical processors
+ * \sa     crossrun_planner_create()
+ * \sa     crossrun_planner_free()
+ */
+typedef struct crossrun_planner_struct* crossrun_planner;
+
+/*! \brief create a planner for distributing shell processes over logical processors
+ * \param  topology      processor topology (NULL to discover the topology of the system)
+ * \param  within        logical processors jobs may be placed on (NULL for the online logical processors the calling process may run on)
+ * \return planner or NULL on error (including when there are no logical processors to place jobs on)
+ * \sa     crossrun_planner_place()
+ * \sa     crossrun_planner_free()
+ * \note   a topology passed must remain valid until the planner is destroyed
+ * \note   a planner is not thread safe, the shell processes placed with it must also be waited for from the same thread
+ */
+DLL_EXPORT_CROSSRUN crossrun_planner crossrun_planner_create (crossrun_topology topology, crossrun_cpumask within);
+
+/*! \brief destroy a planner and all its placements
+ * \param  planner       planner
+ * \sa     crossrun_planner_create()
+ * \note   shell processes attached to placements are not affected
+ */
+DLL_EXPORT_CROSSRUN void crossrun_planner_free (crossrun_planner planner);
+
+/*! \brief choose the logical processors for a job and count its threads as load on them
+ * \param  planner       planner
+ * \param  threads       number of threads of the job (0 is the same as 1)
+ * \param  policy        placement policy as CROSSRUN_PLAN_*
+ * \return logical processor mask to pass to crossrun_open() or NULL on error, the mask belongs to the planner
+ * \sa     crossrun_planner_plan()
+ * \sa     crossrun_planner_release()
+ * \sa     crossrun_planner_attach()
+ * \note   each thread is counted on the least loaded logical processor, where load on any logical processor of a core counts for the whole core,
+ *         so threads only share cores with SMT siblings when all cores are in use
+ * \note   with more threads than logical processors available to the policy all of them are used
+ */
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_planner_place (crossrun_planner planner, unsigned int threads, int policy);
+
+/*! \brief choose the logical processors for a number of jobs
+ * \param  planner       planner
+ * \param  jobs          number of jobs
+ * \param  threads       array with the number of threads of each job
+ * \param  policy        placement policy as CROSSRUN_PLAN_*
+ * \param  cpumasks      array that will receive the logical processor mask of each job
+ * \return zero on success, non-zero on error (in which case none of the jobs are placed)
+ * \sa     crossrun_planner_place()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_planner_plan (crossrun_planner planner, size_t jobs, const unsigned int* threads, int policy, crossrun_cpumask* cpumasks);
+
+/*! \brief remove the load of a job and destroy its logical processor mask
+ * \param  planner       planner
+ * \param  cpumask       logical processor mask returned by crossrun_planner_place()
+ * \return zero on success, non-zero on error (for example if the mask doesn't belong to the planner)
+ * \sa     crossrun_planner_place()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_planner_release (crossrun_planner planner, crossrun_cpumask cpumask);
+
+/*! \brief release the placement of a job automatically when the shell process running it exits
+ * \param  planner       planner
+ * \param  cpumask       logical processor mask returned by crossrun_planner_place()
+ * \param  handle        shell process handle
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_planner_place()
+ * \sa     crossrun_planner_open()
+ * \note   the placement is released when the exit of the shell process is noticed (for example by crossrun_wait(), crossrun_stopped()
+ *         or crossrun_loop) or when the handle is destroyed, after which the mask can no longer be used
+ */
+DLL_EXPORT_CROSSRUN int crossrun_planner_attach (crossrun_planner planner, crossrun_cpumask cpumask, crossrun handle);
+
+/*! \brief place a job and start a shell process for it on the logical processors chosen
+ * \param  planner       planner
+ * \param  threads       number of threads of the job (0 is the same as 1)
+ * \param  policy        placement policy as CROSSRUN_PLAN_*
+ * \param  command       shell command to execute
+ * \param  environment   environment variables (NULL to inherit)
+ * \param  priority      desired process priority value as CROSSRUN_PRIO_*
+ * \param  options       options (NULL for defaults)
+ * \return shell process handle or NULL on error
+ * \sa     crossrun_planner_place()
+ * \sa     crossrun_planner_attach()
+ * \sa     crossrun_open_with_options()
+ * \note   the placement is released automatically when the shell process exits
+ */
+DLL_EXPORT_CROSSRUN crossrun crossrun_planner_open (crossrun_planner planner, unsigned int threads, int policy, const char* command, crossrunenv environment, int priority, crossrun_options options);
+
+/*! \brief get the number of threads placed on a logical processor
+ * \param  planner       planner
+ * \param  cpuindex      logical processor number (0-based index)
+ * \return number of threads placed on the logical processor
+ * \sa     crossrun_planner_place()
+ */
+DLL_EXPORT_CROSSRUN unsigned int crossrun_planner_get_load (crossrun_planner planner, int cpuindex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNPLANNER_H
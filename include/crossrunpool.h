@@ -0,0 +1,123 @@
+/**
+ * @file crossrunpool.h
+ * @brief crossrun library header file with functions for keeping a pool of identical shell processes ready for use
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for a pool of pre-started worker processes that are leased to the caller and taken back,
+ * so the time needed to start a process isn't spent when the process is needed.
+ */
+
+#ifndef __INCLUDED_CROSSRUNPOOL_H
+#define __INCLUDED_CROSSRUNPOOL_H
+
+#include "crossrun.h"
+#include "crossrunproc.h"
+#include "crossrunopts.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief flags for crossrun_pool_create()
+ * \sa     crossrun_pool_create()
+ * \name   CROSSRUN_POOL_*
+ * \{
+ */
+/*! \brief pin each worker process to a single logical processor, spreading the workers over the allowed processors */
+#define CROSSRUN_POOL_PIN_EACH          0x01
+/*! @} */
+
+/*! \brief data type for a pool of worker processes
+ * \sa     crossrun_pool_create()
+ * \sa     crossrun_pool_free()
+ */
+typedef struct crossrun_pool_struct* crossrun_pool;
+
+/*! \brief start a pool of identical worker processes
+ * \param  command       shell command to execute for each worker process
+ * \param  environment   environment variables (NULL to inherit)
+ * \param  priority      desired process priority value as CROSSRUN_PRIO_*
+ * \param  affinity      logical processors the worker processes are allowed to run on (NULL for no restriction)
+ * \param  options       options (NULL for defaults)
+ * \param  size          number of worker processes
+ * \param  flags         flags as a combination of CROSSRUN_POOL_* (0 for none)
+ * \return pool or NULL on error
+ * \sa     crossrun_pool_lease()
+ * \sa     crossrun_pool_release()
+ * \sa     crossrun_pool_set_recycle()
+ * \sa     crossrun_pool_free()
+ * \note   environment and options are used again whenever a worker process is replaced, so they must remain valid until the pool is destroyed
+ */
+DLL_EXPORT_CROSSRUN crossrun_pool crossrun_pool_create (const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options, unsigned int size, int flags);
+
+/*! \brief stop all worker processes and destroy the pool
+ * \param  pool          pool
+ * \sa     crossrun_pool_create()
+ * \note   the standard input of each worker process is closed and worker processes that don't exit within a second are killed,
+ *         this includes worker processes that are still leased
+ */
+DLL_EXPORT_CROSSRUN void crossrun_pool_free (crossrun_pool pool);
+
+/*! \brief set when worker processes are replaced with new ones
+ * \param  pool          pool
+ * \param  maxuses       number of times a worker process can be leased before it is replaced (0 for no limit, which is the default)
+ * \param  maxrssgrowth  number of bytes the resident memory of a worker process can grow before it is replaced (0 for no limit, which is the default)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_pool_release()
+ * \note   the growth of the resident memory is measured from the first time the worker process is released
+ * \note   the resident memory is only checked on Linux
+ */
+DLL_EXPORT_CROSSRUN int crossrun_pool_set_recycle (crossrun_pool pool, unsigned long maxuses, uint64_t maxrssgrowth);
+
+/*! \brief get a worker process from the pool for exclusive use
+ * \param  pool          pool
+ * \return shell process handle or NULL if all worker processes are leased or on error
+ * \sa     crossrun_pool_release()
+ * \note   worker processes found to have exited are replaced first
+ * \note   the handle must not be closed or freed by the caller
+ */
+DLL_EXPORT_CROSSRUN crossrun crossrun_pool_lease (crossrun_pool pool);
+
+/*! \brief return a leased worker process to the pool
+ * \param  pool          pool
+ * \param  handle        shell process handle returned by crossrun_pool_lease()
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_pool_lease()
+ * \sa     crossrun_pool_set_recycle()
+ * \note   the worker process is replaced if it exited or reached the limits set with crossrun_pool_set_recycle(),
+ *         the old worker process gets its standard input closed and is cleaned up after it exits
+ */
+DLL_EXPORT_CROSSRUN int crossrun_pool_release (crossrun_pool pool, crossrun handle);
+
+/*! \brief check worker processes that are not leased and replace the ones that exited
+ * \param  pool          pool
+ * \return number of worker processes replaced or -1 on error
+ * \sa     crossrun_pool_lease()
+ * \note   meant to be called periodically (for example from the event loop of the calling process) so dead workers are
+ *         replaced before they are needed, as this is also done when leasing but then adds the time needed to start a process
+ */
+DLL_EXPORT_CROSSRUN int crossrun_pool_maintain (crossrun_pool pool);
+
+/*! \brief get number of worker processes ready to be leased
+ * \param  pool          pool
+ * \return number of worker processes not leased
+ * \sa     crossrun_pool_lease()
+ */
+DLL_EXPORT_CROSSRUN unsigned int crossrun_pool_idle (crossrun_pool pool);
+
+/*! \brief get statistics of the pool
+ * \param  pool          pool
+ * \param  started       pointer that will receive the number of worker processes started (can be NULL)
+ * \param  recycled      pointer that will receive the number of worker processes replaced because they reached their limits (can be NULL)
+ * \param  replaced      pointer that will receive the number of worker processes replaced because they exited (can be NULL)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_pool_set_recycle()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_pool_get_stats (crossrun_pool pool, uint64_t* started, uint64_t* recycled, uint64_t* replaced);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNPOOL_H
@@ -97,6 +97,17 @@ typedef struct crossrun_cpumask_struct* crossrun_cpumask;
  */
 DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_cpumask_create ();
 
+/*! \brief create data structure for logical processor mask with room for a specific number of logical processors
+ * \param  cpus          number of logical processors (processor numbers 0 to cpus - 1 can be used)
+ * \return data structure for logical processor mask or NULL on error (for example on platforms where affinity is not supported)
+ * \sa     crossrun_cpumask
+ * \sa     crossrun_cpumask_create
+ * \sa     crossrun_cpumask_free
+ * \note   useful when the number of processors reported by crossrun_get_logical_processors() doesn't cover all processor numbers,
+ *         for example when processors are offline, on Windows at most 64 processors are supported
+ */
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_cpumask_create_size (size_t cpus);
+
 /*! \brief destroy data structure for logical processor mask
  * \param  cpumask       logical processor mask
  * \sa     crossrun_cpumask
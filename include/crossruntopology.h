@@ -0,0 +1,152 @@
+/**
+ * @file crossruntopology.h
+ * @brief crossrun library header file with functions for discovering the processor topology
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for finding out how logical processors are grouped in packages, cores (SMT siblings),
+ * shared caches and NUMA nodes, and for building logical processor masks from these groups.
+ */
+
+#ifndef __INCLUDED_CROSSRUNTOPOLOGY_H
+#define __INCLUDED_CROSSRUNTOPOLOGY_H
+
+#include "crossrunproc.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief levels of the processor topology
+ * \sa     crossrun_topology_get_count()
+ * \sa     crossrun_topology_get_domain()
+ * \name   CROSSRUN_TOPOLOGY_*
+ * \{
+ */
+/*! \brief physical processor package (socket) */
+#define CROSSRUN_TOPOLOGY_PACKAGE       0
+/*! \brief physical core, its logical processors are SMT siblings (hyperthreads) */
+#define CROSSRUN_TOPOLOGY_CORE          1
+/*! \brief logical processors sharing a level 2 cache */
+#define CROSSRUN_TOPOLOGY_L2            2
+/*! \brief logical processors sharing a level 3 cache */
+#define CROSSRUN_TOPOLOGY_L3            3
+/*! \brief NUMA node */
+#define CROSSRUN_TOPOLOGY_NODE          4
+/*! @} */
+
+/*! \brief data type for processor topology
+ * \sa     crossrun_topology_create()
+ * \sa     crossrun_topology_free()
+ */
+typedef struct crossrun_topology_struct* crossrun_topology;
+
+/*! \brief discover the processor topology of the system
+ * \return processor topology or NULL on error
+ * \sa     crossrun_topology_free()
+ * \note   on Linux this information is read from /sys/devices/system, on Windows it is requested from the system,
+ *         where the information isn't available every logical processor is reported as a separate core in a single package and NUMA node
+ *         and the caches are unknown
+ */
+DLL_EXPORT_CROSSRUN crossrun_topology crossrun_topology_create ();
+
+/*! \brief read the processor topology from a sysfs directory tree
+ * \param  path          directory containing the cpu and node directories (normally /sys/devices/system)
+ * \return processor topology or NULL on error (including on platforms without sysfs)
+ * \sa     crossrun_topology_create()
+ * \sa     crossrun_topology_free()
+ * \note   useful for examining the topology of other systems from a copy of their sysfs files
+ */
+DLL_EXPORT_CROSSRUN crossrun_topology crossrun_topology_create_from_path (const char* path);
+
+/*! \brief destroy processor topology
+ * \param  topology      processor topology
+ * \sa     crossrun_topology_create()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_topology_free (crossrun_topology topology);
+
+/*! \brief get number of online logical processors
+ * \param  topology      processor topology
+ * \return number of online logical processors
+ * \sa     crossrun_topology_is_online()
+ * \note   unlike crossrun_get_logical_processors() offline logical processors are not counted
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_topology_get_cpus (crossrun_topology topology);
+
+/*! \brief get highest logical processor number
+ * \param  topology      processor topology
+ * \return highest logical processor number (online or not) or -1 on error
+ */
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_highest_cpu (crossrun_topology topology);
+
+/*! \brief check if a logical processor is online
+ * \param  topology      processor topology
+ * \param  cpuindex      logical processor number (0-based index)
+ * \return non-zero if online or zero if not
+ */
+DLL_EXPORT_CROSSRUN int crossrun_topology_is_online (crossrun_topology topology, int cpuindex);
+
+/*! \brief get number of domains (packages, cores, caches or nodes) at a level of the processor topology
+ * \param  topology      processor topology
+ * \param  level         topology level as CROSSRUN_TOPOLOGY_*
+ * \return number of domains with at least one online logical processor (0 if unknown)
+ * \sa     CROSSRUN_TOPOLOGY_*
+ */
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_count (crossrun_topology topology, int level);
+
+/*! \brief get the domain a logical processor belongs to at a level of the processor topology
+ * \param  topology      processor topology
+ * \param  cpuindex      logical processor number (0-based index)
+ * \param  level         topology level as CROSSRUN_TOPOLOGY_*
+ * \return index of the domain (0 to crossrun_topology_get_count() - 1) or -1 if unknown or if the logical processor is offline
+ * \sa     CROSSRUN_TOPOLOGY_*
+ * \note   domains are numbered in order of their lowest logical processor, NUMA nodes in order of their node number
+ */
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_domain (crossrun_topology topology, int cpuindex, int level);
+
+/*! \brief get the identifier used by the system for a domain
+ * \param  topology      processor topology
+ * \param  level         topology level as CROSSRUN_TOPOLOGY_*
+ * \param  index         index of the domain (0 to crossrun_topology_get_count() - 1)
+ * \return package id, core id (unique within its package), cache id or NUMA node number, or -1 on error
+ * \sa     crossrun_topology_get_domain()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_domain_id (crossrun_topology topology, int level, int index);
+
+/*! \brief get the domains at a level of the processor topology that logical processors in a mask belong to
+ * \param  topology      processor topology
+ * \param  level         topology level as CROSSRUN_TOPOLOGY_*
+ * \param  cpumask       logical processor mask
+ * \param  domains       array that will receive the indexes of the domains in ascending order (can be NULL)
+ * \param  maxdomains    number of elements in domains
+ * \return number of domains with at least one online logical processor in the mask (of which at most maxdomains are stored) or -1 on error
+ * \sa     crossrun_topology_get_domain_id()
+ * \note   for example with CROSSRUN_TOPOLOGY_NODE this gives the NUMA nodes a process with this affinity mask runs on
+ */
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_domains (crossrun_topology topology, int level, crossrun_cpumask cpumask, int* domains, int maxdomains);
+
+/*! \brief create logical processor mask with the online logical processors of a domain
+ * \param  topology      processor topology
+ * \param  level         topology level as CROSSRUN_TOPOLOGY_*
+ * \param  index         index of the domain (0 to crossrun_topology_get_count() - 1) or -1 for all online logical processors
+ * \return logical processor mask (to be freed with crossrun_cpumask_free()) or NULL on error
+ * \sa     crossrun_cpumask
+ */
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_topology_get_cpumask (crossrun_topology topology, int level, int index);
+
+/*! \brief create logical processor mask with one logical processor of each domain
+ * \param  topology      processor topology
+ * \param  level         topology level as CROSSRUN_TOPOLOGY_*
+ * \param  within        only use logical processors in this mask (or NULL for all online logical processors)
+ * \return logical processor mask (to be freed with crossrun_cpumask_free()) or NULL on error
+ * \sa     crossrun_cpumask
+ * \note   the lowest logical processor of each domain is used,
+ *         for example CROSSRUN_TOPOLOGY_CORE gives one thread per physical core
+ */
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_topology_get_one_per_domain (crossrun_topology topology, int level, crossrun_cpumask within);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNTOPOLOGY_H
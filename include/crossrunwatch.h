@@ -0,0 +1,127 @@
+/**
+ * @file crossrunwatch.h
+ * @brief crossrun library header file with functions for watching the output of a shell process for patterns
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for matching several patterns at once against output as it arrives,
+ * for example to wait until a shell process reports it is ready or to interact with it expect-style.
+ */
+
+#ifndef __INCLUDED_CROSSRUNWATCH_H
+#define __INCLUDED_CROSSRUNWATCH_H
+
+#include "crossrun.h"
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief pattern types for crossrun_watch_add()
+ * \sa     crossrun_watch_add()
+ * \name   CROSSRUN_WATCH_*
+ * \{
+ */
+/*! \brief pattern is a literal text that is matched anywhere in the output, also across lines */
+#define CROSSRUN_WATCH_LITERAL          0
+/*! \brief pattern is a simple regular expression that is matched against each complete line of output */
+#define CROSSRUN_WATCH_REGEX            1
+/*! @} */
+
+/*! \brief results of crossrun_expect() other than the index of the pattern found
+ * \sa     crossrun_expect()
+ * \name   CROSSRUN_EXPECT_*
+ * \{
+ */
+/*! \brief no pattern was found within the timeout */
+#define CROSSRUN_EXPECT_TIMEOUT         -2
+/*! \brief the end of the output was reached without finding a pattern */
+#define CROSSRUN_EXPECT_EOF             -3
+/*! @} */
+
+/*! \brief maximum line length for matching regular expressions, longer lines are matched on their first part */
+#define CROSSRUN_WATCH_MAX_LINE         4096
+
+/*! \brief data type for a set of patterns to watch for
+ * \sa     crossrun_watch_create()
+ * \sa     crossrun_watch_free()
+ */
+typedef struct crossrun_watch_struct* crossrun_watch;
+
+/*! \brief callback function type called when a pattern is found
+ * \param  watch        set of patterns
+ * \param  index        index of the pattern as returned by crossrun_watch_add()
+ * \param  text         the pattern for CROSSRUN_WATCH_LITERAL or the matching line (without line ending) for CROSSRUN_WATCH_REGEX
+ * \param  textlen      length of text
+ * \param  callbackdata user data passed to crossrun_watch_add()
+ * \sa     crossrun_watch_add()
+ */
+typedef void (*crossrun_watch_fn) (crossrun_watch watch, int index, const char* text, size_t textlen, void* callbackdata);
+
+/*! \brief create an empty set of patterns to watch for
+ * \return set of patterns or NULL on error
+ * \sa     crossrun_watch_add()
+ * \sa     crossrun_watch_free()
+ */
+DLL_EXPORT_CROSSRUN crossrun_watch crossrun_watch_create ();
+
+/*! \brief destroy a set of patterns
+ * \param  watch         set of patterns
+ * \sa     crossrun_watch_create()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_watch_free (crossrun_watch watch);
+
+/*! \brief add a pattern to watch for
+ * \param  watch         set of patterns
+ * \param  pattern       pattern
+ * \param  type          type of pattern as CROSSRUN_WATCH_*
+ * \param  fn            callback function called when the pattern is found (or NULL)
+ * \param  callbackdata  user data passed to the callback function
+ * \return index of the pattern (starting at 0 and incremented for each pattern added) or -1 on error
+ * \sa     crossrun_watch_feed()
+ * \sa     crossrun_expect()
+ * \note   regular expressions support . [] [^] * + ? ^ $ and escapes with \ including \\d \\s and \\w,
+ *         matching uses backtracking so nested repetitions can be slow on long lines
+ * \note   adding a pattern resets the matching state
+ */
+DLL_EXPORT_CROSSRUN int crossrun_watch_add (crossrun_watch watch, const char* pattern, int type, crossrun_watch_fn fn, void* callbackdata);
+
+/*! \brief match output against the patterns, continuing from where the previous call left off
+ * \param  watch         set of patterns
+ * \param  data          output data
+ * \param  datalen       size of output data
+ * \param  consumed      pointer that will receive the number of bytes processed, up to the end of the first match (can be NULL)
+ * \return index of the pattern found or -1 if no pattern was found
+ * \sa     crossrun_watch_add()
+ * \sa     crossrun_watch_reset()
+ * \note   literal patterns are found even if they are split over different calls,
+ *         the processor skips to possible matches with vector instructions where supported
+ * \note   only the first match is reported, to find more matches call again with the data following the consumed bytes
+ * \note   when a literal pattern ends with the newline that ends a line the regular expressions are checked against that line by the next call,
+ *         which consumes no data if one of them matches
+ */
+DLL_EXPORT_CROSSRUN int crossrun_watch_feed (crossrun_watch watch, const char* data, size_t datalen, size_t* consumed);
+
+/*! \brief forget output fed before, so partial matches don't continue in the next output
+ * \param  watch         set of patterns
+ * \sa     crossrun_watch_feed()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_watch_reset (crossrun_watch watch);
+
+/*! \brief read standard output of a shell process until one of the patterns is found
+ * \param  handle        shell process handle
+ * \param  watch         set of patterns
+ * \param  timeout       maximum time in milliseconds to wait (0 to only check output already available or -1 to wait indefinitely)
+ * \return index of the pattern found, CROSSRUN_EXPECT_TIMEOUT, CROSSRUN_EXPECT_EOF or -1 on error
+ * \sa     crossrun_watch_add()
+ * \sa     CROSSRUN_EXPECT_*
+ * \note   output up to the end of the match is consumed, output following it remains available for the next read
+ *         (this uses the read-ahead buffer, which is created if needed)
+ */
+DLL_EXPORT_CROSSRUN int crossrun_expect (crossrun handle, crossrun_watch watch, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNWATCH_H
@@ -0,0 +1,154 @@
+/**
+ * @file crossrunworker.h
+ * @brief crossrun library header file with functions for sending requests to a persistent worker process
+ * @author Brecht Sanders
+ *
+ * This header file defines the functions for exchanging framed requests and responses with a long-running shell process
+ * over its standard input and standard output, with several requests in flight at the same time.
+ * Each frame consists of an 8 byte header (request ID and data length, both as 32-bit little-endian values) followed by the data.
+ * The worker process uses the crossrun_worker_child_*() functions to receive requests and send responses.
+ */
+
+#ifndef __INCLUDED_CROSSRUNWORKER_H
+#define __INCLUDED_CROSSRUNWORKER_H
+
+#include "crossrun.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \brief size of the header in front of the data of each frame */
+#define CROSSRUN_WORKER_FRAME_HEADER 8
+
+/*! \brief maximum size of the data of a frame, larger frames are considered a protocol error */
+#define CROSSRUN_WORKER_MAX_FRAME (256 * 1024 * 1024)
+
+/*! \brief data type for sending requests to a worker process
+ * \sa     crossrun_worker_create()
+ * \sa     crossrun_worker_free()
+ */
+typedef struct crossrun_worker_struct* crossrun_worker;
+
+/*! \brief callback function type called when the response to a request is received
+ * \param  worker       worker
+ * \param  requestid    ID of the request
+ * \param  data         response data (NULL if the worker process ended before responding)
+ * \param  datalen      size of response data
+ * \param  callbackdata user data passed to crossrun_worker_send()
+ * \sa     crossrun_worker_send()
+ * \note   the data is only valid during the callback
+ */
+typedef void (*crossrun_worker_response_fn) (crossrun_worker worker, uint32_t requestid, const char* data, size_t datalen, void* callbackdata);
+
+/*! \brief use a shell process as a worker process that receives framed requests
+ * \param  handle        shell process handle
+ * \return worker or NULL on error
+ * \sa     crossrun_worker_send()
+ * \sa     crossrun_worker_free()
+ * \note   the shell process must only write response frames to its standard output
+ * \note   the standard input of the shell process is switched to non-blocking mode
+ */
+DLL_EXPORT_CROSSRUN crossrun_worker crossrun_worker_create (crossrun handle);
+
+/*! \brief clean up worker
+ * \param  worker        worker
+ * \sa     crossrun_worker_create()
+ * \note   the shell process handle is not closed and callbacks of requests still in flight are not called
+ */
+DLL_EXPORT_CROSSRUN void crossrun_worker_free (crossrun_worker worker);
+
+/*! \brief send a request to a worker process
+ * \param  worker        worker
+ * \param  data          request data
+ * \param  datalen       size of request data
+ * \param  fn            callback function called when the response is received (or NULL to ignore the response)
+ * \param  callbackdata  user data passed to the callback function
+ * \param  requestid     pointer that will receive the ID of the request (can be NULL)
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_worker_process()
+ * \sa     crossrun_worker_wait()
+ * \note   the request is queued and written as far as possible without blocking,
+ *         the rest is written by crossrun_worker_process() while responses are read, so many requests can be in flight without deadlocks
+ */
+DLL_EXPORT_CROSSRUN int crossrun_worker_send (crossrun_worker worker, const char* data, size_t datalen, crossrun_worker_response_fn fn, void* callbackdata, uint32_t* requestid);
+
+/*! \brief write queued requests to and read responses from a worker process and call the callback functions for the responses
+ * \param  worker        worker
+ * \param  timeout       maximum time in milliseconds to wait for a response (0 to not wait or -1 to wait indefinitely)
+ * \return number of responses received (responses can arrive in a different order than the requests were sent)
+ *         or -1 if the worker process ended or on error, in which case the callbacks of the requests in flight are called without data
+ * \sa     crossrun_worker_send()
+ * \sa     crossrun_worker_wait()
+ */
+DLL_EXPORT_CROSSRUN int crossrun_worker_process (crossrun_worker worker, int timeout);
+
+/*! \brief wait until the response to a request is received
+ * \param  worker        worker
+ * \param  requestid     ID of the request
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_worker_send()
+ * \sa     crossrun_worker_process()
+ * \note   callbacks of responses to other requests received in the meantime are called as well
+ */
+DLL_EXPORT_CROSSRUN int crossrun_worker_wait (crossrun_worker worker, uint32_t requestid);
+
+/*! \brief get number of requests sent to a worker process that didn't get a response yet
+ * \param  worker        worker
+ * \return number of requests in flight
+ * \sa     crossrun_worker_send()
+ */
+DLL_EXPORT_CROSSRUN size_t crossrun_worker_pending (crossrun_worker worker);
+
+/*! \brief data type for receiving requests in a worker process
+ * \sa     crossrun_worker_child_create()
+ * \sa     crossrun_worker_child_free()
+ */
+typedef struct crossrun_worker_child_struct* crossrun_worker_child;
+
+/*! \brief set up receiving requests on standard input and sending responses on standard output of the current process
+ * \return worker child data structure or NULL on error
+ * \sa     crossrun_worker_child_receive()
+ * \sa     crossrun_worker_child_respond()
+ * \sa     crossrun_worker_child_free()
+ * \note   to be called from the worker process, which must not write anything else to standard output
+ */
+DLL_EXPORT_CROSSRUN crossrun_worker_child crossrun_worker_child_create ();
+
+/*! \brief send responses still buffered and clean up worker child data structure
+ * \param  child         worker child data structure
+ * \sa     crossrun_worker_child_create()
+ */
+DLL_EXPORT_CROSSRUN void crossrun_worker_child_free (crossrun_worker_child child);
+
+/*! \brief receive the next request in a worker process
+ * \param  child         worker child data structure
+ * \param  requestid     pointer that will receive the ID of the request, to be passed to crossrun_worker_child_respond()
+ * \param  data          pointer that will receive the request data (valid until the next call)
+ * \param  datalen       pointer that will receive the size of request data
+ * \return 1 if a request was received, 0 at the end of input or -1 on error
+ * \sa     crossrun_worker_child_respond()
+ * \note   buffered responses are sent before waiting for more requests
+ */
+DLL_EXPORT_CROSSRUN int crossrun_worker_child_receive (crossrun_worker_child child, uint32_t* requestid, const char** data, size_t* datalen);
+
+/*! \brief send the response to a request from a worker process
+ * \param  child         worker child data structure
+ * \param  requestid     ID of the request
+ * \param  data          response data
+ * \param  datalen       size of response data
+ * \return zero on success, non-zero on error
+ * \sa     crossrun_worker_child_receive()
+ * \note   responses are buffered until the next call to crossrun_worker_child_receive() would have to wait for a request,
+ *         so responses to requests that arrived together are sent together
+ * \note   responses can be sent in any order
+ */
+DLL_EXPORT_CROSSRUN int crossrun_worker_child_respond (crossrun_worker_child child, uint32_t requestid, const char* data, size_t datalen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //__INCLUDED_CROSSRUNWORKER_H
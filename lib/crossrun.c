@@ -1,32 +1,37 @@
-#include "crossrun.h"
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+#include "crossrunpriv.h"
+#include "crossrunchannel.h"
+#include "crossrunwatch.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#include <fcntl.h>
 #else
 #include <sys/types.h>
-//#define _GNU_SOURCE
 #include <unistd.h>
-//#include <fcntl.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <signal.h>
 //#include <sys/types.h>
 #include <sys/wait.h>
 #include <poll.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <termios.h>
 #endif
 
 //#define SHOWERROR(format, ...) fprintf(stderr, format "\n" __VA_OPT__(,) __VA_ARGS__);
 #define SHOWERROR(...) fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n");
 
-//#define WITH_STDERR
-
-#define PIPE_READ  0
-#define PIPE_WRITE 1
-
 #define USE_NEW_PROCESS_GROUP
 
 DLL_EXPORT_CROSSRUN void crossrun_get_version (int* pmajor, int* pminor, int* pmicro)
@@ -44,27 +49,6 @@ DLL_EXPORT_CROSSRUN const char* crossrun_get_version_string ()
   return CROSSRUN_VERSION_STRING;
 }
 
-struct crossrun_data {
-#ifdef _WIN32
-  HANDLE stdin_pipe[2];           //pipe for process standard input
-  HANDLE stdout_pipe[2];          //pipe for process standard output
-#ifdef WITH_STDERR
-  HANDLE stderr_pipe[2];          //pipe for process error output
-#endif
-  PROCESS_INFORMATION proc_info;  //Windows process information structure
-  DWORD exitcode;                 //exit code after process exited
-#else
-  int stdin_pipe[2];              //pipe for process standard input
-  int stdout_pipe[2];             //pipe for process standard output
-#ifdef WITH_STDERR
-  int stderr_pipe[2];             //pipe for process error output
-#endif
-  pid_t pid;                      //process ID
-  int exitcode;                   //exit code after process exited
-#endif
-  int exited;
-};
-
 #ifndef _WIN32
 #ifdef _WIN32
 static inline char* strndup (const char* s, size_t n)
@@ -141,73 +125,356 @@ void free_argv (char** argv)
 }
 #endif
 
+#ifdef _WIN32
+static void close_handle_if_open (HANDLE* h)
+{
+  if (*h) {
+    CloseHandle(*h);
+    *h = NULL;
+  }
+}
+#else
+static void close_fd_if_open (int* fd)
+{
+  if (*fd >= 0) {
+    close(*fd);
+    *fd = -1;
+  }
+}
+#endif
+
+//close both ends of all pipes of a shell process (used for cleaning up on error)
+static void close_all_pipes (crossrun handle)
+{
+  int i;
+#ifndef _WIN32
+  //standard input and output share the socket, so only close it once
+  if (handle->socket && handle->stdin_pipe[PIPE_WRITE] == handle->stdout_pipe[PIPE_READ])
+    handle->stdin_pipe[PIPE_WRITE] = -1;
+#endif
+  for (i = 0; i < 2; i++) {
+#ifdef _WIN32
+    close_handle_if_open(&handle->stdin_pipe[i]);
+    close_handle_if_open(&handle->stdout_pipe[i]);
+    close_handle_if_open(&handle->stderr_pipe[i]);
+#else
+    close_fd_if_open(&handle->stdin_pipe[i]);
+    close_fd_if_open(&handle->stdout_pipe[i]);
+    close_fd_if_open(&handle->stderr_pipe[i]);
+#endif
+  }
+}
+
+static void free_handle (crossrun handle)
+{
+  crossrun_placement_release(handle);
+  crossrun_limit_free(handle);
+  free(handle->readbuf);
+  free(handle->wqueue);
+  free(handle);
+}
+
 DLL_EXPORT_CROSSRUN crossrun crossrun_open (const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity)
 {
-  crossrun handle;
-  //allocate data structure
-  if ((handle = (struct crossrun_data*)malloc(sizeof(struct crossrun_data))) == NULL) {
-    SHOWERROR("Memory allocation error")
-    return NULL;
+  return crossrun_open_with_options(command, environment, priority, affinity, NULL);
+}
+
+//how the standard streams are connected if no options are given
+static const struct crossrun_stdio_option default_stdio[3] = {
+  {CROSSRUN_STDIO_PIPE, -1, NULL, 0},
+  {CROSSRUN_STDIO_PIPE, -1, NULL, 0},
+  {CROSSRUN_STDIO_MERGE, -1, NULL, 0}
+};
+
+//get the pipe used for a standard stream of a shell process
+#ifdef _WIN32
+static HANDLE* stdio_pipe (crossrun handle, int stream)
+#else
+static int* stdio_pipe (crossrun handle, int stream)
+#endif
+{
+  switch (stream) {
+    case CROSSRUN_STREAM_STDIN:
+      return handle->stdin_pipe;
+    case CROSSRUN_STREAM_STDOUT:
+      return handle->stdout_pipe;
   }
-  handle->exitcode = 0;
-  handle->exited = 0;
+  return handle->stderr_pipe;
+}
+
 #ifdef _WIN32
+//create the pipes and open the files for the standard streams of a shell process (childhandle will receive the inheritable handles for streams not connected to a pipe)
+static int open_stdio (crossrun handle, const struct crossrun_stdio_option* stdio, size_t pipesize, HANDLE* childhandle)
+{
+  int stream;
+  HANDLE* pipe;
+  HANDLE h;
+  DWORD access;
+  DWORD disposition;
   SECURITY_ATTRIBUTES sattr;
-  //allocate data structure
-  //create pipes and make the end for the shell process inheritable
+  static const DWORD stdhandle[3] = {STD_INPUT_HANDLE, STD_OUTPUT_HANDLE, STD_ERROR_HANDLE};
   sattr.nLength = sizeof(SECURITY_ATTRIBUTES);
   sattr.lpSecurityDescriptor = NULL;
   sattr.bInheritHandle = TRUE;
-  if (!CreatePipe(&handle->stdin_pipe[PIPE_READ], &handle->stdin_pipe[PIPE_WRITE], &sattr, 0)) {
-    SHOWERROR("Error in CreatePipe()")
-    free(handle);
-    return NULL;
+  for (stream = CROSSRUN_STREAM_STDIN; stream <= CROSSRUN_STREAM_STDERR; stream++) {
+    pipe = stdio_pipe(handle, stream);
+    access = (stream == CROSSRUN_STREAM_STDIN ? GENERIC_READ : GENERIC_WRITE);
+    switch (stdio[stream].mode) {
+      case CROSSRUN_STDIO_PIPE:
+        //create pipe and make the end for the shell process inheritable
+        if (!CreatePipe(&pipe[PIPE_READ], &pipe[PIPE_WRITE], &sattr, (DWORD)pipesize)) {
+          SHOWERROR("Error in CreatePipe()")
+          return -1;
+        }
+        if (!SetHandleInformation(pipe[stream == CROSSRUN_STREAM_STDIN ? PIPE_WRITE : PIPE_READ], HANDLE_FLAG_INHERIT, 0)) {
+          SHOWERROR("Error in SetHandleInformation()")
+          return -1;
+        }
+        break;
+      case CROSSRUN_STDIO_INHERIT:
+      case CROSSRUN_STDIO_FD:
+        //duplicate handle of the calling process as inheritable handle
+        h = (stdio[stream].mode == CROSSRUN_STDIO_INHERIT ? GetStdHandle(stdhandle[stream]) : (HANDLE)_get_osfhandle(stdio[stream].fd));
+        if (h == NULL || h == INVALID_HANDLE_VALUE) {
+          if (stdio[stream].mode == CROSSRUN_STDIO_INHERIT)
+            break;
+          SHOWERROR("Invalid file descriptor")
+          return -1;
+        }
+        if (!DuplicateHandle(GetCurrentProcess(), h, GetCurrentProcess(), &childhandle[stream], 0, TRUE, DUPLICATE_SAME_ACCESS)) {
+          childhandle[stream] = NULL;
+          SHOWERROR("Error in DuplicateHandle()")
+          return -1;
+        }
+        break;
+      case CROSSRUN_STDIO_NULL:
+        if ((childhandle[stream] = CreateFileA("NUL", access, FILE_SHARE_READ | FILE_SHARE_WRITE, &sattr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE) {
+          childhandle[stream] = NULL;
+          SHOWERROR("Error opening NUL device")
+          return -1;
+        }
+        break;
+      case CROSSRUN_STDIO_FILE:
+        //translate open() flags
+        if ((stdio[stream].flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL))
+          disposition = CREATE_NEW;
+        else if ((stdio[stream].flags & (O_CREAT | O_TRUNC)) == (O_CREAT | O_TRUNC))
+          disposition = CREATE_ALWAYS;
+        else if (stdio[stream].flags & O_CREAT)
+          disposition = OPEN_ALWAYS;
+        else if (stdio[stream].flags & O_TRUNC)
+          disposition = TRUNCATE_EXISTING;
+        else
+          disposition = OPEN_EXISTING;
+        if (stream != CROSSRUN_STREAM_STDIN && (stdio[stream].flags & O_APPEND))
+          access = FILE_APPEND_DATA;
+        if ((childhandle[stream] = CreateFileA(stdio[stream].path, access, FILE_SHARE_READ | FILE_SHARE_WRITE, &sattr, disposition, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE) {
+          childhandle[stream] = NULL;
+          SHOWERROR("Error opening file: %s", stdio[stream].path)
+          return -1;
+        }
+        break;
+    }
   }
-  if (!SetHandleInformation(handle->stdin_pipe[PIPE_WRITE], HANDLE_FLAG_INHERIT, 0)) {
-    SHOWERROR("Error in SetHandleInformation()")
-    CloseHandle(handle->stdin_pipe[PIPE_READ]);
-    CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
-    free(handle);
-    return NULL;
+  return 0;
+}
+#else
+//create the pipes and open the files for the standard streams of a shell process (childfd will receive the file descriptors for streams not connected to a pipe, which are not inherited by other processes)
+static int open_stdio (crossrun handle, const struct crossrun_stdio_option* stdio, int* childfd)
+{
+  int stream;
+  int mode;
+  for (stream = CROSSRUN_STREAM_STDIN; stream <= CROSSRUN_STREAM_STDERR; stream++) {
+    mode = (stream == CROSSRUN_STREAM_STDIN ? O_RDONLY : O_WRONLY);
+    switch (stdio[stream].mode) {
+      case CROSSRUN_STDIO_PIPE:
+        //skip if already connected to a pseudo-terminal or socket
+        if (childfd[stream] >= 0 || (handle->socket && stream != CROSSRUN_STREAM_STDERR))
+          break;
+        if (pipe(stdio_pipe(handle, stream)) < 0) {
+          SHOWERROR("Error in pipe()")
+          return -1;
+        }
+        break;
+      case CROSSRUN_STDIO_FD:
+        //use a duplicate that can't conflict with the standard streams while they are being rerouted
+        if ((childfd[stream] = fcntl(stdio[stream].fd, F_DUPFD_CLOEXEC, 3)) < 0) {
+          SHOWERROR("Invalid file descriptor")
+          return -1;
+        }
+        break;
+      case CROSSRUN_STDIO_NULL:
+        if ((childfd[stream] = open("/dev/null", mode | O_CLOEXEC)) < 0) {
+          SHOWERROR("Error opening /dev/null")
+          return -1;
+        }
+        break;
+      case CROSSRUN_STDIO_FILE:
+        if ((childfd[stream] = open(stdio[stream].path, mode | O_CLOEXEC | stdio[stream].flags, 0666)) < 0) {
+          SHOWERROR("Error opening file: %s", stdio[stream].path)
+          return -1;
+        }
+        break;
+    }
   }
-  if (!CreatePipe(&handle->stdout_pipe[PIPE_READ], &handle->stdout_pipe[PIPE_WRITE], &sattr, 0)) {
-    SHOWERROR("Error in CreatePipe()")
-    CloseHandle(handle->stdin_pipe[PIPE_READ]);
-    CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
-    free(handle);
-    return NULL;
+  return 0;
+}
+
+//create a pseudo-terminal for standard input and output of a shell process (ptyslave will receive the terminal end for the shell process, which is not inherited by other processes)
+static int open_pty (crossrun handle, const struct crossrun_stdio_option* stdio, const struct crossrun_options_struct* options, int* childfd, int* ptyslave)
+{
+  int master;
+  const char* name;
+  struct termios attr;
+  struct winsize size;
+  if ((master = posix_openpt(O_RDWR | O_NOCTTY)) < 0) {
+    SHOWERROR("Error in posix_openpt()")
+    return -1;
   }
-  if (!SetHandleInformation(handle->stdout_pipe[PIPE_READ], HANDLE_FLAG_INHERIT, 0)) {
-    SHOWERROR("Error in SetHandleInformation()")
-    CloseHandle(handle->stdin_pipe[PIPE_READ]);
-    CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
-    CloseHandle(handle->stdout_pipe[PIPE_READ]);
-    CloseHandle(handle->stdout_pipe[PIPE_WRITE]);
-    free(handle);
-    return NULL;
+  fcntl(master, F_SETFD, FD_CLOEXEC);
+  if (grantpt(master) != 0 || unlockpt(master) != 0 || (name = ptsname(master)) == NULL || (*ptyslave = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC)) < 0) {
+    SHOWERROR("Error opening pseudo-terminal")
+    close(master);
+    return -1;
   }
-#ifdef WITH_STDERR
-  if (!CreatePipe(&handle->stderr_pipe[PIPE_READ], &handle->stderr_pipe[PIPE_WRITE], &sattr, 0)) {
-    SHOWERROR("Error in CreatePipe()")
-    CloseHandle(handle->stdin_pipe[PIPE_READ]);
-    CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
-    CloseHandle(handle->stdout_pipe[PIPE_READ]);
-    CloseHandle(handle->stdout_pipe[PIPE_WRITE]);
-    free(handle);
+  //set raw mode before the shell process can use the terminal, so data is passed unchanged
+  if (tcgetattr(*ptyslave, &attr) == 0) {
+    cfmakeraw(&attr);
+    tcsetattr(*ptyslave, TCSANOW, &attr);
+  }
+  size.ws_row = options->ptyrows;
+  size.ws_col = options->ptycolumns;
+  size.ws_xpixel = 0;
+  size.ws_ypixel = 0;
+  ioctl(*ptyslave, TIOCSWINSZ, &size);
+  //the calling process reads and writes the same terminal end
+  if (stdio[CROSSRUN_STREAM_STDOUT].mode == CROSSRUN_STDIO_PIPE) {
+    handle->stdout_pipe[PIPE_READ] = master;
+    childfd[CROSSRUN_STREAM_STDOUT] = fcntl(*ptyslave, F_DUPFD_CLOEXEC, 3);
+  }
+  if (stdio[CROSSRUN_STREAM_STDIN].mode == CROSSRUN_STDIO_PIPE) {
+    handle->stdin_pipe[PIPE_WRITE] = (handle->stdout_pipe[PIPE_READ] == master ? fcntl(master, F_DUPFD_CLOEXEC, 3) : master);
+    childfd[CROSSRUN_STREAM_STDIN] = fcntl(*ptyslave, F_DUPFD_CLOEXEC, 3);
+  }
+  if (handle->stdout_pipe[PIPE_READ] != master && handle->stdin_pipe[PIPE_WRITE] != master)
+    close(master);
+  handle->pty = 1;
+  return 0;
+}
+
+//create one socket for standard input and output of a shell process (childfd will receive the end for the shell process as standard input, which is also used as standard output)
+static int open_socketpair (crossrun handle, const struct crossrun_stdio_option* stdio, const struct crossrun_options_struct* options, int* childfd)
+{
+  int sock[2];
+  int size;
+  int i;
+  if (stdio[CROSSRUN_STREAM_STDIN].mode != CROSSRUN_STDIO_PIPE || stdio[CROSSRUN_STREAM_STDOUT].mode != CROSSRUN_STDIO_PIPE || options->pty)
+    return 0;
+#ifdef SOCK_CLOEXEC
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sock) != 0) {
+#else
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, sock) != 0) {
+#endif
+    SHOWERROR("Error in socketpair()")
+    return -1;
+  }
+#ifndef SOCK_CLOEXEC
+  //not all platforms (like macOS) can create the sockets with close-on-exec set
+  fcntl(sock[0], F_SETFD, FD_CLOEXEC);
+  fcntl(sock[1], F_SETFD, FD_CLOEXEC);
+#endif
+  if (options->socketbufsize > 0) {
+    size = (options->socketbufsize > 0x7FFFFFFF ? 0x7FFFFFFF : (int)options->socketbufsize);
+    for (i = 0; i < 2; i++) {
+      setsockopt(sock[i], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+      setsockopt(sock[i], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+  }
+  //the calling process reads and writes the same end
+  handle->stdin_pipe[PIPE_WRITE] = sock[0];
+  handle->stdout_pipe[PIPE_READ] = sock[0];
+  childfd[CROSSRUN_STREAM_STDIN] = sock[1];
+  handle->socket = 1;
+  return 0;
+}
+
+//make a file descriptor a standard stream in the shell process (use loop to cover possibility of being interrupted by signal)
+static void set_child_stdio (int fd, int target)
+{
+  if (fd < 0)
+    return;
+  if (fd == target) {
+    fcntl(fd, F_SETFD, 0);
+    return;
+  }
+  while ((dup2(fd, target) == -1) && (errno == EINTR))
+    ;
+}
+#endif
+
+DLL_EXPORT_CROSSRUN crossrun crossrun_open_with_options (const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options)
+{
+  int i;
+  crossrun handle;
+  const struct crossrun_stdio_option* stdio = (options ? options->stdio : default_stdio);
+  //allocate data structure
+  if ((handle = (struct crossrun_data*)malloc(sizeof(struct crossrun_data))) == NULL) {
+    SHOWERROR("Memory allocation error")
     return NULL;
   }
-  if (!SetHandleInformation(handle->stderr_pipe[PIPE_READ], HANDLE_FLAG_INHERIT, 0)) {
-    SHOWERROR("Error in SetHandleInformation()")
-    CloseHandle(handle->stdin_pipe[PIPE_READ]);
-    CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
-    CloseHandle(handle->stdout_pipe[PIPE_READ]);
-    CloseHandle(handle->stdout_pipe[PIPE_WRITE]);
-    CloseHandle(handle->stderr_pipe[PIPE_READ]);
-    CloseHandle(handle->stderr_pipe[PIPE_WRITE]);
-    free(handle);
+  handle->exitcode = 0;
+  handle->exited = 0;
+  handle->pty = 0;
+  handle->socket = 0;
+  handle->stdout_eof = 0;
+  handle->stderr_eof = 0;
+  handle->loopentry = NULL;
+  handle->readbuf = NULL;
+  handle->readbufsize = 0;
+  handle->readbufpos = 0;
+  handle->readbuflen = 0;
+  handle->statsbytes = 0;
+  handle->statssyscalls = 0;
+  handle->wqueue = NULL;
+  handle->wqueuesize = 0;
+  handle->wqueuepos = 0;
+  handle->wqueuelen = 0;
+  handle->wqueuehigh = 0;
+  handle->wqueuebackpressure = 0;
+  handle->wqueuefn = NULL;
+  handle->wqueuecallbackdata = NULL;
+  handle->pipemaxsize = 0;
+  for (i = 0; i < 3; i++) {
+    handle->pipesize[i] = 0;
+    handle->pipefull[i] = 0;
+    handle->checksumcrc[i] = 0;
+    handle->checksumlen[i] = 0;
+    handle->limit[i] = NULL;
+  }
+  handle->placement = NULL;
+  handle->checksum = (options ? options->checksum : 0);
+  //allocate read-ahead buffer
+  if (options && options->readbufsize > 0) {
+    if ((handle->readbuf = (char*)malloc(options->readbufsize)) == NULL) {
+      SHOWERROR("Memory allocation error")
+      free(handle);
+      return NULL;
+    }
+    handle->readbufsize = options->readbufsize;
+  }
+#ifdef _WIN32
+  HANDLE childhandle[3] = {NULL, NULL, NULL};
+  handle->stdin_pipe[PIPE_READ] = handle->stdin_pipe[PIPE_WRITE] = NULL;
+  handle->stdout_pipe[PIPE_READ] = handle->stdout_pipe[PIPE_WRITE] = NULL;
+  handle->stderr_pipe[PIPE_READ] = handle->stderr_pipe[PIPE_WRITE] = NULL;
+  //create pipes and open files
+  if (open_stdio(handle, stdio, (options ? options->pipesize : 0), childhandle) != 0) {
+    close_all_pipes(handle);
+    for (i = 0; i < 3; i++)
+      close_handle_if_open(&childhandle[i]);
+    free_handle(handle);
     return NULL;
   }
-#endif
   //create process
   char* cmd = strdup(command);
   char* envbuf = (environment ? crossrunenv_generate(environment) : NULL);
@@ -216,13 +483,12 @@ DLL_EXPORT_CROSSRUN crossrun crossrun_open (const char* command, crossrunenv env
   startupinfo.cb = sizeof(startupinfo);
   startupinfo.dwFlags = STARTF_USESHOWWINDOW | STARTF_USESTDHANDLES;
   startupinfo.wShowWindow = SW_HIDE;
-  startupinfo.hStdInput = handle->stdin_pipe[PIPE_READ];
-  startupinfo.hStdOutput = handle->stdout_pipe[PIPE_WRITE];
-#ifdef WITH_STDERR
-  startupinfo.hStdError = handle->stderr_pipe[PIPE_WRITE];
-#else
-  startupinfo.hStdError = handle->stdout_pipe[PIPE_WRITE];
-#endif
+  startupinfo.hStdInput = (handle->stdin_pipe[PIPE_READ] ? handle->stdin_pipe[PIPE_READ] : childhandle[CROSSRUN_STREAM_STDIN]);
+  startupinfo.hStdOutput = (handle->stdout_pipe[PIPE_WRITE] ? handle->stdout_pipe[PIPE_WRITE] : childhandle[CROSSRUN_STREAM_STDOUT]);
+  if (stdio[CROSSRUN_STREAM_STDERR].mode == CROSSRUN_STDIO_MERGE)
+    startupinfo.hStdError = startupinfo.hStdOutput;
+  else
+    startupinfo.hStdError = (handle->stderr_pipe[PIPE_WRITE] ? handle->stderr_pipe[PIPE_WRITE] : childhandle[CROSSRUN_STREAM_STDERR]);
 #ifdef CREATE_NEW_PROCESS_GROUP
 #define CREATEPROCESS_FLAGS /*| CREATE_NEW_CONSOLE |*/ CREATE_NO_WINDOW | CREATE_NEW_PROCESS_GROUP
 #else
@@ -230,15 +496,12 @@ DLL_EXPORT_CROSSRUN crossrun crossrun_open (const char* command, crossrunenv env
 #endif
   if (!CreateProcessA(NULL, cmd, NULL, NULL, TRUE, CREATEPROCESS_FLAGS | (priority > 0 && priority <= CROSSRUN_PRIO_HIGH ? crossrun_prio_os_value[priority] : NORMAL_PRIORITY_CLASS), envbuf, NULL, &startupinfo, &handle->proc_info)) {
     SHOWERROR("Error in CreateProcess()")
-    CloseHandle(handle->stdin_pipe[PIPE_READ]);
-    CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
-    CloseHandle(handle->stdout_pipe[PIPE_READ]);
-    CloseHandle(handle->stdout_pipe[PIPE_WRITE]);
-#ifdef WITH_STDERR
-    CloseHandle(handle->stderr_pipe[PIPE_READ]);
-    CloseHandle(handle->stderr_pipe[PIPE_WRITE]);
-#endif
-    free(handle);
+    close_all_pipes(handle);
+    for (i = 0; i < 3; i++)
+      close_handle_if_open(&childhandle[i]);
+    free(cmd);
+    crossrunenv_free_generated(envbuf);
+    free_handle(handle);
     return NULL;
   }
   //set requested process affinity
@@ -250,58 +513,55 @@ DLL_EXPORT_CROSSRUN crossrun crossrun_open (const char* command, crossrunenv env
   crossrunenv_free_generated(envbuf);
   //close thread handle (no longer needed)
   CloseHandle(handle->proc_info.hThread);
-  //close pipe handles only used by the process
-  CloseHandle(handle->stdin_pipe[PIPE_READ]);
-  CloseHandle(handle->stdout_pipe[PIPE_WRITE]);
-#ifdef WITH_STDERR
-  CloseHandle(handle->stderr_pipe[PIPE_WRITE]);
-#endif
+  //close pipe and file handles only used by the process
+  close_handle_if_open(&handle->stdin_pipe[PIPE_READ]);
+  close_handle_if_open(&handle->stdout_pipe[PIPE_WRITE]);
+  close_handle_if_open(&handle->stderr_pipe[PIPE_WRITE]);
+  for (i = 0; i < 3; i++)
+    close_handle_if_open(&childhandle[i]);
 #else
   char** argv;
   char** envbuf;
+  int childfd[3] = {-1, -1, -1};
+  int ptyslave = -1;
+  struct crossrun_mempolicy mempolicy;
+  handle->stdin_pipe[PIPE_READ] = handle->stdin_pipe[PIPE_WRITE] = -1;
+  handle->stdout_pipe[PIPE_READ] = handle->stdout_pipe[PIPE_WRITE] = -1;
+  handle->stderr_pipe[PIPE_READ] = handle->stderr_pipe[PIPE_WRITE] = -1;
   //split command in separate arguments
   if (command_to_argv(command, &argv) != 0) {
     SHOWERROR("Error processing command line")
+    free_handle(handle);
     return NULL;
   }
-  //generate environment
-  envbuf = (environment ? crossrunenv_generate(environment) : NULL);
-  //create pipes
-  if (pipe(handle->stdin_pipe) < 0) {
-    SHOWERROR("Error in pipe()")
-    return NULL;
-  }
-  if (pipe(handle->stdout_pipe) < 0) {
-    SHOWERROR("Error in pipe()")
-    close(handle->stdin_pipe[PIPE_READ]);
-    close(handle->stdin_pipe[PIPE_WRITE]);
-    free(handle);
-    return NULL;
-  }
-#ifdef WITH_STDERR
-  if (pipe(handle->stderr_pipe) < 0) {
-    SHOWERROR("Error in pipe()")
-    close(handle->stdin_pipe[PIPE_READ]);
-    close(handle->stdin_pipe[PIPE_WRITE]);
-    close(handle->stdout_pipe[PIPE_READ]);
-    close(handle->stdout_pipe[PIPE_WRITE]);
-    free(handle);
+  //create pseudo-terminal, pipes and open files
+  if ((options && options->pty && open_pty(handle, stdio, options, childfd, &ptyslave) != 0) || (options && options->socketpair && open_socketpair(handle, stdio, options, childfd) != 0) || open_stdio(handle, stdio, childfd) != 0) {
+    close_all_pipes(handle);
+    for (i = 0; i < 3; i++)
+      close_fd_if_open(&childfd[i]);
+    close_fd_if_open(&ptyslave);
+    free_argv(argv);
+    free_handle(handle);
     return NULL;
   }
-#endif
+  //set pipe sizes
+  if (options && (options->pipesize > 0 || options->pipemaxsize > 0))
+    crossrun_pipe_setup(handle, options->pipesize, options->pipemaxsize);
+  //generate environment
+  envbuf = (environment ? crossrunenv_generate(environment) : NULL);
+  //determine NUMA memory policy
+  crossrun_mempolicy_prepare(&mempolicy, options, affinity);
   //fork
   if ((handle->pid = fork()) < 0) {
     //fork failed
     SHOWERROR("Error in fork()")
-    close(handle->stdin_pipe[PIPE_READ]);
-    close(handle->stdin_pipe[PIPE_WRITE]);
-    close(handle->stdout_pipe[PIPE_READ]);
-    close(handle->stdout_pipe[PIPE_WRITE]);
-#ifdef WITH_STDERR
-    close(handle->stderr_pipe[PIPE_READ]);
-    close(handle->stderr_pipe[PIPE_WRITE]);
-#endif
-    free(handle);
+    close_all_pipes(handle);
+    for (i = 0; i < 3; i++)
+      close_fd_if_open(&childfd[i]);
+    close_fd_if_open(&ptyslave);
+    crossrunenv_free_generated(envbuf);
+    free_argv(argv);
+    free_handle(handle);
     return NULL;
   } else if (handle->pid == 0) {
     //child process
@@ -309,42 +569,59 @@ DLL_EXPORT_CROSSRUN crossrun crossrun_open (const char* command, crossrunenv env
     //set process new group
     setpgid(0, 0);
 #endif
+    //start a new session with the pseudo-terminal as controlling terminal
+    if (ptyslave >= 0) {
+      setsid();
+      ioctl(ptyslave, TIOCSCTTY, 0);
+    }
     //set requested priority
     if (priority > 0 && priority <= CROSSRUN_PRIO_HIGH)
       setpriority(PRIO_PROCESS, 0, crossrun_prio_os_value[priority]);
     //set requested process affinity
     if (affinity)
       crossrun_set_current_affinity(affinity);
-    //reroute standard input to read end of pipe (use loop to cover possibility of being interrupted by signal) and close other end of pipe
-    while ((dup2(handle->stdin_pipe[PIPE_READ], STDIN_FILENO) == -1) && (errno == EINTR))
-      ;
-    close(handle->stdin_pipe[PIPE_READ]);
-    close(handle->stdin_pipe[PIPE_WRITE]);
-    //reroute standard output to write end of pipe (use loop to cover possibility of being interrupted by signal) and close other end of pipe
-    while ((dup2(handle->stdout_pipe[PIPE_WRITE], STDOUT_FILENO) == -1) && (errno == EINTR))
-      ;
-    close(handle->stdout_pipe[PIPE_WRITE]);
-    close(handle->stdout_pipe[PIPE_READ]);
-#ifdef WITH_STDERR
-    //reroute error output to write end of pipe (use loop to cover possibility of being interrupted by signal) and close other end of pipe
-    while ((dup2(handle->stderr_pipe[PIPE_WRITE], STDOUT_FILENO) == -1) && (errno == EINTR))
-      ;
-    close(handle->stderr_pipe[PIPE_WRITE]);
-    close(handle->stderr_pipe[PIPE_READ]);
-#endif
-    if (execve(*argv, argv, envbuf) < 0)
+    //set requested NUMA memory policy
+    crossrun_mempolicy_apply(&mempolicy);
+    //reroute standard input to read end of pipe or to the file
+    set_child_stdio((handle->stdin_pipe[PIPE_READ] >= 0 ? handle->stdin_pipe[PIPE_READ] : childfd[CROSSRUN_STREAM_STDIN]), STDIN_FILENO);
+    //reroute standard output to write end of pipe, to the socket that is also standard input or to the file
+    set_child_stdio((handle->stdout_pipe[PIPE_WRITE] >= 0 ? handle->stdout_pipe[PIPE_WRITE] : (handle->socket ? STDIN_FILENO : childfd[CROSSRUN_STREAM_STDOUT])), STDOUT_FILENO);
+    //reroute error output to wherever standard output goes, to write end of pipe or to the file
+    if (stdio[CROSSRUN_STREAM_STDERR].mode == CROSSRUN_STDIO_MERGE)
+      set_child_stdio(STDOUT_FILENO, STDERR_FILENO);
+    else
+      set_child_stdio((handle->stderr_pipe[PIPE_WRITE] >= 0 ? handle->stderr_pipe[PIPE_WRITE] : childfd[CROSSRUN_STREAM_STDERR]), STDERR_FILENO);
+    //close both ends of the pipes (files are closed on exec)
+    close_all_pipes(handle);
+    //pass the shared memory channel on a known file descriptor
+    if (options && options->channelfd >= 0)
+      set_child_stdio(options->channelfd, CROSSRUN_CHANNEL_FD);
+    if (execve(*argv, argv, envbuf) < 0) {
       SHOWERROR("Error in executing program")
-    return NULL;
+    }
+    _exit(127);
   } else {
     //parent process
     //close read end of standard input pipe
-    close(handle->stdin_pipe[PIPE_READ]);
+    close_fd_if_open(&handle->stdin_pipe[PIPE_READ]);
     //close write end of standard output pipe
-    close(handle->stdout_pipe[PIPE_WRITE]);
-#ifdef WITH_STDERR
+    close_fd_if_open(&handle->stdout_pipe[PIPE_WRITE]);
     //close write end of error output pipe
-    close(handle->stderr_pipe[PIPE_WRITE]);
-#endif
+    close_fd_if_open(&handle->stderr_pipe[PIPE_WRITE]);
+    //close files only used by the process
+    for (i = 0; i < 3; i++)
+      close_fd_if_open(&childfd[i]);
+    close_fd_if_open(&ptyslave);
+    //make sure processes started later don't inherit the parent ends of the pipes (which would keep them open)
+    if (handle->stdin_pipe[PIPE_WRITE] >= 0)
+      fcntl(handle->stdin_pipe[PIPE_WRITE], F_SETFD, FD_CLOEXEC);
+    if (handle->stdout_pipe[PIPE_READ] >= 0)
+      fcntl(handle->stdout_pipe[PIPE_READ], F_SETFD, FD_CLOEXEC);
+    if (handle->stderr_pipe[PIPE_READ] >= 0)
+      fcntl(handle->stderr_pipe[PIPE_READ], F_SETFD, FD_CLOEXEC);
+    //with a read-ahead buffer standard output is read without blocking and only waited for when the buffer is empty
+    if (handle->readbuf && handle->stdout_pipe[PIPE_READ] >= 0)
+      fcntl(handle->stdout_pipe[PIPE_READ], F_SETFL, fcntl(handle->stdout_pipe[PIPE_READ], F_GETFL) | O_NONBLOCK);
   }
   //clean up
   crossrunenv_free_generated(envbuf);
@@ -376,7 +653,7 @@ DLL_EXPORT_CROSSRUN int crossrun_stopped (crossrun handle)
   if (!GetExitCodeProcess(handle->proc_info.hProcess, &handle->exitcode))
     handle->exitcode = ~0;
 #else
-  int status;
+  int status = 0;
   if (waitpid(handle->pid, &status, WNOHANG | WUNTRACED) == -1) {
     handle->exitcode = ~0;
     return 0;
@@ -387,9 +664,31 @@ DLL_EXPORT_CROSSRUN int crossrun_stopped (crossrun handle)
     handle->exitcode = ~0;
 #endif
   handle->exited = 1;
+  crossrun_placement_release(handle);
   return 1;
 }
 
+int crossrun_poll_exit (crossrun handle)
+{
+  if (handle->exited)
+    return 1;
+#ifdef _WIN32
+  return crossrun_stopped(handle);
+#else
+  int status;
+  pid_t result;
+  if ((result = waitpid(handle->pid, &status, WNOHANG)) == 0)
+    return 0;
+  if (result == -1 || !WIFEXITED(status))
+    handle->exitcode = ~0;
+  else
+    handle->exitcode = WEXITSTATUS(status);
+  handle->exited = 1;
+  crossrun_placement_release(handle);
+  return 1;
+#endif
+}
+
 DLL_EXPORT_CROSSRUN int crossrun_wait (crossrun handle)
 {
   if (!handle || handle->exited)
@@ -416,6 +715,7 @@ DLL_EXPORT_CROSSRUN int crossrun_wait (crossrun handle)
     handle->exitcode = ~0;
 #endif
   handle->exited = 1;
+  crossrun_placement_release(handle);
   return 1;
 }
 
@@ -428,6 +728,10 @@ DLL_EXPORT_CROSSRUN unsigned long crossrun_get_exit_code (crossrun handle)
 
 DLL_EXPORT_CROSSRUN void crossrun_close (crossrun handle)
 {
+  crossrun_loop_notify_close(handle, CROSSRUN_STREAM_STDIN);
+  crossrun_loop_notify_close(handle, CROSSRUN_STREAM_STDOUT);
+  crossrun_loop_notify_close(handle, CROSSRUN_STREAM_STDERR);
+  crossrun_write_queue_discard(handle, 0);
 #ifdef _WIN32
   if (handle->stdin_pipe[PIPE_WRITE]) {
     CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
@@ -437,31 +741,28 @@ DLL_EXPORT_CROSSRUN void crossrun_close (crossrun handle)
     CloseHandle(handle->stdout_pipe[PIPE_READ]);
     handle->stdout_pipe[PIPE_READ] = NULL;
   }
-#ifdef WITH_STDERR
   if (handle->stderr_pipe[PIPE_READ]) {
     CloseHandle(handle->stderr_pipe[PIPE_READ]);
     handle->stderr_pipe[PIPE_READ] = NULL;
   }
-#endif
   if (handle->proc_info.hProcess != 0) {
     CloseHandle(handle->proc_info.hProcess);
     handle->proc_info.hProcess = 0;
   }
 #else
   if (handle->stdin_pipe[PIPE_WRITE] >= 0) {
-    close(handle->stdin_pipe[PIPE_WRITE]);
+    if (!handle->socket || handle->stdin_pipe[PIPE_WRITE] != handle->stdout_pipe[PIPE_READ])
+      close(handle->stdin_pipe[PIPE_WRITE]);
     handle->stdin_pipe[PIPE_WRITE] = -1;
   }
   if (handle->stdout_pipe[PIPE_READ] >= 0) {
     close(handle->stdout_pipe[PIPE_READ]);
     handle->stdout_pipe[PIPE_READ] = -1;
   }
-#ifdef WITH_STDERR
   if (handle->stderr_pipe[PIPE_READ] >= 0) {
     close(handle->stderr_pipe[PIPE_READ]);
     handle->stderr_pipe[PIPE_READ] = -1;
   }
-#endif
   //kill(handle->pid, SIGTERM);
 #endif
 }
@@ -479,14 +780,163 @@ DLL_EXPORT_CROSSRUN void crossrun_free (crossrun handle)
 {
   if (!handle)
     return;
+  crossrun_loop_notify_close(handle, -1);
   crossrun_close(handle);
-  free(handle);
+  free_handle(handle);
+}
+
+//result of readbuf_fill() when no data is available yet
+#define READBUF_NO_DATA -2
+
+//allocate read-ahead buffer for standard output
+static int readbuf_create (crossrun handle, size_t size)
+{
+  if (handle->readbuf)
+    return 0;
+  if ((handle->readbuf = (char*)malloc(size)) == NULL)
+    return -1;
+  handle->readbufsize = size;
+  handle->readbufpos = 0;
+  handle->readbuflen = 0;
+#ifndef _WIN32
+  fcntl(handle->stdout_pipe[PIPE_READ], F_SETFL, fcntl(handle->stdout_pipe[PIPE_READ], F_GETFL) | O_NONBLOCK);
+#endif
+  return 0;
+}
+
+//read as much as fits from standard output into the read-ahead buffer with a single read, returns number of bytes read, 0 on end of file, -1 on error or READBUF_NO_DATA if wait is zero and no data is available
+static int readbuf_read (crossrun handle, int wait)
+{
+  size_t space;
+  //move unread data to the start of the buffer
+  if (handle->readbuflen == 0) {
+    handle->readbufpos = 0;
+  } else if (handle->readbufpos > 0) {
+    memmove(handle->readbuf, handle->readbuf + handle->readbufpos, handle->readbuflen);
+    handle->readbufpos = 0;
+  }
+  if ((space = handle->readbufsize - handle->readbuflen) == 0)
+    return READBUF_NO_DATA;
+  if (handle->stdout_eof)
+    return 0;
+#ifdef _WIN32
+  DWORD n;
+  if (!handle->stdout_pipe[PIPE_READ])
+    return -1;
+  if (!wait) {
+    n = 0;
+    handle->statssyscalls++;
+    if (!PeekNamedPipe(handle->stdout_pipe[PIPE_READ], NULL, 0, NULL, &n, NULL)) {
+      if (GetLastError() != ERROR_BROKEN_PIPE)
+        return -1;
+      handle->stdout_eof = 1;
+      return 0;
+    }
+    if (n == 0)
+      return READBUF_NO_DATA;
+    if (n < space)
+      space = n;
+  }
+  handle->statssyscalls++;
+  if (!ReadFile(handle->stdout_pipe[PIPE_READ], handle->readbuf + handle->readbuflen, (DWORD)space, &n, NULL)) {
+    if (GetLastError() != ERROR_BROKEN_PIPE)
+      return -1;
+    n = 0;
+  }
+  if (n == 0) {
+    handle->stdout_eof = 1;
+    return 0;
+  }
+#else
+  ssize_t n;
+  struct pollfd pollinfo;
+  if (handle->stdout_pipe[PIPE_READ] < 0)
+    return -1;
+  //the pipe is non-blocking, so only wait when nothing can be read
+  while (1) {
+    handle->statssyscalls++;
+    if ((n = read(handle->stdout_pipe[PIPE_READ], handle->readbuf + handle->readbuflen, space)) > 0) {
+      crossrun_pipe_adapt(handle, CROSSRUN_STREAM_STDOUT, n, space);
+      break;
+    }
+    if (n == 0 || (errno == EIO && handle->pty)) {
+      handle->stdout_eof = 1;
+      return 0;
+    }
+    if (errno == EINTR)
+      continue;
+    if (errno != EAGAIN)
+      return -1;
+    if (!wait)
+      return READBUF_NO_DATA;
+    pollinfo.fd = handle->stdout_pipe[PIPE_READ];
+    pollinfo.events = POLLIN;
+    pollinfo.revents = 0;
+    handle->statssyscalls++;
+    if (poll(&pollinfo, 1, -1) < 0 && errno != EINTR)
+      return -1;
+  }
+#endif
+  crossrun_checksum_update(handle, CROSSRUN_STREAM_STDOUT, handle->readbuf + handle->readbuflen, n);
+  handle->readbuflen += n;
+  handle->statsbytes += n;
+  return (int)n;
+}
+
+//read into the read-ahead buffer like readbuf_read(), but only keep output within the rate limit
+static int readbuf_fill (crossrun handle, int wait)
+{
+  int n;
+  size_t kept;
+  while ((n = readbuf_read(handle, wait)) > 0 && handle->limit[CROSSRUN_STREAM_STDOUT]) {
+    kept = crossrun_limit_apply(handle, CROSSRUN_STREAM_STDOUT, handle->readbuf + handle->readbuflen - n, n);
+    handle->readbuflen -= n - kept;
+    if (kept > 0)
+      return (int)kept;
+  }
+  return n;
+}
+
+//copy data from the read-ahead buffer and optionally remove it from the buffer
+static int readbuf_get (crossrun handle, char* buf, int buflen, int consume)
+{
+  size_t n = handle->readbuflen;
+  if (buflen <= 0)
+    return 0;
+  if (n > (size_t)buflen)
+    n = buflen;
+  memcpy(buf, handle->readbuf + handle->readbufpos, n);
+  if (consume) {
+    handle->readbufpos += n;
+    handle->readbuflen -= n;
+  }
+  return (int)n;
+}
+
+int crossrun_readbuf_flush (crossrun handle, crossrun_pump_fn pumpfn, void* callbackdata)
+{
+  int result = 0;
+  if (handle->readbuf && handle->readbuflen > 0) {
+    if (pumpfn)
+      result = (*pumpfn)(CROSSRUN_STREAM_STDOUT, handle->readbuf + handle->readbufpos, handle->readbuflen, callbackdata);
+    handle->readbufpos = 0;
+    handle->readbuflen = 0;
+  }
+  return result;
 }
 
 DLL_EXPORT_CROSSRUN int crossrun_data_waiting (crossrun handle)
 {
+  //serve from the read-ahead buffer and only read when it is empty
+  if (handle->readbuf) {
+    int n;
+    if (handle->readbuflen == 0 && (n = readbuf_fill(handle, 0)) != READBUF_NO_DATA && n <= 0)
+      return -1;
+    return (int)handle->readbuflen;
+  }
 #ifdef _WIN32
   DWORD n = 0;
+  handle->statssyscalls++;
   if (!PeekNamedPipe(handle->stdout_pipe[PIPE_READ], NULL, 0, NULL, &n, NULL))
     return -1;
   return n;
@@ -525,9 +975,11 @@ DLL_EXPORT_CROSSRUN int crossrun_data_waiting (crossrun handle)
     return -1;
 */
   n = -1;
+  handle->statssyscalls++;
   if (ioctl(handle->stdout_pipe[PIPE_READ], FIONREAD, &n) < 0)
     return -1;
   if (n == 0) {
+    handle->statssyscalls++;
     n = waitpid(handle->pid, NULL, WNOHANG | WUNTRACED);
     return (n < 0 || n == handle->pid ? -1 : 0);
   }
@@ -535,23 +987,184 @@ DLL_EXPORT_CROSSRUN int crossrun_data_waiting (crossrun handle)
 #endif
 }
 
-DLL_EXPORT_CROSSRUN int crossrun_read (crossrun handle, char* buf, int buflen)
+//read data from standard output without the read-ahead buffer
+static int read_stdout (crossrun handle, char* buf, int buflen)
 {
 #ifdef _WIN32
   DWORD n;
   //read data
+  handle->statssyscalls++;
   if (!ReadFile(handle->stdout_pipe[PIPE_READ], buf, buflen, &n, NULL))
     return -1;
+  crossrun_checksum_update(handle, CROSSRUN_STREAM_STDOUT, buf, n);
+  handle->statsbytes += n;
   return n;
 #else
   ssize_t n;
   //read data
-  if ((n = read(handle->stdout_pipe[PIPE_READ], buf, buflen)) < 0)
-    return -1;
+  while (1) {
+    handle->statssyscalls++;
+    if ((n = read(handle->stdout_pipe[PIPE_READ], buf, buflen)) >= 0)
+      break;
+    //a pseudo-terminal reports an error instead of the end of file after the shell process closed it
+    if (errno == EIO && handle->pty) {
+      n = 0;
+      break;
+    }
+    //wait if the pipe was set to non-blocking mode (for the read-ahead buffer or because a pseudo-terminal shares it with standard input)
+    if (errno == EAGAIN) {
+      struct pollfd pollinfo;
+      pollinfo.fd = handle->stdout_pipe[PIPE_READ];
+      pollinfo.events = POLLIN;
+      pollinfo.revents = 0;
+      handle->statssyscalls++;
+      poll(&pollinfo, 1, -1);
+      continue;
+    }
+    if (errno != EINTR)
+      return -1;
+  }
+  if (n == 0 && handle->readbuf)
+    handle->stdout_eof = 1;
+  else
+    crossrun_pipe_adapt(handle, CROSSRUN_STREAM_STDOUT, n, buflen);
+  crossrun_checksum_update(handle, CROSSRUN_STREAM_STDOUT, buf, n);
+  handle->statsbytes += n;
   return n;
 #endif
 }
 
+DLL_EXPORT_CROSSRUN int crossrun_peek (crossrun handle, char* buf, int buflen)
+{
+  int n;
+  if (!handle->readbuf && readbuf_create(handle, CROSSRUN_READ_BUFFER_DEFAULT_SIZE) != 0)
+    return -1;
+  //try to read more data if the buffer doesn't hold enough data yet
+  if (handle->readbuflen < (size_t)buflen && (n = readbuf_fill(handle, 0)) != READBUF_NO_DATA && n <= 0 && handle->readbuflen == 0)
+    return -1;
+  return readbuf_get(handle, buf, buflen, 0);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_read_line (crossrun handle, const char** line, size_t* linelen)
+{
+  int n;
+  size_t len;
+  size_t scanned = 0;
+  const char* p;
+  if (!handle->readbuf && readbuf_create(handle, CROSSRUN_READ_BUFFER_DEFAULT_SIZE) != 0)
+    return -1;
+  while (1) {
+    //look for the end of the line in the part of the buffer not scanned yet
+    if ((p = crossrun_scan_byte(handle->readbuf + handle->readbufpos + scanned, handle->readbuflen - scanned, '\n')) != NULL) {
+      len = p - (handle->readbuf + handle->readbufpos);
+      *line = handle->readbuf + handle->readbufpos;
+      *linelen = len;
+      handle->readbufpos += len + 1;
+      handle->readbuflen -= len + 1;
+      return CROSSRUN_LINE_COMPLETE;
+    }
+    scanned = handle->readbuflen;
+    //return the part of the line that fits if the line is longer than the buffer
+    if (handle->readbuflen > 0 && (handle->readbuflen == handle->readbufsize || handle->stdout_eof)) {
+      *line = handle->readbuf + handle->readbufpos;
+      *linelen = handle->readbuflen;
+      handle->readbufpos = 0;
+      handle->readbuflen = 0;
+      return (handle->stdout_eof ? CROSSRUN_LINE_COMPLETE : CROSSRUN_LINE_PARTIAL);
+    }
+    //read more data
+    if ((n = readbuf_fill(handle, 1)) < 0)
+      return -1;
+    if (n == 0 && handle->readbuflen == 0)
+      return 0;
+  }
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_read_lines (crossrun handle, crossrun_line_callback_fn linefn, void* callbackdata)
+{
+  int status;
+  int result;
+  const char* line;
+  size_t linelen;
+  while ((status = crossrun_read_line(handle, &line, &linelen)) > 0) {
+    if ((result = (*linefn)(line, linelen, (status == CROSSRUN_LINE_PARTIAL), callbackdata)) != 0)
+      return result;
+  }
+  return status;
+}
+
+//get monotonic time in milliseconds
+static uint64_t get_milliseconds ()
+{
+#ifdef _WIN32
+  return GetTickCount64();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_expect (crossrun handle, crossrun_watch watch, int timeout)
+{
+  int n;
+  int result;
+  size_t consumed;
+  uint64_t deadline = 0;
+  uint64_t now = 0;
+  if (!handle || !watch)
+    return -1;
+  if (!handle->readbuf && readbuf_create(handle, CROSSRUN_READ_BUFFER_DEFAULT_SIZE) != 0)
+    return -1;
+  if (timeout > 0)
+    deadline = get_milliseconds() + timeout;
+  while (1) {
+    //match the data in the read-ahead buffer, removing it up to the end of the match
+    //(also without data, as a line ended by the previous match may still have to be checked)
+    result = crossrun_watch_feed(watch, handle->readbuf + handle->readbufpos, handle->readbuflen, &consumed);
+    handle->readbufpos += consumed;
+    handle->readbuflen -= consumed;
+    if (result >= 0)
+      return result;
+    //read more data without blocking
+    if ((n = readbuf_fill(handle, 0)) > 0)
+      continue;
+    if (n == 0)
+      return CROSSRUN_EXPECT_EOF;
+    if (n != READBUF_NO_DATA)
+      return -1;
+    //wait for more data
+    if (timeout == 0)
+      return CROSSRUN_EXPECT_TIMEOUT;
+    if (timeout > 0 && (now = get_milliseconds()) >= deadline)
+      return CROSSRUN_EXPECT_TIMEOUT;
+#ifdef _WIN32
+    Sleep(10);
+#else
+    {
+      struct pollfd pollinfo;
+      pollinfo.fd = handle->stdout_pipe[PIPE_READ];
+      pollinfo.events = POLLIN;
+      pollinfo.revents = 0;
+      handle->statssyscalls++;
+      if (poll(&pollinfo, 1, (timeout < 0 ? -1 : (int)(deadline - now))) < 0 && errno != EINTR)
+        return -1;
+    }
+#endif
+  }
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_get_read_stats (crossrun handle, uint64_t* bytesread, uint64_t* syscalls)
+{
+  if (!handle)
+    return -1;
+  if (bytesread)
+    *bytesread = handle->statsbytes;
+  if (syscalls)
+    *syscalls = handle->statssyscalls;
+  return 0;
+}
+
 DLL_EXPORT_CROSSRUN int crossrun_read_available (crossrun handle, char* buf, int buflen)
 {
   int n;
@@ -618,34 +1231,287 @@ DLL_EXPORT_CROSSRUN int crossrun_read_available (crossrun handle, char* buf, int
 */
 }
 
-DLL_EXPORT_CROSSRUN int crossrun_writedata (crossrun handle, const char* data, int datalen)
+DLL_EXPORT_CROSSRUN int crossrun_read (crossrun handle, char* buf, int buflen)
+{
+  int n;
+  //serve from the read-ahead buffer (unless it is empty and the caller's buffer is at least as large)
+  if (handle->readbuf && (handle->readbuflen > 0 || (size_t)buflen < handle->readbufsize)) {
+    if (handle->readbuflen == 0 && (n = readbuf_fill(handle, 1)) <= 0)
+      return n;
+    return readbuf_get(handle, buf, buflen, 1);
+  }
+  //read again if all data read was above the rate limit
+  while ((n = read_stdout(handle, buf, buflen)) > 0 && handle->limit[CROSSRUN_STREAM_STDOUT] && (n = (int)crossrun_limit_apply(handle, CROSSRUN_STREAM_STDOUT, buf, n)) == 0)
+    ;
+  return n;
+}
+
+//read data from error output
+static int read_stderr (crossrun handle, char* buf, int buflen)
 {
 #ifdef _WIN32
-  if (!handle->stdin_pipe[PIPE_WRITE])
+  DWORD n;
+  if (!handle->stderr_pipe[PIPE_READ])
     return -1;
+  //read data
+  handle->statssyscalls++;
+  if (!ReadFile(handle->stderr_pipe[PIPE_READ], buf, buflen, &n, NULL))
+    return (GetLastError() == ERROR_BROKEN_PIPE ? 0 : -1);
+  crossrun_checksum_update(handle, CROSSRUN_STREAM_STDERR, buf, n);
+  handle->statsbytes += n;
+  return n;
+#else
+  ssize_t n;
+  if (handle->stderr_pipe[PIPE_READ] < 0)
+    return -1;
+  //read data
+  handle->statssyscalls++;
+  if ((n = read(handle->stderr_pipe[PIPE_READ], buf, buflen)) < 0)
+    return -1;
+  crossrun_pipe_adapt(handle, CROSSRUN_STREAM_STDERR, n, buflen);
+  crossrun_checksum_update(handle, CROSSRUN_STREAM_STDERR, buf, n);
+  handle->statsbytes += n;
+  return n;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_read_stderr (crossrun handle, char* buf, int buflen)
+{
+  int n;
+  //read again if all data read was above the rate limit
+  while ((n = read_stderr(handle, buf, buflen)) > 0 && handle->limit[CROSSRUN_STREAM_STDERR] && (n = (int)crossrun_limit_apply(handle, CROSSRUN_STREAM_STDERR, buf, n)) == 0)
+    ;
+  return n;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_read_any (crossrun handle, char* buf, int buflen, int* stream)
+{
+  //return data from the read-ahead buffer first
+  if (handle->readbuf && handle->readbuflen > 0) {
+    if (stream)
+      *stream = CROSSRUN_STREAM_STDOUT;
+    return readbuf_get(handle, buf, buflen, 1);
+  }
+#ifdef _WIN32
   DWORD n;
-  int pos = 0;
-  int dataleft = datalen;
-  do {
-    if (!WriteFile(handle->stdin_pipe[PIPE_WRITE], data + pos, dataleft, &n, NULL))
+  int i;
+  int waiting;
+  HANDLE pipes[2];
+  int* eof[2];
+  pipes[0] = handle->stdout_pipe[PIPE_READ];
+  pipes[1] = handle->stderr_pipe[PIPE_READ];
+  eof[0] = &handle->stdout_eof;
+  eof[1] = &handle->stderr_eof;
+  //anonymous pipes can't be waited for on Windows, so check both pipes until one of them has data
+  while (1) {
+    waiting = 0;
+    for (i = 0; i < 2; i++) {
+      if (!pipes[i] || *eof[i])
+        continue;
+      n = 0;
+      handle->statssyscalls++;
+      if (!PeekNamedPipe(pipes[i], NULL, 0, NULL, &n, NULL)) {
+        if (GetLastError() != ERROR_BROKEN_PIPE)
+          return -1;
+        *eof[i] = 1;
+        continue;
+      }
+      waiting++;
+      if (n > 0) {
+        handle->statssyscalls++;
+        if (!ReadFile(pipes[i], buf, (n < (DWORD)buflen ? n : (DWORD)buflen), &n, NULL))
+          return -1;
+        crossrun_checksum_update(handle, (i == 0 ? CROSSRUN_STREAM_STDOUT : CROSSRUN_STREAM_STDERR), buf, n);
+        handle->statsbytes += n;
+        if (handle->limit[i == 0 ? CROSSRUN_STREAM_STDOUT : CROSSRUN_STREAM_STDERR] && (n = (DWORD)crossrun_limit_apply(handle, (i == 0 ? CROSSRUN_STREAM_STDOUT : CROSSRUN_STREAM_STDERR), buf, n)) == 0)
+          continue;
+        if (stream)
+          *stream = (i == 0 ? CROSSRUN_STREAM_STDOUT : CROSSRUN_STREAM_STDERR);
+        return n;
+      }
+    }
+    if (!waiting)
+      return 0;
+    Sleep(1);
+  }
+#else
+  int i;
+  int count;
+  ssize_t n;
+  struct pollfd pollinfo[2];
+  int pollstream[2];
+  while (1) {
+    //wait for data on outputs that haven't reached end of file yet
+    count = 0;
+    if (!handle->stdout_eof && handle->stdout_pipe[PIPE_READ] >= 0) {
+      pollinfo[count].fd = handle->stdout_pipe[PIPE_READ];
+      pollinfo[count].events = POLLIN;
+      pollinfo[count].revents = 0;
+      pollstream[count++] = CROSSRUN_STREAM_STDOUT;
+    }
+    if (!handle->stderr_eof && handle->stderr_pipe[PIPE_READ] >= 0) {
+      pollinfo[count].fd = handle->stderr_pipe[PIPE_READ];
+      pollinfo[count].events = POLLIN;
+      pollinfo[count].revents = 0;
+      pollstream[count++] = CROSSRUN_STREAM_STDERR;
+    }
+    if (count == 0)
+      return 0;
+    handle->statssyscalls++;
+    if (poll(pollinfo, count, -1) < 0) {
+      if (errno == EINTR)
+        continue;
       return -1;
-    pos += n;
-  } while (n < dataleft);
+    }
+    //read from the first output that is ready
+    for (i = 0; i < count; i++) {
+      if (!pollinfo[i].revents)
+        continue;
+      handle->statssyscalls++;
+      if ((n = read(pollinfo[i].fd, buf, buflen)) < 0) {
+        if (errno == EINTR || errno == EAGAIN)
+          continue;
+        if (errno != EIO || !handle->pty || pollstream[i] != CROSSRUN_STREAM_STDOUT)
+          return -1;
+        n = 0;
+      }
+      if (n == 0) {
+        if (pollstream[i] == CROSSRUN_STREAM_STDOUT)
+          handle->stdout_eof = 1;
+        else
+          handle->stderr_eof = 1;
+        continue;
+      }
+      if (stream)
+        *stream = pollstream[i];
+      crossrun_pipe_adapt(handle, pollstream[i], n, buflen);
+      crossrun_checksum_update(handle, pollstream[i], buf, n);
+      handle->statsbytes += n;
+      if (handle->limit[pollstream[i]] && (n = crossrun_limit_apply(handle, pollstream[i], buf, n)) == 0)
+        continue;
+      return n;
+    }
+  }
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_writedata (crossrun handle, const char* data, int datalen)
+{
+  crossrun_iovec iov;
+  if (datalen < 0)
+    return -1;
+  iov.data = data;
+  iov.datalen = datalen;
+  return crossrun_writev(handle, &iov, 1);
+}
+
+#ifndef _WIN32
+//wait until the standard input pipe can be written to if it was set to non-blocking mode
+static void wait_stdin_writable (crossrun handle)
+{
+  struct pollfd pollinfo;
+  pollinfo.fd = handle->stdin_pipe[PIPE_WRITE];
+  pollinfo.events = POLLOUT;
+  pollinfo.revents = 0;
+  poll(&pollinfo, 1, -1);
+}
+#endif
+
+//maximum number of data blocks passed to one writev() call
+#define WRITEV_BATCH 64
+
+DLL_EXPORT_CROSSRUN int crossrun_writev (crossrun handle, const crossrun_iovec* iov, int iovcnt)
+{
+  int i;
+#ifdef _WIN32
+  DWORD n;
+  size_t pos;
+  if (!handle->stdin_pipe[PIPE_WRITE])
+    return -1;
+  //pipes don't support gather writes, so write each block (in parts that fit in a DWORD)
+  for (i = 0; i < iovcnt; i++) {
+    pos = 0;
+    while (pos < iov[i].datalen) {
+      if (!WriteFile(handle->stdin_pipe[PIPE_WRITE], iov[i].data + pos, (iov[i].datalen - pos > 0x40000000 ? 0x40000000 : (DWORD)(iov[i].datalen - pos)), &n, NULL))
+        return -1;
+      pos += n;
+    }
+  }
 #else
+  int count;
+  ssize_t n;
+  struct iovec vec[WRITEV_BATCH];
   if (handle->stdin_pipe[PIPE_WRITE] < 0)
     return -1;
-  ssize_t n;
-  int pos = 0;
-  int dataleft = datalen;
-  do {
-    if ((n = write(handle->stdin_pipe[PIPE_WRITE], data + pos, dataleft)) < 0)
-      return -1;
-    pos += n;
-  } while (n < dataleft);
+  i = 0;
+  count = 0;
+  while (i < iovcnt || count > 0) {
+    //add blocks to the batch
+    while (count < WRITEV_BATCH && i < iovcnt) {
+      if (iov[i].datalen > 0) {
+        vec[count].iov_base = (void*)iov[i].data;
+        vec[count].iov_len = iov[i].datalen;
+        count++;
+      }
+      i++;
+    }
+    if (count == 0)
+      break;
+    if ((n = writev(handle->stdin_pipe[PIPE_WRITE], vec, count)) < 0) {
+      if (errno == EAGAIN)
+        wait_stdin_writable(handle);
+      else if (errno != EINTR)
+        return -1;
+      continue;
+    }
+    //remove what was written from the batch
+    while (count > 0 && (size_t)n >= vec[0].iov_len) {
+      n -= vec[0].iov_len;
+      memmove(vec, vec + 1, --count * sizeof(struct iovec));
+    }
+    if (count > 0) {
+      vec[0].iov_base = (char*)vec[0].iov_base + n;
+      vec[0].iov_len -= n;
+    }
+  }
 #endif
   return 0;
 }
 
+DLL_EXPORT_CROSSRUN int crossrun_write_pages (crossrun handle, const char* data, size_t datalen)
+{
+#if defined(__linux__) && defined(SPLICE_F_GIFT)
+  ssize_t n;
+  struct iovec vec;
+  long pagesize;
+  unsigned int flags = 0;
+  if (handle->stdin_pipe[PIPE_WRITE] < 0)
+    return -1;
+  //the pages can only be gifted if the whole buffer consists of complete pages
+  if ((pagesize = sysconf(_SC_PAGESIZE)) > 0 && (uintptr_t)data % pagesize == 0 && datalen % pagesize == 0)
+    flags = SPLICE_F_GIFT;
+  vec.iov_base = (void*)data;
+  vec.iov_len = datalen;
+  while (vec.iov_len > 0) {
+    if ((n = vmsplice(handle->stdin_pipe[PIPE_WRITE], &vec, 1, flags)) < 0) {
+      if (errno == EAGAIN)
+        wait_stdin_writable(handle);
+      else if (errno != EINTR)
+        return -1;
+      continue;
+    }
+    vec.iov_base = (char*)vec.iov_base + n;
+    vec.iov_len -= n;
+  }
+  return 0;
+#else
+  crossrun_iovec iov;
+  iov.data = data;
+  iov.datalen = datalen;
+  return crossrun_writev(handle, &iov, 1);
+#endif
+}
+
 DLL_EXPORT_CROSSRUN int crossrun_write (crossrun handle, const char* data)
 {
   return crossrun_writedata(handle, data, strlen(data));
@@ -653,110 +1519,200 @@ DLL_EXPORT_CROSSRUN int crossrun_write (crossrun handle, const char* data)
 
 DLL_EXPORT_CROSSRUN void crossrun_write_eof (crossrun handle)
 {
+  crossrun_loop_notify_close(handle, CROSSRUN_STREAM_STDIN);
+  crossrun_write_queue_discard(handle, 0);
 #ifdef _WIN32
   CloseHandle(handle->stdin_pipe[PIPE_WRITE]);
   handle->stdin_pipe[PIPE_WRITE] = NULL;
 #else
-  close(handle->stdin_pipe[PIPE_WRITE]);
+  //keep a socket shared with standard output open and only stop sending
+  if (handle->socket && handle->stdin_pipe[PIPE_WRITE] >= 0 && handle->stdin_pipe[PIPE_WRITE] == handle->stdout_pipe[PIPE_READ])
+    shutdown(handle->stdin_pipe[PIPE_WRITE], SHUT_WR);
+  else
+    close(handle->stdin_pipe[PIPE_WRITE]);
   handle->stdin_pipe[PIPE_WRITE] = -1;
 #endif
 }
 
 
+#ifdef _WIN32
+struct crossrun_pump_writer_data {
+  HANDLE pipe;
+  const char* data;
+  size_t datalen;
+};
 
-#ifdef ___EXPERIMENTAL___
-
-typedef int (*crossrun_read_callback_fn)(const char* data, size_t datalen, void* callbackdata);
-
-DLL_EXPORT_CROSSRUN int crossrun_read_write (crossrun handle, crossrun_read_callback_fn readfn, void* readcallbackdata, const char* writedata, size_t writedatalen);
+static DWORD WINAPI crossrun_pump_writer_thread (LPVOID param)
+{
+  DWORD n;
+  struct crossrun_pump_writer_data* writer = (struct crossrun_pump_writer_data*)param;
+  //write all data and close the pipe so the process sees the end of its input
+  while (writer->datalen > 0) {
+    if (!WriteFile(writer->pipe, writer->data, (writer->datalen > 0x10000 ? 0x10000 : (DWORD)writer->datalen), &n, NULL))
+      break;
+    writer->data += n;
+    writer->datalen -= n;
+  }
+  CloseHandle(writer->pipe);
+  return 0;
+}
+#endif
 
-DLL_EXPORT_CROSSRUN int crossrun_read_write (crossrun handle, crossrun_read_callback_fn readfn, void* readcallbackdata, const char* writedata, size_t writedatalen)
+int crossrun_pump (crossrun handle, const char* writedata, size_t writedatalen, crossrun_pump_fn pumpfn, void* callbackdata)
 {
 #ifdef _WIN32
-#ifdef WITH_STDERR
-  HANDLE handles[2];
+  int n;
+  int stream;
+  int result = 0;
+  HANDLE thread = NULL;
+  char buf[CROSSRUN_PUMP_BUFFER_SIZE];
+  struct crossrun_pump_writer_data writer;
+  //pass data already in the read-ahead buffer first
+  if ((result = crossrun_readbuf_flush(handle, pumpfn, callbackdata)) != 0)
+    return result;
+  //anonymous pipes don't support overlapped I/O, so write from a separate thread while reading in this one
+  if (handle->stdin_pipe[PIPE_WRITE]) {
+    crossrun_loop_notify_close(handle, CROSSRUN_STREAM_STDIN);
+    writer.pipe = handle->stdin_pipe[PIPE_WRITE];
+    writer.data = writedata;
+    writer.datalen = (writedata ? writedatalen : 0);
+    handle->stdin_pipe[PIPE_WRITE] = NULL;
+    if ((thread = CreateThread(NULL, 0, crossrun_pump_writer_thread, &writer, 0, NULL)) == NULL) {
+      CloseHandle(writer.pipe);
+      return -1;
+    }
+  }
+  while ((n = crossrun_read_any(handle, buf, sizeof(buf), &stream)) > 0) {
+    if (pumpfn && (result = (*pumpfn)(stream, buf, n, callbackdata)) != 0)
+      break;
+  }
+  if (n < 0)
+    result = -1;
+  if (thread) {
+    //unblock the writer if reading stopped before the process consumed all input
+    if (result != 0)
+      CancelSynchronousIo(thread);
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+  }
+  return result;
 #else
-  HANDLE handles[3];
-#endif
-  DWORD i;
-  DWORD result;
-  DWORD handlescount;
+  int i;
+  int count;
+  int result;
+  int flags;
+  int writeerror = 0;
+  ssize_t n;
   size_t writedatapos = 0;
-  size_t writedataleft = writedatalen;
-  //set handles to wait for
-  handlescount = 0;
-  if (writedataleft && handle->stdin_pipe[PIPE_WRITE])
-    handles[handlescount++] = handle->stdin_pipe[PIPE_WRITE];
-#ifdef WITH_STDERR
-  if (handle->stderr_pipe[PIPE_READ] && handle->stderr_pipe[PIPE_READ] != handle->stdout_pipe[PIPE_READ])
-    handles[handlescount++] = handle->stderr_pipe[PIPE_READ];
-#endif
-  if (handle->stdout_pipe[PIPE_READ])
-    handles[handlescount++] = handle->stdout_pipe[PIPE_READ];
-  //abort if no more open handles to wait for
-  if (handlescount == 0)
-    return -1;
-  //loop
-  while (writedataleft > 0 || writedatalen == 0) {
-    //wait for handles
-    if ((result = WaitForMultipleObjects(handlescount, handles, FALSE, INFINITE)) == WAIT_FAILED)
+  struct pollfd pollinfo[3];
+  int pollstream[3];
+  char buf[CROSSRUN_PUMP_BUFFER_SIZE];
+  //pass data already in the read-ahead buffer first
+  if ((result = crossrun_readbuf_flush(handle, pumpfn, callbackdata)) != 0)
+    return result;
+  //close standard input right away if there is nothing to write, otherwise make writes non-blocking
+  if (handle->stdin_pipe[PIPE_WRITE] >= 0) {
+    if (!writedata || writedatalen == 0)
+      crossrun_write_eof(handle);
+    else if ((flags = fcntl(handle->stdin_pipe[PIPE_WRITE], F_GETFL)) == -1 || fcntl(handle->stdin_pipe[PIPE_WRITE], F_SETFL, flags | O_NONBLOCK) == -1)
       return -1;
-    if (result == WAIT_TIMEOUT)
-      return 0;
-    for (i = 0; i < handlescount; i++) {
-      if (result - WAIT_ABANDONED_0 == i) {
-        fprintf(stderr, "Handle abandoned\n");
-        return -1;
-      }
-      if (result - WAIT_OBJECT_0 == i) {
-        if (handles[i] == handle->stdout_pipe[PIPE_READ]) {
-          char readbuf[1024];
-          DWORD n;
-          n = 0;
-          if (!PeekNamedPipe(handle->stdout_pipe[PIPE_READ], NULL, 0, NULL, &n, NULL))
-            return -1;
-          if (n == 0)
-            break;
-          if (!ReadFile(handle->stdout_pipe[PIPE_READ], readbuf, (n <= sizeof(readbuf) ? n : sizeof(readbuf)), &n, NULL)) {
-            fprintf(stderr, "ReadFile() failed after WaitForMultipleObjects()\n");
-            /////TO DO: close handle
-            return -1;
-          }
-          if (readfn)
-            (*readfn)(readbuf, n, readcallbackdata);
-          break;
+  }
+  while (1) {
+    //wait for standard input to become writable and for data on outputs that haven't reached end of file yet
+    count = 0;
+    if (handle->stdin_pipe[PIPE_WRITE] >= 0) {
+      pollinfo[count].fd = handle->stdin_pipe[PIPE_WRITE];
+      pollinfo[count].events = POLLOUT;
+      pollinfo[count].revents = 0;
+      pollstream[count++] = CROSSRUN_STREAM_STDIN;
+    }
+    if (!handle->stdout_eof && handle->stdout_pipe[PIPE_READ] >= 0) {
+      pollinfo[count].fd = handle->stdout_pipe[PIPE_READ];
+      pollinfo[count].events = POLLIN;
+      pollinfo[count].revents = 0;
+      pollstream[count++] = CROSSRUN_STREAM_STDOUT;
+    }
+    if (!handle->stderr_eof && handle->stderr_pipe[PIPE_READ] >= 0) {
+      pollinfo[count].fd = handle->stderr_pipe[PIPE_READ];
+      pollinfo[count].events = POLLIN;
+      pollinfo[count].revents = 0;
+      pollstream[count++] = CROSSRUN_STREAM_STDERR;
+    }
+    if (count == 0)
+      return (writeerror ? -1 : 0);
+    handle->statssyscalls++;
+    if (poll(pollinfo, count, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    for (i = 0; i < count; i++) {
+      if (!pollinfo[i].revents)
+        continue;
+      if (pollstream[i] == CROSSRUN_STREAM_STDIN) {
+        //write as much as the pipe accepts without blocking
+        if ((n = write(pollinfo[i].fd, writedata + writedatapos, writedatalen - writedatapos)) < 0) {
+          if (errno == EINTR || errno == EAGAIN)
+            continue;
+          //the process closed its standard input, so stop writing but keep reading its output
+          if (errno != EPIPE)
+            writeerror = 1;
+          crossrun_write_eof(handle);
+          continue;
         }
-#ifdef WITH_STDERR
-        if (handles[i] == handle->stderr_pipe[PIPE_READ]) {
-
-          break;
+        if ((writedatapos += n) >= writedatalen)
+          crossrun_write_eof(handle);
+      } else {
+        handle->statssyscalls++;
+        if ((n = read(pollinfo[i].fd, buf, sizeof(buf))) < 0) {
+          if (errno == EINTR || errno == EAGAIN)
+            continue;
+          if (errno != EIO || !handle->pty || pollstream[i] != CROSSRUN_STREAM_STDOUT)
+            return -1;
+          n = 0;
         }
-#endif
-        if (handles[i] == handle->stdin_pipe[PIPE_WRITE]) {
-          if (writedataleft) {
-            DWORD n;
-            if (!WriteFile(handle->stdin_pipe[PIPE_WRITE], writedata + writedatapos, writedataleft, &n, NULL)) {
-            //if (!WriteFile(handle->stdin_pipe[PIPE_WRITE], writedata + writedatapos, (writedataleft > 1024 ? 1024 : writedataleft), &n, NULL)) {
-              fprintf(stderr, "WriteFile() failed after WaitForMultipleObjects()\n");
-              /////TO DO: close handle
-              return -1;
-            }
-            writedatapos += n;
-            if ((writedataleft -= n) == 0)
-              return 0;
-          }
-          break;
+        crossrun_checksum_update(handle, pollstream[i], buf, n);
+        handle->statsbytes += n;
+        if (n == 0) {
+          if (pollstream[i] == CROSSRUN_STREAM_STDOUT)
+            handle->stdout_eof = 1;
+          else
+            handle->stderr_eof = 1;
+          continue;
         }
-        break;
+        crossrun_pipe_adapt(handle, pollstream[i], n, sizeof(buf));
+        if (handle->limit[pollstream[i]] && (n = crossrun_limit_apply(handle, pollstream[i], buf, n)) == 0)
+          continue;
+        if (pumpfn && (result = (*pumpfn)(pollstream[i], buf, n, callbackdata)) != 0)
+          return result;
       }
     }
   }
-#else
 #endif
-  return -1;
 }
 
-#endif // ___EXPERIMENTAL___
+struct crossrun_read_write_data {
+  crossrun_read_callback_fn readfn;
+  void* readcallbackdata;
+};
+
+static int crossrun_read_write_pump (int stream, const char* data, size_t datalen, void* callbackdata)
+{
+  struct crossrun_read_write_data* readwritedata = (struct crossrun_read_write_data*)callbackdata;
+  //standard output and error output are passed to the same callback
+  (void)stream;
+  return (*readwritedata->readfn)(data, datalen, readwritedata->readcallbackdata);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_read_write (crossrun handle, crossrun_read_callback_fn readfn, void* readcallbackdata, const char* writedata, size_t writedatalen)
+{
+  struct crossrun_read_write_data readwritedata;
+  if (!readfn)
+    return crossrun_pump(handle, writedata, writedatalen, NULL, NULL);
+  readwritedata.readfn = readfn;
+  readwritedata.readcallbackdata = readcallbackdata;
+  return crossrun_pump(handle, writedata, writedatalen, crossrun_read_write_pump, &readwritedata);
+}
 
 /////See also: https://docs.microsoft.com/en-us/windows/win32/ipc/synchronous-and-overlapped-input-and-output?redirectedfrom=MSDN
 
@@ -0,0 +1,447 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossruncapture.h"
+#include "crossrunpriv.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#endif
+
+//initial size of memory allocated for captured output
+#define CAPTURE_INITIAL_SIZE 4096
+
+struct crossrun_capture_output {
+  char* data;                     //captured data
+  size_t datalen;                 //number of bytes captured
+  size_t datasize;                //size of allocated or provided buffer
+  int external;                   //buffer was provided by the caller
+  uint64_t total;                 //number of bytes written by the process
+#ifdef _WIN32
+  HANDLE spillfile;               //file output is spilled to (or NULL)
+  HANDLE mapping;                 //file mapping of spilled output (or NULL)
+#else
+  int spillfd;                    //file output is spilled to (or -1)
+#endif
+  uint64_t spilled;               //number of bytes written to the spill file
+  uint64_t spillwrites;           //number of writes to the spill file
+  void* map;                      //mapped spill file (or NULL)
+  size_t maplen;
+};
+
+struct crossrun_capture_struct {
+  struct crossrun_capture_output output[2];   //captured standard output and error output
+  size_t memorylimit;             //maximum memory used per output before spilling to a file (0 for no limit)
+  char* spilldir;                 //directory for spill files (or NULL)
+  unsigned long exitcode;
+  uint64_t startusec;
+  uint64_t totalusec;
+};
+
+static uint64_t get_microseconds ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+static struct crossrun_capture_output* get_output (crossrun_capture capture, int stream)
+{
+  if (!capture || (stream != CROSSRUN_STREAM_STDOUT && stream != CROSSRUN_STREAM_STDERR))
+    return NULL;
+  return &capture->output[stream == CROSSRUN_STREAM_STDOUT ? 0 : 1];
+}
+
+//create an anonymous file to spill output to
+static int spill_open (crossrun_capture capture, struct crossrun_capture_output* output)
+{
+#ifdef _WIN32
+  char path[MAX_PATH];
+  char dir[MAX_PATH];
+  if (capture->spilldir) {
+    strncpy(dir, capture->spilldir, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = 0;
+  } else if (!GetTempPathA(sizeof(dir), dir)) {
+    return -1;
+  }
+  if (!GetTempFileNameA(dir, "crr", 0, path))
+    return -1;
+  if ((output->spillfile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL)) == INVALID_HANDLE_VALUE) {
+    output->spillfile = NULL;
+    DeleteFileA(path);
+    return -1;
+  }
+#else
+  output->spillfd = -1;
+#ifdef O_TMPFILE
+  //unnamed file in the requested directory
+  if (capture->spilldir)
+    output->spillfd = open(capture->spilldir, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+#endif
+#ifdef MFD_CLOEXEC
+  //memory backed file that can be swapped out and doesn't count as process memory
+  if (output->spillfd < 0 && !capture->spilldir)
+    output->spillfd = memfd_create("crossrun_capture", MFD_CLOEXEC);
+#endif
+  //fall back to a named file that is removed right away
+  if (output->spillfd < 0) {
+    char* path;
+    const char* dir = (capture->spilldir ? capture->spilldir : (getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp"));
+    if ((path = (char*)malloc(strlen(dir) + 24)) == NULL)
+      return -1;
+    strcpy(path, dir);
+    strcat(path, "/crossrun_captureXXXXXX");
+    if ((output->spillfd = mkstemp(path)) >= 0) {
+      unlink(path);
+      fcntl(output->spillfd, F_SETFD, FD_CLOEXEC);
+    }
+    free(path);
+    if (output->spillfd < 0)
+      return -1;
+  }
+#endif
+  output->spilled = 0;
+  output->spillwrites = 0;
+  return 0;
+}
+
+//append data to the spill file
+static int spill_write (struct crossrun_capture_output* output, const char* data, size_t datalen)
+{
+  size_t pos = 0;
+#ifdef _WIN32
+  DWORD n;
+  while (pos < datalen) {
+    output->spillwrites++;
+    if (!WriteFile(output->spillfile, data + pos, (datalen - pos > 0x40000000 ? 0x40000000 : (DWORD)(datalen - pos)), &n, NULL))
+      return -1;
+    pos += n;
+  }
+#else
+  ssize_t n;
+  while (pos < datalen) {
+    output->spillwrites++;
+    if ((n = write(output->spillfd, data + pos, datalen - pos)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    pos += n;
+  }
+#endif
+  output->spilled += datalen;
+  return 0;
+}
+
+//write the data held in memory to the spill file
+static int spill_flush (struct crossrun_capture_output* output)
+{
+  if (spill_write(output, output->data, output->datalen) != 0)
+    return -1;
+  output->datalen = 0;
+  return 0;
+}
+
+static int is_spilled (struct crossrun_capture_output* output)
+{
+#ifdef _WIN32
+  return (output->spillfile != NULL);
+#else
+  return (output->spillfd >= 0);
+#endif
+}
+
+//close spill file and mapping
+static void spill_close (struct crossrun_capture_output* output)
+{
+#ifdef _WIN32
+  if (output->map)
+    UnmapViewOfFile(output->map);
+  if (output->mapping)
+    CloseHandle(output->mapping);
+  if (output->spillfile)
+    CloseHandle(output->spillfile);
+  output->mapping = NULL;
+  output->spillfile = NULL;
+#else
+  if (output->map)
+    munmap(output->map, output->maplen);
+  if (output->spillfd >= 0)
+    close(output->spillfd);
+  output->spillfd = -1;
+#endif
+  output->map = NULL;
+  output->maplen = 0;
+  output->spilled = 0;
+  output->spillwrites = 0;
+}
+
+//append data to captured output, growing the allocated memory geometrically (keeping space for a terminating zero)
+static int capture_data (int stream, const char* data, size_t datalen, void* callbackdata)
+{
+  crossrun_capture capture = (crossrun_capture)callbackdata;
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL)
+    return 0;
+  output->total += datalen;
+  if (output->external) {
+    //discard what doesn't fit in the buffer provided by the caller
+    if (datalen > output->datasize - output->datalen)
+      datalen = output->datasize - output->datalen;
+  } else if (capture->memorylimit && output->datalen + datalen > capture->memorylimit) {
+    //beyond the memory limit write the data in memory to the spill file, after which memory is only used to combine small writes
+    if (!is_spilled(output) && spill_open(capture, output) != 0)
+      return -1;
+    if (spill_flush(output) != 0)
+      return -1;
+    if (datalen >= output->datasize)
+      return spill_write(output, data, datalen);
+  } else if (output->datalen + datalen >= output->datasize) {
+    char* newdata;
+    size_t newsize = (output->datasize ? output->datasize : CAPTURE_INITIAL_SIZE);
+    while (newsize <= output->datalen + datalen)
+      newsize *= 2;
+    if (capture->memorylimit && newsize > capture->memorylimit + 1)
+      newsize = capture->memorylimit + 1;
+    if ((newdata = (char*)realloc(output->data, newsize)) == NULL)
+      return -1;
+    output->data = newdata;
+    output->datasize = newsize;
+  }
+  if (datalen > 0) {
+    memcpy(output->data + output->datalen, data, datalen);
+    output->datalen += datalen;
+  }
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_capture crossrun_capture_create ()
+{
+  struct crossrun_capture_struct* capture;
+  if ((capture = (struct crossrun_capture_struct*)malloc(sizeof(struct crossrun_capture_struct))) == NULL)
+    return NULL;
+  memset(capture, 0, sizeof(struct crossrun_capture_struct));
+#ifndef _WIN32
+  capture->output[0].spillfd = -1;
+  capture->output[1].spillfd = -1;
+#endif
+  return capture;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_capture_free (crossrun_capture capture)
+{
+  int i;
+  if (!capture)
+    return;
+  for (i = 0; i < 2; i++) {
+    spill_close(&capture->output[i]);
+    if (!capture->output[i].external)
+      free(capture->output[i].data);
+  }
+  free(capture->spilldir);
+  free(capture);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_capture_set_buffer (crossrun_capture capture, int stream, char* buf, size_t bufsize)
+{
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL)
+    return -1;
+  if (!output->external)
+    free(output->data);
+  output->data = buf;
+  output->datasize = (buf ? bufsize : 0);
+  output->datalen = 0;
+  output->external = (buf ? 1 : 0);
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_capture_set_memory_limit (crossrun_capture capture, size_t limit, const char* spilldir)
+{
+  char* dir = NULL;
+  if (!capture)
+    return -1;
+  if (spilldir && (dir = strdup(spilldir)) == NULL)
+    return -1;
+  free(capture->spilldir);
+  capture->spilldir = dir;
+  capture->memorylimit = limit;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_run_capture (crossrun_capture capture, const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options, const char* input, size_t inputlen)
+{
+  int i;
+  int result;
+  crossrun handle;
+  uint64_t starttime;
+  if (!capture)
+    return -1;
+  //reset captured data but keep allocated memory
+  for (i = 0; i < 2; i++) {
+    spill_close(&capture->output[i]);
+    capture->output[i].datalen = 0;
+    capture->output[i].total = 0;
+  }
+  capture->exitcode = ~0UL;
+  capture->startusec = 0;
+  capture->totalusec = 0;
+  //start process
+  starttime = get_microseconds();
+  if ((handle = crossrun_open_with_options(command, environment, priority, affinity, options)) == NULL)
+    return -1;
+  capture->startusec = get_microseconds() - starttime;
+  //write input and read output at the same time
+  result = crossrun_pump(handle, input, inputlen, capture_data, capture);
+  if (result != 0)
+    crossrun_kill(handle);
+  crossrun_wait(handle);
+  capture->totalusec = get_microseconds() - starttime;
+  capture->exitcode = crossrun_get_exit_code(handle);
+  crossrun_free(handle);
+  for (i = 0; i < 2; i++) {
+    //write remaining data to the spill file
+    if (is_spilled(&capture->output[i])) {
+      if (spill_flush(&capture->output[i]) != 0)
+        result = -1;
+      continue;
+    }
+    //terminate captured data if there is space
+    if (capture->output[i].datalen < capture->output[i].datasize)
+      capture->output[i].data[capture->output[i].datalen] = 0;
+  }
+  return result;
+}
+
+DLL_EXPORT_CROSSRUN const char* crossrun_capture_get_data (crossrun_capture capture, int stream, size_t* datalen)
+{
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL || is_spilled(output))
+    return NULL;
+  if (datalen)
+    *datalen = output->datalen;
+  return (output->data ? output->data : "");
+}
+
+DLL_EXPORT_CROSSRUN const char* crossrun_capture_map (crossrun_capture capture, int stream, uint64_t* datalen)
+{
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL)
+    return NULL;
+  if (!is_spilled(output)) {
+    if (datalen)
+      *datalen = output->datalen;
+    return (output->data ? output->data : "");
+  }
+  if (datalen)
+    *datalen = output->spilled;
+  if (output->spilled == 0)
+    return "";
+  if (output->map)
+    return (const char*)output->map;
+  if (output->spilled > (uint64_t)(size_t)-1)
+    return NULL;
+#ifdef _WIN32
+  if ((output->mapping = CreateFileMappingA(output->spillfile, NULL, PAGE_READONLY, 0, 0, NULL)) == NULL)
+    return NULL;
+  if ((output->map = MapViewOfFile(output->mapping, FILE_MAP_READ, 0, 0, 0)) == NULL) {
+    CloseHandle(output->mapping);
+    output->mapping = NULL;
+    return NULL;
+  }
+#else
+  if ((output->map = mmap(NULL, (size_t)output->spilled, PROT_READ, MAP_SHARED, output->spillfd, 0)) == MAP_FAILED) {
+    output->map = NULL;
+    return NULL;
+  }
+#endif
+  output->maplen = (size_t)output->spilled;
+  return (const char*)output->map;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_capture_read (crossrun_capture capture, int stream, uint64_t offset, char* buf, size_t buflen)
+{
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL)
+    return -1;
+  if (buflen > 0x40000000)
+    buflen = 0x40000000;
+  if (!is_spilled(output)) {
+    if (offset >= output->datalen)
+      return 0;
+    if (buflen > output->datalen - offset)
+      buflen = output->datalen - (size_t)offset;
+    memcpy(buf, output->data + offset, buflen);
+    return (int)buflen;
+  }
+#ifdef _WIN32
+  DWORD n;
+  OVERLAPPED overlapped;
+  memset(&overlapped, 0, sizeof(overlapped));
+  overlapped.Offset = (DWORD)offset;
+  overlapped.OffsetHigh = (DWORD)(offset >> 32);
+  if (!ReadFile(output->spillfile, buf, (DWORD)buflen, &n, &overlapped))
+    return (GetLastError() == ERROR_HANDLE_EOF ? 0 : -1);
+  return (int)n;
+#else
+  ssize_t n;
+  while ((n = pread(output->spillfd, buf, buflen, (off_t)offset)) < 0) {
+    if (errno != EINTR)
+      return -1;
+  }
+  return (int)n;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_capture_get_spill_stats (crossrun_capture capture, int stream, uint64_t* spilledbytes, uint64_t* spillwrites)
+{
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL)
+    return -1;
+  if (spilledbytes)
+    *spilledbytes = output->spilled;
+  if (spillwrites)
+    *spillwrites = output->spillwrites;
+  return (is_spilled(output) ? 1 : 0);
+}
+
+DLL_EXPORT_CROSSRUN uint64_t crossrun_capture_get_total (crossrun_capture capture, int stream)
+{
+  struct crossrun_capture_output* output;
+  if ((output = get_output(capture, stream)) == NULL)
+    return 0;
+  return output->total;
+}
+
+DLL_EXPORT_CROSSRUN unsigned long crossrun_capture_get_exit_code (crossrun_capture capture)
+{
+  if (!capture)
+    return ~0UL;
+  return capture->exitcode;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_capture_get_timings (crossrun_capture capture, uint64_t* startusec, uint64_t* totalusec)
+{
+  if (!capture)
+    return -1;
+  if (startusec)
+    *startusec = capture->startusec;
+  if (totalusec)
+    *totalusec = capture->totalusec;
+  return 0;
+}
@@ -0,0 +1,342 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossrunpriv.h"
+#include "crossrunchannel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#define CHANNEL_SUPPORTED
+#endif
+
+#ifdef CHANNEL_SUPPORTED
+
+//identifies the shared memory of a channel
+#define CHANNEL_MAGIC 0x4E435243
+#define CHANNEL_VERSION 1
+//size of the control block at the start of the shared memory, followed by the data of both ring buffers
+#define CHANNEL_HEADER_SIZE 4096
+//minimum size of each ring buffer
+#define CHANNEL_MIN_SIZE 4096
+//size of the length in front of each record, records are aligned to this size so the length never wraps around
+#define CHANNEL_RECORD_HEADER 8
+#define CHANNEL_CACHE_LINE 64
+
+//control block of a ring buffer, the fields written by the producer and by the consumer are on separate cache lines
+struct channel_ring {
+  uint64_t head;                  //total number of bytes written by the producer
+  uint32_t dataseq;               //incremented by the producer after publishing a record (futex the consumer waits on)
+  uint32_t closed;                //set by the producer when no more records will follow
+  uint32_t producerwaiting;       //set by the producer while waiting for space
+  char pad1[CHANNEL_CACHE_LINE - 20];
+  uint64_t tail;                  //total number of bytes consumed by the consumer
+  uint32_t spaceseq;              //incremented by the consumer after removing a record (futex the producer waits on)
+  uint32_t consumerwaiting;       //set by the consumer while waiting for data
+  char pad2[CHANNEL_CACHE_LINE - 16];
+};
+
+//control block at the start of the shared memory
+struct channel_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t ringsize;
+  char pad[CHANNEL_CACHE_LINE - 16];
+  struct channel_ring ring[2];    //ring 0 carries records to the shell process, ring 1 carries records from the shell process
+};
+
+struct crossrun_channel_struct {
+  int fd;
+  size_t mapsize;
+  struct channel_header* header;
+  uint64_t ringsize;
+  struct channel_ring* send;
+  char* senddata;
+  struct channel_ring* recv;
+  char* recvdata;
+};
+
+//wake up a process waiting on a futex in shared memory
+static void channel_wake (uint32_t* futex)
+{
+  syscall(SYS_futex, futex, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+//wait on a futex in shared memory as long as it has the expected value, returns non-zero when the deadline has passed
+static int channel_wait (uint32_t* futex, uint32_t value, int timeout, const struct timespec* deadline)
+{
+  struct timespec now;
+  struct timespec remaining;
+  if (timeout < 0) {
+    syscall(SYS_futex, futex, FUTEX_WAIT, value, NULL, NULL, 0);
+    return 0;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  remaining.tv_sec = deadline->tv_sec - now.tv_sec;
+  remaining.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+  if (remaining.tv_nsec < 0) {
+    remaining.tv_sec--;
+    remaining.tv_nsec += 1000000000L;
+  }
+  if (remaining.tv_sec < 0)
+    return -1;
+  if (syscall(SYS_futex, futex, FUTEX_WAIT, value, &remaining, NULL, 0) != 0 && errno == ETIMEDOUT)
+    return -1;
+  return 0;
+}
+
+//determine the time at which waiting stops
+static void channel_deadline (int timeout, struct timespec* deadline)
+{
+  if (timeout <= 0)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += timeout / 1000;
+  deadline->tv_nsec += (long)(timeout % 1000) * 1000000L;
+  if (deadline->tv_nsec >= 1000000000L) {
+    deadline->tv_sec++;
+    deadline->tv_nsec -= 1000000000L;
+  }
+}
+
+//map the shared memory and point to the ring buffers for the calling process (side 0) or the shell process (side 1)
+static crossrun_channel channel_map (int fd, size_t mapsize, int side)
+{
+  struct crossrun_channel_struct* channel;
+  if ((channel = (struct crossrun_channel_struct*)malloc(sizeof(struct crossrun_channel_struct))) == NULL)
+    return NULL;
+  if ((channel->header = (struct channel_header*)mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    free(channel);
+    return NULL;
+  }
+  channel->fd = fd;
+  channel->mapsize = mapsize;
+  channel->ringsize = (mapsize - CHANNEL_HEADER_SIZE) / 2;
+  channel->send = &channel->header->ring[side];
+  channel->senddata = (char*)channel->header + CHANNEL_HEADER_SIZE + side * channel->ringsize;
+  channel->recv = &channel->header->ring[1 - side];
+  channel->recvdata = (char*)channel->header + CHANNEL_HEADER_SIZE + (1 - side) * channel->ringsize;
+  return channel;
+}
+#endif
+
+DLL_EXPORT_CROSSRUN crossrun_channel crossrun_channel_create (size_t size)
+{
+#ifdef CHANNEL_SUPPORTED
+  int fd;
+  size_t ringsize = CHANNEL_MIN_SIZE;
+  crossrun_channel channel;
+  while (ringsize < size) {
+    if (ringsize > (SIZE_MAX - CHANNEL_HEADER_SIZE) / 4)
+      return NULL;
+    ringsize <<= 1;
+  }
+  if ((fd = memfd_create("crossrun-channel", MFD_CLOEXEC)) < 0)
+    return NULL;
+  if (ftruncate(fd, CHANNEL_HEADER_SIZE + 2 * ringsize) != 0 || (channel = channel_map(fd, CHANNEL_HEADER_SIZE + 2 * ringsize, 0)) == NULL) {
+    close(fd);
+    return NULL;
+  }
+  //the memory starts out zeroed
+  channel->header->ringsize = ringsize;
+  channel->header->version = CHANNEL_VERSION;
+  channel->header->magic = CHANNEL_MAGIC;
+  return channel;
+#else
+  return NULL;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN crossrun_channel crossrun_channel_open_child ()
+{
+#ifdef CHANNEL_SUPPORTED
+  int fd;
+  struct stat st;
+  const struct channel_header* header;
+  crossrun_channel channel;
+  if (fstat(CROSSRUN_CHANNEL_FD, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < CHANNEL_HEADER_SIZE + 2 * CHANNEL_MIN_SIZE)
+    return NULL;
+  //don't pass the channel on to processes started by the shell process
+  if ((fd = fcntl(CROSSRUN_CHANNEL_FD, F_DUPFD_CLOEXEC, 3)) < 0)
+    return NULL;
+  if ((channel = channel_map(fd, (size_t)st.st_size, 1)) == NULL) {
+    close(fd);
+    return NULL;
+  }
+  //check if the file descriptor really is a channel
+  header = channel->header;
+  if (header->magic != CHANNEL_MAGIC || header->version != CHANNEL_VERSION || header->ringsize != channel->ringsize || (header->ringsize & (header->ringsize - 1)) != 0) {
+    crossrun_channel_free(channel);
+    return NULL;
+  }
+  close(CROSSRUN_CHANNEL_FD);
+  return channel;
+#else
+  return NULL;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_channel_free (crossrun_channel channel)
+{
+#ifdef CHANNEL_SUPPORTED
+  if (!channel)
+    return;
+  munmap(channel->header, channel->mapsize);
+  close(channel->fd);
+  free(channel);
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_channel (crossrun_options options, crossrun_channel channel)
+{
+#ifdef CHANNEL_SUPPORTED
+  if (!options)
+    return -1;
+  options->channelfd = (channel ? channel->fd : -1);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_channel_write (crossrun_channel channel, const char* data, size_t datalen, int timeout)
+{
+#ifdef CHANNEL_SUPPORTED
+  uint64_t head;
+  uint64_t need;
+  uint64_t pos;
+  uint64_t n;
+  uint32_t seq;
+  struct timespec deadline;
+  struct channel_ring* ring;
+  if (!channel || (!data && datalen > 0) || datalen > UINT32_MAX)
+    return -1;
+  ring = channel->send;
+  need = CHANNEL_RECORD_HEADER + ((datalen + CHANNEL_RECORD_HEADER - 1) & ~(uint64_t)(CHANNEL_RECORD_HEADER - 1));
+  if (need > channel->ringsize || __atomic_load_n(&ring->closed, __ATOMIC_RELAXED))
+    return -1;
+  //only this process changes the head
+  head = ring->head;
+  channel_deadline(timeout, &deadline);
+  while (head + need - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > channel->ringsize) {
+    if (timeout == 0)
+      return 1;
+    //announce waiting before checking again, so either the consumer sees the flag or this process sees the space
+    seq = __atomic_load_n(&ring->spaceseq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->producerwaiting, 1, __ATOMIC_SEQ_CST);
+    if (head + need - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) <= channel->ringsize)
+      break;
+    if (channel_wait(&ring->spaceseq, seq, timeout, &deadline) != 0) {
+      __atomic_store_n(&ring->producerwaiting, 0, __ATOMIC_RELAXED);
+      return 1;
+    }
+  }
+  __atomic_store_n(&ring->producerwaiting, 0, __ATOMIC_RELAXED);
+  //write the length followed by the data, which may wrap around
+  pos = head & (channel->ringsize - 1);
+  *(uint32_t*)(channel->senddata + pos) = (uint32_t)datalen;
+  *(uint32_t*)(channel->senddata + pos + 4) = 0;
+  pos += CHANNEL_RECORD_HEADER;
+  n = (datalen < channel->ringsize - pos ? datalen : channel->ringsize - pos);
+  memcpy(channel->senddata + pos, data, n);
+  if (n < datalen)
+    memcpy(channel->senddata, data + n, datalen - n);
+  //publish the record and only make a system call if the consumer is waiting
+  __atomic_store_n(&ring->head, head + need, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&ring->dataseq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->consumerwaiting, __ATOMIC_SEQ_CST))
+    channel_wake(&ring->dataseq);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_channel_read (crossrun_channel channel, char* buf, size_t buflen, size_t* datalen, int timeout)
+{
+#ifdef CHANNEL_SUPPORTED
+  uint64_t head;
+  uint64_t tail;
+  uint64_t need;
+  uint64_t pos;
+  uint64_t n;
+  uint32_t len;
+  uint32_t seq;
+  struct timespec deadline;
+  struct channel_ring* ring;
+  if (!channel)
+    return -1;
+  ring = channel->recv;
+  //only this process changes the tail
+  tail = ring->tail;
+  channel_deadline(timeout, &deadline);
+  while ((head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) == tail) {
+    //the producer closes after publishing its last record
+    if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE)) {
+      if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+        return -1;
+      continue;
+    }
+    if (timeout == 0)
+      return 0;
+    //announce waiting before checking again, so either the producer sees the flag or this process sees the data
+    seq = __atomic_load_n(&ring->dataseq, __ATOMIC_ACQUIRE);
+    __atomic_store_n(&ring->consumerwaiting, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != tail || __atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST)) {
+      __atomic_store_n(&ring->consumerwaiting, 0, __ATOMIC_RELAXED);
+      continue;
+    }
+    if (channel_wait(&ring->dataseq, seq, timeout, &deadline) != 0) {
+      __atomic_store_n(&ring->consumerwaiting, 0, __ATOMIC_RELAXED);
+      return 0;
+    }
+    __atomic_store_n(&ring->consumerwaiting, 0, __ATOMIC_RELAXED);
+  }
+  //get the length and don't trust it beyond the data that was published
+  pos = tail & (channel->ringsize - 1);
+  len = *(const uint32_t*)(channel->recvdata + pos);
+  need = CHANNEL_RECORD_HEADER + (((uint64_t)len + CHANNEL_RECORD_HEADER - 1) & ~(uint64_t)(CHANNEL_RECORD_HEADER - 1));
+  if (need > head - tail)
+    return -1;
+  if (datalen)
+    *datalen = len;
+  if (len > buflen || (!buf && len > 0))
+    return -1;
+  //copy the data, which may wrap around
+  pos += CHANNEL_RECORD_HEADER;
+  n = (len < channel->ringsize - pos ? len : channel->ringsize - pos);
+  memcpy(buf, channel->recvdata + pos, n);
+  if (n < len)
+    memcpy(buf + n, channel->recvdata, len - n);
+  //release the space and only make a system call if the producer is waiting
+  __atomic_store_n(&ring->tail, tail + need, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&ring->spaceseq, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->producerwaiting, __ATOMIC_SEQ_CST))
+    channel_wake(&ring->spaceseq);
+  return 1;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_channel_close (crossrun_channel channel)
+{
+#ifdef CHANNEL_SUPPORTED
+  if (!channel)
+    return -1;
+  __atomic_store_n(&channel->send->closed, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&channel->send->dataseq, 1, __ATOMIC_SEQ_CST);
+  channel_wake(&channel->send->dataseq);
+  return 0;
+#else
+  return -1;
+#endif
+}
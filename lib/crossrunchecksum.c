@@ -0,0 +1,129 @@
+#include "crossrunpriv.h"
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32C_X86_SIMD
+#include <immintrin.h>
+#endif
+
+//reversed Castagnoli polynomial
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+typedef uint32_t (*crc32c_fn) (uint32_t crc, const unsigned char* data, size_t datalen);
+
+//lookup tables for processing 8 bytes at a time without hardware support
+static uint32_t crc32c_table[8][256];
+
+static void crc32c_table_init ()
+{
+  int i;
+  int j;
+  uint32_t crc;
+  for (i = 0; i < 256; i++) {
+    crc = i;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1);
+    crc32c_table[0][i] = crc;
+  }
+  for (i = 0; i < 256; i++) {
+    crc = crc32c_table[0][i];
+    for (j = 1; j < 8; j++) {
+      crc = crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+      crc32c_table[j][i] = crc;
+    }
+  }
+}
+
+static uint32_t crc32c_scalar (uint32_t crc, const unsigned char* data, size_t datalen)
+{
+  uint32_t lo;
+  uint32_t hi;
+  //process 8 bytes per iteration (slicing-by-8)
+  while (datalen >= 8) {
+    lo = crc ^ ((uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24));
+    hi = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+    crc = crc32c_table[7][lo & 0xFF] ^ crc32c_table[6][(lo >> 8) & 0xFF] ^ crc32c_table[5][(lo >> 16) & 0xFF] ^ crc32c_table[4][lo >> 24] ^
+          crc32c_table[3][hi & 0xFF] ^ crc32c_table[2][(hi >> 8) & 0xFF] ^ crc32c_table[1][(hi >> 16) & 0xFF] ^ crc32c_table[0][hi >> 24];
+    data += 8;
+    datalen -= 8;
+  }
+  while (datalen-- > 0)
+    crc = crc32c_table[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+#ifdef CRC32C_X86_SIMD
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42 (uint32_t crc, const unsigned char* data, size_t datalen)
+{
+#ifdef __x86_64__
+  uint64_t crc64 = crc;
+  uint64_t value;
+  //process 8 bytes per instruction
+  while (datalen >= 8) {
+    memcpy(&value, data, 8);
+    crc64 = _mm_crc32_u64(crc64, value);
+    data += 8;
+    datalen -= 8;
+  }
+  crc = (uint32_t)crc64;
+#else
+  uint32_t value;
+  //process 4 bytes per instruction
+  while (datalen >= 4) {
+    memcpy(&value, data, 4);
+    crc = _mm_crc32_u32(crc, value);
+    data += 4;
+    datalen -= 4;
+  }
+#endif
+  while (datalen-- > 0)
+    crc = _mm_crc32_u8(crc, *data++);
+  return crc;
+}
+#endif
+
+//select the fastest implementation supported by the processor
+static uint32_t crc32c_dispatch (uint32_t crc, const unsigned char* data, size_t datalen);
+
+static crc32c_fn crc32c_impl = crc32c_dispatch;
+
+static uint32_t crc32c_dispatch (uint32_t crc, const unsigned char* data, size_t datalen)
+{
+#ifdef CRC32C_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    crc32c_impl = crc32c_sse42;
+  } else
+#endif
+  {
+    crc32c_table_init();
+    crc32c_impl = crc32c_scalar;
+  }
+  return (*crc32c_impl)(crc, data, datalen);
+}
+
+DLL_EXPORT_CROSSRUN uint32_t crossrun_crc32c (uint32_t crc, const void* data, size_t datalen)
+{
+  if (!data)
+    return crc;
+  return ~(*crc32c_impl)(~crc, (const unsigned char*)data, datalen);
+}
+
+void crossrun_checksum_update (crossrun handle, int stream, const char* data, size_t datalen)
+{
+  if (!handle->checksum || datalen == 0 || (stream != CROSSRUN_STREAM_STDOUT && stream != CROSSRUN_STREAM_STDERR))
+    return;
+  handle->checksumcrc[stream] = crossrun_crc32c(handle->checksumcrc[stream], data, datalen);
+  handle->checksumlen[stream] += datalen;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_get_checksum (crossrun handle, int stream, uint32_t* crc, uint64_t* length)
+{
+  if (!handle || !handle->checksum || (stream != CROSSRUN_STREAM_STDOUT && stream != CROSSRUN_STREAM_STDERR))
+    return -1;
+  if (crc)
+    *crc = handle->checksumcrc[stream];
+  if (length)
+    *length = handle->checksumlen[stream];
+  return 0;
+}
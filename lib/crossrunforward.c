@@ -0,0 +1,275 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossrunpriv.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#endif
+
+//maximum number of bytes forwarded at once
+#define FORWARD_BUFFER_SIZE (64 * 1024)
+
+#if defined(__linux__) && defined(SPLICE_F_MOVE)
+#define FORWARD_SPLICE
+//result of forward_splice() when splice() can't be used for the file descriptors
+#define FORWARD_SPLICE_UNSUPPORTED -2
+#endif
+
+#ifndef _WIN32
+//wait until a file descriptor (which may be non-blocking) is ready
+static int wait_fd (int fd, short events)
+{
+  struct pollfd pollinfo;
+  pollinfo.fd = fd;
+  pollinfo.events = events;
+  pollinfo.revents = 0;
+  if (poll(&pollinfo, 1, -1) < 0 && errno != EINTR)
+    return -1;
+  return 0;
+}
+#endif
+
+//write all data to a file descriptor
+static int write_all (int fd, const char* data, size_t datalen)
+{
+#ifdef _WIN32
+  DWORD n;
+  HANDLE h;
+  if ((h = (HANDLE)_get_osfhandle(fd)) == INVALID_HANDLE_VALUE)
+    return -1;
+  while (datalen > 0) {
+    if (!WriteFile(h, data, (DWORD)datalen, &n, NULL))
+      return -1;
+    data += n;
+    datalen -= n;
+  }
+#else
+  ssize_t n;
+  while (datalen > 0) {
+    if ((n = write(fd, data, datalen)) < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN && wait_fd(fd, POLLOUT) == 0)
+        continue;
+      return -1;
+    }
+    data += n;
+    datalen -= n;
+  }
+#endif
+  return 0;
+}
+
+#ifdef FORWARD_SPLICE
+//move data from a pipe to a file descriptor without copying it to user space, duplicating it to a second pipe with tee() for inspection or checksums if needed
+static int forward_splice (crossrun handle, int stream, int in, int out, crossrun_read_callback_fn inspectfn, void* callbackdata, uint64_t* total)
+{
+  ssize_t n;
+  ssize_t m;
+  ssize_t moved;
+  uint64_t spliced = 0;
+  int result = 0;
+  int teepipe[2] = {-1, -1};
+  char* buf = NULL;
+  int inspect = (inspectfn || handle->checksum);
+  if (inspect) {
+    if (pipe2(teepipe, O_CLOEXEC) != 0)
+      return FORWARD_SPLICE_UNSUPPORTED;
+    if ((buf = (char*)malloc(FORWARD_BUFFER_SIZE)) == NULL) {
+      close(teepipe[0]);
+      close(teepipe[1]);
+      return -1;
+    }
+  }
+  while (1) {
+    n = FORWARD_BUFFER_SIZE;
+    if (inspect) {
+      //duplicate the data waiting in the pipe without consuming it
+      handle->statssyscalls++;
+      if ((n = tee(in, teepipe[PIPE_WRITE], FORWARD_BUFFER_SIZE, 0)) == 0)
+        break;
+      if (n < 0) {
+        if (errno == EINTR || (errno == EAGAIN && wait_fd(in, POLLIN) == 0))
+          continue;
+        result = (errno == EINVAL && spliced == 0 ? FORWARD_SPLICE_UNSUPPORTED : -1);
+        break;
+      }
+    }
+    //move the data to the destination (exactly the duplicated amount when inspecting)
+    moved = 0;
+    while (moved < n) {
+      handle->statssyscalls++;
+      if ((m = splice(in, NULL, out, NULL, n - moved, SPLICE_F_MOVE | SPLICE_F_MORE)) < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN && wait_fd(out, POLLOUT) == 0 && wait_fd(in, POLLIN) == 0)
+          continue;
+        result = (errno == EINVAL && spliced == 0 ? FORWARD_SPLICE_UNSUPPORTED : -1);
+        break;
+      }
+      if (m == 0)
+        break;
+      moved += m;
+      if (!inspect)
+        break;
+    }
+    spliced += moved;
+    *total += moved;
+    handle->statsbytes += moved;
+    if (result != 0 || moved == 0)
+      break;
+    //read the duplicated data for inspection
+    if (inspect) {
+      m = 0;
+      while (m < moved) {
+        if ((n = read(teepipe[PIPE_READ], buf + m, moved - m)) <= 0) {
+          if (n < 0 && errno == EINTR)
+            continue;
+          result = -1;
+          break;
+        }
+        m += n;
+      }
+      if (result != 0)
+        break;
+      crossrun_checksum_update(handle, stream, buf, moved);
+      if (inspectfn && (result = (*inspectfn)(buf, moved, callbackdata)) != 0)
+        break;
+    }
+  }
+  if (inspect) {
+    close(teepipe[0]);
+    close(teepipe[1]);
+    free(buf);
+  }
+  return result;
+}
+#endif
+
+DLL_EXPORT_CROSSRUN int crossrun_forward (crossrun handle, int fd, int flags, crossrun_read_callback_fn inspectfn, void* callbackdata, uint64_t* forwarded)
+{
+  int result = 0;
+  int stream = (flags & CROSSRUN_FORWARD_STDERR ? CROSSRUN_STREAM_STDERR : CROSSRUN_STREAM_STDOUT);
+  int* eof = (stream == CROSSRUN_STREAM_STDOUT ? &handle->stdout_eof : &handle->stderr_eof);
+  uint64_t total = 0;
+  char* buf;
+  if (forwarded)
+    *forwarded = 0;
+  //forward data already in the read-ahead buffer first
+  if (stream == CROSSRUN_STREAM_STDOUT && handle->readbuf && handle->readbuflen > 0) {
+    if (write_all(fd, handle->readbuf + handle->readbufpos, handle->readbuflen) != 0)
+      return -1;
+    total = handle->readbuflen;
+    if (inspectfn)
+      result = (*inspectfn)(handle->readbuf + handle->readbufpos, handle->readbuflen, callbackdata);
+    handle->readbufpos = 0;
+    handle->readbuflen = 0;
+    if (result != 0) {
+      if (forwarded)
+        *forwarded = total;
+      return result;
+    }
+  }
+#ifdef _WIN32
+  DWORD n;
+  HANDLE pipe = (stream == CROSSRUN_STREAM_STDOUT ? handle->stdout_pipe[PIPE_READ] : handle->stderr_pipe[PIPE_READ]);
+  if (!pipe)
+    return -1;
+  if ((buf = (char*)malloc(FORWARD_BUFFER_SIZE)) == NULL)
+    return -1;
+  while (!*eof) {
+    handle->statssyscalls++;
+    if (!ReadFile(pipe, buf, FORWARD_BUFFER_SIZE, &n, NULL)) {
+      if (GetLastError() != ERROR_BROKEN_PIPE)
+        result = -1;
+      else
+        *eof = 1;
+      break;
+    }
+    if (n == 0) {
+      *eof = 1;
+      break;
+    }
+    crossrun_checksum_update(handle, stream, buf, n);
+    handle->statsbytes += n;
+    if (handle->limit[stream] && (n = crossrun_limit_apply(handle, stream, buf, n)) == 0)
+      continue;
+    if (write_all(fd, buf, n) != 0) {
+      result = -1;
+      break;
+    }
+    total += n;
+    if (inspectfn && (result = (*inspectfn)(buf, n, callbackdata)) != 0)
+      break;
+  }
+  free(buf);
+#else
+  ssize_t n;
+  int in = (stream == CROSSRUN_STREAM_STDOUT ? handle->stdout_pipe[PIPE_READ] : handle->stderr_pipe[PIPE_READ]);
+  if (in < 0)
+    return -1;
+  if (*eof) {
+    if (forwarded)
+      *forwarded = total;
+    return 0;
+  }
+#ifdef FORWARD_SPLICE
+  //move data in the kernel unless the destination doesn't support it (or the data needs to be checked against the rate limit)
+  if (!(flags & CROSSRUN_FORWARD_NO_SPLICE) && !handle->limit[stream]) {
+    if ((result = forward_splice(handle, stream, in, fd, inspectfn, callbackdata, &total)) != FORWARD_SPLICE_UNSUPPORTED) {
+      if (result == 0)
+        *eof = 1;
+      if (forwarded)
+        *forwarded = total;
+      return result;
+    }
+    result = 0;
+  }
+#endif
+  //copy data through a buffer
+  if ((buf = (char*)malloc(FORWARD_BUFFER_SIZE)) == NULL)
+    return -1;
+  while (1) {
+    handle->statssyscalls++;
+    if ((n = read(in, buf, FORWARD_BUFFER_SIZE)) < 0) {
+      if (errno == EINTR || (errno == EAGAIN && wait_fd(in, POLLIN) == 0))
+        continue;
+      //a pseudo-terminal reports an error instead of the end of file
+      if (errno == EIO && handle->pty && stream == CROSSRUN_STREAM_STDOUT) {
+        *eof = 1;
+        break;
+      }
+      result = -1;
+      break;
+    }
+    if (n == 0) {
+      *eof = 1;
+      break;
+    }
+    crossrun_pipe_adapt(handle, stream, n, FORWARD_BUFFER_SIZE);
+    crossrun_checksum_update(handle, stream, buf, n);
+    handle->statsbytes += n;
+    if (handle->limit[stream] && (n = crossrun_limit_apply(handle, stream, buf, n)) == 0)
+      continue;
+    if (write_all(fd, buf, n) != 0) {
+      result = -1;
+      break;
+    }
+    total += n;
+    if (inspectfn && (result = (*inspectfn)(buf, n, callbackdata)) != 0)
+      break;
+  }
+  free(buf);
+#endif
+  if (forwarded)
+    *forwarded = total;
+  return result;
+}
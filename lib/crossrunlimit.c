@@ -0,0 +1,294 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossrunpriv.h"
+#include "crossrunlimit.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+#if defined(__linux__) && defined(SPLICE_F_NONBLOCK)
+#define LIMIT_SPLICE
+#endif
+
+//length of the period the limits apply to in milliseconds
+#define LIMIT_PERIOD 1000
+
+//maximum number of splice() calls made at once to move output above the limit to /dev/null
+#define LIMIT_DRAIN_CALLS 16
+
+//state of the line being processed
+#define LINE_START   0
+#define LINE_KEEP    1
+#define LINE_DISCARD 2
+
+struct crossrun_limit_state {
+  uint64_t maxbytes;
+  uint64_t maxlines;
+  int mode;
+  size_t sample;                  //keep one in every sample lines (CROSSRUN_LIMIT_SAMPLE)
+  uint64_t periodstart;           //start time of the current period in milliseconds
+  uint64_t periodbytes;           //number of bytes kept in the current period
+  uint64_t periodlines;           //number of lines kept in the current period
+  int linestate;                  //state of the line being processed as LINE_*
+  size_t samplecount;             //number of lines above the limit since the last one kept
+  uint64_t discardedbytes;
+  uint64_t discardedlines;
+  int nodrain;                    //splice() is not supported for the output
+  char* tail;                     //ring buffer with the most recently discarded output (CROSSRUN_LIMIT_HEAD_TAIL)
+  size_t tailsize;
+  size_t tailpos;                 //position in the ring buffer where the next data is written
+  size_t taillen;                 //number of bytes in the ring buffer
+  int tailpartial;                //more output was discarded than fits in the ring buffer
+};
+
+static uint64_t get_milliseconds ()
+{
+#ifdef _WIN32
+  return GetTickCount64();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+//check if the limit was reached in the current period
+static int limit_reached (struct crossrun_limit_state* limit)
+{
+  return (limit->maxbytes && limit->periodbytes >= limit->maxbytes) || (limit->maxlines && limit->periodlines >= limit->maxlines);
+}
+
+//remember discarded output in the ring buffer
+static void tail_add (struct crossrun_limit_state* limit, const char* data, size_t datalen)
+{
+  size_t n;
+  if (datalen >= limit->tailsize) {
+    memcpy(limit->tail, data + datalen - limit->tailsize, limit->tailsize);
+    limit->tailpos = 0;
+    limit->tailpartial = (limit->taillen > 0 || datalen > limit->tailsize);
+    limit->taillen = limit->tailsize;
+    return;
+  }
+  if (limit->taillen + datalen > limit->tailsize)
+    limit->tailpartial = 1;
+  //copy in up to 2 parts if the data wraps around the end of the buffer
+  n = limit->tailsize - limit->tailpos;
+  if (n > datalen)
+    n = datalen;
+  memcpy(limit->tail + limit->tailpos, data, n);
+  memcpy(limit->tail, data + n, datalen - n);
+  limit->tailpos = (limit->tailpos + datalen) % limit->tailsize;
+  if ((limit->taillen += datalen) > limit->tailsize)
+    limit->taillen = limit->tailsize;
+}
+
+#ifdef LIMIT_SPLICE
+static int nullfd = -1;
+
+//move output waiting in a pipe to /dev/null without reading it
+static void limit_drain (crossrun handle, int stream, struct crossrun_limit_state* limit)
+{
+  int i;
+  int fd;
+  ssize_t n;
+  int drained = 0;
+  if (limit->nodrain || handle->checksum || (fd = (stream == CROSSRUN_STREAM_STDOUT ? handle->stdout_pipe[PIPE_READ] : handle->stderr_pipe[PIPE_READ])) < 0)
+    return;
+  if (nullfd < 0) {
+    if ((i = open("/dev/null", O_WRONLY | O_CLOEXEC)) < 0) {
+      limit->nodrain = 1;
+      return;
+    }
+    if (!__sync_bool_compare_and_swap(&nullfd, -1, i))
+      close(i);
+  }
+  for (i = 0; i < LIMIT_DRAIN_CALLS; i++) {
+    handle->statssyscalls++;
+    if ((n = splice(fd, NULL, nullfd, NULL, 1024 * 1024, SPLICE_F_MOVE | SPLICE_F_NONBLOCK)) <= 0) {
+      if (n < 0 && errno == EINTR)
+        continue;
+      //not a pipe (pseudo-terminal or socket)
+      if (n < 0 && errno != EAGAIN)
+        limit->nodrain = 1;
+      break;
+    }
+    handle->statsbytes += n;
+    limit->discardedbytes += n;
+    drained = 1;
+  }
+  //the output read next continues somewhere in a discarded line
+  if (drained)
+    limit->linestate = LINE_DISCARD;
+}
+#endif
+
+size_t crossrun_limit_apply (crossrun handle, int stream, char* data, size_t datalen)
+{
+  uint64_t now;
+  size_t pos;
+  size_t len;
+  size_t kept;
+  const char* p;
+  struct crossrun_limit_state* limit = handle->limit[stream];
+  if (datalen == 0)
+    return 0;
+  //start a new period
+  now = get_milliseconds();
+  if (now - limit->periodstart >= LIMIT_PERIOD) {
+    limit->periodstart = now;
+    limit->periodbytes = 0;
+    limit->periodlines = 0;
+  }
+  //keep all data if no line in it can start above the limit
+  if (limit->linestate != LINE_DISCARD && !limit->maxlines && limit->periodbytes + datalen <= limit->maxbytes) {
+    limit->periodbytes += datalen;
+    limit->linestate = (data[datalen - 1] == '\n' ? LINE_START : LINE_KEEP);
+    return datalen;
+  }
+  pos = 0;
+  kept = 0;
+  while (pos < datalen) {
+    //decide what happens to the line at its start
+    if (limit->linestate == LINE_START) {
+      limit->linestate = LINE_KEEP;
+      if (limit_reached(limit)) {
+        limit->linestate = LINE_DISCARD;
+        if (limit->mode == CROSSRUN_LIMIT_SAMPLE && ++limit->samplecount >= limit->sample) {
+          limit->samplecount = 0;
+          limit->linestate = LINE_KEEP;
+        }
+      }
+      if (limit->linestate == LINE_KEEP)
+        limit->periodlines++;
+      else
+        limit->discardedlines++;
+    }
+    //find the end of the line
+    p = crossrun_scan_byte(data + pos, datalen - pos, '\n');
+    len = (p ? (size_t)(p - (data + pos)) + 1 : datalen - pos);
+    if (limit->linestate == LINE_KEEP) {
+      if (kept < pos)
+        memmove(data + kept, data + pos, len);
+      kept += len;
+      limit->periodbytes += len;
+    } else {
+      limit->discardedbytes += len;
+      if (limit->tail)
+        tail_add(limit, data + pos, len);
+    }
+    pos += len;
+    if (p)
+      limit->linestate = LINE_START;
+  }
+#ifdef LIMIT_SPLICE
+  //get rid of more output above the limit without reading it
+  if (limit->mode == CROSSRUN_LIMIT_DROP && limit->linestate != LINE_KEEP && limit_reached(limit))
+    limit_drain(handle, stream, limit);
+#endif
+  return kept;
+}
+
+void crossrun_limit_free (crossrun handle)
+{
+  int i;
+  for (i = CROSSRUN_STREAM_STDOUT; i <= CROSSRUN_STREAM_STDERR; i++) {
+    if (handle->limit[i]) {
+      free(handle->limit[i]->tail);
+      free(handle->limit[i]);
+      handle->limit[i] = NULL;
+    }
+  }
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_set_output_limit (crossrun handle, int stream, uint64_t maxbytes, uint64_t maxlines, int mode, size_t param)
+{
+  struct crossrun_limit_state* limit;
+  if (!handle || (stream != CROSSRUN_STREAM_STDOUT && stream != CROSSRUN_STREAM_STDERR))
+    return -1;
+  if (mode != CROSSRUN_LIMIT_DROP && mode != CROSSRUN_LIMIT_SAMPLE && mode != CROSSRUN_LIMIT_HEAD_TAIL)
+    return -1;
+  if ((mode == CROSSRUN_LIMIT_SAMPLE || mode == CROSSRUN_LIMIT_HEAD_TAIL) && param == 0)
+    return -1;
+  //remove the existing limit
+  if ((limit = handle->limit[stream]) != NULL) {
+    free(limit->tail);
+    free(limit);
+    handle->limit[stream] = NULL;
+  }
+  if (!maxbytes && !maxlines)
+    return 0;
+  if ((limit = (struct crossrun_limit_state*)malloc(sizeof(struct crossrun_limit_state))) == NULL)
+    return -1;
+  limit->maxbytes = maxbytes;
+  limit->maxlines = maxlines;
+  limit->mode = mode;
+  limit->sample = (mode == CROSSRUN_LIMIT_SAMPLE ? param : 0);
+  limit->periodstart = get_milliseconds();
+  limit->periodbytes = 0;
+  limit->periodlines = 0;
+  limit->linestate = LINE_START;
+  limit->samplecount = 0;
+  limit->discardedbytes = 0;
+  limit->discardedlines = 0;
+  limit->nodrain = 0;
+  limit->tail = NULL;
+  limit->tailsize = 0;
+  limit->tailpos = 0;
+  limit->taillen = 0;
+  limit->tailpartial = 0;
+  if (mode == CROSSRUN_LIMIT_HEAD_TAIL) {
+    if ((limit->tail = (char*)malloc(param)) == NULL) {
+      free(limit);
+      return -1;
+    }
+    limit->tailsize = param;
+  }
+  handle->limit[stream] = limit;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_get_output_limit_stats (crossrun handle, int stream, uint64_t* discardedbytes, uint64_t* discardedlines)
+{
+  if (!handle || (stream != CROSSRUN_STREAM_STDOUT && stream != CROSSRUN_STREAM_STDERR) || !handle->limit[stream])
+    return -1;
+  if (discardedbytes)
+    *discardedbytes = handle->limit[stream]->discardedbytes;
+  if (discardedlines)
+    *discardedlines = handle->limit[stream]->discardedlines;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_get_output_limit_tail (crossrun handle, int stream, char* buf, size_t buflen)
+{
+  size_t i;
+  size_t start;
+  size_t len;
+  struct crossrun_limit_state* limit;
+  if (!handle || (stream != CROSSRUN_STREAM_STDOUT && stream != CROSSRUN_STREAM_STDERR) || (limit = handle->limit[stream]) == NULL || !limit->tail)
+    return 0;
+  start = (limit->tailpos + limit->tailsize - limit->taillen) % limit->tailsize;
+  len = limit->taillen;
+  //skip the incomplete first line
+  if (limit->tailpartial) {
+    for (i = 0; i < limit->taillen; i++) {
+      if (limit->tail[(start + i) % limit->tailsize] == '\n') {
+        start = (start + i + 1) % limit->tailsize;
+        len -= i + 1;
+        break;
+      }
+    }
+  }
+  if (buf) {
+    for (i = 0; i < len && i < buflen; i++)
+      buf[i] = limit->tail[(start + i) % limit->tailsize];
+  }
+  return len;
+}
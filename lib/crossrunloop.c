@@ -0,0 +1,1172 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossrunloop.h"
+#include "crossrunpriv.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define CROSSRUN_LOOP_SUPPORTED
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(SYS_io_uring_setup) && defined(SYS_io_uring_enter) && defined(SYS_io_uring_register) && defined(IORING_CQE_F_BUFFER) && defined(IO_URING_OP_SUPPORTED)
+#define CROSSRUN_LOOP_IO_URING
+#endif
+#endif
+#endif
+#endif
+
+#ifdef CROSSRUN_LOOP_SUPPORTED
+
+#if !defined(SYS_pidfd_open) && defined(__NR_pidfd_open)
+#define SYS_pidfd_open __NR_pidfd_open
+#endif
+
+//internal stream identifier used for the process exit notification
+#define LOOP_STREAM_EXIT 3
+#define LOOP_STREAMS 4
+
+//maximum number of events to process per wait
+#define LOOP_MAX_EVENTS 256
+//size of the buffer used for reading output
+#define LOOP_READ_BUFFER_SIZE (64 * 1024)
+//polling interval in milliseconds for processes for which no exit notification is available
+#define LOOP_EXIT_POLL_INTERVAL 10
+
+#ifdef CROSSRUN_LOOP_IO_URING
+//number of submission queue entries
+#define URING_SQ_ENTRIES 1024
+//number of completion queue entries (enough for a read on stdout and stderr and a poll for exit of thousands of processes)
+#define URING_CQ_ENTRIES 65536
+//number and size of the buffers provided to the kernel for reading output
+#define URING_READ_BUFFERS 256
+#define URING_READ_BUFFER_SIZE (16 * 1024)
+#define URING_READ_BUFFER_GROUP 1
+//operation types stored in the lower bits of the user data (slots are aligned to at least 8 bytes)
+#define URING_OP_READ 1
+#define URING_OP_POLL 2
+#define URING_OP_WRITE 3
+#define URING_OP_TIMEOUT 4
+#define URING_OP_MASK 7
+//user data for operations for which the completion is not processed
+#define URING_USERDATA_IGNORE 0
+//user data for a timeout (contains a sequence number instead of a slot)
+#define URING_USERDATA_TIMEOUT(seq) (((uint64_t)(seq) << 3) | URING_OP_TIMEOUT)
+#endif
+
+struct crossrun_loop_slot {
+  struct crossrun_loop_entry* entry;  //entry the slot belongs to
+  int stream;                         //stream as CROSSRUN_STREAM_* or LOOP_STREAM_EXIT
+  int fd;                             //file descriptor being watched (or -1)
+  int ownfd;                          //epoll: fd is a duplicate owned by the slot (for standard input and output sharing a socket)
+  int armed;                          //io_uring: read or poll operation is pending
+  int inflight;                       //io_uring: number of pending operations referring to this slot
+};
+
+struct crossrun_loop_entry {
+  struct crossrun_loop_struct* loop;
+  crossrun handle;
+  crossrun_loop_data_fn datafn;
+  crossrun_loop_writable_fn writablefn;
+  crossrun_loop_exit_fn exitfn;
+  void* callbackdata;
+  struct crossrun_loop_slot slot[LOOP_STREAMS];
+  int wantwrite;                      //writable callback was requested
+  char* writedata;                    //data queued by crossrun_loop_write()
+  size_t writedatalen;
+  size_t writedatasize;
+  size_t writedatapos;
+  char* writebusy;                    //io_uring: data being written by a pending write operation
+  size_t writebusylen;
+  size_t writebusysize;
+  size_t writebusypos;
+  int exited;                         //process exit was detected
+  int removed;                        //entry was removed and will be freed
+  int polling;                        //entry is in the list of processes to poll for exit
+  int buffered;                       //read-ahead buffer of the process held data when it was added
+  struct crossrun_loop_entry* prev;
+  struct crossrun_loop_entry* next;
+  struct crossrun_loop_entry* nextpending;
+};
+
+#ifdef CROSSRUN_LOOP_IO_URING
+struct crossrun_loop_uring {
+  int fd;
+  void* sqptr;
+  size_t sqlen;
+  void* cqptr;
+  size_t cqlen;
+  struct io_uring_sqe* sqes;
+  size_t sqeslen;
+  unsigned* sqhead;
+  unsigned* sqtail;
+  unsigned* sqmask;
+  unsigned* sqarray;
+  unsigned sqentries;
+  unsigned sqlocaltail;
+  unsigned* cqhead;
+  unsigned* cqtail;
+  unsigned* cqmask;
+  struct io_uring_cqe* cqes;
+  char* readbuffers;
+  struct __kernel_timespec timeout;
+  int timeoutpending;                   //number of timeouts posted that haven't completed yet
+  uint64_t timeoutseq;                  //sequence number of the last timeout posted
+  int timedout;                         //the timeout of the current wait expired
+  struct crossrun_loop_slot** starved;  //slots for which reading was stopped because no buffers were available
+  size_t starvedcount;
+  size_t starvedsize;
+};
+#endif
+
+struct crossrun_loop_struct {
+  int engine;
+  int epollfd;
+#ifdef CROSSRUN_LOOP_IO_URING
+  struct crossrun_loop_uring uring;
+#endif
+  size_t count;
+  struct crossrun_loop_entry* first;
+  struct crossrun_loop_entry* polllist;   //entries that need polling to detect process exit
+  struct crossrun_loop_entry* removedlist;  //entries removed but not freed yet
+  char* readbuf;
+  int processed;                          //number of events processed during current wait
+  size_t bufferedcount;                   //number of entries with data left in their read-ahead buffer
+};
+
+static void loop_slot_stop (struct crossrun_loop_struct* loop, struct crossrun_loop_slot* slot);
+static void loop_entry_remove (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry);
+static void loop_entry_check_finished (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry);
+
+////////////////////////////////////////////////////////////////////////
+// io_uring engine
+
+#ifdef CROSSRUN_LOOP_IO_URING
+
+static int uring_setup (struct crossrun_loop_uring* uring)
+{
+  struct io_uring_params params;
+  struct io_uring_probe* probe;
+  size_t probelen;
+  size_t i;
+  static const int required_ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_TIMEOUT, IORING_OP_TIMEOUT_REMOVE, IORING_OP_PROVIDE_BUFFERS};
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = URING_CQ_ENTRIES;
+  if ((uring->fd = syscall(SYS_io_uring_setup, URING_SQ_ENTRIES, &params)) < 0)
+    return -1;
+  //check if all needed operations are supported
+  probelen = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  if ((probe = (struct io_uring_probe*)calloc(1, probelen)) == NULL) {
+    close(uring->fd);
+    return -1;
+  }
+  if (syscall(SYS_io_uring_register, uring->fd, IORING_REGISTER_PROBE, probe, 256) < 0 || !(params.features & IORING_FEAT_NODROP)) {
+    free(probe);
+    close(uring->fd);
+    return -1;
+  }
+  for (i = 0; i < sizeof(required_ops) / sizeof(*required_ops); i++) {
+    if (required_ops[i] > probe->last_op || !(probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+      free(probe);
+      close(uring->fd);
+      return -1;
+    }
+  }
+  free(probe);
+  //map the rings
+  uring->sqlen = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  uring->cqlen = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    if (uring->cqlen > uring->sqlen)
+      uring->sqlen = uring->cqlen;
+    uring->cqlen = 0;
+  }
+  if ((uring->sqptr = mmap(NULL, uring->sqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING)) == MAP_FAILED) {
+    close(uring->fd);
+    return -1;
+  }
+  if (uring->cqlen == 0) {
+    uring->cqptr = uring->sqptr;
+  } else if ((uring->cqptr = mmap(NULL, uring->cqlen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING)) == MAP_FAILED) {
+    munmap(uring->sqptr, uring->sqlen);
+    close(uring->fd);
+    return -1;
+  }
+  uring->sqeslen = params.sq_entries * sizeof(struct io_uring_sqe);
+  if ((uring->sqes = (struct io_uring_sqe*)mmap(NULL, uring->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES)) == MAP_FAILED) {
+    if (uring->cqlen)
+      munmap(uring->cqptr, uring->cqlen);
+    munmap(uring->sqptr, uring->sqlen);
+    close(uring->fd);
+    return -1;
+  }
+  uring->sqhead = (unsigned*)((char*)uring->sqptr + params.sq_off.head);
+  uring->sqtail = (unsigned*)((char*)uring->sqptr + params.sq_off.tail);
+  uring->sqmask = (unsigned*)((char*)uring->sqptr + params.sq_off.ring_mask);
+  uring->sqarray = (unsigned*)((char*)uring->sqptr + params.sq_off.array);
+  uring->sqentries = params.sq_entries;
+  uring->sqlocaltail = *uring->sqtail;
+  uring->cqhead = (unsigned*)((char*)uring->cqptr + params.cq_off.head);
+  uring->cqtail = (unsigned*)((char*)uring->cqptr + params.cq_off.tail);
+  uring->cqmask = (unsigned*)((char*)uring->cqptr + params.cq_off.ring_mask);
+  uring->cqes = (struct io_uring_cqe*)((char*)uring->cqptr + params.cq_off.cqes);
+  uring->readbuffers = NULL;
+  uring->timeoutpending = 0;
+  uring->timeoutseq = 0;
+  uring->timedout = 0;
+  uring->starved = NULL;
+  uring->starvedcount = 0;
+  uring->starvedsize = 0;
+  return 0;
+}
+
+static void uring_cleanup (struct crossrun_loop_uring* uring)
+{
+  munmap(uring->sqes, uring->sqeslen);
+  if (uring->cqlen)
+    munmap(uring->cqptr, uring->cqlen);
+  munmap(uring->sqptr, uring->sqlen);
+  close(uring->fd);
+  free(uring->readbuffers);
+  free(uring->starved);
+}
+
+//submit queued operations and optionally wait for at least one completion
+static int uring_submit (struct crossrun_loop_uring* uring, int wait)
+{
+  int result;
+  unsigned tosubmit;
+  tosubmit = uring->sqlocaltail - *uring->sqtail;
+  __atomic_store_n(uring->sqtail, uring->sqlocaltail, __ATOMIC_RELEASE);
+  if (tosubmit == 0 && !wait)
+    return 0;
+  while ((result = syscall(SYS_io_uring_enter, uring->fd, tosubmit, (wait ? 1 : 0), (wait ? IORING_ENTER_GETEVENTS : 0), NULL, 0)) < 0 && errno == EINTR && !wait)
+    ;
+  if (result < 0 && errno != EINTR && errno != EBUSY && errno != ETIME)
+    return -1;
+  return 0;
+}
+
+//get a cleared submission queue entry (submitting queued entries first if the queue is full)
+static struct io_uring_sqe* uring_get_sqe (struct crossrun_loop_uring* uring, uint64_t userdata)
+{
+  unsigned index;
+  struct io_uring_sqe* sqe;
+  while (uring->sqlocaltail - __atomic_load_n(uring->sqhead, __ATOMIC_ACQUIRE) >= uring->sqentries) {
+    if (uring_submit(uring, 0) != 0)
+      return NULL;
+  }
+  index = uring->sqlocaltail & *uring->sqmask;
+  sqe = &uring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->user_data = userdata;
+  uring->sqarray[index] = index;
+  uring->sqlocaltail++;
+  return sqe;
+}
+
+static void uring_provide_buffers (struct crossrun_loop_uring* uring, unsigned bufferid, unsigned count)
+{
+  struct io_uring_sqe* sqe;
+  if ((sqe = uring_get_sqe(uring, URING_USERDATA_IGNORE)) == NULL)
+    return;
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr = (uint64_t)(uintptr_t)(uring->readbuffers + (size_t)bufferid * URING_READ_BUFFER_SIZE);
+  sqe->len = URING_READ_BUFFER_SIZE;
+  sqe->off = bufferid;
+  sqe->buf_group = URING_READ_BUFFER_GROUP;
+}
+
+static int uring_init_buffers (struct crossrun_loop_uring* uring)
+{
+  if ((uring->readbuffers = (char*)malloc((size_t)URING_READ_BUFFERS * URING_READ_BUFFER_SIZE)) == NULL)
+    return -1;
+  uring_provide_buffers(uring, 0, URING_READ_BUFFERS);
+  return uring_submit(uring, 0);
+}
+
+//post a read (for output) or a poll (for exit notification or writable standard input) for a slot
+static void uring_arm (struct crossrun_loop_struct* loop, struct crossrun_loop_slot* slot)
+{
+  struct io_uring_sqe* sqe;
+  if (slot->armed || slot->fd < 0)
+    return;
+  if (slot->stream == CROSSRUN_STREAM_STDOUT || slot->stream == CROSSRUN_STREAM_STDERR) {
+    if ((sqe = uring_get_sqe(&loop->uring, (uint64_t)(uintptr_t)slot | URING_OP_READ)) == NULL)
+      return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = slot->fd;
+    sqe->len = URING_READ_BUFFER_SIZE;
+    sqe->off = (uint64_t)-1;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_READ_BUFFER_GROUP;
+  } else {
+    if ((sqe = uring_get_sqe(&loop->uring, (uint64_t)(uintptr_t)slot | URING_OP_POLL)) == NULL)
+      return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = slot->fd;
+    sqe->poll32_events = (slot->stream == CROSSRUN_STREAM_STDIN ? POLLOUT : POLLIN);
+  }
+  slot->armed = 1;
+  slot->inflight++;
+}
+
+static void uring_disarm (struct crossrun_loop_struct* loop, struct crossrun_loop_slot* slot)
+{
+  struct io_uring_sqe* sqe;
+  if (!slot->armed)
+    return;
+  if ((sqe = uring_get_sqe(&loop->uring, URING_USERDATA_IGNORE)) == NULL)
+    return;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = (uint64_t)(uintptr_t)slot | (slot->stream == CROSSRUN_STREAM_STDOUT || slot->stream == CROSSRUN_STREAM_STDERR ? URING_OP_READ : URING_OP_POLL);
+  slot->armed = 0;
+}
+
+//get a submission queue entry for writing to the standard input of a shell process, optionally preceded by a poll so the write waits until the pipe is writable
+static struct io_uring_sqe* uring_get_write_sqe (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry, int waitwritable)
+{
+  struct io_uring_sqe* poll = NULL;
+  struct io_uring_sqe* sqe;
+  if (waitwritable) {
+    //make sure the poll and the write linked to it are submitted together
+    if (loop->uring.sqlocaltail - __atomic_load_n(loop->uring.sqhead, __ATOMIC_ACQUIRE) + 2 > loop->uring.sqentries && uring_submit(&loop->uring, 0) != 0)
+      return NULL;
+    if ((poll = uring_get_sqe(&loop->uring, URING_USERDATA_IGNORE)) == NULL)
+      return NULL;
+    poll->opcode = IORING_OP_POLL_ADD;
+    poll->fd = entry->handle->stdin_pipe[PIPE_WRITE];
+    poll->poll32_events = POLLOUT;
+    poll->flags = IOSQE_IO_LINK;
+  }
+  if ((sqe = uring_get_sqe(&loop->uring, (uint64_t)(uintptr_t)&entry->slot[CROSSRUN_STREAM_STDIN] | URING_OP_WRITE)) == NULL) {
+    if (poll)
+      poll->flags = 0;
+    return NULL;
+  }
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = entry->handle->stdin_pipe[PIPE_WRITE];
+  sqe->off = (uint64_t)-1;
+  return sqe;
+}
+
+//fill in the data still to be written from the buffer of the pending write
+static void uring_set_write_data (struct crossrun_loop_entry* entry, struct io_uring_sqe* sqe)
+{
+  sqe->addr = (uint64_t)(uintptr_t)(entry->writebusy + entry->writebusypos);
+  sqe->len = (entry->writebusylen - entry->writebusypos > 0x40000000 ? 0x40000000 : entry->writebusylen - entry->writebusypos);
+  entry->slot[CROSSRUN_STREAM_STDIN].inflight++;
+}
+
+//post a write of the data queued for the standard input of a shell process
+static void uring_start_write (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry)
+{
+  char* p;
+  size_t n;
+  struct io_uring_sqe* sqe;
+  if (entry->writebusylen > entry->writebusypos || entry->writedatalen == entry->writedatapos || entry->handle->stdin_pipe[PIPE_WRITE] < 0)
+    return;
+  //leave the data queued if the write can't be posted
+  if ((sqe = uring_get_write_sqe(loop, entry, 0)) == NULL)
+    return;
+  //swap the buffers so more data can be queued while the write is pending
+  p = entry->writebusy;
+  n = entry->writebusysize;
+  entry->writebusy = entry->writedata;
+  entry->writebusysize = entry->writedatasize;
+  entry->writebusylen = entry->writedatalen;
+  entry->writebusypos = entry->writedatapos;
+  entry->writedata = p;
+  entry->writedatasize = n;
+  entry->writedatalen = 0;
+  entry->writedatapos = 0;
+  uring_set_write_data(entry, sqe);
+}
+
+static void uring_process_completion (struct crossrun_loop_struct* loop, struct io_uring_cqe* cqe)
+{
+  int op;
+  struct crossrun_loop_slot* slot;
+  struct crossrun_loop_entry* entry;
+  if (cqe->user_data == URING_USERDATA_IGNORE)
+    return;
+  op = cqe->user_data & URING_OP_MASK;
+  if (op == URING_OP_TIMEOUT) {
+    //only expiry of the timeout of the current wait ends the wait, not the cancellation of an earlier one
+    loop->uring.timeoutpending--;
+    if (cqe->user_data == URING_USERDATA_TIMEOUT(loop->uring.timeoutseq) && cqe->res == -ETIME)
+      loop->uring.timedout = 1;
+    return;
+  }
+  slot = (struct crossrun_loop_slot*)(uintptr_t)(cqe->user_data & ~(uint64_t)URING_OP_MASK);
+  entry = slot->entry;
+  slot->inflight--;
+  switch (op) {
+    case URING_OP_READ:
+      slot->armed = 0;
+      if (cqe->res > 0) {
+        unsigned bufferid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        char* data = loop->uring.readbuffers + (size_t)bufferid * URING_READ_BUFFER_SIZE;
+        size_t datalen = cqe->res;
+        if (!entry->removed && slot->fd >= 0) {
+          loop->processed++;
+          crossrun_pipe_adapt(entry->handle, slot->stream, datalen, URING_READ_BUFFER_SIZE);
+          crossrun_checksum_update(entry->handle, slot->stream, data, datalen);
+          if (entry->handle->limit[slot->stream])
+            datalen = crossrun_limit_apply(entry->handle, slot->stream, data, datalen);
+          if (datalen > 0 && entry->datafn && (*entry->datafn)(entry->handle, slot->stream, data, datalen, entry->callbackdata) != 0)
+            loop_entry_remove(loop, entry);
+        }
+        uring_provide_buffers(&loop->uring, bufferid, 1);
+        if (!entry->removed && slot->fd >= 0)
+          uring_arm(loop, slot);
+      } else {
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+          uring_provide_buffers(&loop->uring, cqe->flags >> IORING_CQE_BUFFER_SHIFT, 1);
+        if (entry->removed || slot->fd < 0 || cqe->res == -ECANCELED)
+          break;
+        if (cqe->res == -ENOBUFS) {
+          //no buffers available, read again after buffers were returned
+          if (loop->uring.starvedcount == loop->uring.starvedsize) {
+            size_t newsize = (loop->uring.starvedsize ? loop->uring.starvedsize * 2 : 64);
+            struct crossrun_loop_slot** newstarved;
+            if ((newstarved = (struct crossrun_loop_slot**)realloc(loop->uring.starved, newsize * sizeof(struct crossrun_loop_slot*))) == NULL)
+              break;
+            loop->uring.starved = newstarved;
+            loop->uring.starvedsize = newsize;
+          }
+          slot->inflight++;
+          loop->uring.starved[loop->uring.starvedcount++] = slot;
+        } else if (cqe->res == -EINTR || cqe->res == -EAGAIN) {
+          uring_arm(loop, slot);
+        } else {
+          //end of file or error
+          loop->processed++;
+          slot->fd = -1;
+          loop_entry_check_finished(loop, entry);
+        }
+      }
+      break;
+    case URING_OP_POLL:
+      slot->armed = 0;
+      if (entry->removed || slot->fd < 0 || cqe->res == -ECANCELED)
+        break;
+      loop->processed++;
+      if (slot->stream == LOOP_STREAM_EXIT) {
+        if (crossrun_poll_exit(entry->handle)) {
+          entry->exited = 1;
+          close(slot->fd);
+          slot->fd = -1;
+          loop_entry_check_finished(loop, entry);
+        } else {
+          uring_arm(loop, slot);
+        }
+      } else {
+        if (cqe->res < 0 || (cqe->res & (POLLERR | POLLHUP))) {
+          //process closed its standard input
+          entry->wantwrite = 0;
+          slot->fd = -1;
+          if (entry->handle->wqueuelen > 0)
+            crossrun_write_queue_discard(entry->handle, 1);
+          break;
+        }
+        //write data queued with crossrun_write_queued() and call writable callback
+        crossrun_write_queue_process(entry->handle);
+        if (entry->wantwrite && !entry->removed && (!entry->writablefn || (*entry->writablefn)(entry->handle, entry->callbackdata) != 0))
+          entry->wantwrite = 0;
+        if ((entry->wantwrite || entry->handle->wqueuelen > 0) && !entry->removed && slot->fd >= 0)
+          uring_arm(loop, slot);
+        else
+          slot->fd = -1;
+      }
+      break;
+    case URING_OP_WRITE:
+      if (entry->removed || entry->handle->stdin_pipe[PIPE_WRITE] < 0) {
+        entry->writebusylen = 0;
+        entry->writebusypos = 0;
+        break;
+      }
+      if (cqe->res > 0)
+        entry->writebusypos += cqe->res;
+      if (entry->writebusypos < entry->writebusylen) {
+        struct io_uring_sqe* sqe = NULL;
+        if (cqe->res > 0) {
+          //write remaining data
+          sqe = uring_get_write_sqe(loop, entry, 0);
+        } else if (cqe->res == 0 || cqe->res == -EAGAIN || cqe->res == -EINTR) {
+          //write again once the pipe is writable
+          sqe = uring_get_write_sqe(loop, entry, 1);
+        }
+        if (sqe) {
+          uring_set_write_data(entry, sqe);
+          break;
+        }
+        //process closed its standard input or writing failed, drop all data queued for it
+        loop->processed++;
+        entry->writebusylen = 0;
+        entry->writebusypos = 0;
+        entry->writedatalen = 0;
+        entry->writedatapos = 0;
+        entry->wantwrite = 0;
+        if (entry->handle->wqueuelen > 0)
+          crossrun_write_queue_discard(entry->handle, 1);
+        loop_slot_stop(loop, slot);
+        break;
+      }
+      //done writing this buffer
+      entry->writebusylen = 0;
+      entry->writebusypos = 0;
+      uring_start_write(loop, entry);
+      break;
+  }
+}
+
+static int uring_wait (struct crossrun_loop_struct* loop, int timeout)
+{
+  unsigned head;
+  unsigned tail;
+  unsigned reaped;
+  size_t i;
+  struct io_uring_sqe* sqe;
+  struct crossrun_loop_slot** starved;
+  size_t starvedcount;
+  //remove timeout left over from previous wait
+  if (loop->uring.timeoutpending > 0) {
+    if ((sqe = uring_get_sqe(&loop->uring, URING_USERDATA_IGNORE)) != NULL) {
+      sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+      sqe->addr = URING_USERDATA_TIMEOUT(loop->uring.timeoutseq);
+    }
+  }
+  //set timeout
+  loop->uring.timedout = 0;
+  if (timeout > 0) {
+    if ((sqe = uring_get_sqe(&loop->uring, URING_USERDATA_TIMEOUT(loop->uring.timeoutseq + 1))) == NULL)
+      return -1;
+    loop->uring.timeoutseq++;
+    loop->uring.timeout.tv_sec = timeout / 1000;
+    loop->uring.timeout.tv_nsec = (long long)(timeout % 1000) * 1000000;
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (uint64_t)(uintptr_t)&loop->uring.timeout;
+    sqe->len = 1;
+    sqe->off = 0;
+    loop->uring.timeoutpending++;
+  }
+  //submit all queued operations in one system call and wait,
+  //keep waiting if only completions that aren't events arrived (like the cancellation of the previous timeout)
+  do {
+    if (uring_submit(&loop->uring, (timeout != 0)) != 0)
+      return -1;
+    //process completions
+    reaped = 0;
+    do {
+      head = *loop->uring.cqhead;
+      tail = __atomic_load_n(loop->uring.cqtail, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+        uring_process_completion(loop, &loop->uring.cqes[head & *loop->uring.cqmask]);
+        head++;
+        reaped++;
+        __atomic_store_n(loop->uring.cqhead, head, __ATOMIC_RELEASE);
+      }
+    } while (head != __atomic_load_n(loop->uring.cqtail, __ATOMIC_ACQUIRE));
+  } while (timeout != 0 && reaped > 0 && loop->processed == 0 && !loop->uring.timedout);
+  //read again for slots for which no buffers were available
+  starved = loop->uring.starved;
+  starvedcount = loop->uring.starvedcount;
+  loop->uring.starvedcount = 0;
+  for (i = 0; i < starvedcount; i++) {
+    starved[i]->inflight--;
+    if (!starved[i]->entry->removed && starved[i]->fd >= 0)
+      uring_arm(loop, starved[i]);
+  }
+  //submit operations queued while processing completions
+  return uring_submit(&loop->uring, 0);
+}
+
+#endif
+
+////////////////////////////////////////////////////////////////////////
+// engine independent functions
+
+static int loop_slot_start (struct crossrun_loop_struct* loop, struct crossrun_loop_slot* slot, int fd)
+{
+  if (fd < 0 || slot->fd >= 0)
+    return -1;
+#ifdef CROSSRUN_LOOP_IO_URING
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING) {
+    slot->fd = fd;
+    uring_arm(loop, slot);
+    return 0;
+  }
+#endif
+  struct epoll_event ev;
+  ev.events = (slot->stream == CROSSRUN_STREAM_STDIN ? EPOLLOUT : EPOLLIN);
+  ev.data.ptr = slot;
+  if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    //a file descriptor can only be added once, so standard input and output sharing a socket each need their own
+    if (errno != EEXIST || (fd = fcntl(fd, F_DUPFD_CLOEXEC, 3)) < 0)
+      return -1;
+    if (epoll_ctl(loop->epollfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      close(fd);
+      return -1;
+    }
+    slot->ownfd = 1;
+  }
+  slot->fd = fd;
+  return 0;
+}
+
+static void loop_slot_stop (struct crossrun_loop_struct* loop, struct crossrun_loop_slot* slot)
+{
+  if (slot->fd < 0)
+    return;
+#ifdef CROSSRUN_LOOP_IO_URING
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING)
+    uring_disarm(loop, slot);
+  else
+#endif
+  epoll_ctl(loop->epollfd, EPOLL_CTL_DEL, slot->fd, NULL);
+  if (slot->stream == LOOP_STREAM_EXIT || slot->ownfd)
+    close(slot->fd);
+  slot->fd = -1;
+  slot->ownfd = 0;
+}
+
+//check if the entry can be freed (no pending io_uring operations refer to it)
+static int loop_entry_idle (struct crossrun_loop_entry* entry)
+{
+  int i;
+  for (i = 0; i < LOOP_STREAMS; i++)
+    if (entry->slot[i].inflight > 0)
+      return 0;
+  return 1;
+}
+
+static void loop_entry_free (struct crossrun_loop_entry* entry)
+{
+  free(entry->writedata);
+  free(entry->writebusy);
+  free(entry);
+}
+
+static void loop_entry_remove (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry)
+{
+  int i;
+  if (entry->removed)
+    return;
+  for (i = 0; i < LOOP_STREAMS; i++)
+    loop_slot_stop(loop, &entry->slot[i]);
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    loop->first = entry->next;
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  if (entry->buffered) {
+    entry->buffered = 0;
+    loop->bufferedcount--;
+  }
+  entry->handle->loopentry = NULL;
+  entry->removed = 1;
+  loop->count--;
+  //entry is freed later as it may still be referenced by pending events
+  if (!entry->polling) {
+    entry->nextpending = loop->removedlist;
+    loop->removedlist = entry;
+  }
+}
+
+static void loop_entry_check_finished (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry)
+{
+  //wait until all output was read
+  if (entry->removed || entry->slot[CROSSRUN_STREAM_STDOUT].fd >= 0 || entry->slot[CROSSRUN_STREAM_STDERR].fd >= 0)
+    return;
+  //without exit notification poll for process exit
+  if (!entry->exited && entry->slot[LOOP_STREAM_EXIT].fd < 0) {
+    if (crossrun_poll_exit(entry->handle))
+      entry->exited = 1;
+    else if (!entry->polling) {
+      entry->polling = 1;
+      entry->nextpending = loop->polllist;
+      loop->polllist = entry;
+    }
+  }
+  if (!entry->exited)
+    return;
+  if (entry->exitfn)
+    (*entry->exitfn)(entry->handle, crossrun_get_exit_code(entry->handle), entry->callbackdata);
+  loop_entry_remove(loop, entry);
+}
+
+//update interest in standard input becoming writable (epoll only)
+static void loop_entry_update_write_interest (struct crossrun_loop_struct* loop, struct crossrun_loop_entry* entry)
+{
+  struct crossrun_loop_slot* slot = &entry->slot[CROSSRUN_STREAM_STDIN];
+  if (entry->wantwrite || entry->writedatapos < entry->writedatalen || entry->handle->wqueuelen > 0) {
+    if (slot->fd < 0)
+      loop_slot_start(loop, slot, entry->handle->stdin_pipe[PIPE_WRITE]);
+  } else {
+    loop_slot_stop(loop, slot);
+  }
+}
+
+static void epoll_process_event (struct crossrun_loop_struct* loop, struct crossrun_loop_slot* slot, uint32_t events)
+{
+  ssize_t n;
+  struct crossrun_loop_entry* entry = slot->entry;
+  if (entry->removed || slot->fd < 0)
+    return;
+  switch (slot->stream) {
+    case CROSSRUN_STREAM_STDIN:
+      if (events & (EPOLLERR | EPOLLHUP)) {
+        //process closed its standard input
+        entry->wantwrite = 0;
+        entry->writedatalen = 0;
+        entry->writedatapos = 0;
+        if (entry->handle->wqueuelen > 0)
+          crossrun_write_queue_discard(entry->handle, 1);
+      } else {
+        //write queued data
+        while (entry->writedatapos < entry->writedatalen) {
+          if ((n = write(slot->fd, entry->writedata + entry->writedatapos, entry->writedatalen - entry->writedatapos)) <= 0) {
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+              entry->writedatalen = 0;
+              entry->writedatapos = 0;
+            }
+            break;
+          }
+          if ((entry->writedatapos += n) == entry->writedatalen) {
+            entry->writedatalen = 0;
+            entry->writedatapos = 0;
+          }
+        }
+        //write data queued with crossrun_write_queued()
+        crossrun_write_queue_process(entry->handle);
+        //call writable callback
+        if (entry->wantwrite && !entry->removed && (!entry->writablefn || (*entry->writablefn)(entry->handle, entry->callbackdata) != 0))
+          entry->wantwrite = 0;
+      }
+      if (!entry->removed)
+        loop_entry_update_write_interest(loop, entry);
+      break;
+    case CROSSRUN_STREAM_STDOUT:
+    case CROSSRUN_STREAM_STDERR:
+      if ((n = read(slot->fd, loop->readbuf, LOOP_READ_BUFFER_SIZE)) > 0) {
+        crossrun_pipe_adapt(entry->handle, slot->stream, n, LOOP_READ_BUFFER_SIZE);
+        crossrun_checksum_update(entry->handle, slot->stream, loop->readbuf, n);
+        if (entry->handle->limit[slot->stream])
+          n = (ssize_t)crossrun_limit_apply(entry->handle, slot->stream, loop->readbuf, n);
+        if (n > 0 && entry->datafn && (*entry->datafn)(entry->handle, slot->stream, loop->readbuf, n, entry->callbackdata) != 0)
+          loop_entry_remove(loop, entry);
+      } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        //end of file or error
+        loop_slot_stop(loop, slot);
+        loop_entry_check_finished(loop, entry);
+      }
+      break;
+    case LOOP_STREAM_EXIT:
+      if (crossrun_poll_exit(entry->handle)) {
+        entry->exited = 1;
+        loop_slot_stop(loop, slot);
+        loop_entry_check_finished(loop, entry);
+      }
+      break;
+  }
+}
+
+static int epoll_wait_events (struct crossrun_loop_struct* loop, int timeout)
+{
+  int i;
+  int n;
+  struct epoll_event events[LOOP_MAX_EVENTS];
+  if ((n = epoll_wait(loop->epollfd, events, LOOP_MAX_EVENTS, timeout)) < 0) {
+    if (errno != EINTR)
+      return -1;
+    n = 0;
+  }
+  for (i = 0; i < n; i++)
+    epoll_process_event(loop, (struct crossrun_loop_slot*)events[i].data.ptr, events[i].events);
+  loop->processed += n;
+  return 0;
+}
+
+#endif
+
+DLL_EXPORT_CROSSRUN crossrun_loop crossrun_loop_create ()
+{
+  return crossrun_loop_create_with_engine(CROSSRUN_LOOP_ENGINE_EPOLL);
+}
+
+DLL_EXPORT_CROSSRUN crossrun_loop crossrun_loop_create_with_engine (int engine)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  struct crossrun_loop_struct* loop;
+  if ((loop = (struct crossrun_loop_struct*)malloc(sizeof(struct crossrun_loop_struct))) == NULL)
+    return NULL;
+  loop->engine = CROSSRUN_LOOP_ENGINE_EPOLL;
+  loop->epollfd = -1;
+  loop->readbuf = NULL;
+#ifdef CROSSRUN_LOOP_IO_URING
+  //use io_uring if requested and supported by the kernel, otherwise fall back to epoll
+  if (engine == CROSSRUN_LOOP_ENGINE_IO_URING && uring_setup(&loop->uring) == 0) {
+    if (uring_init_buffers(&loop->uring) == 0)
+      loop->engine = CROSSRUN_LOOP_ENGINE_IO_URING;
+    else
+      uring_cleanup(&loop->uring);
+  }
+#endif
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_EPOLL) {
+    if ((loop->readbuf = (char*)malloc(LOOP_READ_BUFFER_SIZE)) == NULL) {
+      free(loop);
+      return NULL;
+    }
+    if ((loop->epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+      free(loop->readbuf);
+      free(loop);
+      return NULL;
+    }
+  }
+  loop->count = 0;
+  loop->first = NULL;
+  loop->polllist = NULL;
+  loop->removedlist = NULL;
+  loop->bufferedcount = 0;
+  loop->processed = 0;
+  return loop;
+#else
+  return NULL;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_get_engine (crossrun_loop loop)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  if (!loop)
+    return -1;
+  return loop->engine;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_loop_free (crossrun_loop loop)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  struct crossrun_loop_entry* entry;
+  if (!loop)
+    return;
+  while (loop->first)
+    loop_entry_remove(loop, loop->first);
+  while ((entry = loop->polllist) != NULL) {
+    loop->polllist = entry->nextpending;
+    loop_entry_free(entry);
+  }
+#ifdef CROSSRUN_LOOP_IO_URING
+  //closing the io_uring instance cancels all pending operations
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING)
+    uring_cleanup(&loop->uring);
+#endif
+  while ((entry = loop->removedlist) != NULL) {
+    loop->removedlist = entry->nextpending;
+    loop_entry_free(entry);
+  }
+  if (loop->epollfd >= 0)
+    close(loop->epollfd);
+  free(loop->readbuf);
+  free(loop);
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_add (crossrun_loop loop, crossrun handle, crossrun_loop_data_fn datafn, crossrun_loop_writable_fn writablefn, crossrun_loop_exit_fn exitfn, void* callbackdata)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  int i;
+  struct crossrun_loop_entry* entry;
+  if (!loop || !handle || handle->loopentry)
+    return -1;
+  if ((entry = (struct crossrun_loop_entry*)malloc(sizeof(struct crossrun_loop_entry))) == NULL)
+    return -1;
+  memset(entry, 0, sizeof(struct crossrun_loop_entry));
+  entry->loop = loop;
+  entry->handle = handle;
+  entry->datafn = datafn;
+  entry->writablefn = writablefn;
+  entry->exitfn = exitfn;
+  entry->callbackdata = callbackdata;
+  for (i = 0; i < LOOP_STREAMS; i++) {
+    entry->slot[i].entry = entry;
+    entry->slot[i].stream = i;
+    entry->slot[i].fd = -1;
+    entry->slot[i].ownfd = 0;
+  }
+  entry->exited = handle->exited;
+  //register output
+  if (handle->stdout_pipe[PIPE_READ] >= 0 && loop_slot_start(loop, &entry->slot[CROSSRUN_STREAM_STDOUT], handle->stdout_pipe[PIPE_READ]) != 0) {
+    free(entry);
+    return -1;
+  }
+  if (handle->stderr_pipe[PIPE_READ] >= 0 && loop_slot_start(loop, &entry->slot[CROSSRUN_STREAM_STDERR], handle->stderr_pipe[PIPE_READ]) != 0) {
+    loop_slot_stop(loop, &entry->slot[CROSSRUN_STREAM_STDOUT]);
+    free(entry);
+    return -1;
+  }
+  //register exit notification (not available before Linux 5.3, in which case the process will be polled after its output is closed)
+#ifdef SYS_pidfd_open
+  if (!entry->exited) {
+    int pidfd;
+    if ((pidfd = syscall(SYS_pidfd_open, handle->pid, 0)) >= 0) {
+      fcntl(pidfd, F_SETFD, FD_CLOEXEC);
+      if (loop_slot_start(loop, &entry->slot[LOOP_STREAM_EXIT], pidfd) != 0)
+        close(pidfd);
+    }
+  }
+#endif
+  //insert in list
+  entry->prev = NULL;
+  if ((entry->next = loop->first) != NULL)
+    entry->next->prev = entry;
+  loop->first = entry;
+  loop->count++;
+  handle->loopentry = entry;
+  //output already read into the read-ahead buffer will be passed on the next wait
+  if (handle->readbuf && handle->readbuflen > 0) {
+    entry->buffered = 1;
+    loop->bufferedcount++;
+  }
+  //data queued with crossrun_write_queued() will be written when the pipe becomes writable
+  if (handle->wqueuelen > 0)
+    crossrun_loop_notify_write(handle);
+  //check if the process has already finished
+  loop_entry_check_finished(loop, entry);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_remove (crossrun_loop loop, crossrun handle)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  if (!loop || !handle || !handle->loopentry || handle->loopentry->loop != loop)
+    return -1;
+  loop_entry_remove(loop, handle->loopentry);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_want_write (crossrun_loop loop, crossrun handle, int enable)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  struct crossrun_loop_entry* entry;
+  if (!loop || !handle || (entry = handle->loopentry) == NULL || entry->loop != loop)
+    return -1;
+  if (enable && handle->stdin_pipe[PIPE_WRITE] < 0)
+    return -1;
+  entry->wantwrite = (enable ? 1 : 0);
+#ifdef CROSSRUN_LOOP_IO_URING
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING) {
+    if (enable)
+      loop_slot_start(loop, &entry->slot[CROSSRUN_STREAM_STDIN], handle->stdin_pipe[PIPE_WRITE]);
+    else
+      loop_slot_stop(loop, &entry->slot[CROSSRUN_STREAM_STDIN]);
+    return 0;
+  }
+#endif
+  loop_entry_update_write_interest(loop, entry);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_write (crossrun_loop loop, crossrun handle, const char* data, size_t datalen)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  struct crossrun_loop_entry* entry;
+  if (!loop || !handle || (entry = handle->loopentry) == NULL || entry->loop != loop || handle->stdin_pipe[PIPE_WRITE] < 0)
+    return -1;
+  if (datalen == 0)
+    return 0;
+  //compact or grow the buffer
+  if (entry->writedatapos > 0) {
+    memmove(entry->writedata, entry->writedata + entry->writedatapos, entry->writedatalen - entry->writedatapos);
+    entry->writedatalen -= entry->writedatapos;
+    entry->writedatapos = 0;
+  }
+  if (entry->writedatalen + datalen > entry->writedatasize) {
+    char* newdata;
+    size_t newsize = (entry->writedatasize ? entry->writedatasize : 4096);
+    while (newsize < entry->writedatalen + datalen)
+      newsize *= 2;
+    if ((newdata = (char*)realloc(entry->writedata, newsize)) == NULL)
+      return -1;
+    entry->writedata = newdata;
+    entry->writedatasize = newsize;
+  }
+  memcpy(entry->writedata + entry->writedatalen, data, datalen);
+  entry->writedatalen += datalen;
+  //make sure writing never blocks the event loop
+  fcntl(handle->stdin_pipe[PIPE_WRITE], F_SETFL, fcntl(handle->stdin_pipe[PIPE_WRITE], F_GETFL) | O_NONBLOCK);
+#ifdef CROSSRUN_LOOP_IO_URING
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING) {
+    uring_start_write(loop, entry);
+    return 0;
+  }
+#endif
+  loop_entry_update_write_interest(loop, entry);
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_loop_count (crossrun_loop loop)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  if (!loop)
+    return 0;
+  return loop->count;
+#else
+  return 0;
+#endif
+}
+
+//pass data from the read-ahead buffer of a shell process to the data callback function
+static int loop_buffered_data (int stream, const char* data, size_t datalen, void* callbackdata)
+{
+  struct crossrun_loop_entry* entry = (struct crossrun_loop_entry*)callbackdata;
+  if (!entry->datafn)
+    return 0;
+  return (*entry->datafn)(entry->handle, stream, data, datalen, entry->callbackdata);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_run_once (crossrun_loop loop, int timeout)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  int result;
+  struct crossrun_loop_entry* entry;
+  struct crossrun_loop_entry* polllist;
+  struct crossrun_loop_entry** current;
+  if (!loop)
+    return -1;
+  if (loop->count == 0)
+    return 0;
+  //don't wait too long if there are processes to poll for exit
+  if (loop->polllist && (timeout < 0 || timeout > LOOP_EXIT_POLL_INTERVAL))
+    timeout = LOOP_EXIT_POLL_INTERVAL;
+  //pass output that was already read into read-ahead buffers and don't wait in that case
+  loop->processed = 0;
+  if (loop->bufferedcount > 0) {
+    for (entry = loop->first; entry; entry = entry->next) {
+      if (entry->buffered) {
+        entry->buffered = 0;
+        loop->bufferedcount--;
+        loop->processed++;
+        if (crossrun_readbuf_flush(entry->handle, loop_buffered_data, entry) != 0)
+          loop_entry_remove(loop, entry);
+      }
+    }
+    timeout = 0;
+  }
+  //wait for and process events
+#ifdef CROSSRUN_LOOP_IO_URING
+  if (loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING)
+    result = uring_wait(loop, timeout);
+  else
+#endif
+  result = epoll_wait_events(loop, timeout);
+  if (result != 0)
+    return -1;
+  //poll processes without exit notification
+  polllist = loop->polllist;
+  loop->polllist = NULL;
+  while ((entry = polllist) != NULL) {
+    polllist = entry->nextpending;
+    entry->polling = 0;
+    if (entry->removed) {
+      entry->nextpending = loop->removedlist;
+      loop->removedlist = entry;
+      continue;
+    }
+    loop_entry_check_finished(loop, entry);
+    if (entry->exited)
+      loop->processed++;
+  }
+  //free removed entries no longer referenced by pending operations
+  current = &loop->removedlist;
+  while ((entry = *current) != NULL) {
+    if (loop_entry_idle(entry)) {
+      *current = entry->nextpending;
+      loop_entry_free(entry);
+    } else {
+      current = &entry->nextpending;
+    }
+  }
+  return loop->processed;
+#else
+  return -1;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_loop_run (crossrun_loop loop)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  if (!loop)
+    return -1;
+  while (loop->count > 0) {
+    if (crossrun_loop_run_once(loop, -1) < 0)
+      return -1;
+  }
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+void crossrun_loop_notify_write (crossrun handle)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  struct crossrun_loop_entry* entry;
+  if ((entry = handle->loopentry) == NULL || entry->removed)
+    return;
+#ifdef CROSSRUN_LOOP_IO_URING
+  if (entry->loop->engine == CROSSRUN_LOOP_ENGINE_IO_URING) {
+    loop_slot_start(entry->loop, &entry->slot[CROSSRUN_STREAM_STDIN], handle->stdin_pipe[PIPE_WRITE]);
+    return;
+  }
+#endif
+  loop_entry_update_write_interest(entry->loop, entry);
+#endif
+}
+
+void crossrun_loop_notify_close (crossrun handle, int stream)
+{
+#ifdef CROSSRUN_LOOP_SUPPORTED
+  struct crossrun_loop_entry* entry;
+  if ((entry = handle->loopentry) == NULL)
+    return;
+  if (stream < 0) {
+    loop_entry_remove(entry->loop, entry);
+    return;
+  }
+  loop_slot_stop(entry->loop, &entry->slot[stream]);
+  if (stream == CROSSRUN_STREAM_STDIN) {
+    entry->wantwrite = 0;
+    entry->writedatalen = 0;
+    entry->writedatapos = 0;
+  } else {
+    loop_entry_check_finished(entry->loop, entry);
+  }
+#endif
+}
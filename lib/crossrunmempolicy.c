@@ -0,0 +1,110 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossrunpriv.h"
+#include "crossruntopology.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
+
+#define NODEMASK_BITS (8 * sizeof(unsigned long))
+
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+//topology of the system, read once when first needed
+static crossrun_topology system_topology = NULL;
+
+static crossrun_topology get_system_topology ()
+{
+  crossrun_topology topology;
+  if (!system_topology && (topology = crossrun_topology_create()) != NULL) {
+    if (!__sync_bool_compare_and_swap(&system_topology, NULL, topology))
+      crossrun_topology_free(topology);
+  }
+  return system_topology;
+}
+
+//add the NUMA nodes of the logical processors in a mask to the memory policy
+static void add_affinity_nodes (struct crossrun_mempolicy* mempolicy, crossrun_cpumask affinity)
+{
+  int i;
+  int id;
+  int count;
+  int* domains;
+  crossrun_topology topology;
+  crossrun_cpumask current = NULL;
+  //nothing to choose from on systems with only one node
+  if ((topology = get_system_topology()) == NULL || crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE) <= 1)
+    return;
+  if (!affinity) {
+    if ((current = crossrun_cpumask_create()) == NULL || crossrun_get_current_affinity(current) != 0) {
+      crossrun_cpumask_free(current);
+      return;
+    }
+    affinity = current;
+  }
+  if ((domains = (int*)malloc(crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE) * sizeof(int))) != NULL) {
+    count = crossrun_topology_get_domains(topology, CROSSRUN_TOPOLOGY_NODE, affinity, domains, crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE));
+    for (i = 0; i < count; i++) {
+      if ((id = crossrun_topology_get_domain_id(topology, CROSSRUN_TOPOLOGY_NODE, domains[i])) >= 0 && id < CROSSRUN_MEMPOLICY_MAX_NODES)
+        mempolicy->nodemask[id / NODEMASK_BITS] |= 1UL << (id % NODEMASK_BITS);
+    }
+    free(domains);
+  }
+  crossrun_cpumask_free(current);
+}
+#endif
+
+int crossrun_mempolicy_prepare (struct crossrun_mempolicy* mempolicy, crossrun_options options, crossrun_cpumask affinity)
+{
+  mempolicy->mode = -1;
+  memset(mempolicy->nodemask, 0, sizeof(mempolicy->nodemask));
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  size_t i;
+  int empty = 1;
+  if (!options || options->mempolicy == CROSSRUN_MEMPOLICY_DEFAULT)
+    return -1;
+  if (options->mempolicynodes) {
+    for (i = 0; i < options->mempolicynodecount; i++) {
+      if (options->mempolicynodes[i] >= 0 && options->mempolicynodes[i] < CROSSRUN_MEMPOLICY_MAX_NODES)
+        mempolicy->nodemask[options->mempolicynodes[i] / NODEMASK_BITS] |= 1UL << (options->mempolicynodes[i] % NODEMASK_BITS);
+    }
+  } else {
+    add_affinity_nodes(mempolicy, affinity);
+  }
+  for (i = 0; i < sizeof(mempolicy->nodemask) / sizeof(mempolicy->nodemask[0]); i++)
+    if (mempolicy->nodemask[i])
+      empty = 0;
+  if (empty)
+    return -1;
+  switch (options->mempolicy) {
+    case CROSSRUN_MEMPOLICY_BIND:
+      mempolicy->mode = MPOL_BIND;
+      break;
+    case CROSSRUN_MEMPOLICY_PREFERRED:
+      mempolicy->mode = MPOL_PREFERRED;
+      break;
+    case CROSSRUN_MEMPOLICY_INTERLEAVE:
+      mempolicy->mode = MPOL_INTERLEAVE;
+      break;
+    default:
+      return -1;
+  }
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+void crossrun_mempolicy_apply (const struct crossrun_mempolicy* mempolicy)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+  if (mempolicy->mode < 0)
+    return;
+  //the system ignores the last bit of the mask
+  syscall(SYS_set_mempolicy, mempolicy->mode, mempolicy->nodemask, (unsigned long)CROSSRUN_MEMPOLICY_MAX_NODES + 1);
+#endif
+}
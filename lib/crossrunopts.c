@@ -0,0 +1,166 @@
+#include "crossrunpriv.h"
+#include <stdlib.h>
+#include <string.h>
+
+DLL_EXPORT_CROSSRUN crossrun_options crossrun_options_create ()
+{
+  int i;
+  struct crossrun_options_struct* options;
+  if ((options = (struct crossrun_options_struct*)malloc(sizeof(struct crossrun_options_struct))) == NULL)
+    return NULL;
+  for (i = 0; i < 3; i++) {
+    options->stdio[i].mode = CROSSRUN_STDIO_PIPE;
+    options->stdio[i].fd = -1;
+    options->stdio[i].path = NULL;
+    options->stdio[i].flags = 0;
+  }
+  options->stdio[CROSSRUN_STREAM_STDERR].mode = CROSSRUN_STDIO_MERGE;
+  options->readbufsize = 0;
+  options->pipesize = 0;
+  options->pipemaxsize = 0;
+  options->pty = 0;
+  options->ptyrows = 0;
+  options->ptycolumns = 0;
+  options->channelfd = -1;
+  options->checksum = 0;
+  options->socketpair = 0;
+  options->socketbufsize = 0;
+  options->mempolicy = CROSSRUN_MEMPOLICY_DEFAULT;
+  options->mempolicynodes = NULL;
+  options->mempolicynodecount = 0;
+  return options;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_options_free (crossrun_options options)
+{
+  int i;
+  if (!options)
+    return;
+  for (i = 0; i < 3; i++)
+    free(options->stdio[i].path);
+  free(options->mempolicynodes);
+  free(options);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stderr (crossrun_options options, int mode)
+{
+  switch (mode) {
+    case CROSSRUN_STDERR_MERGE:
+      return crossrun_options_set_stdio(options, CROSSRUN_STREAM_STDERR, CROSSRUN_STDIO_MERGE);
+    case CROSSRUN_STDERR_PIPE:
+      return crossrun_options_set_stdio(options, CROSSRUN_STREAM_STDERR, CROSSRUN_STDIO_PIPE);
+    case CROSSRUN_STDERR_DISCARD:
+      return crossrun_options_set_stdio(options, CROSSRUN_STREAM_STDERR, CROSSRUN_STDIO_NULL);
+  }
+  return -1;
+}
+
+//set how a standard stream is connected, releasing settings for the previous mode
+static int set_stdio (crossrun_options options, int stream, int mode, int fd, const char* path, int flags)
+{
+  char* s = NULL;
+  if (!options || stream < CROSSRUN_STREAM_STDIN || stream > CROSSRUN_STREAM_STDERR)
+    return -1;
+  if (path && (s = strdup(path)) == NULL)
+    return -1;
+  free(options->stdio[stream].path);
+  options->stdio[stream].mode = mode;
+  options->stdio[stream].fd = fd;
+  options->stdio[stream].path = s;
+  options->stdio[stream].flags = flags;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stdio (crossrun_options options, int stream, int mode)
+{
+  if (mode != CROSSRUN_STDIO_PIPE && mode != CROSSRUN_STDIO_INHERIT && mode != CROSSRUN_STDIO_NULL && !(mode == CROSSRUN_STDIO_MERGE && stream == CROSSRUN_STREAM_STDERR))
+    return -1;
+  return set_stdio(options, stream, mode, -1, NULL, 0);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stdio_fd (crossrun_options options, int stream, int fd)
+{
+  if (fd < 0)
+    return -1;
+  return set_stdio(options, stream, CROSSRUN_STDIO_FD, fd, NULL, 0);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_stdio_file (crossrun_options options, int stream, const char* path, int flags)
+{
+  if (!path || !*path)
+    return -1;
+  return set_stdio(options, stream, CROSSRUN_STDIO_FILE, -1, path, flags);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_read_buffer (crossrun_options options, size_t size)
+{
+  if (!options)
+    return -1;
+  options->readbufsize = size;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_pipe_size (crossrun_options options, size_t size, size_t maxsize)
+{
+  if (!options || (maxsize > 0 && maxsize < size))
+    return -1;
+  options->pipesize = size;
+  options->pipemaxsize = maxsize;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_socketpair (crossrun_options options, int enable, size_t bufsize)
+{
+#ifdef _WIN32
+  return -1;
+#else
+  if (!options)
+    return -1;
+  options->socketpair = (enable ? 1 : 0);
+  options->socketbufsize = bufsize;
+  return 0;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_checksum (crossrun_options options, int enable)
+{
+  if (!options)
+    return -1;
+  options->checksum = (enable ? 1 : 0);
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_pty (crossrun_options options, int enable, unsigned short rows, unsigned short columns)
+{
+#ifdef _WIN32
+  return -1;
+#else
+  if (!options)
+    return -1;
+  options->pty = (enable ? 1 : 0);
+  options->ptyrows = (rows ? rows : 24);
+  options->ptycolumns = (columns ? columns : 80);
+  return 0;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_options_set_mempolicy (crossrun_options options, int mode, const int* nodes, size_t nodecount)
+{
+#ifdef __linux__
+  int* p = NULL;
+  if (!options || mode < CROSSRUN_MEMPOLICY_DEFAULT || mode > CROSSRUN_MEMPOLICY_INTERLEAVE)
+    return -1;
+  if (nodes && nodecount > 0) {
+    if ((p = (int*)malloc(nodecount * sizeof(int))) == NULL)
+      return -1;
+    memcpy(p, nodes, nodecount * sizeof(int));
+  }
+  free(options->mempolicynodes);
+  options->mempolicy = mode;
+  options->mempolicynodes = p;
+  options->mempolicynodecount = (p ? nodecount : 0);
+  return 0;
+#else
+  return -1;
+#endif
+}
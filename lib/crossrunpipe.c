@@ -0,0 +1,142 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossrunpriv.h"
+#include <stdio.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#endif
+
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+#define PIPE_RESIZE_SUPPORTED
+#endif
+
+//number of consecutive reads finding a pipe full before its size is doubled
+#define PIPE_ADAPT_THRESHOLD 4
+
+#ifdef PIPE_RESIZE_SUPPORTED
+//get the maximum pipe size allowed for unprivileged processes
+static size_t pipe_max_size ()
+{
+  static size_t maxsize = 0;
+  FILE* src;
+  unsigned long n;
+  if (maxsize == 0) {
+    maxsize = 1024 * 1024;
+    if ((src = fopen("/proc/sys/fs/pipe-max-size", "r")) != NULL) {
+      if (fscanf(src, "%lu", &n) == 1 && n > 0)
+        maxsize = n;
+      fclose(src);
+    }
+  }
+  return maxsize;
+}
+
+//get the file descriptor of the end of a pipe used by the calling process
+static int pipe_fd (crossrun handle, int stream)
+{
+  switch (stream) {
+    case CROSSRUN_STREAM_STDIN:
+      return handle->stdin_pipe[PIPE_WRITE];
+    case CROSSRUN_STREAM_STDOUT:
+      return handle->stdout_pipe[PIPE_READ];
+    case CROSSRUN_STREAM_STDERR:
+      return handle->stderr_pipe[PIPE_READ];
+  }
+  return -1;
+}
+#endif
+
+size_t crossrun_pipe_resize (int fd, size_t size)
+{
+#ifdef PIPE_RESIZE_SUPPORTED
+  int n;
+  if (size > pipe_max_size())
+    size = pipe_max_size();
+  //the kernel rounds the size up to a power of 2 pages and refuses to shrink below the data currently in the pipe
+  if ((n = fcntl(fd, F_SETPIPE_SZ, (int)size)) < 0)
+    return 0;
+  return (size_t)n;
+#else
+  return 0;
+#endif
+}
+
+void crossrun_pipe_setup (crossrun handle, size_t size, size_t maxsize)
+{
+#ifdef PIPE_RESIZE_SUPPORTED
+  int i;
+  int fd;
+  size_t n;
+  handle->pipemaxsize = (maxsize > pipe_max_size() ? pipe_max_size() : maxsize);
+  for (i = CROSSRUN_STREAM_STDIN; i <= CROSSRUN_STREAM_STDERR; i++) {
+    handle->pipesize[i] = 0;
+    handle->pipefull[i] = 0;
+    if ((fd = pipe_fd(handle, i)) < 0)
+      continue;
+    if (size > 0 && (n = crossrun_pipe_resize(fd, size)) > 0)
+      handle->pipesize[i] = n;
+    else if (handle->pipemaxsize > 0 && (int)(n = fcntl(fd, F_GETPIPE_SZ)) > 0)
+      handle->pipesize[i] = n;
+  }
+#endif
+}
+
+void crossrun_pipe_adapt (crossrun handle, int stream, size_t n, size_t buflen)
+{
+#ifdef PIPE_RESIZE_SUPPORTED
+  int fd;
+  int waiting;
+  size_t newsize;
+  if (handle->pipemaxsize <= handle->pipesize[stream])
+    return;
+  //the pipe was full if the read emptied a full pipe or filled the buffer while the rest of a full pipe is still waiting
+  if (n < handle->pipesize[stream]) {
+    if (n < buflen || (fd = pipe_fd(handle, stream)) < 0 || ioctl(fd, FIONREAD, &waiting) < 0 || n + waiting < handle->pipesize[stream]) {
+      handle->pipefull[stream] = 0;
+      return;
+    }
+  }
+  if (++handle->pipefull[stream] < PIPE_ADAPT_THRESHOLD)
+    return;
+  //grow the pipe
+  handle->pipefull[stream] = 0;
+  if ((newsize = handle->pipesize[stream] * 2) > handle->pipemaxsize)
+    newsize = handle->pipemaxsize;
+  if ((fd = pipe_fd(handle, stream)) < 0 || (newsize = crossrun_pipe_resize(fd, newsize)) <= handle->pipesize[stream]) {
+    //stop trying if the pipe can't grow (for example when the limit on pipe memory per user was reached)
+    handle->pipesize[stream] = handle->pipemaxsize;
+    return;
+  }
+  handle->pipesize[stream] = newsize;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_get_pipe_size (crossrun handle, int stream)
+{
+#ifdef PIPE_RESIZE_SUPPORTED
+  int fd;
+  int n;
+  if ((fd = pipe_fd(handle, stream)) < 0 || (n = fcntl(fd, F_GETPIPE_SZ)) < 0)
+    return 0;
+  return (size_t)n;
+#else
+  return 0;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_set_pipe_size (crossrun handle, int stream, size_t size)
+{
+#ifdef PIPE_RESIZE_SUPPORTED
+  int fd;
+  size_t n;
+  if ((fd = pipe_fd(handle, stream)) < 0 || (n = crossrun_pipe_resize(fd, size)) == 0)
+    return 0;
+  handle->pipesize[stream] = n;
+  handle->pipefull[stream] = 0;
+  return n;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,174 @@
+#include "crossrunpipeline.h"
+#include "crossrunpriv.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+struct crossrun_pipeline_struct {
+  int count;                      //number of shell processes
+  crossrun* stages;               //shell process handles
+};
+
+//copy how a standard stream is connected
+static int copy_stdio (crossrun_options dst, crossrun_options src, int stream)
+{
+  switch (src->stdio[stream].mode) {
+    case CROSSRUN_STDIO_FD:
+      return crossrun_options_set_stdio_fd(dst, stream, src->stdio[stream].fd);
+    case CROSSRUN_STDIO_FILE:
+      return crossrun_options_set_stdio_file(dst, stream, src->stdio[stream].path, src->stdio[stream].flags);
+  }
+  return crossrun_options_set_stdio(dst, stream, src->stdio[stream].mode);
+}
+
+//create a pipe that is not inherited
+static int create_pipe (int* fds)
+{
+#ifdef _WIN32
+  return _pipe(fds, 0, _O_BINARY | _O_NOINHERIT);
+#else
+  if (pipe(fds) != 0)
+    return -1;
+  fcntl(fds[PIPE_READ], F_SETFD, FD_CLOEXEC);
+  fcntl(fds[PIPE_WRITE], F_SETFD, FD_CLOEXEC);
+  return 0;
+#endif
+}
+
+static void close_pipe_fd (int* fd)
+{
+  if (*fd >= 0) {
+#ifdef _WIN32
+    _close(*fd);
+#else
+    close(*fd);
+#endif
+    *fd = -1;
+  }
+}
+
+DLL_EXPORT_CROSSRUN crossrun_pipeline crossrun_pipeline_open (const char** commands, int count, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options)
+{
+  int i;
+  int error = 0;
+  int prevread = -1;
+  int fds[2];
+  crossrun_options stageoptions = NULL;
+  struct crossrun_pipeline_struct* pipeline;
+  if (!commands || count <= 0)
+    return NULL;
+  //the processes of a pipeline are connected with pipes
+  if (options && (options->socketpair || options->pty))
+    return NULL;
+  if ((pipeline = (struct crossrun_pipeline_struct*)malloc(sizeof(struct crossrun_pipeline_struct))) == NULL)
+    return NULL;
+  pipeline->count = 0;
+  if ((pipeline->stages = (crossrun*)malloc(count * sizeof(crossrun))) == NULL) {
+    free(pipeline);
+    return NULL;
+  }
+  for (i = 0; i < count && !error; i++) {
+    fds[PIPE_READ] = fds[PIPE_WRITE] = -1;
+    if ((stageoptions = crossrun_options_create()) == NULL) {
+      error = 1;
+      break;
+    }
+    if (options) {
+      stageoptions->readbufsize = options->readbufsize;
+      stageoptions->pipesize = options->pipesize;
+      stageoptions->pipemaxsize = options->pipemaxsize;
+      stageoptions->checksum = options->checksum;
+      if (options->mempolicy != CROSSRUN_MEMPOLICY_DEFAULT)
+        error |= crossrun_options_set_mempolicy(stageoptions, options->mempolicy, options->mempolicynodes, options->mempolicynodecount);
+      if (options->stdio[CROSSRUN_STREAM_STDERR].mode != CROSSRUN_STDIO_MERGE)
+        error |= copy_stdio(stageoptions, options, CROSSRUN_STREAM_STDERR);
+      else if (i < count - 1)
+        error |= crossrun_options_set_stdio(stageoptions, CROSSRUN_STREAM_STDERR, CROSSRUN_STDIO_INHERIT);
+    } else if (i < count - 1) {
+      error |= crossrun_options_set_stdio(stageoptions, CROSSRUN_STREAM_STDERR, CROSSRUN_STDIO_INHERIT);
+    }
+    //read from the previous process or as requested for the first process
+    if (prevread >= 0)
+      error |= crossrun_options_set_stdio_fd(stageoptions, CROSSRUN_STREAM_STDIN, prevread);
+    else if (options)
+      error |= copy_stdio(stageoptions, options, CROSSRUN_STREAM_STDIN);
+    //write to the next process or as requested for the last process
+    if (i < count - 1) {
+      if (create_pipe(fds) != 0)
+        error = 1;
+      else
+        error |= crossrun_options_set_stdio_fd(stageoptions, CROSSRUN_STREAM_STDOUT, fds[PIPE_WRITE]);
+    } else if (options) {
+      error |= copy_stdio(stageoptions, options, CROSSRUN_STREAM_STDOUT);
+    }
+    //start the process (which gets its own copies of the pipe ends)
+    if (!error) {
+      if ((pipeline->stages[i] = crossrun_open_with_options(commands[i], environment, priority, affinity, stageoptions)) == NULL)
+        error = 1;
+      else
+        pipeline->count++;
+    }
+    crossrun_options_free(stageoptions);
+    close_pipe_fd(&prevread);
+    close_pipe_fd(&fds[PIPE_WRITE]);
+    prevread = fds[PIPE_READ];
+  }
+  close_pipe_fd(&prevread);
+  if (error) {
+    crossrun_pipeline_kill(pipeline);
+    crossrun_pipeline_wait(pipeline);
+    crossrun_pipeline_free(pipeline);
+    return NULL;
+  }
+  return pipeline;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_pipeline_count (crossrun_pipeline pipeline)
+{
+  return pipeline->count;
+}
+
+DLL_EXPORT_CROSSRUN crossrun crossrun_pipeline_get_stage (crossrun_pipeline pipeline, int index)
+{
+  if (index < 0)
+    index += pipeline->count;
+  if (index < 0 || index >= pipeline->count)
+    return NULL;
+  return pipeline->stages[index];
+}
+
+DLL_EXPORT_CROSSRUN unsigned long crossrun_pipeline_wait (crossrun_pipeline pipeline)
+{
+  int i;
+  if (pipeline->count == 0)
+    return ~0UL;
+  for (i = 0; i < pipeline->count; i++)
+    crossrun_wait(pipeline->stages[i]);
+  return crossrun_get_exit_code(pipeline->stages[pipeline->count - 1]);
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_pipeline_kill (crossrun_pipeline pipeline)
+{
+  int i;
+  for (i = 0; i < pipeline->count; i++) {
+    if (!crossrun_poll_exit(pipeline->stages[i]))
+      crossrun_kill(pipeline->stages[i]);
+  }
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_pipeline_free (crossrun_pipeline pipeline)
+{
+  int i;
+  if (!pipeline)
+    return;
+  for (i = 0; i < pipeline->count; i++) {
+    crossrun_free(pipeline->stages[i]);
+  }
+  free(pipeline->stages);
+  free(pipeline);
+}
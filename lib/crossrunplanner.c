@@ -0,0 +1,317 @@
+#include "crossrunpriv.h"
+#include "crossrunplanner.h"
+#include <stdlib.h>
+#include <string.h>
+
+//number of topology levels (CROSSRUN_TOPOLOGY_*)
+#define TOPOLOGY_LEVELS 5
+
+//order in which the load of the levels is compared when choosing a logical processor (most important first)
+static const int planner_levels[] = {CROSSRUN_TOPOLOGY_CORE, CROSSRUN_TOPOLOGY_L3, CROSSRUN_TOPOLOGY_PACKAGE, CROSSRUN_TOPOLOGY_NODE};
+#define PLANNER_LEVEL_COUNT (sizeof(planner_levels) / sizeof(planner_levels[0]))
+
+struct crossrun_placement {
+  struct crossrun_planner_struct* planner;
+  crossrun_cpumask cpumask;
+  crossrun handle;                //shell process the placement is released with (or NULL)
+  int* cpus;                      //logical processor each thread was counted on
+  unsigned int threads;
+  struct crossrun_placement* next;
+};
+
+struct crossrun_planner_struct {
+  crossrun_topology topology;
+  int owntopology;                //topology was created by the planner
+  int highest;                    //highest logical processor number
+  size_t maskcpus;                //number of logical processors in masks created
+  unsigned char* allowed;         //logical processors jobs may be placed on
+  int* domain[TOPOLOGY_LEVELS];   //domain index for each logical processor (-1 if unknown)
+  unsigned int* cpuload;          //number of threads placed on each logical processor
+  unsigned int* domainload[TOPOLOGY_LEVELS];  //number of threads placed in each domain
+  struct crossrun_placement* placements;
+};
+
+DLL_EXPORT_CROSSRUN crossrun_planner crossrun_planner_create (crossrun_topology topology, crossrun_cpumask within)
+{
+  int i;
+  int level;
+  int count = 0;
+  unsigned long n;
+  crossrun_cpumask current = NULL;
+  struct crossrun_planner_struct* planner;
+  if ((planner = (struct crossrun_planner_struct*)malloc(sizeof(struct crossrun_planner_struct))) == NULL)
+    return NULL;
+  memset(planner, 0, sizeof(struct crossrun_planner_struct));
+  if (!topology) {
+    if ((topology = crossrun_topology_create()) == NULL) {
+      free(planner);
+      return NULL;
+    }
+    planner->owntopology = 1;
+  }
+  planner->topology = topology;
+  planner->highest = crossrun_topology_get_highest_cpu(topology);
+  planner->maskcpus = planner->highest + 1;
+  if ((n = crossrun_get_logical_processors()) > planner->maskcpus)
+    planner->maskcpus = n;
+  if ((planner->allowed = (unsigned char*)malloc(planner->highest + 1)) == NULL || (planner->cpuload = (unsigned int*)calloc(planner->highest + 1, sizeof(unsigned int))) == NULL) {
+    crossrun_planner_free(planner);
+    return NULL;
+  }
+  for (level = 0; level < TOPOLOGY_LEVELS; level++) {
+    if ((planner->domain[level] = (int*)malloc((planner->highest + 1) * sizeof(int))) == NULL || (planner->domainload[level] = (unsigned int*)calloc(crossrun_topology_get_count(topology, level) + 1, sizeof(unsigned int))) == NULL) {
+      crossrun_planner_free(planner);
+      return NULL;
+    }
+    for (i = 0; i <= planner->highest; i++)
+      planner->domain[level][i] = crossrun_topology_get_domain(topology, i, level);
+  }
+  //without a mask use the logical processors the calling process may run on
+  if (!within && (current = crossrun_cpumask_create()) != NULL) {
+    if (crossrun_get_current_affinity(current) == 0)
+      within = current;
+  }
+  for (i = 0; i <= planner->highest; i++) {
+    planner->allowed[i] = (crossrun_topology_is_online(topology, i) && (!within || (i < (int)crossrun_cpumask_get_cpus(within) && crossrun_cpumask_is_set(within, i))));
+    if (planner->allowed[i])
+      count++;
+  }
+  crossrun_cpumask_free(current);
+  if (count == 0) {
+    crossrun_planner_free(planner);
+    return NULL;
+  }
+  return planner;
+}
+
+static void placement_free (struct crossrun_placement* placement)
+{
+  if (placement->handle)
+    placement->handle->placement = NULL;
+  crossrun_cpumask_free(placement->cpumask);
+  free(placement->cpus);
+  free(placement);
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_planner_free (crossrun_planner planner)
+{
+  int level;
+  struct crossrun_placement* next;
+  if (!planner)
+    return;
+  while (planner->placements) {
+    next = planner->placements->next;
+    placement_free(planner->placements);
+    planner->placements = next;
+  }
+  for (level = 0; level < TOPOLOGY_LEVELS; level++) {
+    free(planner->domain[level]);
+    free(planner->domainload[level]);
+  }
+  free(planner->cpuload);
+  free(planner->allowed);
+  if (planner->owntopology)
+    crossrun_topology_free(planner->topology);
+  free(planner);
+}
+
+//add or remove a thread on a logical processor
+static void planner_add_load (struct crossrun_planner_struct* planner, int cpu, int delta)
+{
+  int level;
+  planner->cpuload[cpu] += delta;
+  for (level = 0; level < TOPOLOGY_LEVELS; level++)
+    if (planner->domain[level][cpu] >= 0)
+      planner->domainload[level][planner->domain[level][cpu]] += delta;
+}
+
+//compare the load of 2 logical processors (negative if a is less loaded than b)
+static int planner_compare_cpus (struct crossrun_planner_struct* planner, int a, int b)
+{
+  size_t i;
+  unsigned int loada;
+  unsigned int loadb;
+  for (i = 0; i < PLANNER_LEVEL_COUNT; i++) {
+    loada = (planner->domain[planner_levels[i]][a] >= 0 ? planner->domainload[planner_levels[i]][planner->domain[planner_levels[i]][a]] : 0);
+    loadb = (planner->domain[planner_levels[i]][b] >= 0 ? planner->domainload[planner_levels[i]][planner->domain[planner_levels[i]][b]] : 0);
+    if (loada != loadb)
+      return (loada < loadb ? -1 : 1);
+  }
+  if (planner->cpuload[a] != planner->cpuload[b])
+    return (planner->cpuload[a] < planner->cpuload[b] ? -1 : 1);
+  return a - b;
+}
+
+//find the least loaded allowed logical processor, only in a domain if level is not -1
+static int planner_pick_cpu (struct crossrun_planner_struct* planner, int level, int index)
+{
+  int i;
+  int best = -1;
+  for (i = 0; i <= planner->highest; i++) {
+    if (!planner->allowed[i] || (level >= 0 && planner->domain[level][i] != index))
+      continue;
+    if (best < 0 || planner_compare_cpus(planner, i, best) < 0)
+      best = i;
+  }
+  return best;
+}
+
+//find the least loaded domain with allowed logical processors
+static int planner_pick_domain (struct crossrun_planner_struct* planner, int level)
+{
+  int i;
+  int index;
+  int best = -1;
+  for (i = 0; i <= planner->highest; i++) {
+    if (!planner->allowed[i] || (index = planner->domain[level][i]) < 0)
+      continue;
+    if (best < 0 || planner->domainload[level][index] < planner->domainload[level][best] || (planner->domainload[level][index] == planner->domainload[level][best] && index < best))
+      best = index;
+  }
+  return best;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_planner_place (crossrun_planner planner, unsigned int threads, int policy)
+{
+  int i;
+  unsigned int t;
+  int level = -1;
+  int index = -1;
+  struct crossrun_placement* placement;
+  if (!planner || (policy != CROSSRUN_PLAN_SPREAD && policy != CROSSRUN_PLAN_COMPACT && policy != CROSSRUN_PLAN_ISOLATE))
+    return NULL;
+  if (threads == 0)
+    threads = 1;
+  //choose the domain to place all threads in
+  if (policy == CROSSRUN_PLAN_COMPACT) {
+    level = (crossrun_topology_get_count(planner->topology, CROSSRUN_TOPOLOGY_L3) > 0 ? CROSSRUN_TOPOLOGY_L3 : CROSSRUN_TOPOLOGY_PACKAGE);
+    index = planner_pick_domain(planner, level);
+  } else if (policy == CROSSRUN_PLAN_ISOLATE) {
+    level = CROSSRUN_TOPOLOGY_NODE;
+    index = planner_pick_domain(planner, level);
+  }
+  if (level >= 0 && index < 0)
+    return NULL;
+  if ((placement = (struct crossrun_placement*)malloc(sizeof(struct crossrun_placement))) == NULL)
+    return NULL;
+  if ((placement->cpus = (int*)malloc(threads * sizeof(int))) == NULL || (placement->cpumask = crossrun_cpumask_create_size(planner->maskcpus)) == NULL) {
+    free(placement->cpus);
+    free(placement);
+    return NULL;
+  }
+  placement->planner = planner;
+  placement->handle = NULL;
+  placement->threads = threads;
+  //count each thread on the least loaded logical processor, taking the threads already counted into account
+  for (t = 0; t < threads; t++) {
+    i = planner_pick_cpu(planner, level, index);
+    placement->cpus[t] = i;
+    planner_add_load(planner, i, 1);
+    crossrun_cpumask_set(placement->cpumask, i);
+  }
+  //an isolated job may use all logical processors of its node
+  if (policy == CROSSRUN_PLAN_ISOLATE) {
+    for (i = 0; i <= planner->highest; i++)
+      if (planner->allowed[i] && planner->domain[level][i] == index)
+        crossrun_cpumask_set(placement->cpumask, i);
+  }
+  placement->next = planner->placements;
+  planner->placements = placement;
+  return placement->cpumask;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_planner_plan (crossrun_planner planner, size_t jobs, const unsigned int* threads, int policy, crossrun_cpumask* cpumasks)
+{
+  size_t i;
+  if (!planner || (jobs > 0 && (!threads || !cpumasks)))
+    return -1;
+  for (i = 0; i < jobs; i++) {
+    if ((cpumasks[i] = crossrun_planner_place(planner, threads[i], policy)) == NULL) {
+      //undo the jobs already placed
+      while (i-- > 0) {
+        crossrun_planner_release(planner, cpumasks[i]);
+        cpumasks[i] = NULL;
+      }
+      return -1;
+    }
+  }
+  return 0;
+}
+
+//remove a placement from its planner and destroy it
+static void placement_release (struct crossrun_placement* placement)
+{
+  unsigned int t;
+  struct crossrun_placement** p;
+  struct crossrun_planner_struct* planner = placement->planner;
+  for (p = &planner->placements; *p; p = &(*p)->next) {
+    if (*p == placement) {
+      *p = placement->next;
+      break;
+    }
+  }
+  for (t = 0; t < placement->threads; t++)
+    planner_add_load(planner, placement->cpus[t], -1);
+  placement_free(placement);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_planner_release (crossrun_planner planner, crossrun_cpumask cpumask)
+{
+  struct crossrun_placement* placement;
+  if (!planner || !cpumask)
+    return -1;
+  for (placement = planner->placements; placement; placement = placement->next) {
+    if (placement->cpumask == cpumask) {
+      placement_release(placement);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_planner_attach (crossrun_planner planner, crossrun_cpumask cpumask, crossrun handle)
+{
+  struct crossrun_placement* placement;
+  if (!planner || !cpumask || !handle || handle->placement)
+    return -1;
+  for (placement = planner->placements; placement; placement = placement->next) {
+    if (placement->cpumask == cpumask) {
+      if (placement->handle)
+        return -1;
+      placement->handle = handle;
+      handle->placement = placement;
+      //the shell process may already have exited
+      if (handle->exited)
+        placement_release(placement);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+DLL_EXPORT_CROSSRUN crossrun crossrun_planner_open (crossrun_planner planner, unsigned int threads, int policy, const char* command, crossrunenv environment, int priority, crossrun_options options)
+{
+  crossrun handle;
+  crossrun_cpumask cpumask;
+  if ((cpumask = crossrun_planner_place(planner, threads, policy)) == NULL)
+    return NULL;
+  if ((handle = crossrun_open_with_options(command, environment, priority, cpumask, options)) == NULL) {
+    crossrun_planner_release(planner, cpumask);
+    return NULL;
+  }
+  crossrun_planner_attach(planner, cpumask, handle);
+  return handle;
+}
+
+DLL_EXPORT_CROSSRUN unsigned int crossrun_planner_get_load (crossrun_planner planner, int cpuindex)
+{
+  if (!planner || cpuindex < 0 || cpuindex > planner->highest)
+    return 0;
+  return planner->cpuload[cpuindex];
+}
+
+void crossrun_placement_release (crossrun handle)
+{
+  if (handle->placement)
+    placement_release(handle->placement);
+}
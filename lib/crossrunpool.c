@@ -0,0 +1,352 @@
+#include "crossrunpriv.h"
+#include "crossrunpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#define sleep_milliseconds(n) Sleep(n)
+#else
+#include <unistd.h>
+#define sleep_milliseconds(n) usleep((n) * 1000)
+#endif
+
+//time in milliseconds worker processes get to exit when the pool is destroyed before they are killed
+#define POOL_EXIT_TIMEOUT 1000
+
+struct pool_worker {
+  crossrun handle;
+  int leased;
+  unsigned long uses;
+  uint64_t rss;                   //resident memory after the first use (0 if not measured yet)
+  crossrun_cpumask affinity;      //processor the worker process is pinned to (NULL for the affinity of the pool)
+};
+
+struct crossrun_pool_struct {
+  char* command;
+  crossrunenv environment;
+  int priority;
+  crossrun_cpumask affinity;
+  crossrun_options options;
+  unsigned long maxuses;
+  uint64_t maxrssgrowth;
+  struct pool_worker* workers;
+  unsigned int size;
+  crossrun* retired;              //replaced worker processes that didn't exit yet
+  size_t retiredcount;
+  size_t retiredsize;
+  uint64_t started;
+  uint64_t recycled;
+  uint64_t replaced;
+};
+
+//get resident memory of a shell process in bytes (0 if unknown)
+static uint64_t get_rss (crossrun handle)
+{
+#ifdef __linux__
+  FILE* src;
+  char path[32];
+  unsigned long size;
+  unsigned long resident;
+  long pagesize;
+  snprintf(path, sizeof(path), "/proc/%lu/statm", crossrun_get_pid(handle));
+  if ((src = fopen(path, "r")) == NULL)
+    return 0;
+  if (fscanf(src, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  fclose(src);
+  if ((pagesize = sysconf(_SC_PAGESIZE)) <= 0)
+    return 0;
+  return (uint64_t)resident * pagesize;
+#else
+  return 0;
+#endif
+}
+
+//start the worker process for a slot
+static int start_worker (crossrun_pool pool, struct pool_worker* worker)
+{
+  if ((worker->handle = crossrun_open_with_options(pool->command, pool->environment, pool->priority, (worker->affinity ? worker->affinity : pool->affinity), pool->options)) == NULL)
+    return -1;
+  worker->leased = 0;
+  worker->uses = 0;
+  worker->rss = 0;
+  pool->started++;
+  return 0;
+}
+
+//clean up replaced worker processes that exited
+static void reap_retired (crossrun_pool pool)
+{
+  size_t i = 0;
+  while (i < pool->retiredcount) {
+    if (crossrun_poll_exit(pool->retired[i])) {
+      crossrun_close(pool->retired[i]);
+      crossrun_free(pool->retired[i]);
+      pool->retired[i] = pool->retired[--pool->retiredcount];
+    } else {
+      i++;
+    }
+  }
+}
+
+//let a worker process finish and start a new one in its slot
+static int replace_worker (crossrun_pool pool, struct pool_worker* worker)
+{
+  crossrun* p;
+  if (worker->handle) {
+    if (crossrun_poll_exit(worker->handle)) {
+      crossrun_close(worker->handle);
+      crossrun_free(worker->handle);
+    } else {
+      //closing standard input tells the worker process to exit
+      crossrun_write_eof(worker->handle);
+      if (pool->retiredcount == pool->retiredsize) {
+        if ((p = (crossrun*)realloc(pool->retired, (pool->retiredsize + 8) * sizeof(crossrun))) == NULL) {
+          crossrun_kill(worker->handle);
+          crossrun_wait(worker->handle);
+          crossrun_close(worker->handle);
+          crossrun_free(worker->handle);
+          worker->handle = NULL;
+          return start_worker(pool, worker);
+        }
+        pool->retired = p;
+        pool->retiredsize += 8;
+      }
+      pool->retired[pool->retiredcount++] = worker->handle;
+    }
+    worker->handle = NULL;
+  }
+  reap_retired(pool);
+  return start_worker(pool, worker);
+}
+
+//copy the processors set in a mask
+static crossrun_cpumask copy_cpumask (crossrun_cpumask src)
+{
+  int i;
+  int n;
+  crossrun_cpumask dst;
+  if ((dst = crossrun_cpumask_create()) == NULL)
+    return NULL;
+  crossrun_cpumask_clear_all(dst);
+  n = (int)crossrun_cpumask_get_cpus(src);
+  for (i = 0; i < n; i++)
+    if (crossrun_cpumask_is_set(src, i))
+      crossrun_cpumask_set(dst, i);
+  return dst;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_pool crossrun_pool_create (const char* command, crossrunenv environment, int priority, crossrun_cpumask affinity, crossrun_options options, unsigned int size, int flags)
+{
+  unsigned int i;
+  int n;
+  int cpu;
+  int cpus;
+  struct crossrun_pool_struct* pool;
+  if (!command || size == 0)
+    return NULL;
+  if ((pool = (struct crossrun_pool_struct*)malloc(sizeof(struct crossrun_pool_struct))) == NULL)
+    return NULL;
+  pool->command = strdup(command);
+  pool->environment = environment;
+  pool->priority = priority;
+  pool->affinity = (affinity ? copy_cpumask(affinity) : NULL);
+  pool->options = options;
+  pool->maxuses = 0;
+  pool->maxrssgrowth = 0;
+  pool->size = size;
+  pool->retired = NULL;
+  pool->retiredcount = 0;
+  pool->retiredsize = 0;
+  pool->started = 0;
+  pool->recycled = 0;
+  pool->replaced = 0;
+  if ((pool->workers = (struct pool_worker*)calloc(size, sizeof(struct pool_worker))) == NULL || !pool->command || (affinity && !pool->affinity)) {
+    pool->size = 0;
+    crossrun_pool_free(pool);
+    return NULL;
+  }
+  //assign the allowed processors to the worker processes in turn
+  if (flags & CROSSRUN_POOL_PIN_EACH) {
+    cpu = -1;
+    cpus = (int)crossrun_get_logical_processors();
+    for (i = 0; i < size; i++) {
+      for (n = 0; n < cpus; n++) {
+        cpu = (cpu + 1) % cpus;
+        if (!pool->affinity || crossrun_cpumask_is_set(pool->affinity, cpu))
+          break;
+      }
+      if (n < cpus && (pool->workers[i].affinity = crossrun_cpumask_create()) != NULL) {
+        crossrun_cpumask_clear_all(pool->workers[i].affinity);
+        crossrun_cpumask_set(pool->workers[i].affinity, cpu);
+      }
+    }
+  }
+  //start the worker processes
+  for (i = 0; i < size; i++) {
+    if (start_worker(pool, &pool->workers[i]) != 0) {
+      crossrun_pool_free(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_pool_free (crossrun_pool pool)
+{
+  unsigned int i;
+  int waited;
+  if (!pool)
+    return;
+  //tell all worker processes to exit
+  for (i = 0; i < pool->size; i++)
+    if (pool->workers[i].handle)
+      crossrun_write_eof(pool->workers[i].handle);
+  //give them some time and kill the ones that don't exit
+  for (waited = 0; waited < POOL_EXIT_TIMEOUT; waited += 10) {
+    int running = 0;
+    size_t j;
+    for (i = 0; i < pool->size; i++)
+      if (pool->workers[i].handle && !crossrun_poll_exit(pool->workers[i].handle))
+        running++;
+    for (j = 0; j < pool->retiredcount; j++)
+      if (!crossrun_poll_exit(pool->retired[j]))
+        running++;
+    if (running == 0)
+      break;
+    sleep_milliseconds(10);
+  }
+  for (i = 0; i < pool->size; i++) {
+    if (pool->workers[i].handle) {
+      if (!crossrun_poll_exit(pool->workers[i].handle)) {
+        crossrun_kill(pool->workers[i].handle);
+        crossrun_wait(pool->workers[i].handle);
+      }
+      crossrun_close(pool->workers[i].handle);
+      crossrun_free(pool->workers[i].handle);
+    }
+    crossrun_cpumask_free(pool->workers[i].affinity);
+  }
+  while (pool->retiredcount > 0) {
+    crossrun handle = pool->retired[--pool->retiredcount];
+    if (!crossrun_poll_exit(handle)) {
+      crossrun_kill(handle);
+      crossrun_wait(handle);
+    }
+    crossrun_close(handle);
+    crossrun_free(handle);
+  }
+  free(pool->retired);
+  free(pool->workers);
+  crossrun_cpumask_free(pool->affinity);
+  free(pool->command);
+  free(pool);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_pool_set_recycle (crossrun_pool pool, unsigned long maxuses, uint64_t maxrssgrowth)
+{
+  if (!pool)
+    return -1;
+  pool->maxuses = maxuses;
+  pool->maxrssgrowth = maxrssgrowth;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN crossrun crossrun_pool_lease (crossrun_pool pool)
+{
+  unsigned int i;
+  struct pool_worker* worker;
+  if (!pool)
+    return NULL;
+  for (i = 0; i < pool->size; i++) {
+    worker = &pool->workers[i];
+    if (worker->leased)
+      continue;
+    //replace worker processes that exited
+    if (!worker->handle || crossrun_poll_exit(worker->handle)) {
+      pool->replaced++;
+      if (replace_worker(pool, worker) != 0)
+        continue;
+    }
+    worker->leased = 1;
+    worker->uses++;
+    return worker->handle;
+  }
+  return NULL;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_pool_release (crossrun_pool pool, crossrun handle)
+{
+  unsigned int i;
+  uint64_t rss;
+  struct pool_worker* worker;
+  if (!pool || !handle)
+    return -1;
+  for (i = 0; i < pool->size; i++) {
+    worker = &pool->workers[i];
+    if (worker->handle == handle && worker->leased) {
+      worker->leased = 0;
+      if (crossrun_poll_exit(handle)) {
+        pool->replaced++;
+        replace_worker(pool, worker);
+      } else if (pool->maxuses && worker->uses >= pool->maxuses) {
+        pool->recycled++;
+        replace_worker(pool, worker);
+      } else if (pool->maxrssgrowth && (rss = get_rss(handle)) > 0) {
+        //right after starting the resident memory may still be that of the calling process instead of the program,
+        //so the starting point is measured when the worker process is released for the first time
+        if (!worker->rss) {
+          worker->rss = rss;
+        } else if (rss > worker->rss + pool->maxrssgrowth) {
+          pool->recycled++;
+          replace_worker(pool, worker);
+        }
+      }
+      return 0;
+    }
+  }
+  return -1;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_pool_maintain (crossrun_pool pool)
+{
+  unsigned int i;
+  int count = 0;
+  if (!pool)
+    return -1;
+  for (i = 0; i < pool->size; i++) {
+    if (!pool->workers[i].leased && (!pool->workers[i].handle || crossrun_poll_exit(pool->workers[i].handle))) {
+      pool->replaced++;
+      if (replace_worker(pool, &pool->workers[i]) == 0)
+        count++;
+    }
+  }
+  reap_retired(pool);
+  return count;
+}
+
+DLL_EXPORT_CROSSRUN unsigned int crossrun_pool_idle (crossrun_pool pool)
+{
+  unsigned int i;
+  unsigned int count = 0;
+  if (!pool)
+    return 0;
+  for (i = 0; i < pool->size; i++)
+    if (!pool->workers[i].leased)
+      count++;
+  return count;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_pool_get_stats (crossrun_pool pool, uint64_t* started, uint64_t* recycled, uint64_t* replaced)
+{
+  if (!pool)
+    return -1;
+  if (started)
+    *started = pool->started;
+  if (recycled)
+    *recycled = pool->recycled;
+  if (replaced)
+    *replaced = pool->replaced;
+  return 0;
+}
@@ -0,0 +1,169 @@
+/**
+ * @file crossrunpriv.h
+ * @brief crossrun library private header file
+ * @author Brecht Sanders
+ *
+ * This header file defines the internal data structures shared between the crossrun library source files.
+ * It is not installed and should not be used by applications.
+ */
+
+#ifndef __INCLUDED_CROSSRUNPRIV_H
+#define __INCLUDED_CROSSRUNPRIV_H
+
+#include "crossrun.h"
+#include <stddef.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+#define PIPE_READ  0
+#define PIPE_WRITE 1
+
+struct crossrun_loop_entry;
+struct crossrun_limit_state;
+struct crossrun_placement;
+
+struct crossrun_stdio_option {
+  int mode;                       //how the standard stream is connected as CROSSRUN_STDIO_*
+  int fd;                         //file descriptor for CROSSRUN_STDIO_FD
+  char* path;                     //path of file for CROSSRUN_STDIO_FILE
+  int flags;                      //open() flags for CROSSRUN_STDIO_FILE
+};
+
+struct crossrun_options_struct {
+  struct crossrun_stdio_option stdio[3];  //how standard input, standard output and error output are connected (indexed by CROSSRUN_STREAM_*)
+  size_t readbufsize;             //size of read-ahead buffer for standard output (0 for none)
+  size_t pipesize;                //size of the pipes (0 for system default)
+  size_t pipemaxsize;             //size up to which output pipes are grown when found full (0 for no growing)
+  int pty;                        //connect standard input and output to a pseudo-terminal
+  unsigned short ptyrows;         //window size of the pseudo-terminal
+  unsigned short ptycolumns;
+  int channelfd;                  //shared memory channel passed to the shell process (-1 for none)
+  int checksum;                   //compute checksums of the outputs while they are read
+  int socketpair;                 //connect standard input and output to one socket instead of 2 pipes
+  size_t socketbufsize;           //size of the socket send and receive buffers (0 for system default)
+  int mempolicy;                  //NUMA memory policy as CROSSRUN_MEMPOLICY_*
+  int* mempolicynodes;            //NUMA nodes for the memory policy (NULL for the nodes of the affinity mask)
+  size_t mempolicynodecount;      //number of NUMA nodes in mempolicynodes
+};
+
+struct crossrun_data {
+#ifdef _WIN32
+  HANDLE stdin_pipe[2];           //pipe for process standard input
+  HANDLE stdout_pipe[2];          //pipe for process standard output
+  HANDLE stderr_pipe[2];          //pipe for process error output
+  PROCESS_INFORMATION proc_info;  //Windows process information structure
+  DWORD exitcode;                 //exit code after process exited
+#else
+  int stdin_pipe[2];              //pipe for process standard input
+  int stdout_pipe[2];             //pipe for process standard output
+  int stderr_pipe[2];             //pipe for process error output
+  pid_t pid;                      //process ID
+  int exitcode;                   //exit code after process exited
+#endif
+  int exited;
+  int pty;                        //standard input and output are connected to a pseudo-terminal
+  int socket;                     //standard input and output are connected to one socket (stdin_pipe[PIPE_WRITE] and stdout_pipe[PIPE_READ] are the same file descriptor)
+  int stdout_eof;                 //end of standard output was reached by crossrun_read_any()
+  int stderr_eof;                 //end of error output was reached by crossrun_read_any()
+  struct crossrun_loop_entry* loopentry;  //entry in crossrun_loop the handle is registered with (or NULL)
+  char* readbuf;                  //read-ahead buffer for standard output (or NULL)
+  size_t readbufsize;             //size of read-ahead buffer
+  size_t readbufpos;              //position of the first unread byte in the read-ahead buffer
+  size_t readbuflen;              //number of unread bytes in the read-ahead buffer
+  uint64_t statsbytes;            //number of bytes read from the outputs
+  uint64_t statssyscalls;         //number of system calls made for reading the outputs
+  char* wqueue;                   //ring buffer for data queued for standard input (or NULL)
+  size_t wqueuesize;              //size of ring buffer
+  size_t wqueuepos;               //position of the first queued byte in the ring buffer
+  size_t wqueuelen;               //number of bytes queued
+  size_t wqueuehigh;              //high watermark
+  int wqueuebackpressure;         //high watermark was reached and queued data didn't drop to half of it yet
+  crossrun_write_queue_fn wqueuefn;  //callback function called when the state of the queue changes
+  void* wqueuecallbackdata;       //user data passed to the callback function
+  size_t pipesize[3];             //size of the pipes (only kept up to date when pipes are grown, indexed by CROSSRUN_STREAM_*)
+  size_t pipemaxsize;             //size up to which output pipes are grown when found full (0 for no growing)
+  int pipefull[3];                //number of consecutive reads that found the pipe full
+  int checksum;                   //compute checksums of the outputs while they are read
+  uint32_t checksumcrc[3];        //CRC32C of the output read so far (indexed by CROSSRUN_STREAM_*)
+  uint64_t checksumlen[3];        //number of bytes included in the checksum (indexed by CROSSRUN_STREAM_*)
+  struct crossrun_limit_state* limit[3];  //rate limit for the outputs (or NULL, indexed by CROSSRUN_STREAM_*)
+  struct crossrun_placement* placement;   //logical processors placed for the shell process by a crossrun_planner (or NULL)
+};
+
+//check without blocking if a shell process has exited (unlike crossrun_stopped() this doesn't report a running process as stopped)
+int crossrun_poll_exit (crossrun handle);
+
+//size of the stack buffer used by crossrun_pump() for reading output
+#define CROSSRUN_PUMP_BUFFER_SIZE 16384
+
+//callback function type called by crossrun_pump() for data read from standard output or error output (return non-zero to stop)
+typedef int (*crossrun_pump_fn) (int stream, const char* data, size_t datalen, void* callbackdata);
+
+//write data to the standard input of a shell process (which is closed afterwards) while reading all its output, returns 0 on success, -1 on error or the non-zero value returned by the callback function
+int crossrun_pump (crossrun handle, const char* writedata, size_t writedatalen, crossrun_pump_fn pumpfn, void* callbackdata);
+
+//pass data waiting in the read-ahead buffer to a callback function and remove it from the buffer (returns the value returned by the callback function)
+int crossrun_readbuf_flush (crossrun handle, crossrun_pump_fn pumpfn, void* callbackdata);
+
+//find the first occurrence of a byte using vector instructions if supported by the processor (returns NULL if not found)
+const char* crossrun_scan_byte (const char* data, size_t datalen, char c);
+
+//maximum number of bytes crossrun_scan_set() compares using vector instructions
+#define CROSSRUN_SCAN_SET_VECTOR_MAX 8
+
+//find the first occurrence of any of the bytes in a set using vector instructions if supported by the processor (returns NULL if not found)
+const char* crossrun_scan_set (const char* data, size_t datalen, const unsigned char* set, int setcount);
+
+//write as much queued data as possible without blocking, returns 0 if the queue is empty, 1 if data is still queued or -1 on error
+int crossrun_write_queue_process (crossrun handle);
+
+//discard data queued for standard input (notify non-zero calls the callback function with CROSSRUN_WRITE_QUEUE_ERROR)
+void crossrun_write_queue_discard (crossrun handle, int notify);
+
+//let the event loop a shell process is registered with know data was queued for its standard input
+void crossrun_loop_notify_write (crossrun handle);
+
+//set the size of a pipe (clamped to the maximum size allowed), returns the new size or 0 on error
+size_t crossrun_pipe_resize (int fd, size_t size);
+
+//set the size of the pipes of a new shell process and prepare growing its output pipes up to maxsize
+void crossrun_pipe_setup (crossrun handle, size_t size, size_t maxsize);
+
+//grow an output pipe if it is repeatedly found full (n is the number of bytes read into a buffer of buflen bytes)
+void crossrun_pipe_adapt (crossrun handle, int stream, size_t n, size_t buflen);
+
+//add output data read from a shell process to the checksum of the stream (does nothing if checksums are not enabled)
+void crossrun_checksum_update (crossrun handle, int stream, const char* data, size_t datalen);
+
+//remove output above the rate limit set with crossrun_set_output_limit() from data read (only call if handle->limit[stream] is set), returns the number of bytes kept at the start of data
+size_t crossrun_limit_apply (crossrun handle, int stream, char* data, size_t datalen);
+
+//free the rate limits of a shell process
+void crossrun_limit_free (crossrun handle);
+
+//maximum number of NUMA nodes a memory policy can use
+#define CROSSRUN_MEMPOLICY_MAX_NODES 1024
+
+//NUMA memory policy determined before starting a shell process
+struct crossrun_mempolicy {
+  int mode;                       //system memory policy mode (-1 for none)
+  unsigned long nodemask[CROSSRUN_MEMPOLICY_MAX_NODES / (8 * sizeof(unsigned long))];  //NUMA nodes
+};
+
+//determine the memory policy for a new shell process from the options and affinity mask, returns zero if a memory policy must be set
+int crossrun_mempolicy_prepare (struct crossrun_mempolicy* mempolicy, crossrun_options options, crossrun_cpumask affinity);
+
+//set the memory policy of the current process (called in the shell process between fork() and exec(), errors are ignored)
+void crossrun_mempolicy_apply (const struct crossrun_mempolicy* mempolicy);
+
+//release the logical processors placed for a shell process by a crossrun_planner (called when the shell process exited or its handle is destroyed)
+void crossrun_placement_release (crossrun handle);
+
+//remove a file descriptor of a shell process that is about to be closed from the event loop it is registered with (stream -1 removes the shell process from the event loop)
+void crossrun_loop_notify_close (crossrun handle, int stream);
+
+#endif //__INCLUDED_CROSSRUNPRIV_H
@@ -172,19 +172,27 @@ struct crossrun_cpumask_struct {
 };
 
 DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_cpumask_create ()
+{
+  return crossrun_cpumask_create_size(crossrun_get_logical_processors());
+}
+
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_cpumask_create_size (size_t cpus)
 {
 #ifdef __APPLE__
   return NULL;
 #else
   struct crossrun_cpumask_struct* cpumask;
-  if ((cpumask = (struct crossrun_cpumask_struct*)malloc(sizeof(struct crossrun_cpumask_struct))) == NULL)
-    return NULL;
-  if ((cpumask->cpucount = crossrun_get_logical_processors()) == 0) {
+  if (cpus == 0) {
     //unable to determine number of logical processors
-    free(cpumask);
     return NULL;
   }
+  if ((cpumask = (struct crossrun_cpumask_struct*)malloc(sizeof(struct crossrun_cpumask_struct))) == NULL)
+    return NULL;
+  cpumask->cpucount = cpus;
 #ifdef _WIN32
+  //the mask holds as many processors as there are bits in a pointer
+  if (cpumask->cpucount > sizeof(DWORD_PTR) * 8)
+    cpumask->cpucount = sizeof(DWORD_PTR) * 8;
   cpumask->cpuset = 0;
 #else
   if ((cpumask->cpuset = CPU_ALLOC(cpumask->cpucount)) == NULL) {
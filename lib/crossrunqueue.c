@@ -0,0 +1,198 @@
+#include "crossrunpriv.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#endif
+
+#ifndef _WIN32
+//notify the callback function of a state change of the write queue
+static void queue_event (crossrun handle, int event)
+{
+  if (handle->wqueuefn)
+    (*handle->wqueuefn)(handle, event, handle->wqueuecallbackdata);
+}
+
+//update the backpressure state after the number of queued bytes changed
+static void queue_update_backpressure (crossrun handle)
+{
+  if (!handle->wqueuebackpressure) {
+    if (handle->wqueuelen >= handle->wqueuehigh)
+      handle->wqueuebackpressure = 1;
+  } else if (handle->wqueuelen <= handle->wqueuehigh / 2) {
+    handle->wqueuebackpressure = 0;
+    queue_event(handle, CROSSRUN_WRITE_QUEUE_LOW);
+  }
+}
+
+//handle a failed write by discarding queued data, returns -1
+static int queue_failed (crossrun handle)
+{
+  crossrun_write_queue_discard(handle, 1);
+  return -1;
+}
+#endif
+
+int crossrun_write_queue_process (crossrun handle)
+{
+#ifdef _WIN32
+  return (handle->wqueuelen > 0 ? -1 : 0);
+#else
+  int count;
+  ssize_t n;
+  struct iovec vec[2];
+  if (handle->wqueuelen == 0)
+    return 0;
+  if (handle->stdin_pipe[PIPE_WRITE] < 0)
+    return queue_failed(handle);
+  while (handle->wqueuelen > 0) {
+    //the queued data wraps around the end of the ring buffer in at most 2 parts
+    vec[0].iov_base = handle->wqueue + handle->wqueuepos;
+    if (handle->wqueuepos + handle->wqueuelen <= handle->wqueuesize) {
+      vec[0].iov_len = handle->wqueuelen;
+      count = 1;
+    } else {
+      vec[0].iov_len = handle->wqueuesize - handle->wqueuepos;
+      vec[1].iov_base = handle->wqueue;
+      vec[1].iov_len = handle->wqueuelen - vec[0].iov_len;
+      count = 2;
+    }
+    if ((n = writev(handle->stdin_pipe[PIPE_WRITE], vec, count)) < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        break;
+      return queue_failed(handle);
+    }
+    handle->wqueuepos = (handle->wqueuepos + n) % handle->wqueuesize;
+    handle->wqueuelen -= n;
+  }
+  queue_update_backpressure(handle);
+  if (handle->wqueuelen > 0)
+    return 1;
+  handle->wqueuepos = 0;
+  queue_event(handle, CROSSRUN_WRITE_QUEUE_DRAINED);
+  return 0;
+#endif
+}
+
+void crossrun_write_queue_discard (crossrun handle, int notify)
+{
+  handle->wqueuepos = 0;
+  handle->wqueuelen = 0;
+  handle->wqueuebackpressure = 0;
+  if (notify && handle->wqueuefn)
+    (*handle->wqueuefn)(handle, CROSSRUN_WRITE_QUEUE_ERROR, handle->wqueuecallbackdata);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_create (crossrun handle, size_t size, size_t highwatermark, crossrun_write_queue_fn fn, void* callbackdata)
+{
+#ifdef _WIN32
+  return -1;
+#else
+  char* p;
+  if (!handle || size == 0 || highwatermark > size || handle->stdin_pipe[PIPE_WRITE] < 0)
+    return -1;
+  //data already queued must fit in the new queue
+  if (handle->wqueuelen > size)
+    return -1;
+  if ((p = (char*)malloc(size)) == NULL)
+    return -1;
+  if (handle->wqueuelen > 0) {
+    size_t n = handle->wqueuesize - handle->wqueuepos;
+    if (n >= handle->wqueuelen) {
+      memcpy(p, handle->wqueue + handle->wqueuepos, handle->wqueuelen);
+    } else {
+      memcpy(p, handle->wqueue + handle->wqueuepos, n);
+      memcpy(p + n, handle->wqueue, handle->wqueuelen - n);
+    }
+  }
+  free(handle->wqueue);
+  handle->wqueue = p;
+  handle->wqueuesize = size;
+  handle->wqueuepos = 0;
+  handle->wqueuehigh = (highwatermark ? highwatermark : size);
+  handle->wqueuefn = fn;
+  handle->wqueuecallbackdata = callbackdata;
+  //make sure writing never blocks
+  fcntl(handle->stdin_pipe[PIPE_WRITE], F_SETFL, fcntl(handle->stdin_pipe[PIPE_WRITE], F_GETFL) | O_NONBLOCK);
+  return 0;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_write_queued (crossrun handle, const char* data, size_t datalen)
+{
+#ifdef _WIN32
+  return -1;
+#else
+  ssize_t n;
+  size_t written = 0;
+  size_t pos;
+  size_t part;
+  if (!handle->wqueue || handle->stdin_pipe[PIPE_WRITE] < 0)
+    return -1;
+  if (datalen > INT_MAX)
+    datalen = INT_MAX;
+  //write directly as long as nothing is queued yet, to avoid copying
+  while (handle->wqueuelen == 0 && written < datalen) {
+    if ((n = write(handle->stdin_pipe[PIPE_WRITE], data + written, datalen - written)) < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        break;
+      queue_failed(handle);
+      return -1;
+    }
+    written += n;
+  }
+  //queue what didn't fit in the pipe (as far as the queue allows)
+  if ((part = datalen - written) > handle->wqueuesize - handle->wqueuelen)
+    part = handle->wqueuesize - handle->wqueuelen;
+  if (part > 0) {
+    pos = (handle->wqueuepos + handle->wqueuelen) % handle->wqueuesize;
+    if (pos + part <= handle->wqueuesize) {
+      memcpy(handle->wqueue + pos, data + written, part);
+    } else {
+      memcpy(handle->wqueue + pos, data + written, handle->wqueuesize - pos);
+      memcpy(handle->wqueue, data + written + (handle->wqueuesize - pos), part - (handle->wqueuesize - pos));
+    }
+    handle->wqueuelen += part;
+    written += part;
+    queue_update_backpressure(handle);
+    crossrun_loop_notify_write(handle);
+  }
+  return (int)written;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_flush (crossrun handle)
+{
+  if (!handle->wqueue)
+    return -1;
+  return crossrun_write_queue_process(handle);
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_write_queue_pending (crossrun handle)
+{
+  return handle->wqueuelen;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_backpressure (crossrun handle)
+{
+  return handle->wqueuebackpressure;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_write_queue_poll_fd (crossrun handle)
+{
+#ifdef _WIN32
+  return -1;
+#else
+  if (handle->wqueuelen == 0)
+    return -1;
+  return handle->stdin_pipe[PIPE_WRITE];
+#endif
+}
@@ -0,0 +1,187 @@
+#include "crossrunpriv.h"
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86_SIMD
+#include <immintrin.h>
+#endif
+
+typedef const char* (*scan_byte_fn) (const char* data, size_t datalen, char c);
+
+static const char* scan_byte_scalar (const char* data, size_t datalen, char c)
+{
+  return (const char*)memchr(data, c, datalen);
+}
+
+#ifdef SCAN_X86_SIMD
+__attribute__((target("sse2")))
+static const char* scan_byte_sse2 (const char* data, size_t datalen, char c)
+{
+  size_t i;
+  unsigned int mask;
+  const __m128i needle = _mm_set1_epi8(c);
+  //compare 16 bytes at a time
+  for (i = 0; i + 16 <= datalen; i += 16) {
+    if ((mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + i)), needle))) != 0)
+      return data + i + __builtin_ctz(mask);
+  }
+  //check remaining bytes
+  for (; i < datalen; i++) {
+    if (data[i] == c)
+      return data + i;
+  }
+  return NULL;
+}
+
+__attribute__((target("avx2")))
+static const char* scan_byte_avx2 (const char* data, size_t datalen, char c)
+{
+  size_t i;
+  unsigned int mask;
+  const __m256i needle = _mm256_set1_epi8(c);
+  //compare 64 bytes per iteration and only locate the match within the block that has one
+  for (i = 0; i + 64 <= datalen; i += 64) {
+    __m256i lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle);
+    __m256i hi = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i + 32)), needle);
+    if (!_mm256_testz_si256(_mm256_or_si256(lo, hi), _mm256_or_si256(lo, hi))) {
+      if ((mask = (unsigned int)_mm256_movemask_epi8(lo)) != 0)
+        return data + i + __builtin_ctz(mask);
+      return data + i + 32 + __builtin_ctz((unsigned int)_mm256_movemask_epi8(hi));
+    }
+  }
+  for (; i + 32 <= datalen; i += 32) {
+    if ((mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(data + i)), needle))) != 0)
+      return data + i + __builtin_ctz(mask);
+  }
+  //check remaining bytes
+  return scan_byte_sse2(data + i, datalen - i, c);
+}
+#endif
+
+//select the fastest implementation supported by the processor
+static const char* scan_byte_dispatch (const char* data, size_t datalen, char c);
+
+static scan_byte_fn scan_byte_impl = scan_byte_dispatch;
+
+static const char* scan_byte_dispatch (const char* data, size_t datalen, char c)
+{
+#ifdef SCAN_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    scan_byte_impl = scan_byte_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    scan_byte_impl = scan_byte_sse2;
+  else
+#endif
+  scan_byte_impl = scan_byte_scalar;
+  return (*scan_byte_impl)(data, datalen, c);
+}
+
+const char* crossrun_scan_byte (const char* data, size_t datalen, char c)
+{
+  //short data is not worth the overhead of vector instructions
+  if (datalen < 16)
+    return (const char*)memchr(data, c, datalen);
+  return (*scan_byte_impl)(data, datalen, c);
+}
+
+typedef const char* (*scan_set_fn) (const char* data, size_t datalen, const unsigned char* set, int setcount);
+
+static const char* scan_set_scalar (const char* data, size_t datalen, const unsigned char* set, int setcount)
+{
+  size_t i;
+  unsigned char table[256];
+  memset(table, 0, sizeof(table));
+  for (i = 0; i < (size_t)setcount; i++)
+    table[set[i]] = 1;
+  for (i = 0; i < datalen; i++) {
+    if (table[(unsigned char)data[i]])
+      return data + i;
+  }
+  return NULL;
+}
+
+#ifdef SCAN_X86_SIMD
+__attribute__((target("sse2")))
+static const char* scan_set_sse2 (const char* data, size_t datalen, const unsigned char* set, int setcount)
+{
+  size_t i;
+  int j;
+  unsigned int mask;
+  __m128i block;
+  __m128i found;
+  __m128i needles[CROSSRUN_SCAN_SET_VECTOR_MAX];
+  for (j = 0; j < setcount; j++)
+    needles[j] = _mm_set1_epi8((char)set[j]);
+  //compare 16 bytes at a time with each byte of the set
+  for (i = 0; i + 16 <= datalen; i += 16) {
+    block = _mm_loadu_si128((const __m128i*)(data + i));
+    found = _mm_cmpeq_epi8(block, needles[0]);
+    for (j = 1; j < setcount; j++)
+      found = _mm_or_si128(found, _mm_cmpeq_epi8(block, needles[j]));
+    if ((mask = (unsigned int)_mm_movemask_epi8(found)) != 0)
+      return data + i + __builtin_ctz(mask);
+  }
+  //check remaining bytes
+  for (; i < datalen; i++) {
+    for (j = 0; j < setcount; j++)
+      if ((unsigned char)data[i] == set[j])
+        return data + i;
+  }
+  return NULL;
+}
+
+__attribute__((target("avx2")))
+static const char* scan_set_avx2 (const char* data, size_t datalen, const unsigned char* set, int setcount)
+{
+  size_t i;
+  int j;
+  unsigned int mask;
+  __m256i block;
+  __m256i found;
+  __m256i needles[CROSSRUN_SCAN_SET_VECTOR_MAX];
+  for (j = 0; j < setcount; j++)
+    needles[j] = _mm256_set1_epi8((char)set[j]);
+  //compare 32 bytes at a time with each byte of the set
+  for (i = 0; i + 32 <= datalen; i += 32) {
+    block = _mm256_loadu_si256((const __m256i*)(data + i));
+    found = _mm256_cmpeq_epi8(block, needles[0]);
+    for (j = 1; j < setcount; j++)
+      found = _mm256_or_si256(found, _mm256_cmpeq_epi8(block, needles[j]));
+    if ((mask = (unsigned int)_mm256_movemask_epi8(found)) != 0)
+      return data + i + __builtin_ctz(mask);
+  }
+  //check remaining bytes
+  return scan_set_sse2(data + i, datalen - i, set, setcount);
+}
+#endif
+
+//select the fastest implementation supported by the processor
+static const char* scan_set_dispatch (const char* data, size_t datalen, const unsigned char* set, int setcount);
+
+static scan_set_fn scan_set_impl = scan_set_dispatch;
+
+static const char* scan_set_dispatch (const char* data, size_t datalen, const unsigned char* set, int setcount)
+{
+#ifdef SCAN_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    scan_set_impl = scan_set_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    scan_set_impl = scan_set_sse2;
+  else
+#endif
+  scan_set_impl = scan_set_scalar;
+  return (*scan_set_impl)(data, datalen, set, setcount);
+}
+
+const char* crossrun_scan_set (const char* data, size_t datalen, const unsigned char* set, int setcount)
+{
+  if (setcount <= 0)
+    return NULL;
+  if (setcount == 1)
+    return crossrun_scan_byte(data, datalen, (char)set[0]);
+  //comparing with each byte of a large set is slower than a table lookup per byte
+  if (datalen < 16 || setcount > CROSSRUN_SCAN_SET_VECTOR_MAX)
+    return scan_set_scalar(data, datalen, set, setcount);
+  return (*scan_set_impl)(data, datalen, set, setcount);
+}
@@ -0,0 +1,543 @@
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+#include "crossruntopology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <ctype.h>
+#endif
+
+//number of topology levels (CROSSRUN_TOPOLOGY_*)
+#define TOPOLOGY_LEVELS 5
+
+//default location of the sysfs topology information
+#define SYSFS_PATH "/sys/devices/system"
+
+//maximum number of cache descriptions examined per logical processor
+#define MAX_CACHES 32
+
+struct crossrun_topology_struct {
+  int highest;                    //highest logical processor number
+  size_t cpus;                    //number of online logical processors
+  size_t maskcpus;                //number of logical processors in masks created
+  unsigned char* online;          //online flag for each logical processor
+  int* domain[TOPOLOGY_LEVELS];   //domain index for each logical processor (-1 if unknown)
+  int* domainid[TOPOLOGY_LEVELS]; //system identifier for each domain
+  int count[TOPOLOGY_LEVELS];     //number of domains
+};
+
+static struct crossrun_topology_struct* topology_alloc (int highest)
+{
+  int i;
+  int level;
+  unsigned long n;
+  struct crossrun_topology_struct* topology;
+  if (highest < 0 || (topology = (struct crossrun_topology_struct*)malloc(sizeof(struct crossrun_topology_struct))) == NULL)
+    return NULL;
+  memset(topology, 0, sizeof(struct crossrun_topology_struct));
+  topology->highest = highest;
+  //make sure masks can also be used with the affinity functions of the current system
+  topology->maskcpus = highest + 1;
+  if ((n = crossrun_get_logical_processors()) > topology->maskcpus)
+    topology->maskcpus = n;
+  if ((topology->online = (unsigned char*)malloc(highest + 1)) == NULL) {
+    free(topology);
+    return NULL;
+  }
+  memset(topology->online, 0, highest + 1);
+  for (level = 0; level < TOPOLOGY_LEVELS; level++) {
+    if ((topology->domain[level] = (int*)malloc((highest + 1) * sizeof(int))) == NULL || (topology->domainid[level] = (int*)malloc((highest + 1) * sizeof(int))) == NULL) {
+      crossrun_topology_free(topology);
+      return NULL;
+    }
+    for (i = 0; i <= highest; i++)
+      topology->domain[level][i] = -1;
+  }
+  return topology;
+}
+
+//add a domain with the online logical processors in cpus that don't belong to a domain at this level yet
+static void topology_add_domain (struct crossrun_topology_struct* topology, int level, const unsigned char* cpus, int id)
+{
+  int i;
+  int index = -1;
+  for (i = 0; i <= topology->highest; i++) {
+    if (cpus[i] && topology->online[i] && topology->domain[level][i] < 0) {
+      if (index < 0) {
+        index = topology->count[level]++;
+        topology->domainid[level][index] = (id >= 0 ? id : index);
+      }
+      topology->domain[level][i] = index;
+    }
+  }
+}
+
+//put the online logical processors without a domain at this level in separate domains or all together in one domain
+static void topology_add_missing (struct crossrun_topology_struct* topology, int level, int separate)
+{
+  int i;
+  unsigned char* cpus;
+  if ((cpus = (unsigned char*)malloc(topology->highest + 1)) == NULL)
+    return;
+  memset(cpus, 0, topology->highest + 1);
+  for (i = 0; i <= topology->highest; i++) {
+    if (topology->online[i] && topology->domain[level][i] < 0) {
+      cpus[i] = 1;
+      if (separate) {
+        topology_add_domain(topology, level, cpus, -1);
+        cpus[i] = 0;
+      }
+    }
+  }
+  if (!separate)
+    topology_add_domain(topology, level, cpus, -1);
+  free(cpus);
+}
+
+static void topology_count_online (struct crossrun_topology_struct* topology)
+{
+  int i;
+  topology->cpus = 0;
+  for (i = 0; i <= topology->highest; i++)
+    if (topology->online[i])
+      topology->cpus++;
+}
+
+#if defined(__linux__)
+//read the contents of a small text file without trailing whitespace
+static int read_text (const char* path, char* buf, size_t buflen)
+{
+  FILE* src;
+  size_t len;
+  if ((src = fopen(path, "rb")) == NULL)
+    return -1;
+  len = fread(buf, 1, buflen - 1, src);
+  fclose(src);
+  while (len > 0 && isspace((unsigned char)buf[len - 1]))
+    len--;
+  buf[len] = 0;
+  return 0;
+}
+
+static int read_int (const char* path, int* value)
+{
+  char buf[32];
+  char* p;
+  long n;
+  if (read_text(path, buf, sizeof(buf)) != 0 || !buf[0])
+    return -1;
+  n = strtol(buf, &p, 10);
+  if (*p)
+    return -1;
+  *value = (int)n;
+  return 0;
+}
+
+//parse a list of logical processors like 0-3,8-11 (marking them in cpus if not NULL), return the highest logical processor or -1 on error
+static int parse_cpulist (const char* list, unsigned char* cpus, int highest)
+{
+  long first;
+  long last;
+  long i;
+  char* p;
+  int result = -1;
+  while (*list) {
+    first = strtol(list, &p, 10);
+    if (p == list || first < 0)
+      return -1;
+    last = first;
+    if (*p == '-') {
+      list = p + 1;
+      last = strtol(list, &p, 10);
+      if (p == list || last < first)
+        return -1;
+    }
+    if (last > result)
+      result = last;
+    if (cpus) {
+      for (i = first; i <= last && i <= highest; i++)
+        cpus[i] = 1;
+    }
+    if (*p == ',')
+      p++;
+    else if (*p)
+      return -1;
+    list = p;
+  }
+  return result;
+}
+
+//read a list of logical processors from a file into cpus
+static int read_cpulist (const char* path, unsigned char* cpus, int highest)
+{
+  char buf[4096];
+  memset(cpus, 0, highest + 1);
+  if (read_text(path, buf, sizeof(buf)) != 0 || parse_cpulist(buf, cpus, highest) < 0)
+    return -1;
+  return 0;
+}
+
+static int compare_int (const void* a, const void* b)
+{
+  return (*(const int*)a > *(const int*)b) - (*(const int*)a < *(const int*)b);
+}
+
+static void sysfs_read_nodes (struct crossrun_topology_struct* topology, const char* path, unsigned char* cpus)
+{
+  char filepath[1024];
+  DIR* dir;
+  struct dirent* entry;
+  const char* p;
+  int* nodes = NULL;
+  int* newnodes;
+  size_t nodecount = 0;
+  size_t i;
+  snprintf(filepath, sizeof(filepath), "%s/node", path);
+  if ((dir = opendir(filepath)) == NULL)
+    return;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, "node", 4) != 0 || !entry->d_name[4])
+      continue;
+    for (p = entry->d_name + 4; *p && isdigit((unsigned char)*p); p++)
+      ;
+    if (*p)
+      continue;
+    if ((newnodes = (int*)realloc(nodes, (nodecount + 1) * sizeof(int))) == NULL)
+      break;
+    nodes = newnodes;
+    nodes[nodecount++] = atoi(entry->d_name + 4);
+  }
+  closedir(dir);
+  //number domains in order of node number
+  qsort(nodes, nodecount, sizeof(int), compare_int);
+  for (i = 0; i < nodecount; i++) {
+    snprintf(filepath, sizeof(filepath), "%s/node/node%i/cpulist", path, nodes[i]);
+    if (read_cpulist(filepath, cpus, topology->highest) == 0)
+      topology_add_domain(topology, CROSSRUN_TOPOLOGY_NODE, cpus, nodes[i]);
+  }
+  free(nodes);
+}
+
+static void sysfs_read_caches (struct crossrun_topology_struct* topology, const char* path, int cpu, unsigned char* cpus)
+{
+  char filepath[1024];
+  char type[32];
+  int index;
+  int level;
+  int id;
+  for (index = 0; index < MAX_CACHES; index++) {
+    snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/cache/index%i/level", path, cpu, index);
+    if (read_int(filepath, &level) != 0)
+      break;
+    if (level != 2 && level != 3)
+      continue;
+    //skip instruction caches
+    snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/cache/index%i/type", path, cpu, index);
+    if (read_text(filepath, type, sizeof(type)) == 0 && strcmp(type, "Instruction") == 0)
+      continue;
+    snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/cache/index%i/shared_cpu_list", path, cpu, index);
+    if (read_cpulist(filepath, cpus, topology->highest) != 0)
+      continue;
+    snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/cache/index%i/id", path, cpu, index);
+    if (read_int(filepath, &id) != 0)
+      id = -1;
+    topology_add_domain(topology, (level == 2 ? CROSSRUN_TOPOLOGY_L2 : CROSSRUN_TOPOLOGY_L3), cpus, id);
+  }
+}
+
+//read the siblings of a logical processor from the first file that exists (newer kernels use different names)
+static int sysfs_read_siblings (struct crossrun_topology_struct* topology, const char* path, int cpu, const char* name, const char* oldname, unsigned char* cpus)
+{
+  char filepath[1024];
+  snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/topology/%s", path, cpu, name);
+  if (read_cpulist(filepath, cpus, topology->highest) == 0)
+    return 0;
+  snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/topology/%s", path, cpu, oldname);
+  return read_cpulist(filepath, cpus, topology->highest);
+}
+
+static struct crossrun_topology_struct* sysfs_read (const char* path)
+{
+  char filepath[1024];
+  char buf[4096];
+  int cpu;
+  int id;
+  int highest;
+  unsigned char* cpus;
+  struct crossrun_topology_struct* topology;
+  snprintf(filepath, sizeof(filepath), "%s/cpu/possible", path);
+  if (read_text(filepath, buf, sizeof(buf)) != 0 || (highest = parse_cpulist(buf, NULL, 0)) < 0)
+    return NULL;
+  if ((topology = topology_alloc(highest)) == NULL)
+    return NULL;
+  if ((cpus = (unsigned char*)malloc(highest + 1)) == NULL) {
+    crossrun_topology_free(topology);
+    return NULL;
+  }
+  //all possible logical processors are online if this isn't reported
+  snprintf(filepath, sizeof(filepath), "%s/cpu/online", path);
+  if (read_cpulist(filepath, topology->online, highest) != 0)
+    parse_cpulist(buf, topology->online, highest);
+  topology_count_online(topology);
+  //get packages, cores and caches of each online logical processor
+  for (cpu = 0; cpu <= highest; cpu++) {
+    if (!topology->online[cpu])
+      continue;
+    if (topology->domain[CROSSRUN_TOPOLOGY_PACKAGE][cpu] < 0 && sysfs_read_siblings(topology, path, cpu, "package_cpus_list", "core_siblings_list", cpus) == 0) {
+      snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/topology/physical_package_id", path, cpu);
+      if (read_int(filepath, &id) != 0)
+        id = -1;
+      topology_add_domain(topology, CROSSRUN_TOPOLOGY_PACKAGE, cpus, id);
+    }
+    if (topology->domain[CROSSRUN_TOPOLOGY_CORE][cpu] < 0 && sysfs_read_siblings(topology, path, cpu, "core_cpus_list", "thread_siblings_list", cpus) == 0) {
+      snprintf(filepath, sizeof(filepath), "%s/cpu/cpu%i/topology/core_id", path, cpu);
+      if (read_int(filepath, &id) != 0)
+        id = -1;
+      topology_add_domain(topology, CROSSRUN_TOPOLOGY_CORE, cpus, id);
+    }
+    if (topology->domain[CROSSRUN_TOPOLOGY_L2][cpu] < 0 || topology->domain[CROSSRUN_TOPOLOGY_L3][cpu] < 0)
+      sysfs_read_caches(topology, path, cpu, cpus);
+  }
+  sysfs_read_nodes(topology, path, cpus);
+  free(cpus);
+  //logical processors without topology information are separate cores in one package and node
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_PACKAGE, 0);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_CORE, 1);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_NODE, 0);
+  return topology;
+}
+#endif
+
+#ifdef _WIN32
+static void windows_add_domain (struct crossrun_topology_struct* topology, int level, ULONG_PTR mask, int id, unsigned char* cpus)
+{
+  int i;
+  for (i = 0; i <= topology->highest; i++)
+    cpus[i] = ((mask >> i) & 1);
+  topology_add_domain(topology, level, cpus, id);
+}
+
+static struct crossrun_topology_struct* windows_read ()
+{
+  SYSTEM_LOGICAL_PROCESSOR_INFORMATION* cpuinfo;
+  DWORD cpuinfolen = 0;
+  DWORD_PTR processmask;
+  DWORD_PTR systemmask;
+  unsigned char cpus[sizeof(ULONG_PTR) * 8];
+  size_t n;
+  size_t i;
+  int cpu;
+  int highest = -1;
+  struct crossrun_topology_struct* topology;
+  if (!GetProcessAffinityMask(GetCurrentProcess(), &processmask, &systemmask) || systemmask == 0)
+    return NULL;
+  for (cpu = 0; cpu < (int)sizeof(systemmask) * 8; cpu++)
+    if ((systemmask >> cpu) & 1)
+      highest = cpu;
+  if (!(GetLogicalProcessorInformation(NULL, &cpuinfolen) == FALSE && GetLastError() == ERROR_INSUFFICIENT_BUFFER))
+    return NULL;
+  if ((cpuinfo = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION*)malloc(cpuinfolen)) == NULL)
+    return NULL;
+  if (!GetLogicalProcessorInformation(cpuinfo, &cpuinfolen) || (topology = topology_alloc(highest)) == NULL) {
+    free(cpuinfo);
+    return NULL;
+  }
+  for (cpu = 0; cpu <= highest; cpu++)
+    topology->online[cpu] = ((systemmask >> cpu) & 1);
+  topology_count_online(topology);
+  n = cpuinfolen / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION);
+  for (i = 0; i < n; i++) {
+    switch (cpuinfo[i].Relationship) {
+      case RelationProcessorPackage:
+        windows_add_domain(topology, CROSSRUN_TOPOLOGY_PACKAGE, cpuinfo[i].ProcessorMask, -1, cpus);
+        break;
+      case RelationProcessorCore:
+        windows_add_domain(topology, CROSSRUN_TOPOLOGY_CORE, cpuinfo[i].ProcessorMask, -1, cpus);
+        break;
+      case RelationCache:
+        if ((cpuinfo[i].Cache.Level == 2 || cpuinfo[i].Cache.Level == 3) && cpuinfo[i].Cache.Type != CacheInstruction)
+          windows_add_domain(topology, (cpuinfo[i].Cache.Level == 2 ? CROSSRUN_TOPOLOGY_L2 : CROSSRUN_TOPOLOGY_L3), cpuinfo[i].ProcessorMask, -1, cpus);
+        break;
+      case RelationNumaNode:
+        windows_add_domain(topology, CROSSRUN_TOPOLOGY_NODE, cpuinfo[i].ProcessorMask, cpuinfo[i].NumaNode.NodeNumber, cpus);
+        break;
+      default:
+        break;
+    }
+  }
+  free(cpuinfo);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_PACKAGE, 0);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_CORE, 1);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_NODE, 0);
+  return topology;
+}
+#endif
+
+//every logical processor is a separate core in one package and node
+static struct crossrun_topology_struct* flat_topology ()
+{
+  int i;
+  unsigned long n;
+  struct crossrun_topology_struct* topology;
+  if ((n = crossrun_get_logical_processors()) == 0 || (topology = topology_alloc((int)n - 1)) == NULL)
+    return NULL;
+  for (i = 0; i <= topology->highest; i++)
+    topology->online[i] = 1;
+  topology_count_online(topology);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_PACKAGE, 0);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_CORE, 1);
+  topology_add_missing(topology, CROSSRUN_TOPOLOGY_NODE, 0);
+  return topology;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_topology crossrun_topology_create ()
+{
+  struct crossrun_topology_struct* topology = NULL;
+#if defined(_WIN32)
+  topology = windows_read();
+#elif defined(__linux__)
+  topology = sysfs_read(SYSFS_PATH);
+#endif
+  if (!topology)
+    topology = flat_topology();
+  return topology;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_topology crossrun_topology_create_from_path (const char* path)
+{
+#ifdef __linux__
+  if (!path)
+    return NULL;
+  return sysfs_read(path);
+#else
+  return NULL;
+#endif
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_topology_free (crossrun_topology topology)
+{
+  int level;
+  if (!topology)
+    return;
+  for (level = 0; level < TOPOLOGY_LEVELS; level++) {
+    free(topology->domain[level]);
+    free(topology->domainid[level]);
+  }
+  free(topology->online);
+  free(topology);
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_topology_get_cpus (crossrun_topology topology)
+{
+  if (!topology)
+    return 0;
+  return topology->cpus;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_highest_cpu (crossrun_topology topology)
+{
+  if (!topology)
+    return -1;
+  return topology->highest;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_topology_is_online (crossrun_topology topology, int cpuindex)
+{
+  if (!topology || cpuindex < 0 || cpuindex > topology->highest)
+    return 0;
+  return topology->online[cpuindex];
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_count (crossrun_topology topology, int level)
+{
+  if (!topology || level < 0 || level >= TOPOLOGY_LEVELS)
+    return 0;
+  return topology->count[level];
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_domain (crossrun_topology topology, int cpuindex, int level)
+{
+  if (!topology || level < 0 || level >= TOPOLOGY_LEVELS || cpuindex < 0 || cpuindex > topology->highest)
+    return -1;
+  return topology->domain[level][cpuindex];
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_domain_id (crossrun_topology topology, int level, int index)
+{
+  if (!topology || level < 0 || level >= TOPOLOGY_LEVELS || index < 0 || index >= topology->count[level])
+    return -1;
+  return topology->domainid[level][index];
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_topology_get_domains (crossrun_topology topology, int level, crossrun_cpumask cpumask, int* domains, int maxdomains)
+{
+  int i;
+  int index;
+  int count = 0;
+  unsigned char* used;
+  if (!topology || level < 0 || level >= TOPOLOGY_LEVELS || !cpumask)
+    return -1;
+  if ((used = (unsigned char*)malloc(topology->count[level] + 1)) == NULL)
+    return -1;
+  memset(used, 0, topology->count[level] + 1);
+  for (i = 0; i <= topology->highest && i < (int)crossrun_cpumask_get_cpus(cpumask); i++) {
+    if (topology->online[i] && (index = topology->domain[level][i]) >= 0 && crossrun_cpumask_is_set(cpumask, i))
+      used[index] = 1;
+  }
+  for (index = 0; index < topology->count[level]; index++) {
+    if (used[index]) {
+      if (domains && count < maxdomains)
+        domains[count] = index;
+      count++;
+    }
+  }
+  free(used);
+  return count;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_topology_get_cpumask (crossrun_topology topology, int level, int index)
+{
+  int i;
+  crossrun_cpumask cpumask;
+  if (!topology || level < 0 || level >= TOPOLOGY_LEVELS || index < -1 || index >= topology->count[level])
+    return NULL;
+  if ((cpumask = crossrun_cpumask_create_size(topology->maskcpus)) == NULL)
+    return NULL;
+  for (i = 0; i <= topology->highest && i < (int)crossrun_cpumask_get_cpus(cpumask); i++) {
+    if (topology->online[i] && (index < 0 || topology->domain[level][i] == index))
+      crossrun_cpumask_set(cpumask, i);
+  }
+  return cpumask;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_cpumask crossrun_topology_get_one_per_domain (crossrun_topology topology, int level, crossrun_cpumask within)
+{
+  int i;
+  int index;
+  unsigned char* used;
+  crossrun_cpumask cpumask;
+  if (!topology || level < 0 || level >= TOPOLOGY_LEVELS)
+    return NULL;
+  if ((used = (unsigned char*)malloc(topology->count[level] + 1)) == NULL)
+    return NULL;
+  memset(used, 0, topology->count[level] + 1);
+  if ((cpumask = crossrun_cpumask_create_size(topology->maskcpus)) == NULL) {
+    free(used);
+    return NULL;
+  }
+  for (i = 0; i <= topology->highest && i < (int)crossrun_cpumask_get_cpus(cpumask); i++) {
+    if (!topology->online[i] || (index = topology->domain[level][i]) < 0 || used[index])
+      continue;
+    if (within && (i >= (int)crossrun_cpumask_get_cpus(within) || !crossrun_cpumask_is_set(within, i)))
+      continue;
+    used[index] = 1;
+    crossrun_cpumask_set(cpumask, i);
+  }
+  free(used);
+  return cpumask;
+}
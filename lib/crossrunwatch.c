@@ -0,0 +1,477 @@
+#include "crossrunpriv.h"
+#include "crossrunwatch.h"
+#include <stdlib.h>
+#include <string.h>
+
+//how often a regular expression element must match
+#define QUANT_ONE       0
+#define QUANT_STAR      1
+#define QUANT_PLUS      2
+#define QUANT_QUEST     3
+
+//element of a regular expression, matching any byte in a set
+struct watch_token {
+  unsigned char set[32];
+  int quant;
+};
+
+struct watch_pattern {
+  char* text;
+  size_t textlen;
+  int type;
+  struct watch_token* tokens;     //compiled regular expression
+  int tokencount;
+  int anchorstart;
+  int anchorend;
+  crossrun_watch_fn fn;
+  void* callbackdata;
+};
+
+struct crossrun_watch_struct {
+  struct watch_pattern* patterns;
+  int patterncount;
+  int literalcount;
+  int regexcount;
+  int* delta;                     //state transitions of the automaton matching all literal patterns (256 per state)
+  int* output;                    //index of literal pattern found when reaching each state (or -1)
+  int statecount;
+  int state;                      //current state of the automaton
+  int dirty;                      //automaton must be rebuilt
+  unsigned char skipset[256];     //bytes that can leave the initial state (first bytes of literal patterns and newline if regular expressions are used)
+  int skipcount;
+  char line[CROSSRUN_WATCH_MAX_LINE];
+  size_t linelen;
+  int lineended;                  //line ended with a newline that completed a literal pattern and wasn't checked yet
+};
+
+#define TOKEN_SET(token, c) ((token)->set[(unsigned char)(c) >> 3] |= (unsigned char)(1 << ((unsigned char)(c) & 7)))
+#define TOKEN_HAS(token, c) ((token)->set[(unsigned char)(c) >> 3] & (1 << ((unsigned char)(c) & 7)))
+
+//add the bytes matched by an escape sequence to a token
+static void token_add_escape (struct watch_token* token, char c)
+{
+  int i;
+  switch (c) {
+    case 'd':
+      for (i = '0'; i <= '9'; i++)
+        TOKEN_SET(token, i);
+      break;
+    case 's':
+      TOKEN_SET(token, ' ');
+      TOKEN_SET(token, '\t');
+      TOKEN_SET(token, '\r');
+      TOKEN_SET(token, '\n');
+      TOKEN_SET(token, '\f');
+      TOKEN_SET(token, '\v');
+      break;
+    case 'w':
+      for (i = 0; i < 256; i++)
+        if ((i >= '0' && i <= '9') || (i >= 'A' && i <= 'Z') || (i >= 'a' && i <= 'z') || i == '_')
+          TOKEN_SET(token, i);
+      break;
+    case 't':
+      TOKEN_SET(token, '\t');
+      break;
+    default:
+      TOKEN_SET(token, c);
+      break;
+  }
+}
+
+//compile a regular expression into a list of tokens
+static int regex_compile (struct watch_pattern* pattern)
+{
+  const char* p = pattern->text;
+  const char* end = pattern->text + pattern->textlen;
+  struct watch_token* token;
+  int i;
+  int negate;
+  if ((pattern->tokens = (struct watch_token*)calloc(pattern->textlen + 1, sizeof(struct watch_token))) == NULL)
+    return -1;
+  pattern->tokencount = 0;
+  pattern->anchorstart = 0;
+  pattern->anchorend = 0;
+  if (p < end && *p == '^') {
+    pattern->anchorstart = 1;
+    p++;
+  }
+  while (p < end) {
+    if (*p == '$' && p + 1 == end) {
+      pattern->anchorend = 1;
+      break;
+    }
+    token = &pattern->tokens[pattern->tokencount++];
+    switch (*p) {
+      case '.':
+        for (i = 0; i < 256; i++)
+          if (i != '\n')
+            TOKEN_SET(token, i);
+        p++;
+        break;
+      case '\\':
+        if (++p == end)
+          return -1;
+        token_add_escape(token, *p++);
+        break;
+      case '[':
+        negate = 0;
+        if (++p < end && *p == '^') {
+          negate = 1;
+          p++;
+        }
+        //a closing bracket right after the opening bracket is part of the set
+        do {
+          if (p == end)
+            return -1;
+          if (*p == '\\' && p + 1 < end) {
+            token_add_escape(token, p[1]);
+            p += 2;
+          } else if (p + 2 < end && p[1] == '-' && p[2] != ']') {
+            for (i = (unsigned char)p[0]; i <= (unsigned char)p[2]; i++)
+              TOKEN_SET(token, i);
+            p += 3;
+          } else {
+            TOKEN_SET(token, *p);
+            p++;
+          }
+        } while (p < end && *p != ']');
+        if (p == end)
+          return -1;
+        p++;
+        if (negate)
+          for (i = 0; i < 32; i++)
+            token->set[i] = ~token->set[i];
+        break;
+      case '*':
+      case '+':
+      case '?':
+        //quantifier without anything to repeat
+        return -1;
+      default:
+        TOKEN_SET(token, *p);
+        p++;
+        break;
+    }
+    if (p < end) {
+      switch (*p) {
+        case '*':
+          token->quant = QUANT_STAR;
+          p++;
+          break;
+        case '+':
+          token->quant = QUANT_PLUS;
+          p++;
+          break;
+        case '?':
+          token->quant = QUANT_QUEST;
+          p++;
+          break;
+      }
+    }
+  }
+  return 0;
+}
+
+//match tokens at the start of the text
+static int regex_match_here (const struct watch_token* token, int count, const unsigned char* s, size_t len, int anchorend)
+{
+  size_t n;
+  size_t min;
+  size_t max;
+  while (count > 0) {
+    if (token->quant == QUANT_ONE) {
+      if (len == 0 || !TOKEN_HAS(token, *s))
+        return 0;
+      s++;
+      len--;
+      token++;
+      count--;
+      continue;
+    }
+    //match as many as possible and back off until the rest matches
+    min = (token->quant == QUANT_PLUS ? 1 : 0);
+    max = (token->quant == QUANT_QUEST ? 1 : len);
+    for (n = 0; n < max && n < len && TOKEN_HAS(token, s[n]); n++)
+      ;
+    while (n >= min) {
+      if (regex_match_here(token + 1, count - 1, s + n, len - n, anchorend))
+        return 1;
+      if (n-- == 0)
+        break;
+    }
+    return 0;
+  }
+  return (!anchorend || len == 0);
+}
+
+static int regex_match (const struct watch_pattern* pattern, const char* line, size_t linelen)
+{
+  size_t i;
+  if (pattern->anchorstart)
+    return regex_match_here(pattern->tokens, pattern->tokencount, (const unsigned char*)line, linelen, pattern->anchorend);
+  for (i = 0; i <= linelen; i++)
+    if (regex_match_here(pattern->tokens, pattern->tokencount, (const unsigned char*)line + i, linelen - i, pattern->anchorend))
+      return 1;
+  return 0;
+}
+
+//build the automaton (Aho-Corasick) that finds all literal patterns in a single pass over the data
+static int build_automaton (crossrun_watch watch)
+{
+  int i;
+  int c;
+  int s;
+  int next;
+  int head;
+  int tail;
+  int states = 1;
+  size_t j;
+  int* fail;
+  int* queue;
+  unsigned char seen[256];
+  free(watch->delta);
+  free(watch->output);
+  watch->delta = NULL;
+  watch->output = NULL;
+  watch->statecount = 0;
+  watch->state = 0;
+  watch->skipcount = 0;
+  memset(seen, 0, sizeof(seen));
+  for (i = 0; i < watch->patterncount; i++)
+    if (watch->patterns[i].type == CROSSRUN_WATCH_LITERAL)
+      states += (int)watch->patterns[i].textlen;
+  if (watch->literalcount > 0) {
+    if ((watch->delta = (int*)malloc((size_t)states * 256 * sizeof(int))) == NULL || (watch->output = (int*)malloc(states * sizeof(int))) == NULL)
+      return -1;
+    for (i = 0; i < states * 256; i++)
+      watch->delta[i] = -1;
+    for (i = 0; i < states; i++)
+      watch->output[i] = -1;
+    //build the trie of all literal patterns
+    watch->statecount = 1;
+    for (i = 0; i < watch->patterncount; i++) {
+      if (watch->patterns[i].type != CROSSRUN_WATCH_LITERAL)
+        continue;
+      s = 0;
+      for (j = 0; j < watch->patterns[i].textlen; j++) {
+        c = (unsigned char)watch->patterns[i].text[j];
+        if (watch->delta[s * 256 + c] < 0)
+          watch->delta[s * 256 + c] = watch->statecount++;
+        s = watch->delta[s * 256 + c];
+      }
+      if (watch->output[s] < 0)
+        watch->output[s] = i;
+      c = (unsigned char)watch->patterns[i].text[0];
+      if (!seen[c]) {
+        seen[c] = 1;
+        watch->skipset[watch->skipcount++] = (unsigned char)c;
+      }
+    }
+    //add failure transitions breadth first so each state continues with the longest suffix that is also a prefix
+    if ((fail = (int*)malloc(watch->statecount * sizeof(int))) == NULL || (queue = (int*)malloc(watch->statecount * sizeof(int))) == NULL) {
+      free(fail);
+      return -1;
+    }
+    head = 0;
+    tail = 0;
+    for (c = 0; c < 256; c++) {
+      if ((next = watch->delta[c]) < 0) {
+        watch->delta[c] = 0;
+      } else {
+        fail[next] = 0;
+        queue[tail++] = next;
+      }
+    }
+    while (head < tail) {
+      s = queue[head++];
+      if (watch->output[s] < 0)
+        watch->output[s] = watch->output[fail[s]];
+      for (c = 0; c < 256; c++) {
+        if ((next = watch->delta[s * 256 + c]) < 0) {
+          watch->delta[s * 256 + c] = watch->delta[fail[s] * 256 + c];
+        } else {
+          fail[next] = watch->delta[fail[s] * 256 + c];
+          queue[tail++] = next;
+        }
+      }
+    }
+    free(queue);
+    free(fail);
+  }
+  //regular expressions are checked at the end of each line
+  if (watch->regexcount > 0 && !seen['\n'])
+    watch->skipset[watch->skipcount++] = '\n';
+  watch->dirty = 0;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN crossrun_watch crossrun_watch_create ()
+{
+  struct crossrun_watch_struct* watch;
+  if ((watch = (struct crossrun_watch_struct*)malloc(sizeof(struct crossrun_watch_struct))) == NULL)
+    return NULL;
+  watch->patterns = NULL;
+  watch->patterncount = 0;
+  watch->literalcount = 0;
+  watch->regexcount = 0;
+  watch->delta = NULL;
+  watch->output = NULL;
+  watch->statecount = 0;
+  watch->state = 0;
+  watch->dirty = 0;
+  watch->skipcount = 0;
+  watch->linelen = 0;
+  watch->lineended = 0;
+  return watch;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_watch_free (crossrun_watch watch)
+{
+  int i;
+  if (!watch)
+    return;
+  for (i = 0; i < watch->patterncount; i++) {
+    free(watch->patterns[i].text);
+    free(watch->patterns[i].tokens);
+  }
+  free(watch->patterns);
+  free(watch->delta);
+  free(watch->output);
+  free(watch);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_watch_add (crossrun_watch watch, const char* pattern, int type, crossrun_watch_fn fn, void* callbackdata)
+{
+  struct watch_pattern* p;
+  if (!watch || !pattern || !*pattern || (type != CROSSRUN_WATCH_LITERAL && type != CROSSRUN_WATCH_REGEX))
+    return -1;
+  if ((p = (struct watch_pattern*)realloc(watch->patterns, (watch->patterncount + 1) * sizeof(struct watch_pattern))) == NULL)
+    return -1;
+  watch->patterns = p;
+  p += watch->patterncount;
+  p->textlen = strlen(pattern);
+  p->type = type;
+  p->tokens = NULL;
+  p->tokencount = 0;
+  p->fn = fn;
+  p->callbackdata = callbackdata;
+  if ((p->text = strdup(pattern)) == NULL)
+    return -1;
+  if (type == CROSSRUN_WATCH_REGEX && regex_compile(p) != 0) {
+    free(p->text);
+    free(p->tokens);
+    return -1;
+  }
+  if (type == CROSSRUN_WATCH_REGEX)
+    watch->regexcount++;
+  else
+    watch->literalcount++;
+  watch->dirty = 1;
+  watch->linelen = 0;
+  watch->lineended = 0;
+  return watch->patterncount++;
+}
+
+//remember the current line for matching regular expressions
+static void line_append (crossrun_watch watch, const char* data, size_t datalen)
+{
+  if (datalen > CROSSRUN_WATCH_MAX_LINE - watch->linelen)
+    datalen = CROSSRUN_WATCH_MAX_LINE - watch->linelen;
+  memcpy(watch->line + watch->linelen, data, datalen);
+  watch->linelen += datalen;
+}
+
+//check the regular expressions against the line that just ended and start a new line
+static int line_check (crossrun_watch watch)
+{
+  int i;
+  size_t len;
+  const struct watch_pattern* pattern;
+  len = watch->linelen;
+  if (len > 0 && watch->line[len - 1] == '\r')
+    len--;
+  watch->linelen = 0;
+  watch->lineended = 0;
+  for (i = 0; i < watch->patterncount; i++) {
+    pattern = &watch->patterns[i];
+    if (pattern->type == CROSSRUN_WATCH_REGEX && regex_match(pattern, watch->line, len)) {
+      if (pattern->fn)
+        (*pattern->fn)(watch, i, watch->line, len, pattern->callbackdata);
+      return i;
+    }
+  }
+  return -1;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_watch_feed (crossrun_watch watch, const char* data, size_t datalen, size_t* consumed)
+{
+  size_t pos = 0;
+  size_t end;
+  int i;
+  const char* p;
+  const struct watch_pattern* pattern;
+  unsigned char c;
+  if (!watch || (!data && datalen > 0))
+    return -1;
+  if (watch->dirty && build_automaton(watch) != 0)
+    return -1;
+  //the line ended by the literal pattern found by the previous call still has to be checked
+  if (watch->lineended && (i = line_check(watch)) >= 0) {
+    if (consumed)
+      *consumed = 0;
+    return i;
+  }
+  while (pos < datalen && watch->skipcount > 0) {
+    //in the initial state skip to the next byte that can start a match
+    if (watch->state == 0) {
+      end = ((p = crossrun_scan_set(data + pos, datalen - pos, watch->skipset, watch->skipcount)) != NULL ? (size_t)(p - data) : datalen);
+      if (watch->regexcount > 0)
+        line_append(watch, data + pos, end - pos);
+      if ((pos = end) == datalen)
+        break;
+    }
+    c = (unsigned char)data[pos++];
+    //check the literal patterns
+    if (watch->literalcount > 0) {
+      watch->state = watch->delta[watch->state * 256 + c];
+      if ((i = watch->output[watch->state]) >= 0) {
+        if (watch->regexcount > 0) {
+          if (c == '\n')
+            watch->lineended = 1;
+          else
+            line_append(watch, (const char*)&c, 1);
+        }
+        pattern = &watch->patterns[i];
+        if (pattern->fn)
+          (*pattern->fn)(watch, i, pattern->text, pattern->textlen, pattern->callbackdata);
+        if (consumed)
+          *consumed = pos;
+        return i;
+      }
+    }
+    //check the regular expressions at the end of each line
+    if (watch->regexcount > 0) {
+      if (c != '\n') {
+        line_append(watch, (const char*)&c, 1);
+        continue;
+      }
+      if ((i = line_check(watch)) >= 0) {
+        if (consumed)
+          *consumed = pos;
+        return i;
+      }
+    }
+  }
+  if (consumed)
+    *consumed = datalen;
+  return -1;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_watch_reset (crossrun_watch watch)
+{
+  if (!watch)
+    return;
+  watch->state = 0;
+  watch->linelen = 0;
+  watch->lineended = 0;
+}
@@ -0,0 +1,478 @@
+#include "crossrunpriv.h"
+#include "crossrunworker.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#endif
+
+//initial size of the buffers for frames
+#define WORKER_BUFFER_SIZE (64 * 1024)
+//initial number of slots for requests in flight (must be a power of 2)
+#define WORKER_PENDING_SLOTS 64
+
+struct worker_request {
+  uint32_t id;
+  int used;
+  crossrun_worker_response_fn fn;
+  void* callbackdata;
+};
+
+struct crossrun_worker_struct {
+  crossrun handle;
+  uint32_t nextid;
+  int failed;
+  struct worker_request* pending; //requests in flight, indexed by ID modulo number of slots
+  size_t pendingslots;
+  size_t pendingcount;
+  char* out;                      //frames not written yet
+  size_t outpos;
+  size_t outlen;
+  size_t outsize;
+  char* in;                       //data read that doesn't form a complete frame yet
+  size_t inlen;
+  size_t insize;
+};
+
+struct crossrun_worker_child_struct {
+  char* in;
+  size_t inpos;
+  size_t inlen;
+  size_t insize;
+  char* out;
+  size_t outlen;
+  size_t outsize;
+};
+
+static void put_uint32 (char* p, uint32_t value)
+{
+  p[0] = (char)(value & 0xFF);
+  p[1] = (char)((value >> 8) & 0xFF);
+  p[2] = (char)((value >> 16) & 0xFF);
+  p[3] = (char)((value >> 24) & 0xFF);
+}
+
+static uint32_t get_uint32 (const char* p)
+{
+  return (uint32_t)(unsigned char)p[0] | ((uint32_t)(unsigned char)p[1] << 8) | ((uint32_t)(unsigned char)p[2] << 16) | ((uint32_t)(unsigned char)p[3] << 24);
+}
+
+//make sure a buffer can hold the specified number of bytes, keeping its contents
+static int ensure_buffer (char** buf, size_t* bufsize, size_t size)
+{
+  char* p;
+  size_t newsize;
+  if (size <= *bufsize)
+    return 0;
+  newsize = (*bufsize ? *bufsize : WORKER_BUFFER_SIZE);
+  while (newsize < size)
+    newsize *= 2;
+  if ((p = (char*)realloc(*buf, newsize)) == NULL)
+    return -1;
+  *buf = p;
+  *bufsize = newsize;
+  return 0;
+}
+
+//add a request in flight, doubling the number of slots until it doesn't collide with another request
+static int pending_add (crossrun_worker worker, uint32_t id, crossrun_worker_response_fn fn, void* callbackdata)
+{
+  size_t i;
+  size_t slots = worker->pendingslots;
+  struct worker_request* p;
+  while (worker->pending[id & (worker->pendingslots - 1)].used) {
+    slots *= 2;
+    if ((p = (struct worker_request*)calloc(slots, sizeof(struct worker_request))) == NULL)
+      return -1;
+    for (i = 0; i < worker->pendingslots; i++) {
+      if (worker->pending[i].used) {
+        if (p[worker->pending[i].id & (slots - 1)].used)
+          break;
+        p[worker->pending[i].id & (slots - 1)] = worker->pending[i];
+      }
+    }
+    //try again with even more slots if requests still collide
+    if (i < worker->pendingslots) {
+      free(p);
+      continue;
+    }
+    free(worker->pending);
+    worker->pending = p;
+    worker->pendingslots = slots;
+  }
+  p = &worker->pending[id & (worker->pendingslots - 1)];
+  p->id = id;
+  p->used = 1;
+  p->fn = fn;
+  p->callbackdata = callbackdata;
+  worker->pendingcount++;
+  return 0;
+}
+
+static struct worker_request* pending_find (crossrun_worker worker, uint32_t id)
+{
+  struct worker_request* p = &worker->pending[id & (worker->pendingslots - 1)];
+  return (p->used && p->id == id ? p : NULL);
+}
+
+//give up on all requests in flight after the worker process ended or on a protocol error
+static int worker_fail (crossrun_worker worker)
+{
+  size_t i;
+  worker->failed = 1;
+  worker->outlen = 0;
+  for (i = 0; i < worker->pendingslots; i++) {
+    if (worker->pending[i].used) {
+      worker->pending[i].used = 0;
+      worker->pendingcount--;
+      if (worker->pending[i].fn)
+        (*worker->pending[i].fn)(worker, worker->pending[i].id, NULL, 0, worker->pending[i].callbackdata);
+    }
+  }
+  return -1;
+}
+
+//call the callbacks for the complete frames read so far, returns the number of responses or -1 on a protocol error
+static int worker_dispatch (crossrun_worker worker)
+{
+  size_t pos = 0;
+  uint32_t id;
+  uint32_t len;
+  int count = 0;
+  struct worker_request* request;
+  struct worker_request r;
+  while (worker->inlen - pos >= CROSSRUN_WORKER_FRAME_HEADER) {
+    id = get_uint32(worker->in + pos);
+    len = get_uint32(worker->in + pos + 4);
+    if (len > CROSSRUN_WORKER_MAX_FRAME)
+      return -1;
+    if (worker->inlen - pos - CROSSRUN_WORKER_FRAME_HEADER < len) {
+      //make room for the rest of the frame
+      if (ensure_buffer(&worker->in, &worker->insize, CROSSRUN_WORKER_FRAME_HEADER + len) != 0)
+        return -1;
+      break;
+    }
+    //responses to unknown requests are ignored
+    if ((request = pending_find(worker, id)) != NULL) {
+      r = *request;
+      request->used = 0;
+      worker->pendingcount--;
+      count++;
+      if (r.fn)
+        (*r.fn)(worker, id, worker->in + pos + CROSSRUN_WORKER_FRAME_HEADER, len, r.callbackdata);
+    }
+    pos += CROSSRUN_WORKER_FRAME_HEADER + len;
+  }
+  if (pos > 0) {
+    memmove(worker->in, worker->in + pos, worker->inlen - pos);
+    worker->inlen -= pos;
+  }
+  return count;
+}
+
+#ifndef _WIN32
+//write queued frames as far as possible without blocking
+static int worker_flush (crossrun_worker worker)
+{
+  ssize_t n;
+  int fd = worker->handle->stdin_pipe[PIPE_WRITE];
+  while (worker->outlen > 0) {
+    if ((n = write(fd, worker->out + worker->outpos, worker->outlen)) < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN)
+        break;
+      return -1;
+    }
+    worker->outpos += n;
+    worker->outlen -= n;
+  }
+  if (worker->outlen == 0)
+    worker->outpos = 0;
+  return 0;
+}
+#endif
+
+DLL_EXPORT_CROSSRUN crossrun_worker crossrun_worker_create (crossrun handle)
+{
+  struct crossrun_worker_struct* worker;
+#ifdef _WIN32
+  if (!handle || !handle->stdin_pipe[PIPE_WRITE] || !handle->stdout_pipe[PIPE_READ])
+    return NULL;
+#else
+  if (!handle || handle->stdin_pipe[PIPE_WRITE] < 0 || handle->stdout_pipe[PIPE_READ] < 0)
+    return NULL;
+#endif
+  if ((worker = (struct crossrun_worker_struct*)malloc(sizeof(struct crossrun_worker_struct))) == NULL)
+    return NULL;
+  worker->handle = handle;
+  worker->nextid = 1;
+  worker->failed = 0;
+  worker->pendingslots = WORKER_PENDING_SLOTS;
+  worker->pendingcount = 0;
+  worker->out = NULL;
+  worker->outpos = 0;
+  worker->outlen = 0;
+  worker->outsize = 0;
+  worker->in = NULL;
+  worker->inlen = 0;
+  worker->insize = 0;
+  if ((worker->pending = (struct worker_request*)calloc(worker->pendingslots, sizeof(struct worker_request))) == NULL || ensure_buffer(&worker->in, &worker->insize, WORKER_BUFFER_SIZE) != 0) {
+    crossrun_worker_free(worker);
+    return NULL;
+  }
+#ifndef _WIN32
+  //make sure writing never blocks
+  fcntl(handle->stdin_pipe[PIPE_WRITE], F_SETFL, fcntl(handle->stdin_pipe[PIPE_WRITE], F_GETFL) | O_NONBLOCK);
+#endif
+  return worker;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_worker_free (crossrun_worker worker)
+{
+  if (!worker)
+    return;
+  free(worker->pending);
+  free(worker->out);
+  free(worker->in);
+  free(worker);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_worker_send (crossrun_worker worker, const char* data, size_t datalen, crossrun_worker_response_fn fn, void* callbackdata, uint32_t* requestid)
+{
+  uint32_t id;
+  char header[CROSSRUN_WORKER_FRAME_HEADER];
+  if (!worker || worker->failed || datalen > CROSSRUN_WORKER_MAX_FRAME || (!data && datalen > 0))
+    return -1;
+  //skip IDs of requests still in flight after the IDs wrapped around
+  do {
+    id = worker->nextid++;
+  } while (pending_find(worker, id));
+  if (pending_add(worker, id, fn, callbackdata) != 0)
+    return -1;
+  put_uint32(header, id);
+  put_uint32(header + 4, (uint32_t)datalen);
+  if (requestid)
+    *requestid = id;
+#ifdef _WIN32
+  {
+    crossrun_iovec iov[2];
+    iov[0].data = header;
+    iov[0].datalen = CROSSRUN_WORKER_FRAME_HEADER;
+    iov[1].data = data;
+    iov[1].datalen = datalen;
+    if (crossrun_writev(worker->handle, iov, 2) != 0)
+      return worker_fail(worker);
+  }
+#else
+  //queue the frame behind frames not written yet
+  if (worker->outpos > 0 && worker->outpos + worker->outlen + CROSSRUN_WORKER_FRAME_HEADER + datalen > worker->outsize) {
+    memmove(worker->out, worker->out + worker->outpos, worker->outlen);
+    worker->outpos = 0;
+  }
+  if (ensure_buffer(&worker->out, &worker->outsize, worker->outpos + worker->outlen + CROSSRUN_WORKER_FRAME_HEADER + datalen) != 0) {
+    pending_find(worker, id)->used = 0;
+    worker->pendingcount--;
+    return -1;
+  }
+  memcpy(worker->out + worker->outpos + worker->outlen, header, CROSSRUN_WORKER_FRAME_HEADER);
+  if (datalen > 0)
+    memcpy(worker->out + worker->outpos + worker->outlen + CROSSRUN_WORKER_FRAME_HEADER, data, datalen);
+  worker->outlen += CROSSRUN_WORKER_FRAME_HEADER + datalen;
+  if (worker_flush(worker) != 0)
+    return worker_fail(worker);
+#endif
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_worker_process (crossrun_worker worker, int timeout)
+{
+  int n;
+  int count = 0;
+  if (!worker || worker->failed)
+    return -1;
+  while (1) {
+#ifdef _WIN32
+    //requests were already written, so only wait for data if asked to
+    if (timeout == 0 && crossrun_data_waiting(worker->handle) <= 0)
+      break;
+#else
+    struct pollfd pollinfo[2];
+    //write queued requests
+    if (worker_flush(worker) != 0)
+      return worker_fail(worker);
+    //wait until responses can be read or more requests can be written
+    if (!worker->handle->readbuf || worker->handle->readbuflen == 0) {
+      pollinfo[0].fd = worker->handle->stdout_pipe[PIPE_READ];
+      pollinfo[0].events = POLLIN;
+      pollinfo[0].revents = 0;
+      pollinfo[1].fd = worker->handle->stdin_pipe[PIPE_WRITE];
+      pollinfo[1].events = POLLOUT;
+      pollinfo[1].revents = 0;
+      if ((n = poll(pollinfo, (worker->outlen > 0 ? 2 : 1), (count > 0 ? 0 : timeout))) < 0 && errno != EINTR)
+        return worker_fail(worker);
+      if (n <= 0)
+        break;
+      if (pollinfo[0].revents == 0)
+        continue;
+    }
+#endif
+    //read responses
+    if ((n = crossrun_read(worker->handle, worker->in + worker->inlen, (int)(worker->insize - worker->inlen > 0x40000000 ? 0x40000000 : worker->insize - worker->inlen))) <= 0)
+      return worker_fail(worker);
+    worker->inlen += n;
+    if ((n = worker_dispatch(worker)) < 0)
+      return worker_fail(worker);
+    count += n;
+    if (count > 0 && worker->inlen == 0)
+      break;
+  }
+  return count;
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_worker_wait (crossrun_worker worker, uint32_t requestid)
+{
+  if (!worker)
+    return -1;
+  while (pending_find(worker, requestid)) {
+    if (crossrun_worker_process(worker, -1) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN size_t crossrun_worker_pending (crossrun_worker worker)
+{
+  return (worker ? worker->pendingcount : 0);
+}
+
+DLL_EXPORT_CROSSRUN crossrun_worker_child crossrun_worker_child_create ()
+{
+  struct crossrun_worker_child_struct* child;
+  if ((child = (struct crossrun_worker_child_struct*)malloc(sizeof(struct crossrun_worker_child_struct))) == NULL)
+    return NULL;
+  child->in = NULL;
+  child->inpos = 0;
+  child->inlen = 0;
+  child->insize = 0;
+  child->out = NULL;
+  child->outlen = 0;
+  child->outsize = 0;
+  if (ensure_buffer(&child->in, &child->insize, WORKER_BUFFER_SIZE) != 0) {
+    free(child);
+    return NULL;
+  }
+#ifdef _WIN32
+  _setmode(0, _O_BINARY);
+  _setmode(1, _O_BINARY);
+#endif
+  return child;
+}
+
+//write buffered responses to standard output
+static int child_flush (crossrun_worker_child child)
+{
+  size_t pos = 0;
+#ifdef _WIN32
+  int n;
+  while (pos < child->outlen) {
+    if ((n = _write(1, child->out + pos, (unsigned int)(child->outlen - pos > 0x40000000 ? 0x40000000 : child->outlen - pos))) <= 0)
+      return -1;
+    pos += n;
+  }
+#else
+  ssize_t n;
+  while (pos < child->outlen) {
+    if ((n = write(STDOUT_FILENO, child->out + pos, child->outlen - pos)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    pos += n;
+  }
+#endif
+  child->outlen = 0;
+  return 0;
+}
+
+DLL_EXPORT_CROSSRUN void crossrun_worker_child_free (crossrun_worker_child child)
+{
+  if (!child)
+    return;
+  child_flush(child);
+  free(child->in);
+  free(child->out);
+  free(child);
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_worker_child_receive (crossrun_worker_child child, uint32_t* requestid, const char** data, size_t* datalen)
+{
+  uint32_t len;
+#ifdef _WIN32
+  int n;
+#else
+  ssize_t n;
+#endif
+  while (1) {
+    //return the next complete frame
+    if (child->inlen - child->inpos >= CROSSRUN_WORKER_FRAME_HEADER) {
+      if ((len = get_uint32(child->in + child->inpos + 4)) > CROSSRUN_WORKER_MAX_FRAME)
+        return -1;
+      if (child->inlen - child->inpos - CROSSRUN_WORKER_FRAME_HEADER >= len) {
+        *requestid = get_uint32(child->in + child->inpos);
+        *data = child->in + child->inpos + CROSSRUN_WORKER_FRAME_HEADER;
+        *datalen = len;
+        child->inpos += CROSSRUN_WORKER_FRAME_HEADER + len;
+        return 1;
+      }
+    }
+    //move the incomplete frame to the start of the buffer and make room for the rest of it
+    if (child->inpos > 0) {
+      memmove(child->in, child->in + child->inpos, child->inlen - child->inpos);
+      child->inlen -= child->inpos;
+      child->inpos = 0;
+    }
+    if (child->inlen >= CROSSRUN_WORKER_FRAME_HEADER && ensure_buffer(&child->in, &child->insize, CROSSRUN_WORKER_FRAME_HEADER + get_uint32(child->in + 4)) != 0)
+      return -1;
+    //send responses before waiting for more requests
+    if (child_flush(child) != 0)
+      return -1;
+#ifdef _WIN32
+    if ((n = _read(0, child->in + child->inlen, (unsigned int)(child->insize - child->inlen > 0x40000000 ? 0x40000000 : child->insize - child->inlen))) < 0)
+      return -1;
+#else
+    if ((n = read(STDIN_FILENO, child->in + child->inlen, child->insize - child->inlen)) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+#endif
+    if (n == 0)
+      return (child->inlen == 0 ? 0 : -1);
+    child->inlen += n;
+  }
+}
+
+DLL_EXPORT_CROSSRUN int crossrun_worker_child_respond (crossrun_worker_child child, uint32_t requestid, const char* data, size_t datalen)
+{
+  if (datalen > CROSSRUN_WORKER_MAX_FRAME || (!data && datalen > 0))
+    return -1;
+  if (ensure_buffer(&child->out, &child->outsize, child->outlen + CROSSRUN_WORKER_FRAME_HEADER + datalen) != 0)
+    return -1;
+  put_uint32(child->out + child->outlen, requestid);
+  put_uint32(child->out + child->outlen + 4, (uint32_t)datalen);
+  if (datalen > 0)
+    memcpy(child->out + child->outlen + CROSSRUN_WORKER_FRAME_HEADER, data, datalen);
+  child->outlen += CROSSRUN_WORKER_FRAME_HEADER + datalen;
+  //don't let buffered responses grow without limit
+  if (child->outlen >= WORKER_BUFFER_SIZE)
+    return child_flush(child);
+  return 0;
+}
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "crossrun.h"
+#include "crossruncapture.h"
+
+#ifdef _WIN32
+#define EXE_SUFFIX ".exe"
+#else
+#define EXE_SUFFIX ""
+#endif
+#define TEST_PROCESS "test_process" EXE_SUFFIX
+
+//default amount of output to generate in megabytes
+#define DEFAULT_MEGABYTES 64
+//size of the buffer passed by the caller to the read functions
+#define CALLER_BUFFER_SIZE 128
+//number of short runs for the capture benchmark
+#define CAPTURE_RUNS 1000
+//size of the read-ahead buffer when enabled
+#define READ_BUFFER_SIZE (64 * 1024)
+
+char* get_test_process_path (const char* argv0)
+{
+  size_t i;
+  char* result;
+  i = strlen(argv0);
+  while (i > 0 && argv0[i - 1] != '/'
+#ifdef _WIN32
+    && argv0[i - 1] != '\\' && argv0[i - 1] != ':'
+#endif
+  )
+    i--;
+  if ((result = (char*)malloc(i + strlen(TEST_PROCESS) + 1)) != NULL) {
+    memcpy(result, argv0, i);
+    strcpy(result + i, TEST_PROCESS);
+  }
+  return result;
+}
+
+double get_seconds ()
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+//read all output of the test process generating the specified amount of output and report system calls per megabyte
+int run_benchmark (const char* test_process_path, int megabytes, size_t readbufsize, int available)
+{
+  int i;
+  int n;
+  char* command;
+  crossrun handle;
+  crossrun_options options;
+  char buf[CALLER_BUFFER_SIZE];
+  uint64_t bytesread = 0;
+  uint64_t syscalls = 0;
+  double starttime;
+  double duration;
+  //build command to send to test process
+  if ((command = (char*)malloc(megabytes + 3)) == NULL)
+    return -1;
+  for (i = 0; i < megabytes; i++)
+    command[i] = 'o';
+  strcpy(command + megabytes, "q\n");
+  //start test process
+  if ((options = crossrun_options_create()) == NULL) {
+    free(command);
+    return -1;
+  }
+  crossrun_options_set_read_buffer(options, readbufsize);
+  handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL, options);
+  crossrun_options_free(options);
+  if (!handle) {
+    fprintf(stderr, "Error launching process\n");
+    free(command);
+    return -1;
+  }
+  //read all output
+  starttime = get_seconds();
+  crossrun_write(handle, command);
+  if (available) {
+    while ((n = crossrun_read_available(handle, buf, sizeof(buf))) >= 0)
+      ;
+  } else {
+    while ((n = crossrun_read(handle, buf, sizeof(buf))) > 0)
+      ;
+  }
+  duration = get_seconds() - starttime;
+  crossrun_get_read_stats(handle, &bytesread, &syscalls);
+  crossrun_wait(handle);
+  crossrun_close(handle);
+  crossrun_free(handle);
+  free(command);
+  //show results
+  printf("%-24s %-10s %8.1f MB %8.3f s %10.1f MB/s %12.1f system calls/MB\n", (available ? "crossrun_read_available" : "crossrun_read"), (readbufsize ? "buffered" : "unbuffered"), bytesread / 1048576.0, duration, (duration > 0 ? bytesread / 1048576.0 / duration : 0), (bytesread ? syscalls * 1048576.0 / bytesread : 0));
+  return 0;
+}
+
+//read all output of the test process line by line and report lines per second
+int run_line_benchmark (const char* test_process_path, int megabytes, int readline)
+{
+  int i;
+  int n;
+  char* command;
+  crossrun handle;
+  const char* line;
+  size_t linelen;
+  size_t lines = 0;
+  uint64_t bytesread = 0;
+  double starttime;
+  double duration;
+  //build command to send to test process
+  if ((command = (char*)malloc(megabytes + 3)) == NULL)
+    return -1;
+  for (i = 0; i < megabytes; i++)
+    command[i] = 'o';
+  strcpy(command + megabytes, "q\n");
+  //start test process
+  if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL)) == NULL) {
+    fprintf(stderr, "Error launching process\n");
+    free(command);
+    return -1;
+  }
+  //read all output
+  starttime = get_seconds();
+  crossrun_write(handle, command);
+  if (readline) {
+    while (crossrun_read_line(handle, &line, &linelen) > 0)
+      lines++;
+  } else {
+    //split blocks into lines by copying them into a line buffer
+    char buf[READ_BUFFER_SIZE];
+    char linebuf[1024];
+    size_t linebufpos = 0;
+    while ((n = crossrun_read(handle, buf, sizeof(buf))) > 0) {
+      for (i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+          lines++;
+          linebufpos = 0;
+        } else if (linebufpos < sizeof(linebuf)) {
+          linebuf[linebufpos++] = buf[i];
+        }
+      }
+    }
+    if (linebufpos > 0)
+      lines++;
+  }
+  duration = get_seconds() - starttime;
+  crossrun_get_read_stats(handle, &bytesread, NULL);
+  crossrun_wait(handle);
+  crossrun_close(handle);
+  crossrun_free(handle);
+  free(command);
+  //show results
+  printf("%-24s %-10s %8.1f MB %8.3f s %10.1f MB/s %12.0f lines/s\n", (readline ? "crossrun_read_line" : "crossrun_read + split"), "", bytesread / 1048576.0, duration, (duration > 0 ? bytesread / 1048576.0 / duration : 0), (duration > 0 ? lines / duration : 0));
+  return 0;
+}
+
+//run many short processes capturing their output and report runs per second
+int run_capture_benchmark (const char* test_process_path, int runs)
+{
+  int i;
+  crossrun_capture capture;
+  uint64_t startusec;
+  uint64_t totalusec;
+  uint64_t sumstartusec = 0;
+  uint64_t sumtotalusec = 0;
+  double starttime;
+  double duration;
+  if ((capture = crossrun_capture_create()) == NULL)
+    return -1;
+  starttime = get_seconds();
+  for (i = 0; i < runs; i++) {
+    if (crossrun_run_capture(capture, test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL, NULL, "iq\n", 3) != 0) {
+      fprintf(stderr, "Error running process\n");
+      break;
+    }
+    crossrun_capture_get_timings(capture, &startusec, &totalusec);
+    sumstartusec += startusec;
+    sumtotalusec += totalusec;
+  }
+  duration = get_seconds() - starttime;
+  crossrun_capture_free(capture);
+  //show results
+  if (i > 0)
+    printf("%-24s %-10s %8i runs %6.3f s %10.1f runs/s %8.1f us to start %8.1f us per run\n", "crossrun_run_capture", "", i, duration, (duration > 0 ? i / duration : 0), (double)sumstartusec / i, (double)sumtotalusec / i);
+  return 0;
+}
+
+//forward all output of the test process to the null device and report processor time used by the calling process
+int run_forward_benchmark (const char* test_process_path, int megabytes, int flags)
+{
+  int i;
+  char* command;
+  crossrun handle;
+  FILE* dst;
+  uint64_t forwarded = 0;
+  double starttime;
+  double duration;
+  clock_t startcpu;
+  double cpu;
+  //build command to send to test process
+  if ((command = (char*)malloc(megabytes + 3)) == NULL)
+    return -1;
+  for (i = 0; i < megabytes; i++)
+    command[i] = 'o';
+  strcpy(command + megabytes, "q\n");
+#ifdef _WIN32
+  if ((dst = fopen("NUL", "wb")) == NULL) {
+#else
+  if ((dst = fopen("/dev/null", "wb")) == NULL) {
+#endif
+    free(command);
+    return -1;
+  }
+  //start test process
+  if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL)) == NULL) {
+    fprintf(stderr, "Error launching process\n");
+    fclose(dst);
+    free(command);
+    return -1;
+  }
+  //forward all output
+  starttime = get_seconds();
+  startcpu = clock();
+  crossrun_write(handle, command);
+  crossrun_forward(handle, fileno(dst), flags, NULL, NULL, &forwarded);
+  cpu = (double)(clock() - startcpu) / CLOCKS_PER_SEC;
+  duration = get_seconds() - starttime;
+  crossrun_wait(handle);
+  crossrun_close(handle);
+  crossrun_free(handle);
+  fclose(dst);
+  free(command);
+  //show results
+  printf("%-24s %-10s %8.1f MB %8.3f s %10.1f MB/s %8.3f s processor time\n", "crossrun_forward", (flags & CROSSRUN_FORWARD_NO_SPLICE ? "copy" : "splice"), forwarded / 1048576.0, duration, (duration > 0 ? forwarded / 1048576.0 / duration : 0), cpu);
+  return 0;
+}
+
+int main (int argc, char* argv[])
+{
+  char* test_process_path;
+  int megabytes = DEFAULT_MEGABYTES;
+  //get amount of output from command line
+  if (argc > 1 && (megabytes = atoi(argv[1])) <= 0) {
+    fprintf(stderr, "Usage: %s [megabytes]\n", argv[0]);
+    return 1;
+  }
+  //determine path to test process to run
+  if ((test_process_path = get_test_process_path(argv[0])) == NULL) {
+    fprintf(stderr, "Unable to determine path of test process\n");
+    return 255;
+  }
+  printf("Reading %i MB of output in blocks of %i bytes\n", megabytes, CALLER_BUFFER_SIZE);
+  run_benchmark(test_process_path, megabytes, 0, 0);
+  run_benchmark(test_process_path, megabytes, READ_BUFFER_SIZE, 0);
+  run_benchmark(test_process_path, megabytes, 0, 1);
+  run_benchmark(test_process_path, megabytes, READ_BUFFER_SIZE, 1);
+  printf("Reading %i MB of output as lines of 64 bytes\n", megabytes);
+  run_line_benchmark(test_process_path, megabytes, 0);
+  run_line_benchmark(test_process_path, megabytes, 1);
+  printf("Forwarding %i MB of output\n", megabytes);
+  run_forward_benchmark(test_process_path, megabytes, CROSSRUN_FORWARD_NO_SPLICE);
+  run_forward_benchmark(test_process_path, megabytes, 0);
+  printf("Running %i short processes\n", CAPTURE_RUNS);
+  run_capture_benchmark(test_process_path, CAPTURE_RUNS);
+  free(test_process_path);
+  return 0;
+}
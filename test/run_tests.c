@@ -1,12 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <unistd.h>
 #endif
+#ifdef __linux__
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
 #include "crossrun.h"
+#include "crossrunloop.h"
+#include "crossruncapture.h"
+#include "crossrunpipeline.h"
+#include "crossrunchannel.h"
+#include "crossrunworker.h"
+#include "crossrunpool.h"
+#include "crossrunwatch.h"
+#include "crossrunlimit.h"
+#include "crossruntopology.h"
+#include "crossrunplanner.h"
 
 #ifdef _WIN32
 #define EXE_SUFFIX ".exe"
@@ -15,6 +30,10 @@
 #endif
 #define TEST_PROCESS "test_process" EXE_SUFFIX
 
+//number of records sent through a shared memory channel (more than fit in the ring buffers)
+#define CHANNEL_TEST_RECORDS 2000
+#define channel_test_record_size(i) (((i) * 37) % 5000)
+
 #ifdef _WIN32
 #define sleep_milliseconds(n) Sleep(n)
 #else
@@ -62,18 +81,387 @@ void test_result (int index, int successcondition)
   printf("Test %i: %s\n", index, (successcondition ? "PASS" : "FAIL"));
 }
 
+#ifdef __linux__
+//write a file in a fixture directory tree, creating the directories as needed
+int write_fixture_file (const char* basepath, const char* relpath, const char* contents)
+{
+  char path[1024];
+  char* p;
+  FILE* dst;
+  snprintf(path, sizeof(path), "%s/%s", basepath, relpath);
+  for (p = path + strlen(basepath) + 1; (p = strchr(p, '/')) != NULL; p++) {
+    *p = 0;
+    mkdir(path, 0755);
+    *p = '/';
+  }
+  if ((dst = fopen(path, "wb")) == NULL)
+    return -1;
+  fprintf(dst, "%s\n", contents);
+  fclose(dst);
+  return 0;
+}
+
+//create a sysfs tree with 2 packages of 2 cores with 2 threads each, with logical processor 7 offline
+int write_topology_fixture (const char* basepath)
+{
+  static const char* packagecpus[] = {"0-1,4-5", "2-3,6-7"};
+  char relpath[256];
+  char value[32];
+  int cpu;
+  int core;
+  int package;
+  int result = 0;
+  result |= write_fixture_file(basepath, "cpu/possible", "0-7");
+  result |= write_fixture_file(basepath, "cpu/online", "0-6");
+  for (cpu = 0; cpu < 8; cpu++) {
+    core = cpu % 4;
+    package = core / 2;
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/topology/physical_package_id", cpu);
+    snprintf(value, sizeof(value), "%i", package);
+    result |= write_fixture_file(basepath, relpath, value);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/topology/core_id", cpu);
+    snprintf(value, sizeof(value), "%i", core % 2);
+    result |= write_fixture_file(basepath, relpath, value);
+    //logical processor 1 uses the file names of older kernels
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/topology/%s", cpu, (cpu == 1 ? "thread_siblings_list" : "core_cpus_list"));
+    snprintf(value, sizeof(value), "%i,%i", core, core + 4);
+    result |= write_fixture_file(basepath, relpath, value);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/topology/%s", cpu, (cpu == 1 ? "core_siblings_list" : "package_cpus_list"));
+    result |= write_fixture_file(basepath, relpath, packagecpus[package]);
+    //level 1 data and instruction caches, level 2 cache per core, level 3 cache per package
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index0/level", cpu);
+    result |= write_fixture_file(basepath, relpath, "1");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index0/type", cpu);
+    result |= write_fixture_file(basepath, relpath, "Data");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index0/shared_cpu_list", cpu);
+    result |= write_fixture_file(basepath, relpath, value);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index1/level", cpu);
+    result |= write_fixture_file(basepath, relpath, "1");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index1/type", cpu);
+    result |= write_fixture_file(basepath, relpath, "Instruction");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index1/shared_cpu_list", cpu);
+    result |= write_fixture_file(basepath, relpath, value);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index2/level", cpu);
+    result |= write_fixture_file(basepath, relpath, "2");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index2/type", cpu);
+    result |= write_fixture_file(basepath, relpath, "Unified");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index2/shared_cpu_list", cpu);
+    snprintf(value, sizeof(value), "%i,%i", core, core + 4);
+    result |= write_fixture_file(basepath, relpath, value);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index2/id", cpu);
+    snprintf(value, sizeof(value), "%i", core);
+    result |= write_fixture_file(basepath, relpath, value);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index3/level", cpu);
+    result |= write_fixture_file(basepath, relpath, "3");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index3/type", cpu);
+    result |= write_fixture_file(basepath, relpath, "Unified");
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index3/shared_cpu_list", cpu);
+    result |= write_fixture_file(basepath, relpath, packagecpus[package]);
+    snprintf(relpath, sizeof(relpath), "cpu/cpu%i/cache/index3/id", cpu);
+    snprintf(value, sizeof(value), "%i", package);
+    result |= write_fixture_file(basepath, relpath, value);
+  }
+  //one NUMA node per package and a node with only memory
+  result |= write_fixture_file(basepath, "node/possible", "0-2");
+  result |= write_fixture_file(basepath, "node/node0/cpulist", packagecpus[0]);
+  result |= write_fixture_file(basepath, "node/node1/cpulist", packagecpus[1]);
+  result |= write_fixture_file(basepath, "node/node2/cpulist", "");
+  return result;
+}
+
+//remove a fixture directory tree
+void remove_fixture (const char* path)
+{
+  char entrypath[1024];
+  DIR* dir;
+  struct dirent* entry;
+  struct stat st;
+  if ((dir = opendir(path)) != NULL) {
+    while ((entry = readdir(dir)) != NULL) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        continue;
+      snprintf(entrypath, sizeof(entrypath), "%s/%s", path, entry->d_name);
+      if (lstat(entrypath, &st) == 0 && S_ISDIR(st.st_mode))
+        remove_fixture(entrypath);
+      else
+        unlink(entrypath);
+    }
+    closedir(dir);
+  }
+  rmdir(path);
+}
+#endif
+
+//check if exactly the listed logical processors are set in a mask
+int cpumask_equals (crossrun_cpumask cpumask, const int* cpus, size_t cpucount)
+{
+  size_t i;
+  if (!cpumask || crossrun_cpumask_count(cpumask) != cpucount)
+    return 0;
+  for (i = 0; i < cpucount; i++)
+    if (!crossrun_cpumask_is_set(cpumask, cpus[i]))
+      return 0;
+  return 1;
+}
+
 int read_data (const char* data, size_t datalen, void* callbackdata)
 {
   printf("%.*s", (int)datalen, data);
   return 0;
 }
 
+int count_data (const char* data, size_t datalen, void* callbackdata)
+{
+  *(size_t*)callbackdata += datalen;
+  return 0;
+}
+
+struct line_test_data {
+  size_t lines;
+  size_t generatedlines;
+  size_t partials;
+  size_t linelen;
+};
+
+int count_line (const char* line, size_t linelen, int partial, void* callbackdata)
+{
+  struct line_test_data* linedata = (struct line_test_data*)callbackdata;
+  //reassemble the length of lines that are returned in parts
+  linedata->linelen += linelen;
+  if (partial) {
+    linedata->partials++;
+    return 0;
+  }
+  linedata->lines++;
+  if (linedata->linelen == 63)
+    linedata->generatedlines++;
+  linedata->linelen = 0;
+  return 0;
+}
+
+struct loop_test_data {
+  size_t bytes;
+  int exited;
+  int failed;
+};
+
+int loop_data (crossrun handle, int stream, const char* data, size_t datalen, void* callbackdata)
+{
+  ((struct loop_test_data*)callbackdata)->bytes += datalen;
+  return 0;
+}
+
+void loop_exit (crossrun handle, unsigned long exitcode, void* callbackdata)
+{
+  ((struct loop_test_data*)callbackdata)->exited++;
+  if (exitcode != 0)
+    ((struct loop_test_data*)callbackdata)->failed++;
+}
+
+#define LOOP_TEST_PROCESSES 16
+
+int run_loop_test (const char* test_process_path, int engine)
+{
+  int i;
+  int success;
+  crossrun_loop loop;
+  crossrun handles[LOOP_TEST_PROCESSES];
+  struct loop_test_data loopdata = {0, 0, 0};
+  if ((loop = crossrun_loop_create_with_engine(engine)) == NULL) {
+    printf("Event loop not supported on this platform\n");
+    return 1;
+  }
+  printf("Event loop engine: %s\n", (crossrun_loop_get_engine(loop) == CROSSRUN_LOOP_ENGINE_IO_URING ? "io_uring" : "epoll"));
+  success = 1;
+  for (i = 0; i < LOOP_TEST_PROCESSES; i++) {
+    if ((handles[i] = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL)) == NULL) {
+      success = 0;
+      continue;
+    }
+    if (crossrun_loop_add(loop, handles[i], loop_data, NULL, loop_exit, &loopdata) != 0 || crossrun_loop_write(loop, handles[i], "iq\n", 3) != 0)
+      success = 0;
+  }
+  if (crossrun_loop_run(loop) != 0)
+    success = 0;
+  crossrun_loop_free(loop);
+  for (i = 0; i < LOOP_TEST_PROCESSES; i++)
+    crossrun_free(handles[i]);
+  printf("processes exited: %i, bytes read: %lu\n", loopdata.exited, (unsigned long)loopdata.bytes);
+  return (success && loopdata.exited == LOOP_TEST_PROCESSES && loopdata.failed == 0 && loopdata.bytes > 0);
+}
+
+//wait with a timeout while the process is sleeping and count how many times the loop returned
+int run_loop_timeout_test (const char* test_process_path, int engine)
+{
+  int n;
+  int success;
+  unsigned long iterations = 0;
+  crossrun_loop loop;
+  crossrun handle;
+  struct loop_test_data loopdata = {0, 0, 0};
+  if ((loop = crossrun_loop_create_with_engine(engine)) == NULL) {
+    printf("Event loop not supported on this platform\n");
+    return 1;
+  }
+  printf("Event loop engine: %s\n", (crossrun_loop_get_engine(loop) == CROSSRUN_LOOP_ENGINE_IO_URING ? "io_uring" : "epoll"));
+  success = 1;
+  if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL)) == NULL || crossrun_loop_add(loop, handle, loop_data, NULL, loop_exit, &loopdata) != 0 || crossrun_loop_write(loop, handle, "1q\n", 3) != 0)
+    success = 0;
+  while (success && crossrun_loop_count(loop) > 0) {
+    if ((n = crossrun_loop_run_once(loop, 500)) < 0)
+      success = 0;
+    //the loop must block until an event or the timeout instead of returning immediately
+    if (++iterations > 1000)
+      success = 0;
+  }
+  crossrun_loop_free(loop);
+  crossrun_free(handle);
+  printf("processes exited: %i, iterations: %lu\n", loopdata.exited, iterations);
+  return (success && loopdata.exited == 1 && loopdata.failed == 0);
+}
+
+struct write_queue_test_data {
+  const char* data;
+  size_t datalen;
+  size_t pos;
+  int events;
+};
+
+//queue data until the queue reaches its high watermark
+void write_queue_feed (crossrun handle, struct write_queue_test_data* queuedata)
+{
+  int n;
+  while (queuedata->pos < queuedata->datalen && !crossrun_write_queue_backpressure(handle)) {
+    if ((n = crossrun_write_queued(handle, queuedata->data + queuedata->pos, queuedata->datalen - queuedata->pos)) <= 0)
+      break;
+    queuedata->pos += n;
+  }
+}
+
+void write_queue_event (crossrun handle, int event, void* callbackdata)
+{
+  struct write_queue_test_data* queuedata = (struct write_queue_test_data*)callbackdata;
+  queuedata->events |= 1 << event;
+  if (event == CROSSRUN_WRITE_QUEUE_LOW || event == CROSSRUN_WRITE_QUEUE_DRAINED)
+    write_queue_feed(handle, queuedata);
+}
+
+#define WRITE_QUEUE_TEST_SIZE (1024 * 1024)
+
+int run_write_queue_test (const char* test_process_path, int engine)
+{
+  int i;
+  int success;
+  char* data;
+  crossrun_loop loop;
+  crossrun handles[LOOP_TEST_PROCESSES];
+  struct write_queue_test_data queuedata[LOOP_TEST_PROCESSES];
+  struct loop_test_data loopdata = {0, 0, 0};
+  if ((loop = crossrun_loop_create_with_engine(engine)) == NULL) {
+    printf("Event loop not supported on this platform\n");
+    return 1;
+  }
+  printf("Event loop engine: %s\n", (crossrun_loop_get_engine(loop) == CROSSRUN_LOOP_ENGINE_IO_URING ? "io_uring" : "epoll"));
+  //input is a command to sleep, many spaces (which are ignored) and a command to quit
+  if ((data = (char*)malloc(WRITE_QUEUE_TEST_SIZE)) == NULL) {
+    crossrun_loop_free(loop);
+    return 0;
+  }
+  memset(data, ' ', WRITE_QUEUE_TEST_SIZE);
+  data[0] = '1';
+  memcpy(data + WRITE_QUEUE_TEST_SIZE - 2, "q\n", 2);
+  success = 1;
+  for (i = 0; i < LOOP_TEST_PROCESSES; i++) {
+    queuedata[i].data = data;
+    queuedata[i].datalen = WRITE_QUEUE_TEST_SIZE;
+    queuedata[i].pos = 0;
+    queuedata[i].events = 0;
+    if ((handles[i] = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL)) == NULL) {
+      success = 0;
+      continue;
+    }
+    if (crossrun_write_queue_create(handles[i], 128 * 1024, 64 * 1024, write_queue_event, &queuedata[i]) != 0 || crossrun_loop_add(loop, handles[i], loop_data, NULL, loop_exit, &loopdata) != 0) {
+      success = 0;
+      continue;
+    }
+    //the process is sleeping, so this must stop at the high watermark without blocking
+    write_queue_feed(handles[i], &queuedata[i]);
+    if (!crossrun_write_queue_backpressure(handles[i]) || crossrun_write_queue_pending(handles[i]) < 64 * 1024 || crossrun_write_queue_poll_fd(handles[i]) < 0)
+      success = 0;
+  }
+  if (crossrun_loop_run(loop) != 0)
+    success = 0;
+  crossrun_loop_free(loop);
+  for (i = 0; i < LOOP_TEST_PROCESSES; i++) {
+    if (queuedata[i].pos != WRITE_QUEUE_TEST_SIZE || !(queuedata[i].events & (1 << CROSSRUN_WRITE_QUEUE_LOW)) || !(queuedata[i].events & (1 << CROSSRUN_WRITE_QUEUE_DRAINED)) || (queuedata[i].events & (1 << CROSSRUN_WRITE_QUEUE_ERROR)))
+      success = 0;
+    crossrun_free(handles[i]);
+  }
+  free(data);
+  printf("processes exited: %i, bytes read: %lu\n", loopdata.exited, (unsigned long)loopdata.bytes);
+  return (success && loopdata.exited == LOOP_TEST_PROCESSES && loopdata.failed == 0);
+}
+
+//number of requests sent to a worker process at once
+#define WORKER_TEST_REQUESTS 2000
+
+struct worker_test_data {
+  int responses;
+  int errors;
+};
+
+//check if the response is the reversed request
+void worker_test_response (crossrun_worker worker, uint32_t requestid, const char* data, size_t datalen, void* callbackdata)
+{
+  char request[32];
+  size_t i;
+  size_t len;
+  struct worker_test_data* testdata = (struct worker_test_data*)callbackdata;
+  len = sprintf(request, "request %lu", (unsigned long)requestid);
+  testdata->responses++;
+  if (!data || datalen != len) {
+    testdata->errors++;
+    return;
+  }
+  for (i = 0; i < len; i++)
+    if (data[i] != request[len - 1 - i])
+      break;
+  if (i < len)
+    testdata->errors++;
+}
+
+//keep the text that matched a watched pattern
+//read output until it contains a text
+int read_until (crossrun handle, const char* text)
+{
+  char buf[1024];
+  size_t len = 0;
+  int n;
+  while (len < sizeof(buf) - 1 && (n = crossrun_read(handle, buf + len, (int)(sizeof(buf) - 1 - len))) > 0) {
+    len += n;
+    buf[len] = 0;
+    if (strstr(buf, text))
+      return 1;
+  }
+  return 0;
+}
+
+void watch_test_match (crossrun_watch watch, int index, const char* text, size_t textlen, void* callbackdata)
+{
+  char* result = (char*)callbackdata;
+  if (textlen > 63)
+    textlen = 63;
+  memcpy(result, text, textlen);
+  result[textlen] = 0;
+}
+
 int main (int argc, char* argv[])
 {
   char* test_process_path;
   crossrun handle;
   crossrunenv env;
   unsigned long exitcode;
+  size_t outputlen;
   char buf[128];
   int n;
   char* p;
@@ -229,34 +617,1189 @@ printf("<");/////
   test_result(index, (handle != NULL && env != NULL && p != NULL && exitcode == 0));
   crossrunenv_free(env);
 
-/*
+  //run test
+  announce_test(++index, "Execute with separate error output");
+  {
+    crossrun_options options = crossrun_options_create();
+    size_t stdoutlen = 0;
+    size_t stderrlen = 0;
+    char* q = NULL;
+    int stream;
+    crossrun_options_set_stderr(options, CROSSRUN_STDERR_PIPE);
+    p = NULL;
+    if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_NORMAL, NULL, options)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+      exitcode = ~0;
+    } else {
+      crossrun_write(handle, "rrq\n");
+      while ((n = crossrun_read_any(handle, buf, sizeof(buf) - 1, &stream)) > 0) {
+        buf[n] = 0;
+        if (stream == CROSSRUN_STREAM_STDERR) {
+          stderrlen += n;
+          if (!p)
+            p = strstr(buf, "Message on error output");
+        } else {
+          stdoutlen += n;
+          if (!q)
+            q = strstr(buf, "Message on error output");
+        }
+      }
+      crossrun_wait(handle);
+      exitcode = crossrun_get_exit_code(handle);
+      crossrun_close(handle);
+      crossrun_free(handle);
+      printf("standard output: %lu bytes, error output: %lu bytes\n", (unsigned long)stdoutlen, (unsigned long)stderrlen);
+    }
+    crossrun_options_free(options);
+    test_result(index, (handle != NULL && p != NULL && q == NULL && stdoutlen > 0 && exitcode == 0));
+  }
+
+  //run test
+  announce_test(++index, "Execute multiple processes with event loop");
+  test_result(index, run_loop_test(test_process_path, CROSSRUN_LOOP_ENGINE_EPOLL));
+
+  //run test
+  announce_test(++index, "Execute multiple processes with io_uring event loop");
+  test_result(index, run_loop_test(test_process_path, CROSSRUN_LOOP_ENGINE_IO_URING));
+
+  //run test
+  announce_test(++index, "Wait for events with timeout in io_uring event loop");
+  test_result(index, run_loop_timeout_test(test_process_path, CROSSRUN_LOOP_ENGINE_IO_URING));
+
   //run test
   announce_test(++index, "Execute and send large block of input");
+  outputlen = 0;
   if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
     fprintf(stderr, "Error launching process\n");
     exitcode = ~0;
   } else {
     char* buf;
     size_t buflen = 128 * 1024;
-    if ((buf = (char*)malloc(buflen)) == NULL) {
+    int result;
+    if ((buf = (char*)malloc(buflen + 2)) == NULL) {
       exitcode = ~0;
       crossrun_kill(handle);
       crossrun_wait(handle);
     } else {
+      //each 'i' makes the process write a line, so the output is much larger than what fits in the pipe while the input is still being written
       memset(buf, 'i', buflen);
-      crossrun_writedata(handle, buf, buflen);
-      crossrun_write(handle, "q\n");
-      while ((n = crossrun_read(handle, buf, sizeof(buf))) > 0) {
-        printf("%.*s", n, buf);
+      memcpy(buf + buflen, "q\n", 2);
+      exitcode = ~0;
+      result = crossrun_read_write(handle, count_data, &outputlen, buf, buflen + 2);
+      crossrun_wait(handle);
+      if (result == 0)
+        exitcode = crossrun_get_exit_code(handle);
+      crossrun_close(handle);
+      free(buf);
+      printf("%lu bytes of output received\n", (unsigned long)outputlen);
+    }
+    crossrun_free(handle);
+  }
+  test_result(index, (handle != NULL && exitcode == 0 && outputlen > 128 * 1024 * 6));
+
+  //run test
+  announce_test(++index, "Execute with read-ahead buffer");
+  {
+    crossrun_options options;
+    uint64_t bytesread = 0;
+    uint64_t syscalls = 0;
+    char peekbuf[16];
+    int peeked = 0;
+    outputlen = 0;
+    exitcode = ~0;
+    handle = NULL;
+    if ((options = crossrun_options_create()) != NULL) {
+      crossrun_options_set_read_buffer(options, 64 * 1024);
+      if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        crossrun_write(handle, "oq\n");
+        //peeking doesn't remove data, so the same data must be read afterwards
+        while ((n = crossrun_peek(handle, peekbuf, 7)) == 0)
+          sleep_milliseconds(1);
+        if (n == 7 && crossrun_read(handle, buf, 7) == 7 && memcmp(peekbuf, buf, 7) == 0 && memcmp(buf, "Program", 7) == 0)
+          peeked = 1;
+        //small reads are served from the read-ahead buffer
+        while ((n = crossrun_read(handle, buf, 64)) > 0)
+          outputlen += n;
+        crossrun_wait(handle);
+        exitcode = crossrun_get_exit_code(handle);
+        crossrun_get_read_stats(handle, &bytesread, &syscalls);
+        crossrun_close(handle);
+        crossrun_free(handle);
+        printf("%lu bytes of output received with %lu system calls\n", (unsigned long)bytesread, (unsigned long)syscalls);
+      }
+      crossrun_options_free(options);
+    }
+    test_result(index, (handle != NULL && exitcode == 0 && peeked && outputlen + 7 == bytesread && outputlen > 1024 * 1024 && syscalls < bytesread / 64 / 4));
+  }
+
+  //run test
+  announce_test(++index, "Execute and read output lines");
+  {
+    const char* line;
+    size_t linelen;
+    size_t lines = 0;
+    size_t generatedlines = 0;
+    int lastlineok = 0;
+    if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+      exitcode = ~0;
+    } else {
+      crossrun_write(handle, "ooq\n");
+      while ((n = crossrun_read_line(handle, &line, &linelen)) == CROSSRUN_LINE_COMPLETE) {
+        lines++;
+        if (linelen == 63 && line[0] == 'a' && line[62] == 'k')
+          generatedlines++;
+        lastlineok = (linelen == 16 && memcmp(line, "Exiting normally", 16) == 0);
       }
       crossrun_wait(handle);
       exitcode = crossrun_get_exit_code(handle);
       crossrun_close(handle);
+      crossrun_free(handle);
+      printf("%lu lines read, %lu generated lines\n", (unsigned long)lines, (unsigned long)generatedlines);
+    }
+    test_result(index, (handle != NULL && exitcode == 0 && n == 0 && lastlineok && generatedlines == 2 * 16384 && lines == generatedlines + 2));
+  }
+
+  //run test
+  announce_test(++index, "Execute and read output lines longer than the buffer");
+  {
+    crossrun_options options;
+    struct line_test_data linedata = {0, 0, 0, 0};
+    exitcode = ~0;
+    handle = NULL;
+    if ((options = crossrun_options_create()) != NULL) {
+      crossrun_options_set_read_buffer(options, 24);
+      if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        crossrun_write(handle, "oq\n");
+        if (crossrun_read_lines(handle, count_line, &linedata) != 0)
+          linedata.lines = 0;
+        crossrun_wait(handle);
+        exitcode = crossrun_get_exit_code(handle);
+        crossrun_close(handle);
+        crossrun_free(handle);
+        printf("%lu lines read in %lu parts, %lu generated lines\n", (unsigned long)linedata.lines, (unsigned long)(linedata.lines + linedata.partials), (unsigned long)linedata.generatedlines);
+      }
+      crossrun_options_free(options);
+    }
+    test_result(index, (handle != NULL && exitcode == 0 && linedata.generatedlines == 16384 && linedata.lines == 16384 + 2 && linedata.partials >= 2 * 16384));
+  }
+
+  //run test
+  announce_test(++index, "Run and capture output");
+  {
+    crossrun_options options;
+    crossrun_capture capture;
+    const char* data;
+    size_t datalen;
+    size_t errlen = 0;
+    char smallbuf[16];
+    uint64_t startusec = 0;
+    uint64_t totalusec = 0;
+    int ok = 0;
+    if ((options = crossrun_options_create()) != NULL && (capture = crossrun_capture_create()) != NULL) {
+      crossrun_options_set_stderr(options, CROSSRUN_STDERR_PIPE);
+      //capture standard output and error output separately
+      if (crossrun_run_capture(capture, test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options, "irq\n", 4) == 0 && crossrun_capture_get_exit_code(capture) == 0) {
+        data = crossrun_capture_get_data(capture, CROSSRUN_STREAM_STDOUT, &datalen);
+        crossrun_capture_get_data(capture, CROSSRUN_STREAM_STDERR, &errlen);
+        crossrun_capture_get_timings(capture, &startusec, &totalusec);
+        printf("captured %lu bytes of output and %lu bytes of error output in %lu microseconds\n", (unsigned long)datalen, (unsigned long)errlen, (unsigned long)totalusec);
+        if (strstr(data, "PID: ") && strstr(data, "Exiting normally") && errlen == 24 && totalusec >= startusec)
+          ok++;
+      }
+      //reuse the capture data structure for a process exiting with an error
+      if (crossrun_run_capture(capture, test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, NULL, "x", 1) == 0 && crossrun_capture_get_exit_code(capture) == 99)
+        ok++;
+      //capture in a buffer that is too small
+      crossrun_capture_set_buffer(capture, CROSSRUN_STREAM_STDOUT, smallbuf, sizeof(smallbuf));
+      if (crossrun_run_capture(capture, test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, NULL, "ooq\n", 4) == 0 && crossrun_capture_get_exit_code(capture) == 0) {
+        data = crossrun_capture_get_data(capture, CROSSRUN_STREAM_STDOUT, &datalen);
+        if (data == smallbuf && datalen == sizeof(smallbuf) && crossrun_capture_get_total(capture, CROSSRUN_STREAM_STDOUT) > 2 * 1024 * 1024)
+          ok++;
+      }
+      crossrun_capture_free(capture);
+    }
+    crossrun_options_free(options);
+    test_result(index, (ok == 3));
+  }
+
+  //run test
+  announce_test(++index, "Run and capture output exceeding memory limit");
+  {
+    crossrun_capture capture;
+    const char* data;
+    uint64_t datalen;
+    uint64_t spilled;
+    uint64_t spillwrites;
+    char readbuf[64];
+    int i;
+    int ok = 0;
+    if ((capture = crossrun_capture_create()) != NULL) {
+      //spill to a memory backed file and then to a file in the current directory
+      for (i = 0; i < 2; i++) {
+        crossrun_capture_set_memory_limit(capture, 64 * 1024, (i == 0 ? NULL : "."));
+        if (crossrun_run_capture(capture, test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, NULL, "ooooq\n", 6) != 0 || crossrun_capture_get_exit_code(capture) != 0)
+          continue;
+        if (crossrun_capture_get_spill_stats(capture, CROSSRUN_STREAM_STDOUT, &spilled, &spillwrites) != 1 || crossrun_capture_get_data(capture, CROSSRUN_STREAM_STDOUT, NULL) != NULL)
+          continue;
+        printf("%lu bytes spilled in %lu writes\n", (unsigned long)spilled, (unsigned long)spillwrites);
+        if ((data = crossrun_capture_map(capture, CROSSRUN_STREAM_STDOUT, &datalen)) == NULL || datalen != spilled || datalen != crossrun_capture_get_total(capture, CROSSRUN_STREAM_STDOUT))
+          continue;
+        //the last line is at the end of the mapped data and can also be read from the file
+        if (datalen < 17 || memcmp(data + datalen - 17, "Exiting normally\n", 17) != 0)
+          continue;
+        if (crossrun_capture_read(capture, CROSSRUN_STREAM_STDOUT, datalen - 17, readbuf, sizeof(readbuf)) != 17 || memcmp(readbuf, "Exiting normally\n", 17) != 0)
+          continue;
+        if (spilled > 4 * 1024 * 1024 && spillwrites < spilled / (32 * 1024))
+          ok++;
+      }
+      crossrun_capture_free(capture);
+    }
+    test_result(index, (ok == 2));
+  }
+
+  //run test
+  announce_test(++index, "Execute and forward output to a file");
+  {
+    FILE* dst;
+    int i;
+    int ok = 0;
+    uint64_t forwarded;
+    for (i = 0; i < 3; i++) {
+      //forward directly, forward while inspecting the data and forward without splice
+      static const int flags[3] = {0, 0, CROSSRUN_FORWARD_NO_SPLICE};
+      outputlen = 0;
+      forwarded = 0;
+      if ((dst = tmpfile()) == NULL)
+        continue;
+      if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        crossrun_write(handle, "ooq\n");
+        if (crossrun_forward(handle, fileno(dst), flags[i], (i == 1 ? count_data : NULL), &outputlen, &forwarded) == 0) {
+          fseek(dst, 0, SEEK_END);
+          printf("%lu bytes forwarded, %lu bytes in file, %lu bytes inspected\n", (unsigned long)forwarded, (unsigned long)ftell(dst), (unsigned long)outputlen);
+          if (forwarded > 2 * 1024 * 1024 && (uint64_t)ftell(dst) == forwarded && outputlen == (i == 1 ? forwarded : 0))
+            ok++;
+        }
+        crossrun_wait(handle);
+        if (crossrun_get_exit_code(handle) != 0)
+          ok = -3;
+        crossrun_close(handle);
+        crossrun_free(handle);
+      }
+      fclose(dst);
     }
+    test_result(index, (ok == 3));
+  }
+
+  //run test
+  announce_test(++index, "Execute with input from and output to files");
+  {
+    FILE* src;
+    FILE* dst;
+    crossrun_options options;
+    int ok = 0;
+    static const char* output_path = "crossrun_test_output.txt";
+    if ((src = tmpfile()) != NULL) {
+      fputs("rq\n", src);
+      fflush(src);
+      rewind(src);
+      if ((options = crossrun_options_create()) != NULL) {
+        crossrun_options_set_stdio_fd(options, CROSSRUN_STREAM_STDIN, fileno(src));
+        crossrun_options_set_stdio_file(options, CROSSRUN_STREAM_STDOUT, output_path, O_CREAT | O_TRUNC);
+        if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+          fprintf(stderr, "Error launching process\n");
+        } else {
+          //the pipes for standard input and output don't exist
+          if (crossrun_write(handle, "q\n") != 0 && crossrun_read(handle, buf, sizeof(buf)) <= 0)
+            ok++;
+          crossrun_wait(handle);
+          if (crossrun_get_exit_code(handle) == 0)
+            ok++;
+          crossrun_close(handle);
+          crossrun_free(handle);
+          //check output and error output were both written to the file
+          if ((dst = fopen(output_path, "rb")) != NULL) {
+            n = fread(buf, 1, sizeof(buf) - 1, dst);
+            buf[(n > 0 ? n : 0)] = 0;
+            printf("%s", buf);
+            if (strstr(buf, "Program started") && strstr(buf, "Message on error output"))
+              ok++;
+            fclose(dst);
+          }
+          remove(output_path);
+        }
+        crossrun_options_free(options);
+      }
+      fclose(src);
+    }
+    test_result(index, (ok == 3));
+  }
+
+  //run test
+  announce_test(++index, "Execute with vectored and page writes");
+  if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+    fprintf(stderr, "Error launching process\n");
+    test_result(index, 0);
+  } else {
+    static const crossrun_iovec commands[] = {{"e", 1}, {"", 0}, {" i", 2}};
+    static const crossrun_iovec quit[] = {{"q", 1}, {"\n", 1}};
+    char output[1024];
+    size_t outputpos = 0;
+    size_t pagebuflen = 256 * 1024;
+    char* pagebufmem;
+    char* pagebuf;
+    int ok = 0;
+    //write commands from separate blocks followed by a large page aligned block of spaces (which are ignored)
+    if (crossrun_writev(handle, commands, sizeof(commands) / sizeof(*commands)) == 0)
+      ok++;
+    if ((pagebufmem = (char*)malloc(pagebuflen + 65536)) != NULL) {
+      pagebuf = pagebufmem + (65536 - (uintptr_t)pagebufmem % 65536);
+      memset(pagebuf, ' ', pagebuflen);
+      if (crossrun_write_pages(handle, pagebuf, pagebuflen) == 0)
+        ok++;
+    }
+    if (crossrun_writev(handle, quit, sizeof(quit) / sizeof(*quit)) == 0)
+      ok++;
+    while (outputpos < sizeof(output) - 1 && (n = crossrun_read(handle, output + outputpos, sizeof(output) - 1 - outputpos)) > 0)
+      outputpos += n;
+    output[outputpos] = 0;
+    printf("%s", output);
+    if (strstr(output, "Value of environment variable TEST") && strstr(output, "PID: ") && strstr(output, "Exiting normally"))
+      ok++;
+    crossrun_wait(handle);
+    if (crossrun_get_exit_code(handle) == 0)
+      ok++;
+    crossrun_close(handle);
     crossrun_free(handle);
+    //the pages may only be released once the process has read them
+    free(pagebufmem);
+    test_result(index, (ok == 5));
+  }
+
+  //run test
+  announce_test(++index, "Execute in event loop and feed input through write queues (epoll)");
+  test_result(index, run_write_queue_test(test_process_path, CROSSRUN_LOOP_ENGINE_EPOLL));
+
+  //run test
+  announce_test(++index, "Execute in event loop and feed input through write queues (io_uring)");
+  test_result(index, run_write_queue_test(test_process_path, CROSSRUN_LOOP_ENGINE_IO_URING));
+
+  //run test
+  announce_test(++index, "Execute with larger and growing pipes");
+  {
+    crossrun_options options;
+    size_t initialsize = 0;
+    size_t grownsize = 0;
+    size_t shrunksize = 0;
+    char* readbuf;
+    if ((options = crossrun_options_create()) == NULL || (readbuf = (char*)malloc(1024 * 1024)) == NULL) {
+      test_result(index, 0);
+    } else {
+      crossrun_options_set_pipe_size(options, 256 * 1024, 1024 * 1024);
+      if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+        test_result(index, 0);
+      } else {
+        initialsize = crossrun_get_pipe_size(handle, CROSSRUN_STREAM_STDOUT);
+        //give the process time to fill the pipe before each read
+        crossrun_write(handle, "oooooooo1q\n");
+        do {
+          sleep_milliseconds(20);
+        } while (crossrun_read(handle, readbuf, 1024 * 1024) > 0);
+        grownsize = crossrun_get_pipe_size(handle, CROSSRUN_STREAM_STDOUT);
+        //shrink the pipe of the idle process
+        shrunksize = crossrun_set_pipe_size(handle, CROSSRUN_STREAM_STDOUT, 4096);
+        crossrun_wait(handle);
+        exitcode = crossrun_get_exit_code(handle);
+        crossrun_close(handle);
+        crossrun_free(handle);
+        printf("pipe size: %lu, grown to: %lu, shrunk to: %lu\n", (unsigned long)initialsize, (unsigned long)grownsize, (unsigned long)shrunksize);
+#ifdef __linux__
+        test_result(index, (exitcode == 0 && initialsize == 256 * 1024 && grownsize > initialsize && shrunksize == 4096));
+#else
+        test_result(index, (exitcode == 0));
+#endif
+      }
+      free(readbuf);
+    }
+    crossrun_options_free(options);
+  }
+
+  //run test
+  announce_test(++index, "Execute pipeline of processes");
+  {
+    crossrun_pipeline pipeline;
+    const char* commands[3];
+    char* catcommand;
+    int ok = 0;
+    if ((catcommand = (char*)malloc(strlen(test_process_path) + 5)) != NULL) {
+      strcpy(catcommand, test_process_path);
+      strcat(catcommand, " cat");
+      //the input passes through 2 processes copying it before reaching the last process
+      commands[0] = catcommand;
+      commands[1] = catcommand;
+      commands[2] = test_process_path;
+      if ((pipeline = crossrun_pipeline_open(commands, 3, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, NULL)) == NULL) {
+        fprintf(stderr, "Error launching pipeline\n");
+      } else {
+        if (crossrun_pipeline_count(pipeline) == 3 && crossrun_pipeline_get_stage(pipeline, -1) == crossrun_pipeline_get_stage(pipeline, 2))
+          ok++;
+        //write to the first process and read from the last process
+        crossrun_write(crossrun_pipeline_get_stage(pipeline, 0), "ioq\n");
+        crossrun_write_eof(crossrun_pipeline_get_stage(pipeline, 0));
+        outputlen = 0;
+        while ((n = crossrun_read(crossrun_pipeline_get_stage(pipeline, -1), buf, sizeof(buf))) > 0)
+          outputlen += n;
+        printf("%lu bytes read from last process\n", (unsigned long)outputlen);
+        if (outputlen > 1024 * 1024)
+          ok++;
+        if (crossrun_pipeline_wait(pipeline) == 0 && crossrun_get_exit_code(crossrun_pipeline_get_stage(pipeline, 0)) == 0 && crossrun_get_exit_code(crossrun_pipeline_get_stage(pipeline, 1)) == 0)
+          ok++;
+        crossrun_pipeline_free(pipeline);
+      }
+      free(catcommand);
+    }
+    test_result(index, (ok == 3));
+  }
+
+  //run test
+  announce_test(++index, "Execute with pseudo-terminal");
+  {
+    crossrun_options options;
+    char output[1024];
+    size_t outputpos = 0;
+    if ((options = crossrun_options_create()) == NULL) {
+      test_result(index, 0);
+    } else if (crossrun_options_set_pty(options, 1, 40, 132) != 0) {
+      printf("Pseudo-terminal not supported on this platform\n");
+      test_result(index, 1);
+    } else if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+      test_result(index, 0);
+    } else {
+      crossrun_write(handle, "tq\n");
+      while (outputpos < sizeof(output) - 1 && (n = crossrun_read(handle, output + outputpos, sizeof(output) - 1 - outputpos)) > 0)
+        outputpos += n;
+      output[outputpos] = 0;
+      printf("%s", output);
+      crossrun_wait(handle);
+      exitcode = crossrun_get_exit_code(handle);
+      crossrun_close(handle);
+      crossrun_free(handle);
+      //the processes of a pipeline can't be connected to a pseudo-terminal
+      {
+        crossrun_pipeline pipeline;
+        const char* commands[2] = {test_process_path, test_process_path};
+        if ((pipeline = crossrun_pipeline_open(commands, 2, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) != NULL) {
+          crossrun_pipeline_free(pipeline);
+          exitcode = ~0;
+        }
+      }
+      //output must not contain echoed input or carriage returns
+      test_result(index, (exitcode == 0 && strstr(output, "Terminal: yes (132x40)\n") && strstr(output, "Exiting normally\n") && !strchr(output, '\r') && !strstr(output, "tq")));
+    }
+    crossrun_options_free(options);
+  }
+
+  //run test
+  announce_test(++index, "Execute with shared memory channel");
+  {
+    crossrun_options options;
+    crossrun_channel channel;
+    char record[5000];
+    char output[1024];
+    size_t outputpos = 0;
+    size_t len;
+    int sent = 0;
+    int received = 0;
+    int progress;
+    int ok = 1;
+    int i;
+    if ((channel = crossrun_channel_create(64 * 1024)) == NULL) {
+      printf("Shared memory channel not supported on this platform\n");
+      test_result(index, 1);
+    } else if ((options = crossrun_options_create()) == NULL || crossrun_options_set_channel(options, channel) != 0 || (handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+      crossrun_options_free(options);
+      crossrun_channel_free(channel);
+      test_result(index, 0);
+    } else {
+      crossrun_options_free(options);
+      crossrun_write(handle, "cq\n");
+      //write records without waiting and read back the records the process sends back
+      while (ok && received < CHANNEL_TEST_RECORDS) {
+        progress = 0;
+        if (sent < CHANNEL_TEST_RECORDS) {
+          len = channel_test_record_size(sent);
+          for (i = 0; i < (int)len; i++)
+            record[i] = (char)(sent + i);
+          if ((n = crossrun_channel_write(channel, record, len, 0)) == 0) {
+            progress = 1;
+            if (++sent == CHANNEL_TEST_RECORDS)
+              crossrun_channel_close(channel);
+          } else if (n < 0) {
+            ok = 0;
+          }
+        }
+        if ((n = crossrun_channel_read(channel, record, sizeof(record), &len, (progress ? 0 : 5000))) > 0) {
+          if (len != channel_test_record_size(received))
+            ok = 0;
+          for (i = 0; ok && i < (int)len; i++)
+            if (record[i] != (char)(received + i))
+              ok = 0;
+          received++;
+        } else if (n < 0 || !progress) {
+          ok = 0;
+        }
+      }
+      printf("%i records sent, %i records received\n", sent, received);
+      //the process closes the channel when done
+      if (crossrun_channel_read(channel, record, sizeof(record), &len, 5000) != -1)
+        ok = 0;
+      while (outputpos < sizeof(output) - 1 && (n = crossrun_read(handle, output + outputpos, sizeof(output) - 1 - outputpos)) > 0)
+        outputpos += n;
+      output[outputpos] = 0;
+      crossrun_wait(handle);
+      exitcode = crossrun_get_exit_code(handle);
+      crossrun_close(handle);
+      crossrun_free(handle);
+      crossrun_channel_free(channel);
+      test_result(index, (ok && exitcode == 0 && strstr(output, "Channel: 2000 records\n")));
+    }
+  }
+
+  //run test
+  announce_test(++index, "Execute worker process with framed requests");
+  {
+    crossrun_worker worker;
+    char* workercommand;
+    char request[32];
+    uint32_t deferid;
+    uint32_t id;
+    struct worker_test_data testdata = {0, 0};
+    int ok = 0;
+    int i;
+    if ((workercommand = (char*)malloc(strlen(test_process_path) + 8)) != NULL) {
+      strcpy(workercommand, test_process_path);
+      strcat(workercommand, " worker");
+      if ((handle = crossrun_open(workercommand, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        if ((worker = crossrun_worker_create(handle)) != NULL) {
+          //the worker answers this request after the next one
+          if (crossrun_worker_send(worker, "defer", 5, NULL, NULL, &deferid) == 0)
+            ok++;
+          //send all requests before reading any response, request IDs follow each other
+          for (i = 0; i < WORKER_TEST_REQUESTS; i++) {
+            sprintf(request, "request %lu", (unsigned long)deferid + 1 + i);
+            if (crossrun_worker_send(worker, request, strlen(request), worker_test_response, &testdata, &id) != 0 || id != deferid + 1 + i)
+              break;
+          }
+          printf("%i requests in flight\n", (int)crossrun_worker_pending(worker));
+          if (crossrun_worker_wait(worker, deferid) == 0)
+            ok++;
+          while (crossrun_worker_pending(worker) > 0 && crossrun_worker_process(worker, 5000) > 0)
+            ;
+          printf("%i responses received, %i errors\n", testdata.responses, testdata.errors);
+          if (testdata.responses == WORKER_TEST_REQUESTS && testdata.errors == 0 && crossrun_worker_pending(worker) == 0)
+            ok++;
+          crossrun_worker_free(worker);
+        }
+        crossrun_write_eof(handle);
+        crossrun_wait(handle);
+        if (crossrun_get_exit_code(handle) == 0)
+          ok++;
+        crossrun_close(handle);
+        crossrun_free(handle);
+      }
+      free(workercommand);
+    }
+    test_result(index, (ok == 4));
+  }
+
+  //run test
+  announce_test(++index, "Execute pool of worker processes");
+  {
+    crossrun_pool pool;
+    crossrun leased[3];
+    char output[4096];
+    size_t outputpos = 0;
+    const char* p;
+    uint64_t started = 0;
+    uint64_t recycled = 0;
+    uint64_t replaced = 0;
+    int ok = 0;
+    if ((pool = crossrun_pool_create(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, NULL, 2, CROSSRUN_POOL_PIN_EACH)) == NULL) {
+      fprintf(stderr, "Error creating pool\n");
+    } else {
+      crossrun_pool_set_recycle(pool, 2, 0);
+      //only 2 worker processes can be leased
+      leased[0] = crossrun_pool_lease(pool);
+      leased[1] = crossrun_pool_lease(pool);
+      leased[2] = crossrun_pool_lease(pool);
+      if (leased[0] && leased[1] && leased[0] != leased[1] && !leased[2] && crossrun_pool_idle(pool) == 0)
+        ok++;
+      //each worker process is pinned to a single logical processor
+      if (leased[0]) {
+        crossrun_write(leased[0], "a\n");
+        while (outputpos < sizeof(output) - 1 && (n = crossrun_read(leased[0], output + outputpos, sizeof(output) - 1 - outputpos)) > 0) {
+          outputpos += n;
+          output[outputpos] = 0;
+          if ((p = strstr(output, "Affinity mask: ")) != NULL && strchr(p, '\n'))
+            break;
+        }
+        output[outputpos] = 0;
+        if ((p = strstr(output, "Affinity mask: ")) != NULL) {
+          printf("%.*s\n", (int)(strchr(p, '\n') ? strchr(p, '\n') - p : strlen(p)), p);
+          for (n = 0, p += 15; *p == '0' || *p == '1'; p++)
+            if (*p == '1')
+              n++;
+          if (n == 1)
+            ok++;
+        }
+      }
+      crossrun_pool_release(pool, leased[0]);
+      crossrun_pool_release(pool, leased[1]);
+      if (crossrun_pool_idle(pool) == 2 && crossrun_pool_release(pool, leased[1]) != 0)
+        ok++;
+      //the first worker process is replaced after its second use
+      leased[0] = crossrun_pool_lease(pool);
+      crossrun_pool_release(pool, leased[0]);
+      //a worker process that died is replaced
+      if ((leased[0] = crossrun_pool_lease(pool)) != NULL) {
+        crossrun_kill(leased[0]);
+        crossrun_wait(leased[0]);
+        crossrun_pool_release(pool, leased[0]);
+      }
+      if (crossrun_pool_maintain(pool) == 0)
+        ok++;
+      crossrun_pool_get_stats(pool, &started, &recycled, &replaced);
+      printf("worker processes started: %lu, recycled: %lu, replaced: %lu\n", (unsigned long)started, (unsigned long)recycled, (unsigned long)replaced);
+      if (started == 4 && recycled == 1 && replaced == 1)
+        ok++;
+      crossrun_pool_free(pool);
+    }
+    //a worker process is replaced when its memory grows too much after its first use
+    if ((pool = crossrun_pool_create(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, NULL, 1, 0)) == NULL) {
+      fprintf(stderr, "Error creating pool\n");
+    } else {
+      crossrun_pool_set_recycle(pool, 0, 8 * 1024 * 1024);
+      for (n = 0; n < 3; n++) {
+        if ((leased[0] = crossrun_pool_lease(pool)) == NULL)
+          break;
+        crossrun_write(leased[0], (n < 2 ? "i\n" : "g\n"));
+        read_until(leased[0], (n < 2 ? "PID: " : "Allocated"));
+        crossrun_pool_release(pool, leased[0]);
+        crossrun_pool_get_stats(pool, &started, &recycled, &replaced);
+        if (n == 1 && recycled == 0)
+          ok++;
+      }
+      printf("worker processes started: %lu, recycled: %lu, replaced: %lu\n", (unsigned long)started, (unsigned long)recycled, (unsigned long)replaced);
+#ifdef __linux__
+      if (started == 2 && recycled == 1)
+#else
+      if (started == 1 && recycled == 0)
+#endif
+        ok++;
+      crossrun_pool_free(pool);
+    }
+    test_result(index, (ok == 7));
+  }
+
+  //run test
+  announce_test(++index, "Execute and wait for output patterns");
+  {
+    crossrun_watch watch;
+    crossrun_watch quitwatch;
+    crossrun_watch linewatch;
+    char matched[64] = "";
+    size_t consumed;
+    int ok = 0;
+    watch = crossrun_watch_create();
+    quitwatch = crossrun_watch_create();
+    if (crossrun_watch_add(watch, "needle", CROSSRUN_WATCH_LITERAL, NULL, NULL) == 0 && crossrun_watch_add(watch, "^PID: [0-9]+$", CROSSRUN_WATCH_REGEX, watch_test_match, matched) == 1)
+      ok++;
+    //a literal pattern split over 2 blocks of output is found, the rest of the block is not consumed
+    if (crossrun_watch_feed(watch, "hay nee", 7, &consumed) == -1 && consumed == 7 && crossrun_watch_feed(watch, "dle hay", 7, &consumed) == 0 && consumed == 3)
+      ok++;
+    //a regular expression only matches complete lines
+    if (crossrun_watch_feed(watch, "PID: 12x\nPID: 34\r\nmore", 22, &consumed) == 1 && consumed == 18 && strcmp(matched, "PID: 34") == 0)
+      ok++;
+    //a line ended by a newline that completes a literal pattern is still checked against the regular expressions
+    linewatch = crossrun_watch_create();
+    if (crossrun_watch_add(linewatch, "done\n", CROSSRUN_WATCH_LITERAL, NULL, NULL) == 0 && crossrun_watch_add(linewatch, "^PID: [0-9]+ done$", CROSSRUN_WATCH_REGEX, watch_test_match, matched) == 1 &&
+        crossrun_watch_feed(linewatch, "PID: 56 done\nmore", 17, &consumed) == 0 && consumed == 13 && crossrun_watch_feed(linewatch, "more", 4, &consumed) == 1 && consumed == 0 && strcmp(matched, "PID: 56 done") == 0)
+      ok++;
+    crossrun_watch_free(linewatch);
+    crossrun_watch_reset(watch);
+    crossrun_watch_add(quitwatch, "never shown", CROSSRUN_WATCH_LITERAL, NULL, NULL);
+    crossrun_watch_add(quitwatch, "Exiting normally", CROSSRUN_WATCH_LITERAL, NULL, NULL);
+    if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+    } else {
+      matched[0] = 0;
+      crossrun_write(handle, "i\n");
+      if (crossrun_expect(handle, watch, 5000) == 1 && strncmp(matched, "PID: ", 5) == 0) {
+        printf("%s\n", matched);
+        ok++;
+      }
+      if (crossrun_expect(handle, quitwatch, 200) == CROSSRUN_EXPECT_TIMEOUT)
+        ok++;
+      crossrun_write(handle, "q\n");
+      if (crossrun_expect(handle, quitwatch, 5000) == 1 && crossrun_expect(handle, quitwatch, 5000) == CROSSRUN_EXPECT_EOF)
+        ok++;
+      crossrun_wait(handle);
+      crossrun_close(handle);
+      crossrun_free(handle);
+    }
+    crossrun_watch_free(quitwatch);
+    crossrun_watch_free(watch);
+    test_result(index, (ok == 7));
+  }
+
+  //run test
+  announce_test(++index, "Execute with output checksums");
+  {
+    crossrun_options options;
+    char buf[4096];
+    int i;
+    int n;
+    int stream;
+    int ok = 0;
+    uint32_t crc[3] = {0, 0, 0};
+    uint32_t checksum;
+    uint32_t stdoutchecksum = 0;
+    uint64_t length;
+    uint64_t forwarded;
+    FILE* dst;
+    //check against the standard check value and check continuing a checksum
+    if (crossrun_crc32c(0, "123456789", 9) == 0xE3069283 && crossrun_crc32c(crossrun_crc32c(0, "1234", 4), "56789", 5) == 0xE3069283)
+      ok++;
+    options = crossrun_options_create();
+    crossrun_options_set_checksum(options, 1);
+    crossrun_options_set_stderr(options, CROSSRUN_STDERR_PIPE);
+    //read output and compare with the checksum of the data read
+    if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+    } else {
+      length = 0;
+      crossrun_write(handle, "orq\n");
+      while ((n = crossrun_read_any(handle, buf, sizeof(buf), &stream)) > 0)
+        crc[stream] = crossrun_crc32c(crc[stream], buf, n);
+      crossrun_wait(handle);
+      if (crossrun_get_checksum(handle, CROSSRUN_STREAM_STDOUT, &stdoutchecksum, &length) == 0 && stdoutchecksum == crc[CROSSRUN_STREAM_STDOUT] && length > 1024 * 1024)
+        ok++;
+      if (crossrun_get_checksum(handle, CROSSRUN_STREAM_STDERR, &checksum, &length) == 0 && checksum == crc[CROSSRUN_STREAM_STDERR] && length > 0)
+        ok++;
+      printf("CRC32C of standard output: %08lX, error output: %08lX\n", (unsigned long)stdoutchecksum, (unsigned long)checksum);
+      crossrun_close(handle);
+      crossrun_free(handle);
+    }
+    //forward the same output with and without splice
+    crossrun_options_set_stderr(options, CROSSRUN_STDERR_DISCARD);
+    for (i = 0; i < 2; i++) {
+      if ((dst = tmpfile()) == NULL)
+        continue;
+      if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        crossrun_write(handle, "orq\n");
+        if (crossrun_forward(handle, fileno(dst), (i == 0 ? 0 : CROSSRUN_FORWARD_NO_SPLICE), NULL, NULL, &forwarded) == 0 && crossrun_get_checksum(handle, CROSSRUN_STREAM_STDOUT, &checksum, &length) == 0 && checksum == stdoutchecksum && length == forwarded)
+          ok++;
+        crossrun_wait(handle);
+        crossrun_close(handle);
+        crossrun_free(handle);
+      }
+      fclose(dst);
+    }
+    //read the same output from the last process of a pipeline
+    {
+      crossrun_pipeline pipeline;
+      const char* commands[2];
+      char* catcommand;
+      if ((catcommand = (char*)malloc(strlen(test_process_path) + 5)) != NULL) {
+        strcpy(catcommand, test_process_path);
+        strcat(catcommand, " cat");
+        commands[0] = catcommand;
+        commands[1] = test_process_path;
+        if ((pipeline = crossrun_pipeline_open(commands, 2, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+          fprintf(stderr, "Error launching pipeline\n");
+        } else {
+          crossrun_write(crossrun_pipeline_get_stage(pipeline, 0), "orq\n");
+          crossrun_write_eof(crossrun_pipeline_get_stage(pipeline, 0));
+          while (crossrun_read(crossrun_pipeline_get_stage(pipeline, -1), buf, sizeof(buf)) > 0)
+            ;
+          crossrun_pipeline_wait(pipeline);
+          if (crossrun_get_checksum(crossrun_pipeline_get_stage(pipeline, -1), CROSSRUN_STREAM_STDOUT, &checksum, &length) == 0 && checksum == stdoutchecksum)
+            ok++;
+          crossrun_pipeline_free(pipeline);
+        }
+        free(catcommand);
+      }
+    }
+    crossrun_options_free(options);
+    test_result(index, (ok == 6));
+  }
+
+  //run test
+  announce_test(++index, "Execute with standard input and output on one socket");
+  {
+    crossrun_options options;
+    crossrun_loop loop;
+    struct loop_test_data loopdata = {0, 0, 0};
+    char buf[256];
+    size_t len = 0;
+    int n;
+    int ok = 0;
+    options = crossrun_options_create();
+    if (crossrun_options_set_socketpair(options, 1, 256 * 1024) != 0) {
+      printf("Socket not supported on this platform\n");
+      ok = 3;
+    } else {
+      //closing standard input still lets the output be read
+      if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        crossrun_write(handle, "i\n");
+        crossrun_write_eof(handle);
+        while (len < sizeof(buf) - 1 && (n = crossrun_read(handle, buf + len, (int)(sizeof(buf) - 1 - len))) > 0)
+          len += n;
+        buf[len] = 0;
+        crossrun_wait(handle);
+        if (strstr(buf, "PID: ") && strstr(buf, "Exiting normally") && crossrun_get_exit_code(handle) == 0)
+          ok++;
+        crossrun_close(handle);
+        crossrun_free(handle);
+      }
+      //the event loop watches writing and reading the same socket
+      if ((loop = crossrun_loop_create_with_engine(CROSSRUN_LOOP_ENGINE_EPOLL)) == NULL) {
+        ok++;
+      } else {
+        if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+          fprintf(stderr, "Error launching process\n");
+        } else {
+          if (crossrun_loop_add(loop, handle, loop_data, NULL, loop_exit, &loopdata) == 0 && crossrun_loop_write(loop, handle, "ooq\n", 4) == 0 && crossrun_loop_run(loop) == 0) {
+            printf("processes exited: %i, bytes read: %lu\n", loopdata.exited, (unsigned long)loopdata.bytes);
+            if (loopdata.exited == 1 && loopdata.failed == 0 && loopdata.bytes > 2 * 1024 * 1024)
+              ok++;
+          }
+          crossrun_loop_free(loop);
+          crossrun_free(handle);
+        }
+      }
+      //the processes of a pipeline can't be connected with sockets
+      {
+        crossrun_pipeline pipeline;
+        const char* commands[2] = {test_process_path, test_process_path};
+        if ((pipeline = crossrun_pipeline_open(commands, 2, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL)
+          ok++;
+        else
+          crossrun_pipeline_free(pipeline);
+      }
+    }
+    crossrun_options_free(options);
+    test_result(index, (ok == 3));
+  }
+
+  //run test
+  announce_test(++index, "Execute with output rate limits");
+  {
+    crossrun_options options;
+    struct line_test_data linedata = {0, 0, 0, 0};
+    char buf[4096];
+    size_t len;
+    int n;
+    int stream;
+    int ok = 0;
+    uint64_t kept = 0;
+    uint64_t discardedbytes = 0;
+    uint64_t discardedlines = 0;
+    //discard lines above the limit
+    if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+    } else {
+      crossrun_set_output_limit(handle, CROSSRUN_STREAM_STDOUT, 0, 100, CROSSRUN_LIMIT_DROP, 0);
+      crossrun_write(handle, "oq\n");
+      while ((n = crossrun_read(handle, buf, sizeof(buf))) > 0)
+        kept += n;
+      crossrun_wait(handle);
+      if (crossrun_get_output_limit_stats(handle, CROSSRUN_STREAM_STDOUT, &discardedbytes, &discardedlines) == 0) {
+        printf("%lu bytes kept, %lu bytes discarded, %lu lines discarded\n", (unsigned long)kept, (unsigned long)discardedbytes, (unsigned long)discardedlines);
+        if (kept > 0 && kept < 512 * 1024 && kept + discardedbytes > 1024 * 1024 && discardedlines > 0)
+          ok++;
+      }
+      crossrun_close(handle);
+      crossrun_free(handle);
+    }
+    //sample complete lines above the limit through the read-ahead buffer
+    options = crossrun_options_create();
+    crossrun_options_set_read_buffer(options, 1000);
+    if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+    } else {
+      crossrun_set_output_limit(handle, CROSSRUN_STREAM_STDOUT, 0, 10, CROSSRUN_LIMIT_SAMPLE, 100);
+      crossrun_write(handle, "oq\n");
+      crossrun_read_lines(handle, count_line, &linedata);
+      crossrun_wait(handle);
+      crossrun_get_output_limit_stats(handle, CROSSRUN_STREAM_STDOUT, NULL, &discardedlines);
+      printf("%lu lines kept, %lu generated lines, %lu lines discarded\n", (unsigned long)linedata.lines, (unsigned long)linedata.generatedlines, (unsigned long)discardedlines);
+      if (linedata.partials == 0 && linedata.generatedlines >= 150 && linedata.generatedlines < 8192 && linedata.lines + discardedlines == 1024 * 1024 / 64 + 2)
+        ok++;
+      crossrun_close(handle);
+      crossrun_free(handle);
+    }
+    crossrun_options_free(options);
+    //remember the end of the discarded output
+    if ((handle = crossrun_open(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+      fprintf(stderr, "Error launching process\n");
+    } else {
+      crossrun_set_output_limit(handle, CROSSRUN_STREAM_STDOUT, 1000, 0, CROSSRUN_LIMIT_HEAD_TAIL, 100);
+      crossrun_write(handle, "oq\n");
+      while (crossrun_read_any(handle, buf, sizeof(buf), &stream) > 0)
+        ;
+      crossrun_wait(handle);
+      len = crossrun_get_output_limit_tail(handle, CROSSRUN_STREAM_STDOUT, buf, sizeof(buf));
+      printf("%lu bytes remembered\n", (unsigned long)len);
+      if (len > 0 && len <= 100 && buf[len - 1] == '\n' && (buf[0] == 'a' || buf[0] == 'E'))
+        ok++;
+      crossrun_close(handle);
+      crossrun_free(handle);
+    }
+    test_result(index, (ok == 3));
+  }
+
+  //run test
+  announce_test(++index, "Discover processor topology");
+  {
+    crossrun_topology topology;
+    crossrun_cpumask cpumask;
+    crossrun_cpumask cpumask2;
+    int ok = 0;
+    //topology of the current system
+    if ((topology = crossrun_topology_create()) != NULL) {
+      printf("%lu online logical processors, %i packages, %i cores, %i L2 caches, %i L3 caches, %i NUMA nodes\n", (unsigned long)crossrun_topology_get_cpus(topology), crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_PACKAGE), crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_CORE), crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_L2), crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_L3), crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE));
+      if ((cpumask = crossrun_topology_get_one_per_domain(topology, CROSSRUN_TOPOLOGY_CORE, NULL)) != NULL) {
+        if (crossrun_topology_get_cpus(topology) > 0 && crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_PACKAGE) > 0 && crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE) > 0 && crossrun_cpumask_count(cpumask) == crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_CORE))
+          ok++;
+        crossrun_cpumask_free(cpumask);
+      }
+      crossrun_topology_free(topology);
+    }
+#ifdef __linux__
+    //topology read from a fixture sysfs tree
+    {
+      char basepath[] = "/tmp/crossrun_topology_XXXXXX";
+      if (mkdtemp(basepath) == NULL || write_topology_fixture(basepath) != 0) {
+        fprintf(stderr, "Error creating sysfs fixture\n");
+      } else if ((topology = crossrun_topology_create_from_path(basepath)) == NULL) {
+        fprintf(stderr, "Error reading topology from sysfs fixture\n");
+      } else {
+        if (crossrun_topology_get_cpus(topology) == 7 && crossrun_topology_get_highest_cpu(topology) == 7 && !crossrun_topology_is_online(topology, 7) &&
+            crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_PACKAGE) == 2 && crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_CORE) == 4 &&
+            crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_L2) == 4 && crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_L3) == 2 &&
+            crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE) == 2)
+          ok++;
+        if (crossrun_topology_get_domain(topology, 1, CROSSRUN_TOPOLOGY_CORE) == crossrun_topology_get_domain(topology, 5, CROSSRUN_TOPOLOGY_CORE) &&
+            crossrun_topology_get_domain(topology, 1, CROSSRUN_TOPOLOGY_CORE) != crossrun_topology_get_domain(topology, 2, CROSSRUN_TOPOLOGY_CORE) &&
+            crossrun_topology_get_domain(topology, 7, CROSSRUN_TOPOLOGY_CORE) == -1 &&
+            crossrun_topology_get_domain_id(topology, CROSSRUN_TOPOLOGY_NODE, crossrun_topology_get_domain(topology, 6, CROSSRUN_TOPOLOGY_NODE)) == 1 &&
+            crossrun_topology_get_domain_id(topology, CROSSRUN_TOPOLOGY_PACKAGE, crossrun_topology_get_domain(topology, 3, CROSSRUN_TOPOLOGY_PACKAGE)) == 1)
+          ok++;
+        //one thread per physical core
+        if ((cpumask = crossrun_topology_get_one_per_domain(topology, CROSSRUN_TOPOLOGY_CORE, NULL)) != NULL) {
+          if (crossrun_cpumask_count(cpumask) == 4 && crossrun_cpumask_is_set(cpumask, 0) && crossrun_cpumask_is_set(cpumask, 1) && crossrun_cpumask_is_set(cpumask, 2) && crossrun_cpumask_is_set(cpumask, 3))
+            ok++;
+          crossrun_cpumask_free(cpumask);
+        }
+        //all logical processors sharing L3 cache 1 and one thread per physical core among them
+        if ((cpumask = crossrun_topology_get_cpumask(topology, CROSSRUN_TOPOLOGY_L3, 1)) != NULL) {
+          if (crossrun_cpumask_count(cpumask) == 3 && crossrun_cpumask_is_set(cpumask, 2) && crossrun_cpumask_is_set(cpumask, 3) && crossrun_cpumask_is_set(cpumask, 6))
+            ok++;
+          if ((cpumask2 = crossrun_topology_get_one_per_domain(topology, CROSSRUN_TOPOLOGY_CORE, cpumask)) != NULL) {
+            if (crossrun_cpumask_count(cpumask2) == 2 && crossrun_cpumask_is_set(cpumask2, 2) && crossrun_cpumask_is_set(cpumask2, 3))
+              ok++;
+            crossrun_cpumask_free(cpumask2);
+          }
+          crossrun_cpumask_free(cpumask);
+        }
+        //NUMA nodes of logical processors
+        if ((cpumask = crossrun_topology_get_cpumask(topology, CROSSRUN_TOPOLOGY_CORE, crossrun_topology_get_domain(topology, 2, CROSSRUN_TOPOLOGY_CORE))) != NULL) {
+          int domains[2];
+          if (crossrun_topology_get_domains(topology, CROSSRUN_TOPOLOGY_NODE, cpumask, domains, 2) == 1 && crossrun_topology_get_domain_id(topology, CROSSRUN_TOPOLOGY_NODE, domains[0]) == 1) {
+            crossrun_cpumask_set(cpumask, 0);
+            if (crossrun_topology_get_domains(topology, CROSSRUN_TOPOLOGY_NODE, cpumask, domains, 2) == 2 && domains[0] == 0 && domains[1] == 1)
+              ok++;
+          }
+          crossrun_cpumask_free(cpumask);
+        }
+        crossrun_topology_free(topology);
+      }
+      remove_fixture(basepath);
+    }
+#else
+    ok += 6;
+#endif
+    test_result(index, (ok == 7));
+  }
+
+  //run test
+  announce_test(++index, "Execute with NUMA memory policy");
+  {
+    crossrun_options options;
+    crossrun_topology topology;
+    char output[1024];
+    size_t outputpos;
+    const char* p;
+    int i;
+    int node = 0;
+    int multinode = 0;
+    int ok = 0;
+    if ((topology = crossrun_topology_create()) != NULL) {
+      multinode = (crossrun_topology_get_count(topology, CROSSRUN_TOPOLOGY_NODE) > 1);
+      node = crossrun_topology_get_domain_id(topology, CROSSRUN_TOPOLOGY_NODE, 0);
+      crossrun_topology_free(topology);
+    }
+    if ((options = crossrun_options_create()) == NULL) {
+      fprintf(stderr, "Error creating options\n");
+    } else if (crossrun_options_set_mempolicy(options, CROSSRUN_MEMPOLICY_INTERLEAVE, &node, 1) != 0) {
+      printf("NUMA memory policy not supported on this platform\n");
+      ok = 2;
+    } else if (crossrun_options_set_mempolicy(options, 99, NULL, 0) == 0) {
+      fprintf(stderr, "Invalid memory policy accepted\n");
+    } else {
+      //interleave over the given node, then bind to the nodes of the logical processors (which does nothing on systems with one node)
+      for (i = 0; i < 2; i++) {
+        if (i == 1)
+          crossrun_options_set_mempolicy(options, CROSSRUN_MEMPOLICY_BIND, NULL, 0);
+        if ((handle = crossrun_open_with_options(test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL, options)) == NULL) {
+          fprintf(stderr, "Error launching process\n");
+          continue;
+        }
+        crossrun_write(handle, "uq\n");
+        outputpos = 0;
+        while (outputpos < sizeof(output) - 1 && (n = crossrun_read(handle, output + outputpos, sizeof(output) - 1 - outputpos)) > 0)
+          outputpos += n;
+        output[outputpos] = 0;
+        crossrun_wait(handle);
+        crossrun_close(handle);
+        crossrun_free(handle);
+        if ((p = strstr(output, "Memory policy: ")) != NULL) {
+          printf("%.*s\n", (int)(strchr(p, '\n') ? strchr(p, '\n') - p : strlen(p)), p);
+          if (strncmp(p + 15, "unsupported", 11) == 0 || strncmp(p + 15, (i == 0 ? "interleave\n" : (multinode ? "bind\n" : "default\n")), (i == 0 ? 11 : (multinode ? 5 : 8))) == 0)
+            ok++;
+        }
+      }
+    }
+    crossrun_options_free(options);
+    test_result(index, (ok == 2));
+  }
+
+  //run test
+  announce_test(++index, "Plan processor placement");
+  {
+    crossrun_planner planner;
+    int ok = 0;
+#ifdef __linux__
+    //placement on a fixture sysfs tree with 2 packages of 2 cores with 2 threads each
+    {
+      static const int cpus0[] = {0};
+      static const int cpus1[] = {1};
+      static const int cpus2[] = {2};
+      static const int cpus3[] = {3};
+      static const int cpus4[] = {4};
+      static const int cpus01[] = {0, 1};
+      static const int cpus23[] = {2, 3};
+      static const int node0[] = {0, 1, 4, 5};
+      static const int node1[] = {2, 3, 6};
+      static const unsigned int threads[] = {1, 1, 1, 1};
+      char basepath[] = "/tmp/crossrun_topology_XXXXXX";
+      crossrun_topology topology;
+      crossrun_cpumask all;
+      crossrun_cpumask cpumasks[4];
+      crossrun_cpumask cpumask;
+      crossrun_cpumask cpumask2;
+      if (mkdtemp(basepath) == NULL || write_topology_fixture(basepath) != 0) {
+        fprintf(stderr, "Error creating sysfs fixture\n");
+      } else if ((topology = crossrun_topology_create_from_path(basepath)) == NULL) {
+        fprintf(stderr, "Error reading topology from sysfs fixture\n");
+      } else {
+        all = crossrun_topology_get_cpumask(topology, CROSSRUN_TOPOLOGY_NODE, -1);
+        if ((planner = crossrun_planner_create(topology, all)) == NULL) {
+          fprintf(stderr, "Error creating planner\n");
+        } else {
+          //single threaded jobs go to separate cores, alternating between packages
+          if (crossrun_planner_plan(planner, 4, threads, CROSSRUN_PLAN_SPREAD, cpumasks) == 0) {
+            if (cpumask_equals(cpumasks[0], cpus0, 1) && cpumask_equals(cpumasks[1], cpus2, 1) && cpumask_equals(cpumasks[2], cpus1, 1) && cpumask_equals(cpumasks[3], cpus3, 1))
+              ok++;
+            //SMT siblings are only used when all cores are in use
+            cpumask = crossrun_planner_place(planner, 1, CROSSRUN_PLAN_SPREAD);
+            if (cpumask_equals(cpumask, cpus4, 1) && crossrun_planner_get_load(planner, 0) == 1 && crossrun_planner_get_load(planner, 4) == 1)
+              ok++;
+            //a released core is used again first
+            crossrun_planner_release(planner, cpumasks[1]);
+            cpumask2 = crossrun_planner_place(planner, 1, CROSSRUN_PLAN_SPREAD);
+            if (cpumask_equals(cpumask2, cpus2, 1) && crossrun_planner_release(planner, all) != 0)
+              ok++;
+            crossrun_planner_release(planner, cpumask);
+            crossrun_planner_release(planner, cpumask2);
+            crossrun_planner_release(planner, cpumasks[0]);
+            crossrun_planner_release(planner, cpumasks[2]);
+            crossrun_planner_release(planner, cpumasks[3]);
+          }
+          //compact jobs fill the cores of one level 3 cache
+          cpumask = crossrun_planner_place(planner, 2, CROSSRUN_PLAN_COMPACT);
+          cpumask2 = crossrun_planner_place(planner, 2, CROSSRUN_PLAN_COMPACT);
+          if (crossrun_planner_get_load(planner, 4) == 0 && cpumask_equals(cpumask, cpus01, 2) && cpumask_equals(cpumask2, cpus23, 2))
+            ok++;
+          //isolated jobs get a NUMA node each
+          cpumasks[0] = crossrun_planner_place(planner, 1, CROSSRUN_PLAN_ISOLATE);
+          cpumasks[1] = crossrun_planner_place(planner, 1, CROSSRUN_PLAN_ISOLATE);
+          if (cpumask_equals(cpumasks[0], node0, 4) && cpumask_equals(cpumasks[1], node1, 3))
+            ok++;
+          crossrun_planner_free(planner);
+        }
+        crossrun_cpumask_free(all);
+        crossrun_topology_free(topology);
+      }
+      remove_fixture(basepath);
+    }
+#else
+    ok += 5;
+#endif
+#ifndef __APPLE__
+    //the placement of a shell process is released when it exits
+    if ((planner = crossrun_planner_create(NULL, NULL)) == NULL) {
+      fprintf(stderr, "Error creating planner\n");
+    } else {
+      if ((handle = crossrun_planner_open(planner, 1, CROSSRUN_PLAN_SPREAD, test_process_path, NULL, CROSSRUN_PRIO_BELOW_NORMAL, NULL)) == NULL) {
+        fprintf(stderr, "Error launching process\n");
+      } else {
+        int cpu;
+        unsigned int load = 0;
+        for (cpu = 0; cpu < (int)crossrun_get_logical_processors(); cpu++)
+          load += crossrun_planner_get_load(planner, cpu);
+        crossrun_write(handle, "q\n");
+        crossrun_wait(handle);
+        for (cpu = 0; cpu < (int)crossrun_get_logical_processors(); cpu++)
+          load += crossrun_planner_get_load(planner, cpu) * 10;
+        crossrun_close(handle);
+        crossrun_free(handle);
+        if (load == 1)
+          ok++;
+      }
+      crossrun_planner_free(planner);
+    }
+#else
+    ok++;
+#endif
+    test_result(index, (ok == 6));
   }
-  test_result(index, (handle != NULL && exitcode == 0));
-*/
 
   printf("Tests succeeded:  %i\n", tests_succeeded);
   printf("Tests failed:     %i\n", tests_failed);
@@ -1,11 +1,19 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <unistd.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 #endif
 #include "crossrun.h"
+#include "crossrunchannel.h"
+#include "crossrunworker.h"
 
 #ifdef _WIN32
 #define sleep_seconds(n) Sleep((n) * 1000)
@@ -23,6 +31,12 @@ void show_help ()
     "  p       show process priority\n"
     "  n       show number of logical processors\n"
     "  a       get processor affinity mask\n"
+    "  r       write message to error output\n"
+    "  o       write 1 MB of output lines\n"
+    "  t       show if standard output is a terminal\n"
+    "  u       show NUMA memory policy\n"
+    "  g       allocate 16 MB of memory that is never freed\n"
+    "  c       send records received on the channel back until it is closed\n"
     "  l       set low CPU affinity and process priority\n"
     "  m       set high CPU affinity and process priority\n"
     "  x       exit with exit code 99\n"
@@ -35,6 +49,49 @@ int main (int argc, char* argv[])
   int i;
   int c;
   char* s;
+  //with parameter "cat" copy standard input to standard output without doing anything else
+  if (argc > 1 && strcmp(argv[1], "cat") == 0) {
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), stdin)) > 0)
+      fwrite(buf, 1, n, stdout);
+    return 0;
+  }
+  //with parameter "worker" answer framed requests with the reversed request data, a request "defer" is answered after the next request
+  if (argc > 1 && strcmp(argv[1], "worker") == 0) {
+    crossrun_worker_child child;
+    uint32_t id;
+    uint32_t deferredid = 0;
+    int deferred = 0;
+    const char* data;
+    size_t datalen;
+    char* buf = NULL;
+    size_t bufsize = 0;
+    if ((child = crossrun_worker_child_create()) == NULL)
+      return 1;
+    while (crossrun_worker_child_receive(child, &id, &data, &datalen) > 0) {
+      if (datalen == 5 && memcmp(data, "defer", 5) == 0) {
+        deferredid = id;
+        deferred = 1;
+        continue;
+      }
+      if (datalen > bufsize) {
+        if ((buf = (char*)realloc(buf, datalen)) == NULL)
+          return 1;
+        bufsize = datalen;
+      }
+      for (i = 0; i < (int)datalen; i++)
+        buf[i] = data[datalen - 1 - i];
+      crossrun_worker_child_respond(child, id, buf, datalen);
+      if (deferred) {
+        crossrun_worker_child_respond(child, deferredid, "deferred", 8);
+        deferred = 0;
+      }
+    }
+    free(buf);
+    crossrun_worker_child_free(child);
+    return 0;
+  }
   printf("Program started: %s\n", argv[0]);
   for (i = 1; i < argc; i++) {
     printf("- Command line parameter %i: \"%s\"\n", i, argv[i]);
@@ -113,6 +170,84 @@ int main (int argc, char* argv[])
           }
         }
         break;
+      case 'r':
+        fprintf(stderr, "Message on error output\n");
+        fflush(stderr);
+        break;
+      case 'o':
+        {
+          int j;
+          char line[64];
+          for (j = 0; j < (int)sizeof(line) - 1; j++)
+            line[j] = 'a' + j % 26;
+          line[sizeof(line) - 1] = '\n';
+          for (j = 0; j < 1024 * 1024 / (int)sizeof(line); j++)
+            fwrite(line, 1, sizeof(line), stdout);
+        }
+        break;
+      case 't':
+#ifdef _WIN32
+        printf("Terminal: no\n");
+#else
+        if (!isatty(STDOUT_FILENO)) {
+          printf("Terminal: no\n");
+        } else {
+          struct winsize size;
+          if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0)
+            printf("Terminal: yes (%ux%u)\n", (unsigned int)size.ws_col, (unsigned int)size.ws_row);
+          else
+            printf("Terminal: yes\n");
+        }
+#endif
+        break;
+      case 'u':
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+        {
+          int mode;
+          static const char* modename[] = {"default", "preferred", "bind", "interleave"};
+          if (syscall(SYS_get_mempolicy, &mode, NULL, 0, NULL, 0) != 0)
+            printf("Memory policy: unsupported\n");
+          else
+            printf("Memory policy: %s\n", (mode >= 0 && mode < (int)(sizeof(modename) / sizeof(modename[0])) ? modename[mode] : "other"));
+        }
+#else
+        printf("Memory policy: unsupported\n");
+#endif
+        break;
+      case 'g':
+        {
+          char* p;
+          if ((p = (char*)malloc(16 * 1024 * 1024)) == NULL) {
+            printf("Error allocating memory\n");
+          } else {
+            memset(p, 1, 16 * 1024 * 1024);
+            printf("Allocated 16 MB\n");
+          }
+        }
+        break;
+      case 'c':
+        {
+          crossrun_channel channel;
+          char* buf;
+          size_t len;
+          unsigned long records = 0;
+          if ((channel = crossrun_channel_open_child()) == NULL) {
+            printf("Channel: none\n");
+          } else {
+            if ((buf = (char*)malloc(64 * 1024)) != NULL) {
+              while (crossrun_channel_read(channel, buf, 64 * 1024, &len, -1) > 0) {
+                if (crossrun_channel_write(channel, buf, len, -1) != 0)
+                  break;
+                records++;
+              }
+              free(buf);
+            }
+            crossrun_channel_close(channel);
+            crossrun_channel_free(channel);
+            printf("Channel: %lu records\n", records);
+          }
+        }
+        break;
       case 'x':
         printf("Exiting with exit code 99\n");
         exit(99);